@@ -0,0 +1,549 @@
+/*
+ * Page fault workload generator for PageFaultStat.
+ *
+ * Generalises Test1.c (touching a file mapping) and Test2.c (growing
+ * anonymous memory until it swaps) into reproducible workloads with a
+ * bounded footprint and a paced fault rate. Every mode repeats a round
+ * until the duration is up and knows how many faults each round should
+ * cost, so the expected counts can be printed next to what getrusage()
+ * saw and what the sampler reported:
+ *
+ *   anon        mmap, write every page, munmap: one minor fault per page
+ *   thp         the same with MADV_HUGEPAGE: one fault per 2MB huge page
+ *   file-read   read a file mapping after dropping it from the page cache,
+ *               one touch per 64KB fault-around window: one fault each,
+ *               major for the pages mincore() says were not cached
+ *   file-write  write every page of a shared file mapping the same way,
+ *               one fault per page (shared write faults do no fault-around)
+ *   cow         fork a child that holds the pages, write every page:
+ *               one copy-on-write minor fault per page in the parent
+ *   dontneed    MADV_DONTNEED a touched region, write it again: one minor
+ *               fault per page
+ *   shm         the same on a POSIX shared memory mapping
+ *   spawn       fork short-lived children that each write the footprint,
+ *               one minor fault per page in every child plus start-up
+ *   swap        keep the footprint and rewrite it every round, major for
+ *               the pages mincore() says were swapped out (Test2.c)
+ *
+ * The fault rate is paced to -r faults per second (children per second
+ * in spawn mode). Footprints over half of MemAvailable are refused
+ * without -f, swap mode needs -f to go beyond that on purpose.
+ *
+ * Build: cc -O2 -o fault_workload fault_workload.c
+ * Usage: ./fault_workload [-m mode] [-s size] [-r rate] [-d secs]
+ *                         [-p path] [-f] [-k] [-q]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define HUGE_PAGE       (2UL * 1024 * 1024)
+#define FAULT_AROUND    (64UL * 1024)      /* default fault_around_bytes */
+#define PACE_CHECK      64                  /* faults between clock reads over 1000/s */
+
+typedef struct {
+    uint64_t minor;         /* expected in this process */
+    uint64_t major;
+    uint64_t child_minor;   /* expected in children */
+} expect_t;
+
+typedef struct {
+    const char *name;
+    const char *describe;   /* what one round costs */
+    int (*setup)(void);
+    int (*round)(expect_t *e);
+    void (*cleanup)(void);
+} workload_t;
+
+static size_t page_size;
+static size_t footprint = 64UL * 1024 * 1024;
+static size_t npages;
+static double rate;                 /* faults (or children) per second, 0 unpaced */
+static const char *path = "fault_workload.bin";
+static bool quiet;
+static bool keep_cache;
+
+static char *region;
+static size_t region_len;
+static int fd = -1;
+
+static volatile sig_atomic_t stop;
+static double pace_start;
+static uint64_t paced;
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Sleep as needed so that n more faults keep to the rate */
+static void pace(uint64_t n) {
+    double ahead;
+
+    paced += n;
+    if ((rate <= 0.0) || ((rate > 1000.0) && (paced % PACE_CHECK)))
+        return;
+    ahead = pace_start + (double)paced / rate - now();
+    if (ahead > 0.0) {
+        const struct timespec ts = {
+            (time_t)ahead, (long)((ahead - (double)(time_t)ahead) * 1e9)
+        };
+
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void touch(char *base, size_t len, size_t stride, bool write) {
+    volatile char *p = base;
+    size_t off;
+
+    /*
+     * A plain store, a read first would take a read fault (zero page or
+     * fault-around) and then a write fault on the same page
+     */
+    for (off = 0; (off < len) && !stop; off += stride) {
+        if (write)
+            p[off] = 1;
+        else
+            (void)p[off];
+        pace(1);
+    }
+}
+
+/* Pages of [base, base + len) that are not resident, by stride */
+static uint64_t not_resident(char *base, size_t len, size_t stride) {
+    unsigned char *vec;
+    uint64_t n = 0;
+    size_t i;
+
+    if ((vec = malloc((len + page_size - 1) / page_size)) == NULL)
+        return 0;
+    if (mincore(base, len, vec) == 0) {
+        for (i = 0; i < len / page_size; i += stride / page_size)
+            n += !(vec[i] & 1);
+    }
+    free(vec);
+    return n;
+}
+
+static char *map_anon(size_t len) {
+    char *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    /* One fault per 4K page, whatever the THP setting */
+    (void)madvise(p, len, MADV_NOHUGEPAGE);
+    return p;
+}
+
+static uint64_t meminfo_kb(const char *field) {
+    char line[256];
+    uint64_t kb = 0;
+    const size_t len = strlen(field);
+    FILE *fp = fopen("/proc/meminfo", "r");
+
+    if (!fp)
+        return 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (!strncmp(line, field, len) && (line[len] == ':')) {
+            kb = strtoull(line + len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(fp);
+    return kb;
+}
+
+static bool thp_enabled(void) {
+    char buf[128];
+    FILE *fp = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    bool on = false;
+
+    if (fp) {
+        if (fgets(buf, sizeof(buf), fp))
+            on = strstr(buf, "[always]") || strstr(buf, "[madvise]");
+        fclose(fp);
+    }
+    return on;
+}
+
+/* anon: first touch of fresh anonymous memory */
+static int anon_round(expect_t *e) {
+    char *p;
+
+    if ((p = map_anon(footprint)) == NULL)
+        return -1;
+    touch(p, footprint, page_size, true);
+    munmap(p, footprint);
+    e->minor += npages;
+    return 0;
+}
+
+/* thp: first touch with huge pages, falls back to 4K if none are free */
+static int thp_round(expect_t *e) {
+    char *raw, *p;
+    const size_t len = footprint + HUGE_PAGE;
+
+    raw = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    p = (char *)(((uintptr_t)raw + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+    (void)madvise(p, footprint, MADV_HUGEPAGE);
+    touch(p, footprint, page_size, true);
+    munmap(raw, len);
+    e->minor += thp_enabled() ? (footprint + HUGE_PAGE - 1) / HUGE_PAGE : npages;
+    return 0;
+}
+
+static int file_setup(void) {
+    static char buf[1024 * 1024];
+    size_t done;
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+        fprintf(stderr, "fault_workload: cannot create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    /* Real blocks rather than a hole, so reads go to the disk */
+    memset(buf, 'A', sizeof(buf));
+    for (done = 0; done < footprint; ) {
+        const size_t n = footprint - done < sizeof(buf) ? footprint - done : sizeof(buf);
+
+        if (write(fd, buf, n) != (ssize_t)n) {
+            fprintf(stderr, "fault_workload: cannot write %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+        done += n;
+    }
+    /*
+     * Start uncached: pages read back under MADV_RANDOM come in one at
+     * a time, the large folios left by write() would map many pages
+     * per fault and break the expected counts with -k
+     */
+    if (fsync(fd) < 0)
+        return -1;
+    return posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+static void file_cleanup(void) {
+    if (fd >= 0) {
+        close(fd);
+        unlink(path);
+    }
+}
+
+/*
+ * Drop the file from the page cache and touch it through a new mapping.
+ * MADV_RANDOM turns off readahead so every touch is its own fault; pages
+ * on tmpfs cannot be dropped and fault as minor. With -k the cache is
+ * left alone, so faults are only major once memory pressure (say a
+ * cgroup memory.max below the footprint) has reclaimed the file.
+ */
+static int file_round(expect_t *e, const bool write) {
+    const size_t stride = write ? page_size : FAULT_AROUND;
+    uint64_t cold;
+    char *p;
+
+    if (!keep_cache) {
+        (void)fdatasync(fd);
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    p = mmap(NULL, footprint, PROT_READ | (write ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    (void)madvise(p, footprint, MADV_RANDOM);
+    cold = not_resident(p, footprint, stride);
+    touch(p, footprint, stride, write);
+    munmap(p, footprint);
+    e->major += cold;
+    e->minor += (footprint + stride - 1) / stride - cold;
+    return 0;
+}
+
+static int file_read_round(expect_t *e) {
+    return file_round(e, false);
+}
+
+static int file_write_round(expect_t *e) {
+    return file_round(e, true);
+}
+
+/* A touched anonymous region kept across rounds */
+static int region_setup(void) {
+    if ((region = map_anon(footprint)) == NULL)
+        return -1;
+    region_len = footprint;
+    touch(region, region_len, page_size, true);
+    return 0;
+}
+
+static void region_cleanup(void) {
+    if (region)
+        munmap(region, region_len);
+}
+
+/* cow: a child shares the region while the parent writes it */
+static int cow_round(expect_t *e) {
+    int pipefd[2];
+    pid_t holder;
+    char c;
+
+    if (pipe(pipefd) < 0) {
+        perror("pipe");
+        return -1;
+    }
+    if ((holder = fork()) < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (holder == 0) {
+        close(pipefd[1]);
+        /* Hold the pages until the parent is done */
+        (void)read(pipefd[0], &c, 1);
+        _exit(EXIT_SUCCESS);
+    }
+    close(pipefd[0]);
+    touch(region, region_len, page_size, true);
+    close(pipefd[1]);
+    (void)waitpid(holder, NULL, 0);
+    e->minor += npages;
+    return 0;
+}
+
+static int dontneed_round(expect_t *e) {
+    (void)madvise(region, region_len, MADV_DONTNEED);
+    touch(region, region_len, page_size, true);
+    e->minor += npages;
+    return 0;
+}
+
+/* shm: the page stays in the shm object, only the mapping is dropped */
+static int shm_setup(void) {
+    char name[64];
+
+    snprintf(name, sizeof(name), "/fault_workload.%d", (int)getpid());
+    if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+        fprintf(stderr, "fault_workload: cannot create shm %s: %s\n", name, strerror(errno));
+        return -1;
+    }
+    shm_unlink(name);
+    if (ftruncate(fd, (off_t)footprint) < 0) {
+        perror("ftruncate");
+        return -1;
+    }
+    region = mmap(NULL, footprint, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (region == MAP_FAILED) {
+        region = NULL;
+        perror("mmap");
+        return -1;
+    }
+    region_len = footprint;
+    touch(region, region_len, page_size, true);
+    return 0;
+}
+
+static void shm_cleanup(void) {
+    region_cleanup();
+    if (fd >= 0)
+        close(fd);
+}
+
+/* spawn: one short-lived child per round, the rate is children per second */
+static int spawn_round(expect_t *e) {
+    const double saved = rate;
+    pid_t pid;
+
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        char *p;
+
+        rate = 0.0;
+        if ((p = map_anon(footprint)) == NULL)
+            _exit(EXIT_FAILURE);
+        touch(p, footprint, page_size, true);
+        _exit(EXIT_SUCCESS);
+    }
+    (void)waitpid(pid, NULL, 0);
+    rate = saved;
+    pace(1);
+    e->child_minor += npages;
+    return 0;
+}
+
+/* swap: rewrite a footprint kept across rounds, major once swapped out */
+static int swap_round(expect_t *e) {
+    const uint64_t cold = not_resident(region, region_len, page_size);
+
+    touch(region, region_len, page_size, true);
+    e->major += cold;
+    return 0;
+}
+
+static const workload_t workloads[] = {
+    { "anon",       "minor faults, one per page",                       NULL,         anon_round,       NULL },
+    { "thp",        "minor faults, one per 2MB huge page if THP is on", NULL,         thp_round,        NULL },
+    { "file-read",  "faults, one per 64KB, major if not cached",        file_setup,   file_read_round,  file_cleanup },
+    { "file-write", "faults, one per page, major if not cached",        file_setup,   file_write_round, file_cleanup },
+    { "cow",        "copy-on-write minor faults, one per page",         region_setup, cow_round,        region_cleanup },
+    { "dontneed",   "minor faults, one per page",                       region_setup, dontneed_round,   region_cleanup },
+    { "shm",        "minor faults, one per page",                       shm_setup,    dontneed_round,   shm_cleanup },
+    { "spawn",      "minor faults per child, one per page, plus start-up", NULL,      spawn_round,      NULL },
+    { "swap",       "major faults for the pages swapped out",           region_setup, swap_round,       region_cleanup },
+};
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static size_t parse_size(const char *str) {
+    char *end;
+    double v = strtod(str, &end);
+
+    switch (*end) {
+    case 'g': case 'G': v *= 1024.0;     /* fall through */
+    case 'm': case 'M': v *= 1024.0;     /* fall through */
+    case 'k': case 'K': v *= 1024.0; break;
+    default: break;
+    }
+    return v > 0.0 ? (size_t)v : 0;
+}
+
+static void usage(void) {
+    size_t i;
+
+    fprintf(stderr,
+        "Usage: fault_workload [-m mode] [-s size] [-r rate] [-d secs] [-p path] [-f] [-k] [-q]\n"
+        "  -m mode   workload, default anon\n"
+        "  -s size   footprint in bytes, K/M/G suffixes (default 64M)\n"
+        "  -r rate   faults per second, children per second for spawn (default 0, unpaced)\n"
+        "  -d secs   run for secs seconds, 0 until interrupted (default 10)\n"
+        "  -p path   file for the file modes (default ./fault_workload.bin)\n"
+        "  -f        allow a footprint over half of MemAvailable\n"
+        "  -k        file modes: keep the page cache between rounds\n"
+        "  -q        only print the summary\n"
+        "Modes:\n");
+    for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+        fprintf(stderr, "  %-11s %s\n", workloads[i].name, workloads[i].describe);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    const workload_t *w = &workloads[0];
+    const char *mode = "anon";
+    struct rusage self0, self1, kids0, kids1;
+    expect_t e = { 0, 0, 0 };
+    double duration = 10.0, start, elapsed;
+    uint64_t rounds = 0, avail_kb;
+    bool force = false;
+    size_t i;
+    int c, ret = EXIT_SUCCESS;
+
+    while ((c = getopt(argc, argv, "m:s:r:d:p:fkq")) != -1) {
+        switch (c) {
+        case 'm': mode = optarg; break;
+        case 's': footprint = parse_size(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'd': duration = atof(optarg); break;
+        case 'p': path = optarg; break;
+        case 'f': force = true; break;
+        case 'k': keep_cache = true; break;
+        case 'q': quiet = true; break;
+        default: usage();
+        }
+    }
+    for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+        if (!strcmp(workloads[i].name, mode))
+            break;
+    }
+    if ((i == sizeof(workloads) / sizeof(workloads[0])) || (optind != argc) ||
+        (footprint == 0) || (rate < 0.0) || (duration < 0.0))
+        usage();
+    w = &workloads[i];
+
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+    footprint = (footprint + page_size - 1) & ~(page_size - 1);
+    npages = footprint / page_size;
+
+    avail_kb = meminfo_kb("MemAvailable");
+    if (!force && avail_kb && (footprint / 1024 > avail_kb / 2)) {
+        fprintf(stderr, "fault_workload: %zu MB is over half of the %llu MB available, "
+            "use -f to run it anyway\n", footprint >> 20, (unsigned long long)(avail_kb >> 10));
+        exit(EXIT_FAILURE);
+    }
+
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+
+    if (w->setup && (w->setup() < 0)) {
+        if (w->cleanup)
+            w->cleanup();
+        exit(EXIT_FAILURE);
+    }
+    if (!quiet) {
+        printf("fault_workload: pid %d, mode %s, %zu pages of %zu bytes\n",
+            (int)getpid(), w->name, npages, page_size);
+        printf("fault_workload: each round costs %s\n", w->describe);
+        fflush(stdout);
+    }
+
+    getrusage(RUSAGE_SELF, &self0);
+    getrusage(RUSAGE_CHILDREN, &kids0);
+    start = pace_start = now();
+    /* Rounds run to the end, only a signal cuts one short */
+    while (!stop && ((duration == 0.0) || (now() - start < duration))) {
+        expect_t round = { 0, 0, 0 };
+
+        if (w->round(&round) < 0) {
+            ret = EXIT_FAILURE;
+            break;
+        }
+        if (stop)
+            break;
+        e.minor += round.minor;
+        e.major += round.major;
+        e.child_minor += round.child_minor;
+        rounds++;
+    }
+    elapsed = now() - start;
+    getrusage(RUSAGE_SELF, &self1);
+    getrusage(RUSAGE_CHILDREN, &kids1);
+    if (w->cleanup)
+        w->cleanup();
+
+    printf("fault_workload: %s, %llu rounds in %.2fs\n",
+        w->name, (unsigned long long)rounds, elapsed);
+    printf("  expected: %llu minor, %llu major, %llu minor in children (%.0f faults/s)\n",
+        (unsigned long long)e.minor, (unsigned long long)e.major,
+        (unsigned long long)e.child_minor,
+        elapsed > 0.0 ? (double)(e.minor + e.major + e.child_minor) / elapsed : 0.0);
+    printf("  rusage:   %ld minor, %ld major, %ld minor in children, %ld major in children\n",
+        self1.ru_minflt - self0.ru_minflt, self1.ru_majflt - self0.ru_majflt,
+        kids1.ru_minflt - kids0.ru_minflt, kids1.ru_majflt - kids0.ru_majflt);
+    if (stop && rounds)
+        printf("  (the interrupted last round is not counted)\n");
+    return ret;
+}
@@ -0,0 +1,480 @@
+/*
+ * Microbenchmarks of the PageFaultStat sampler's hot paths.
+ *
+ * Each case is calibrated to a batch of calls that takes at least
+ * 100us, warmed up, then timed for a number of repetitions (fewer, but
+ * at least 5, when they would take over 3s); the median and p99 of the
+ * per-call time and cycle count are reported. Cycles come from rdtsc on
+ * x86 (reference cycles, not core cycles) and from a perf_event_open()
+ * cycle counter elsewhere, if the kernel allows it.
+ *
+ * proc.c is included rather than linked so its static helpers can be
+ * timed directly; the rest of the sampler is linked from its objects
+ * (main.c built with main renamed). See the bench target in the Makefile.
+ *
+ * Usage: ./microbench [-r reps] [-w warmup] [-f filter] [-j file]
+ *   -j writes the results as JSON, keyed by case name and size, so runs
+ *   from different commits can be diffed.
+ */
+#include "../src/proc.c"
+
+#include <math.h>
+#include <ncurses.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLE_SOURCE    "rdtsc"
+#else
+#include <linux/perf_event.h>
+#define CYCLE_SOURCE    "perf"
+#endif
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT    "unknown"
+#endif
+
+#define MIN_REP_NS      100000.0    /* calibrate batches to at least 100us */
+#define MAX_BATCH       (1 << 20)
+#define CASE_BUDGET_NS  3e9         /* fewer repetitions of slow cases */
+#define MIN_REPS        5
+
+typedef struct {
+    const char *name;
+    size_t n;                       /* items handled per call */
+    void (*setup)(size_t n);
+    void (*run)(size_t n);
+    void (*teardown)(void);
+} bench_t;
+
+typedef struct {
+    const bench_t *bench;
+    long batch;
+    int reps;
+    double median_ns, p99_ns;
+    double median_cycles, p99_cycles;
+} result_t;
+
+static fault_info_t *old_list, *new_list;
+static fault_info_t *old_entries, *new_entries;
+static strbuf_t frame;
+static char stat_line[4096];
+static char tmp_root[] = "/tmp/microbench.XXXXXX";
+static FILE *null_fp;
+static SCREEN *screen;
+static int saved_stdout = -1;
+static uint64_t rng = 88172645463325252ULL;
+static volatile int sink;           /* keeps results alive */
+static bool have_cycles = true;
+
+static uint64_t rand64(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static void cycles_open(void) {
+}
+
+static uint64_t cycles(void) {
+    return __rdtsc();
+}
+#else
+static int cycles_fd = -1;
+
+static void cycles_open(void) {
+    struct perf_event_attr pe;
+
+    memset(&pe, 0, sizeof(pe));
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.size = sizeof(pe);
+    pe.config = PERF_COUNT_HW_CPU_CYCLES;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    cycles_fd = (int)syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+    have_cycles = cycles_fd >= 0;
+}
+
+static uint64_t cycles(void) {
+    uint64_t val = 0;
+
+    if ((cycles_fd < 0) || (read(cycles_fd, &val, sizeof(val)) != sizeof(val)))
+        return 0;
+    return val;
+}
+#endif
+
+static void null_printf(const char *fmt, ...) {
+    (void)fmt;
+}
+
+/* Two samples of the same n processes, every one of them faulting */
+static void lists_setup(size_t n) {
+    size_t i;
+
+    old_entries = calloc(n, sizeof(*old_entries));
+    new_entries = calloc(n, sizeof(*new_entries));
+    if (!old_entries || !new_entries) {
+        fprintf(stderr, "microbench: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    old_list = new_list = NULL;
+    for (i = n; i-- > 0; ) {
+        fault_info_t *o = &old_entries[i], *f = &new_entries[i];
+
+        o->pid = f->pid = (pid_t)(1000 + i * 7);
+        o->min_fault = (int64_t)(rand64() % 10000000);
+        o->maj_fault = (int64_t)(rand64() % 10000);
+        o->vm_swap = (int64_t)(rand64() % 100000);
+        f->min_fault = o->min_fault + (int64_t)(rand64() % 1000) + 1;
+        f->maj_fault = o->maj_fault + (int64_t)(rand64() % 10);
+        f->vm_swap = o->vm_swap;
+        o->next = old_list;
+        old_list = o;
+        f->next = new_list;
+        new_list = f;
+    }
+    /* The dumps render the deltas the sampler computed once */
+    fault_deltas(new_list, old_list);
+
+    /* Text dumps format every row but print nothing */
+    df = df_normal;
+    df.df_printf = null_printf;
+}
+
+static void lists_teardown(void) {
+    free(old_entries);
+    free(new_entries);
+    old_entries = new_entries = NULL;
+    old_list = new_list = NULL;
+    df = df_normal;
+}
+
+static void run_fault_deltas(size_t n) {
+    (void)n;
+    fault_deltas(new_list, old_list);
+}
+
+static void run_fault_dump(size_t n) {
+    (void)n;
+    (void)fault_dump(new_list, false);
+}
+
+static void run_fault_dump_diff(size_t n) {
+    (void)n;
+    (void)fault_dump_diff(new_list);
+}
+
+static void run_fault_json_frame(size_t n) {
+    (void)n;
+    (void)fault_json_frame(new_list, &frame);
+}
+
+static void stat_setup(size_t n) {
+    (void)n;
+    if (read_file("/proc/self/stat", stat_line, sizeof(stat_line)) <= 0) {
+        fprintf(stderr, "microbench: cannot read /proc/self/stat\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void run_stat_parse(size_t n) {
+    fault_info_t f;
+
+    (void)n;
+    sink = fault_parse_stat(stat_line, &f);
+}
+
+static void run_int64_to_str(size_t n) {
+    static const int64_t vals[] = { 7, 123456, 98765432, 12345678901LL };
+    char buf[12];
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        int64_to_str(vals[i & 3], buf, sizeof(buf));
+        sink = buf[0];
+    }
+}
+
+/* stdout goes to /dev/null so the cost is formatting plus stdio */
+static void normal_printf_setup(size_t n) {
+    (void)n;
+    fflush(stdout);
+    saved_stdout = dup(STDOUT_FILENO);
+    dup2(fileno(null_fp), STDOUT_FILENO);
+}
+
+static void normal_printf_teardown(void) {
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+}
+
+static void run_normal_printf(size_t n) {
+    (void)n;
+    faultstat_normal_printf(" %*d %7s %7s %7s %7s %7s%s %s%-10.10s %s\n",
+        7, 123456, "   1234 ", "  98765k", "      3 ", "    987 ",
+        "      0 ", "", "", "root", "/usr/lib/firefox/firefox -contentproc");
+}
+
+/* An ncurses screen drawing to /dev/null, only the window is updated */
+static void top_printf_setup(size_t n) {
+    (void)n;
+    if ((screen = newterm("vt100", null_fp, stdin)) == NULL) {
+        fprintf(stderr, "microbench: cannot set up ncurses\n");
+        exit(EXIT_FAILURE);
+    }
+    rows = 25;
+    cols = 80;
+}
+
+static void top_printf_teardown(void) {
+    endwin();
+    delscreen(screen);
+    screen = NULL;
+    cury = 0;
+}
+
+static void run_top_printf(size_t n) {
+    (void)n;
+    cury = 0;
+    move(0, 0);
+    faultstat_top_printf(" %*d %7s %7s %7s %7s %7s%s %s%-10.10s %s\n",
+        7, 123456, "   1234 ", "  98765k", "      3 ", "    987 ",
+        "      0 ", "", "", "root", "/usr/lib/firefox/firefox -contentproc");
+}
+
+/* n fake processes under a temporary --proc-root, all cached */
+static void proc_cache_setup(size_t n) {
+    char path[PATH_MAX];
+    size_t i;
+
+    if (mkdtemp(tmp_root) == NULL) {
+        fprintf(stderr, "microbench: cannot create %s\n", tmp_root);
+        exit(EXIT_FAILURE);
+    }
+    proc_root = tmp_root;
+    for (i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "%s/%zu", tmp_root, 1000 + i * 7);
+        mkdir(path, 0755);
+        (void)proc_cache_find_by_pid((pid_t)(1000 + i * 7));
+    }
+}
+
+static void proc_cache_teardown(void) {
+    char path[PATH_MAX];
+    size_t i;
+
+    proc_cache_cleanup();
+    for (i = 0; ; i++) {
+        snprintf(path, sizeof(path), "%s/%zu", tmp_root, 1000 + i * 7);
+        if (rmdir(path) < 0)
+            break;
+    }
+    rmdir(tmp_root);
+    strcpy(tmp_root, "/tmp/microbench.XXXXXX");
+    proc_root = "/proc";
+}
+
+static void run_proc_cache_find(size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        sink = proc_cache_find_by_pid((pid_t)(1000 + i * 7)) != NULL;
+}
+
+static void run_uname_cache_find(size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        sink = uname_cache_find((uid_t)i) != NULL;
+}
+
+static const bench_t benches[] = {
+    { "stat_parse",       1,     stat_setup,          run_stat_parse,       NULL },
+    { "int64_to_str",     4,     NULL,                run_int64_to_str,     NULL },
+    { "normal_printf",    1,     normal_printf_setup, run_normal_printf,    normal_printf_teardown },
+    { "top_printf",       1,     top_printf_setup,    run_top_printf,       top_printf_teardown },
+    { "uname_cache_find", 8,     NULL,                run_uname_cache_find, NULL },
+    { "proc_cache_find",  1000,  proc_cache_setup,    run_proc_cache_find,  proc_cache_teardown },
+    { "proc_cache_find",  10000, proc_cache_setup,    run_proc_cache_find,  proc_cache_teardown },
+    { "fault_deltas",     1000,  lists_setup,         run_fault_deltas,     lists_teardown },
+    { "fault_deltas",     10000, lists_setup,         run_fault_deltas,     lists_teardown },
+    { "fault_dump",       1000,  lists_setup,         run_fault_dump,       lists_teardown },
+    { "fault_dump",       10000, lists_setup,         run_fault_dump,       lists_teardown },
+    { "fault_dump_diff",  1000,  lists_setup,         run_fault_dump_diff,  lists_teardown },
+    { "fault_dump_diff",  10000, lists_setup,         run_fault_dump_diff,  lists_teardown },
+    { "fault_json_frame", 1000,  lists_setup,         run_fault_json_frame, lists_teardown },
+    { "fault_json_frame", 10000, lists_setup,         run_fault_json_frame, lists_teardown },
+};
+
+static int cmp_double(const void *a, const void *b) {
+    const double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double percentile(double *v, int n, double pct) {
+    int idx = (int)ceil(pct / 100.0 * n) - 1;
+
+    if (idx < 0)
+        idx = 0;
+    return v[idx];
+}
+
+static void run_batch(const bench_t *b, long batch, double *ns, double *cyc) {
+    double t0, t1;
+    uint64_t c0, c1;
+    long i;
+
+    t0 = now_ns();
+    c0 = cycles();
+    for (i = 0; i < batch; i++)
+        b->run(b->n);
+    c1 = cycles();
+    t1 = now_ns();
+    *ns = (t1 - t0) / (double)batch;
+    *cyc = (double)(c1 - c0) / (double)batch;
+}
+
+static void run_bench(const bench_t *b, int reps, int warmup, result_t *r) {
+    double *ns = calloc((size_t)reps, sizeof(double));
+    double *cyc = calloc((size_t)reps, sizeof(double));
+    double t, c;
+    long batch = 1;
+    int i;
+
+    if (!ns || !cyc) {
+        fprintf(stderr, "microbench: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    if (b->setup)
+        b->setup(b->n);
+
+    /* First call fills caches, it would skew the calibration */
+    run_batch(b, 1, &t, &c);
+    for (;;) {
+        run_batch(b, batch, &t, &c);
+        if ((t * (double)batch >= MIN_REP_NS) || (batch >= MAX_BATCH))
+            break;
+        batch *= 2;
+    }
+    for (i = 0; i < warmup; i++)
+        run_batch(b, batch, &t, &c);
+    if ((double)reps * t * (double)batch > CASE_BUDGET_NS)
+        reps = (int)(CASE_BUDGET_NS / (t * (double)batch));
+    if (reps < MIN_REPS)
+        reps = MIN_REPS;
+    for (i = 0; i < reps; i++)
+        run_batch(b, batch, &ns[i], &cyc[i]);
+
+    if (b->teardown)
+        b->teardown();
+
+    qsort(ns, (size_t)reps, sizeof(double), cmp_double);
+    qsort(cyc, (size_t)reps, sizeof(double), cmp_double);
+    r->bench = b;
+    r->batch = batch;
+    r->reps = reps;
+    r->median_ns = percentile(ns, reps, 50.0);
+    r->p99_ns = percentile(ns, reps, 99.0);
+    r->median_cycles = percentile(cyc, reps, 50.0);
+    r->p99_cycles = percentile(cyc, reps, 99.0);
+    free(ns);
+    free(cyc);
+}
+
+static int write_json(const char *path, const result_t *results, size_t count) {
+    FILE *fp = fopen(path, "w");
+    size_t i;
+
+    if (!fp)
+        return -1;
+    fprintf(fp, "{\"version\":\"%s\",\"commit\":\"%s\",\"cycles\":\"%s\",\"results\":[",
+        VERSION, BENCH_COMMIT, have_cycles ? CYCLE_SOURCE : "none");
+    for (i = 0; i < count; i++) {
+        const result_t *r = &results[i];
+
+        fprintf(fp, "%s\n{\"name\":\"%s\",\"n\":%zu,\"reps\":%d,\"batch\":%ld,"
+            "\"medianNs\":%.1f,\"p99Ns\":%.1f,",
+            i ? "," : "", r->bench->name, r->bench->n, r->reps, r->batch,
+            r->median_ns, r->p99_ns);
+        if (have_cycles)
+            fprintf(fp, "\"medianCycles\":%.0f,\"p99Cycles\":%.0f}",
+                r->median_cycles, r->p99_cycles);
+        else
+            fprintf(fp, "\"medianCycles\":null,\"p99Cycles\":null}");
+    }
+    fprintf(fp, "\n]}\n");
+    return fclose(fp);
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: microbench [-r reps] [-w warmup] [-f filter] [-j file]\n"
+        "  -r reps     timed repetitions per case (default 51)\n"
+        "  -w warmup   untimed repetitions first (default 5)\n"
+        "  -f filter   only run cases whose name contains filter\n"
+        "  -j file     also write the results to file as JSON\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    const size_t nbenches = sizeof(benches) / sizeof(benches[0]);
+    result_t results[sizeof(benches) / sizeof(benches[0])];
+    const char *filter = NULL, *json = NULL;
+    int reps = 51, warmup = 5, c;
+    size_t i, count = 0;
+
+    while ((c = getopt(argc, argv, "r:w:f:j:")) != -1) {
+        switch (c) {
+        case 'r': reps = atoi(optarg); break;
+        case 'w': warmup = atoi(optarg); break;
+        case 'f': filter = optarg; break;
+        case 'j': json = optarg; break;
+        default: usage();
+        }
+    }
+    if ((optind != argc) || (reps < 1) || (warmup < 0))
+        usage();
+
+    if ((null_fp = fopen("/dev/null", "w")) == NULL) {
+        fprintf(stderr, "microbench: cannot open /dev/null\n");
+        exit(EXIT_FAILURE);
+    }
+    cycles_open();
+    df = df_normal;
+
+    printf("%-18s %6s %8s %12s %12s %12s %12s %10s\n",
+        "case", "n", "batch", "median ns", "p99 ns", "median cyc", "p99 cyc", "ns/item");
+    for (i = 0; i < nbenches; i++) {
+        const result_t *r = &results[count];
+
+        if (filter && !strstr(benches[i].name, filter))
+            continue;
+        run_bench(&benches[i], reps, warmup, &results[count]);
+        printf("%-18s %6zu %8ld %12.1f %12.1f %12.0f %12.0f %10.2f\n",
+            r->bench->name, r->bench->n, r->batch, r->median_ns, r->p99_ns,
+            r->median_cycles, r->p99_cycles, r->median_ns / (double)r->bench->n);
+        fflush(stdout);
+        count++;
+    }
+
+    strbuf_free(&frame);
+    uname_cache_cleanup();
+    fclose(null_fp);
+
+    if (json && (write_json(json, results, count) < 0)) {
+        fprintf(stderr, "microbench: cannot write %s: %s\n", json, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,533 @@
+/*
+ * Memory pressure harness for PageFaultStat thrash detection.
+ *
+ * Creates a transient cgroup v2 group, runs fault_workload inside it and
+ * PageFaultStat (-J frames, -e events) outside it, and drives three
+ * phases with known boundaries:
+ *
+ *   baseline   memory.max (or memory.high with -H) unlimited, the
+ *              workload's footprint fits and faults stay minor
+ *   pressure   the limit drops below the footprint, reclaim makes the
+ *              workload refault its file pages (or swap in, in swap mode)
+ *   recovery   the limit is lifted again
+ *
+ * Once a second the group's own counters (memory.stat pgmajfault and
+ * workingset refaults, memory.events, memory.current, memory.pressure
+ * some avg10) are appended to kernel.ndjson. At the end the sampler's
+ * onset/end events are scored against the phase boundaries and against
+ * the first second the kernel saw refaults, and its major fault count
+ * for the workload against the group's pgmajfault. Everything goes to
+ * the output directory, the score also to score.json. The group is
+ * removed afterwards, also on SIGINT/SIGTERM.
+ *
+ * Needs root and a cgroup v2 hierarchy with the memory controller.
+ * The swap mode of fault_workload needs swap; the default file-read
+ * mode (with the page cache kept) needs only a disk-backed directory.
+ *
+ * Build: make pressure (or cc -O2 -o pressure_harness pressure_harness.c)
+ * Usage: ./pressure_harness [-P sampler] [-W workload] [-c cgroup root]
+ *                           [-o dir] [-l limit] [-H] [-m mode] [-s size]
+ *                           [-r rate] [-b secs] [-t secs] [-e secs]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+enum { PHASE_BASELINE, PHASE_PRESSURE, PHASE_RECOVERY, PHASE_DONE };
+
+static const char *const phase_names[] = { "baseline", "pressure", "recovery", "done" };
+
+typedef struct {
+    double time;
+    uint64_t pgmajfault;
+    uint64_t refault_file;
+    uint64_t refault_anon;
+    uint64_t current;
+    uint64_t high_events;
+    uint64_t max_events;
+    uint64_t oom_kill;
+    double psi_some10;
+} kernel_sample_t;
+
+static const char *sampler = "./build/PageFaultStat";
+static const char *workload = "./Test/fault_workload";
+static const char *cg_root = "/sys/fs/cgroup";
+static const char *out_dir = "pressure-out";
+static const char *mode = "file-read";
+static const char *size;
+static const char *rate = "5000";
+static const char *limit = "64M";
+static bool use_high;
+static double phase_secs[3] = { 20.0, 20.0, 20.0 };
+
+static char cg_path[PATH_MAX];
+static bool cg_created;
+static pid_t workload_pid = -1, sampler_pid = -1;
+static volatile sig_atomic_t stop;
+
+static double now(void) {
+    struct timespec ts;
+
+    /* Same clock as the sampler's event timestamps */
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void sleep_until(double t) {
+    double d;
+
+    while (!stop && ((d = t - now()) > 0.0)) {
+        const struct timespec ts = { (time_t)d, (long)((d - (double)(time_t)d) * 1e9) };
+
+        nanosleep(&ts, NULL);
+    }
+}
+
+static int cg_write(const char *file, const char *val) {
+    char path[PATH_MAX + 64];
+    int fd;
+    ssize_t ret;
+
+    snprintf(path, sizeof(path), "%s/%s", cg_path, file);
+    if ((fd = open(path, O_WRONLY)) < 0)
+        return -1;
+    ret = write(fd, val, strlen(val));
+    close(fd);
+    return ret < 0 ? -1 : 0;
+}
+
+static ssize_t read_text(const char *path, char *buf, size_t len) {
+    ssize_t n;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+    n = read(fd, buf, len - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+/* Value of "key value" line in a flat keyed cgroup file */
+static uint64_t keyed(const char *buf, const char *key) {
+    const size_t len = strlen(key);
+    const char *p;
+
+    for (p = buf; p && *p; p = strchr(p, '\n'), p = p ? p + 1 : NULL) {
+        if (!strncmp(p, key, len) && (p[len] == ' '))
+            return strtoull(p + len + 1, NULL, 10);
+    }
+    return 0;
+}
+
+static void kernel_sample(kernel_sample_t *ks) {
+    char path[PATH_MAX + 64], buf[8192];
+    const char *p;
+
+    memset(ks, 0, sizeof(*ks));
+    ks->time = now();
+    snprintf(path, sizeof(path), "%s/memory.stat", cg_path);
+    if (read_text(path, buf, sizeof(buf)) > 0) {
+        ks->pgmajfault = keyed(buf, "pgmajfault");
+        ks->refault_file = keyed(buf, "workingset_refault_file");
+        ks->refault_anon = keyed(buf, "workingset_refault_anon");
+    }
+    snprintf(path, sizeof(path), "%s/memory.events", cg_path);
+    if (read_text(path, buf, sizeof(buf)) > 0) {
+        ks->high_events = keyed(buf, "high");
+        ks->max_events = keyed(buf, "max");
+        ks->oom_kill = keyed(buf, "oom_kill");
+    }
+    snprintf(path, sizeof(path), "%s/memory.current", cg_path);
+    if (read_text(path, buf, sizeof(buf)) > 0)
+        ks->current = strtoull(buf, NULL, 10);
+    snprintf(path, sizeof(path), "%s/memory.pressure", cg_path);
+    if ((read_text(path, buf, sizeof(buf)) > 0) && ((p = strstr(buf, "some avg10=")) != NULL))
+        ks->psi_some10 = atof(p + 11);
+}
+
+static void kernel_log(FILE *fp, const kernel_sample_t *ks, int phase) {
+    fprintf(fp, "{\"timestamp\":%.3f,\"phase\":\"%s\",\"pgmajfault\":%llu,"
+        "\"refaultFile\":%llu,\"refaultAnon\":%llu,\"current\":%llu,"
+        "\"high\":%llu,\"max\":%llu,\"oomKill\":%llu,\"psiSome10\":%.2f}\n",
+        ks->time, phase_names[phase], (unsigned long long)ks->pgmajfault,
+        (unsigned long long)ks->refault_file, (unsigned long long)ks->refault_anon,
+        (unsigned long long)ks->current, (unsigned long long)ks->high_events,
+        (unsigned long long)ks->max_events, (unsigned long long)ks->oom_kill,
+        ks->psi_some10);
+    fflush(fp);
+}
+
+static int cg_setup(void) {
+    char path[PATH_MAX + 64], buf[512];
+
+    snprintf(path, sizeof(path), "%s/cgroup.controllers", cg_root);
+    if ((read_text(path, buf, sizeof(buf)) < 0) || !strstr(buf, "memory")) {
+        fprintf(stderr, "pressure_harness: no cgroup v2 memory controller in %s\n", cg_root);
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/cgroup.subtree_control", cg_root);
+    if ((read_text(path, buf, sizeof(buf)) >= 0) && !strstr(buf, "memory")) {
+        const int fd = open(path, O_WRONLY);
+
+        if ((fd < 0) || (write(fd, "+memory", 7) < 0))
+            fprintf(stderr, "pressure_harness: cannot enable memory in %s\n", path);
+        if (fd >= 0)
+            close(fd);
+    }
+    snprintf(cg_path, sizeof(cg_path), "%s/pagefaultstat-%d", cg_root, (int)getpid());
+    if (mkdir(cg_path, 0755) < 0) {
+        fprintf(stderr, "pressure_harness: cannot create %s: %s\n", cg_path, strerror(errno));
+        return -1;
+    }
+    cg_created = true;
+    (void)cg_write("memory.high", "max");
+    if (cg_write("memory.max", "max") < 0) {
+        fprintf(stderr, "pressure_harness: cannot write %s/memory.max\n", cg_path);
+        return -1;
+    }
+    return 0;
+}
+
+static void stop_child(pid_t *pid) {
+    int i;
+
+    if (*pid <= 0)
+        return;
+    kill(*pid, SIGTERM);
+    for (i = 0; i < 50; i++) {
+        if (waitpid(*pid, NULL, WNOHANG) != 0)
+            break;
+        usleep(100000);
+    }
+    if (i == 50) {
+        kill(*pid, SIGKILL);
+        (void)waitpid(*pid, NULL, 0);
+    }
+    *pid = -1;
+}
+
+static void teardown(void) {
+    int i;
+
+    stop_child(&workload_pid);
+    stop_child(&sampler_pid);
+    if (!cg_created)
+        return;
+    /* The group can only go once its last process has been reaped */
+    for (i = 0; (i < 50) && (rmdir(cg_path) < 0) && (errno == EBUSY); i++)
+        usleep(100000);
+    cg_created = false;
+}
+
+/* Fork a child with stdout to out_dir/name, held until gate[1] is closed */
+static pid_t spawn(char *const argv[], const char *name, const int *gate) {
+    char path[PATH_MAX];
+    pid_t pid;
+
+    snprintf(path, sizeof(path), "%s/%s", out_dir, name);
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        char c;
+
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            close(fd);
+        }
+        if (gate) {
+            close(gate[1]);
+            (void)read(gate[0], &c, 1);
+        }
+        execv(argv[0], argv);
+        fprintf(stderr, "pressure_harness: cannot run %s: %s\n", argv[0], strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+/*
+ * Major fault counter of pid in the last frame that has it, the workload
+ * joined the group before exec so both count from zero
+ */
+static int frames_major(const char *path, pid_t pid, uint64_t *last) {
+    char key[48];
+    char *line = NULL;
+    size_t len = 0;
+    bool seen = false;
+    FILE *fp = fopen(path, "r");
+
+    if (!fp)
+        return -1;
+    snprintf(key, sizeof(key), "{\"pid\":%d,\"major\":", (int)pid);
+    while (getline(&line, &len, fp) > 0) {
+        const char *p = strstr(line, key);
+        if (!p)
+            continue;
+        *last = strtoull(p + strlen(key), NULL, 10);
+        seen = true;
+    }
+    free(line);
+    fclose(fp);
+    return seen ? 0 : -1;
+}
+
+static double json_number(const char *line, const char *key) {
+    const char *p = strstr(line, key);
+
+    return p ? atof(p + strlen(key)) : 0.0;
+}
+
+typedef struct {
+    int onsets_before;      /* false onsets in the baseline */
+    double onset;           /* first onset in pressure, 0 if none */
+    double end;             /* first end after the limit was lifted */
+} detect_t;
+
+/* Onsets and ends for the workload (or system wide, pid 0) */
+static void score_events(const char *path, pid_t pid, double t_pressure, double t_recovery, detect_t *d) {
+    char *line = NULL;
+    size_t len = 0;
+    FILE *fp = fopen(path, "r");
+
+    memset(d, 0, sizeof(*d));
+    if (!fp)
+        return;
+    while (getline(&line, &len, fp) > 0) {
+        const int ev_pid = (int)json_number(line, "\"pid\":");
+        const double t = json_number(line, "\"timestamp\":");
+
+        if ((ev_pid != (int)pid) && (ev_pid != 0))
+            continue;
+        if (strstr(line, "\"type\":\"onset\"")) {
+            if (t < t_pressure)
+                d->onsets_before++;
+            else if ((d->onset == 0.0) && (t < t_recovery))
+                d->onset = t;
+        } else if ((d->end == 0.0) && (t >= t_recovery)) {
+            d->end = t;
+        }
+    }
+    free(line);
+    fclose(fp);
+}
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: pressure_harness [-P sampler] [-W workload] [-c cgroup root] [-o dir]\n"
+        "                        [-l limit] [-H] [-m mode] [-s size] [-r rate]\n"
+        "                        [-b secs] [-t secs] [-e secs]\n"
+        "  -P sampler   PageFaultStat binary (default ./build/PageFaultStat)\n"
+        "  -W workload  fault_workload binary (default ./Test/fault_workload)\n"
+        "  -c root      cgroup v2 mount (default /sys/fs/cgroup)\n"
+        "  -o dir       output directory (default pressure-out)\n"
+        "  -l limit     memory limit of the pressure phase (default 64M)\n"
+        "  -H           limit with memory.high (throttling) instead of memory.max\n"
+        "  -m mode      fault_workload mode, file-read or swap (default file-read)\n"
+        "  -s size      workload footprint (default twice the limit)\n"
+        "  -r rate      workload faults per second (default 5000)\n"
+        "  -b/-t/-e s   baseline, pressure and recovery seconds (default 20 each)\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    char path[PATH_MAX], sz[32], pidstr[16], file[PATH_MAX];
+    kernel_sample_t k_start, k_end, ks, prev;
+    double t_start, t_phase[PHASE_DONE + 1], t_kernel = 0.0, elapsed;
+    uint64_t s_major = 0;
+    detect_t d;
+    FILE *klog, *score;
+    int gate[2], c, phase, ret = EXIT_SUCCESS;
+
+    while ((c = getopt(argc, argv, "P:W:c:o:l:Hm:s:r:b:t:e:")) != -1) {
+        switch (c) {
+        case 'P': sampler = optarg; break;
+        case 'W': workload = optarg; break;
+        case 'c': cg_root = optarg; break;
+        case 'o': out_dir = optarg; break;
+        case 'l': limit = optarg; break;
+        case 'H': use_high = true; break;
+        case 'm': mode = optarg; break;
+        case 's': size = optarg; break;
+        case 'r': rate = optarg; break;
+        case 'b': phase_secs[PHASE_BASELINE] = atof(optarg); break;
+        case 't': phase_secs[PHASE_PRESSURE] = atof(optarg); break;
+        case 'e': phase_secs[PHASE_RECOVERY] = atof(optarg); break;
+        default: usage();
+        }
+    }
+    if (optind != argc)
+        usage();
+    if (!size) {
+        /* Twice the limit, whatever its suffix */
+        char *end;
+        const double v = strtod(limit, &end);
+
+        snprintf(sz, sizeof(sz), "%.0f%s", v * 2.0, end);
+        size = sz;
+    }
+    if ((mkdir(out_dir, 0755) < 0) && (errno != EEXIST)) {
+        fprintf(stderr, "pressure_harness: cannot create %s: %s\n", out_dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+    if (cg_setup() < 0) {
+        teardown();
+        exit(EXIT_FAILURE);
+    }
+
+    /* The workload waits on the gate until it has been moved into the group */
+    if (pipe2(gate, O_CLOEXEC) < 0) {
+        perror("pipe");
+        teardown();
+        exit(EXIT_FAILURE);
+    }
+    snprintf(file, sizeof(file), "%s/fault_workload.bin", out_dir);
+    {
+        char *const wargv[] = {
+            (char *)workload, "-m", (char *)mode, "-s", (char *)size, "-r", (char *)rate,
+            "-d", "0", "-k", "-f", "-p", file, NULL
+        };
+
+        workload_pid = spawn(wargv, "workload.txt", gate);
+    }
+    close(gate[0]);
+    snprintf(pidstr, sizeof(pidstr), "%d", (int)workload_pid);
+    if ((workload_pid < 0) || (cg_write("cgroup.procs", pidstr) < 0)) {
+        fprintf(stderr, "pressure_harness: cannot move the workload into %s\n", cg_path);
+        close(gate[1]);
+        teardown();
+        exit(EXIT_FAILURE);
+    }
+    {
+        char frames[PATH_MAX + 16], events[PATH_MAX + 16];
+        char *const sargv[] = {
+            (char *)sampler, "-J", "-o", frames, "-e", events, "-p", pidstr, "1", NULL
+        };
+
+        snprintf(frames, sizeof(frames), "%s/frames.ndjson", out_dir);
+        snprintf(events, sizeof(events), "%s/events.ndjson", out_dir);
+        sampler_pid = spawn(sargv, "sampler.txt", NULL);
+    }
+
+    snprintf(path, sizeof(path), "%s/kernel.ndjson", out_dir);
+    if ((klog = fopen(path, "w")) == NULL) {
+        fprintf(stderr, "pressure_harness: cannot create %s\n", path);
+        close(gate[1]);
+        teardown();
+        exit(EXIT_FAILURE);
+    }
+    kernel_sample(&k_start);
+    prev = k_start;
+    close(gate[1]);
+
+    printf("pressure_harness: %s, workload %d (%s, %s), limit %s via %s\n",
+        cg_path, (int)workload_pid, mode, size, limit, use_high ? "memory.high" : "memory.max");
+    fflush(stdout);
+
+    t_start = now();
+    t_phase[PHASE_BASELINE] = t_start;
+    for (phase = PHASE_BASELINE; phase < PHASE_DONE; phase++)
+        t_phase[phase + 1] = t_phase[phase] + phase_secs[phase];
+
+    /* One kernel sample a second, limits switched at the phase boundaries */
+    phase = PHASE_BASELINE;
+    for (elapsed = 1.0; !stop && (phase < PHASE_DONE); elapsed += 1.0) {
+        sleep_until(t_start + elapsed);
+        while ((phase < PHASE_DONE) && (now() >= t_phase[phase + 1])) {
+            phase++;
+            if (phase == PHASE_PRESSURE) {
+                t_phase[PHASE_PRESSURE] = now();
+                (void)cg_write(use_high ? "memory.high" : "memory.max", limit);
+            } else if (phase == PHASE_RECOVERY) {
+                t_phase[PHASE_RECOVERY] = now();
+                (void)cg_write(use_high ? "memory.high" : "memory.max", "max");
+            }
+        }
+        if (waitpid(workload_pid, NULL, WNOHANG) == workload_pid) {
+            fprintf(stderr, "pressure_harness: the workload exited early\n");
+            workload_pid = -1;
+            ret = EXIT_FAILURE;
+            break;
+        }
+        kernel_sample(&ks);
+        kernel_log(klog, &ks, phase < PHASE_DONE ? phase : PHASE_RECOVERY);
+        /* The kernel's own onset, the first refaults under the limit */
+        if ((phase == PHASE_PRESSURE) && (t_kernel == 0.0) &&
+            (ks.pgmajfault > prev.pgmajfault))
+            t_kernel = ks.time;
+        prev = ks;
+    }
+
+    stop_child(&workload_pid);
+    kernel_sample(&k_end);
+    kernel_log(klog, &k_end, PHASE_DONE);
+    fclose(klog);
+    /* Let the sampler take one more sample of the exited workload */
+    sleep(1);
+    stop_child(&sampler_pid);
+    teardown();
+
+    snprintf(path, sizeof(path), "%s/frames.ndjson", out_dir);
+    if (frames_major(path, (pid_t)atoi(pidstr), &s_major) < 0)
+        fprintf(stderr, "pressure_harness: no frames of the workload in %s\n", path);
+    snprintf(path, sizeof(path), "%s/events.ndjson", out_dir);
+    score_events(path, (pid_t)atoi(pidstr), t_phase[PHASE_PRESSURE], t_phase[PHASE_RECOVERY], &d);
+
+    snprintf(path, sizeof(path), "%s/score.json", out_dir);
+    if ((score = fopen(path, "w")) != NULL) {
+        const uint64_t k_major = k_end.pgmajfault - k_start.pgmajfault;
+
+        fprintf(score, "{\"pressureAt\":%.3f,\"recoveryAt\":%.3f,\"kernelOnsetAt\":%.3f,"
+            "\"onsetAt\":%.3f,\"onsetLatency\":%.3f,\"onsetLatencyFromKernel\":%.3f,"
+            "\"falseOnsets\":%d,\"endAt\":%.3f,\"endLatency\":%.3f,"
+            "\"majorSampler\":%llu,\"majorKernel\":%llu,\"majorError\":%.4f,"
+            "\"refaultFile\":%llu,\"refaultAnon\":%llu,\"oomKill\":%llu,\"interrupted\":%s}\n",
+            t_phase[PHASE_PRESSURE], t_phase[PHASE_RECOVERY], t_kernel,
+            d.onset, d.onset > 0.0 ? d.onset - t_phase[PHASE_PRESSURE] : -1.0,
+            (d.onset > 0.0) && (t_kernel > 0.0) ? d.onset - t_kernel : -1.0,
+            d.onsets_before, d.end, d.end > 0.0 ? d.end - t_phase[PHASE_RECOVERY] : -1.0,
+            (unsigned long long)s_major, (unsigned long long)k_major,
+            k_major ? ((double)s_major - (double)k_major) / (double)k_major : 0.0,
+            (unsigned long long)(k_end.refault_file - k_start.refault_file),
+            (unsigned long long)(k_end.refault_anon - k_start.refault_anon),
+            (unsigned long long)(k_end.oom_kill - k_start.oom_kill),
+            stop ? "true" : "false");
+        fclose(score);
+        printf("  onset:  %s", d.onset > 0.0 ? "" : "not detected\n");
+        if (d.onset > 0.0)
+            printf("%.1fs after the limit, %.1fs after the first kernel refaults\n",
+                d.onset - t_phase[PHASE_PRESSURE], t_kernel > 0.0 ? d.onset - t_kernel : -1.0);
+        printf("  end:    %s", d.end > 0.0 ? "" : "not detected\n");
+        if (d.end > 0.0)
+            printf("%.1fs after the limit was lifted\n", d.end - t_phase[PHASE_RECOVERY]);
+        printf("  false onsets in the baseline: %d\n", d.onsets_before);
+        printf("  major faults: sampler %llu, kernel %llu\n",
+            (unsigned long long)s_major, (unsigned long long)k_major);
+        printf("  results in %s\n", out_dir);
+    }
+    return ret;
+}
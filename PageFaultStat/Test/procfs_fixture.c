@@ -0,0 +1,319 @@
+/*
+ * Synthetic procfs tree for PageFaultStat --proc-root.
+ *
+ * Writes dir/<pid>/{stat,status,cmdline,comm} for the given number of
+ * processes, plus the dir/stat, dir/meminfo and dir/sys/kernel/pid_max
+ * files the sampler reads, so it can be benchmarked at any process
+ * count and tested against deterministic input. With -t the tree keeps
+ * changing: every tick a share of the processes fault (the stat files
+ * are replaced by rename(), so a reader never sees a torn file) and a
+ * share exit and are replaced by new PIDs. The same seed gives the same
+ * sequence of trees.
+ *
+ * Build: cc -O2 -o procfs_fixture procfs_fixture.c
+ * Usage: ./procfs_fixture [-n procs] [-c churn%] [-f faulting%] [-g growth]
+ *                         [-i secs] [-t ticks] [-s seed] [-D] dir
+ *   -t 0 (default) only creates the tree, -t -1 keeps ticking until killed,
+ *   -D creates the tree, then ticks in the background and prints its PID.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define FIRST_PID   1000
+#define PID_MAX     4194304
+#define HZ          100
+
+typedef struct {
+    int pid;
+    uint64_t min_fault;
+    uint64_t maj_fault;
+    uint64_t start_time;    /* clock ticks after boot */
+    uint64_t rss;           /* pages */
+    uint64_t swap;          /* kB */
+} fake_proc_t;
+
+static const char *const commands[] = {
+    "postgres", "java", "node", "python3", "chrome", "nginx", "redis-server", "bash",
+};
+
+static const char *root;
+static fake_proc_t *procs;
+static int nprocs = 1000;
+static int next_pid = FIRST_PID;
+static uint64_t rng = 1;
+static volatile sig_atomic_t stop;
+
+static uint64_t rand64(void) {
+    /* xorshift64*, small and the same everywhere */
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 2685821657736338717ULL;
+}
+
+static double percent(void) {
+    return (double)(rand64() >> 11) / (double)(1ULL << 53) * 100.0;
+}
+
+static uint64_t uptime_ticks(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (uint64_t)ts.tv_sec * HZ + (uint64_t)ts.tv_nsec / (1000000000 / HZ);
+}
+
+static void die(const char *what, const char *path) {
+    fprintf(stderr, "procfs_fixture: %s %s: %s\n", what, path, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+static void write_file(const char *path, const char *data, size_t len) {
+    int fd;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        die("cannot create", path);
+    if (write(fd, data, len) != (ssize_t)len)
+        die("cannot write", path);
+    close(fd);
+}
+
+/* Replace a file in one step, as a read of procfs would see it */
+static void replace_file(const char *path, const char *data, size_t len) {
+    char tmp[PATH_MAX + 8];
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    write_file(tmp, data, len);
+    if (rename(tmp, path) < 0)
+        die("cannot rename", tmp);
+}
+
+static const char *command(const fake_proc_t *p) {
+    return commands[p->pid % (sizeof(commands) / sizeof(commands[0]))];
+}
+
+static void write_stat(const fake_proc_t *p, bool replace) {
+    char path[PATH_MAX], buf[512];
+    int len;
+
+    /* Fields 10 minflt, 12 majflt, 22 starttime and 24 rss are read */
+    len = snprintf(buf, sizeof(buf),
+        "%d (%s) S 1 %d %d 0 -1 4194304 %llu 0 %llu 0 0 0 0 0 20 0 1 0 %llu %llu %llu "
+        "18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 0 0 0 0 0 0\n",
+        p->pid, command(p), p->pid, p->pid,
+        (unsigned long long)p->min_fault, (unsigned long long)p->maj_fault,
+        (unsigned long long)p->start_time, (unsigned long long)p->rss * 4096,
+        (unsigned long long)p->rss);
+    snprintf(path, sizeof(path), "%s/%d/stat", root, p->pid);
+    if (replace)
+        replace_file(path, buf, (size_t)len);
+    else
+        write_file(path, buf, (size_t)len);
+}
+
+static void write_status(const fake_proc_t *p, bool replace) {
+    char path[PATH_MAX], buf[512];
+    const unsigned uid = (unsigned)getuid();
+    int len;
+
+    len = snprintf(buf, sizeof(buf),
+        "Name:\t%s\nState:\tS (sleeping)\nPid:\t%d\nPPid:\t1\n"
+        "Uid:\t%u\t%u\t%u\t%u\nGid:\t%u\t%u\t%u\t%u\n"
+        "VmRSS:\t%llu kB\nVmSwap:\t%llu kB\nThreads:\t1\n",
+        command(p), p->pid, uid, uid, uid, uid, uid, uid, uid, uid,
+        (unsigned long long)p->rss * 4, (unsigned long long)p->swap);
+    snprintf(path, sizeof(path), "%s/%d/status", root, p->pid);
+    if (replace)
+        replace_file(path, buf, (size_t)len);
+    else
+        write_file(path, buf, (size_t)len);
+}
+
+static void create_proc(fake_proc_t *p, uint64_t start_time) {
+    char path[PATH_MAX], buf[256];
+    int len;
+
+    memset(p, 0, sizeof(*p));
+    p->pid = next_pid++;
+    p->start_time = start_time;
+    p->rss = 256 + rand64() % 65536;
+    p->min_fault = p->rss;
+
+    snprintf(path, sizeof(path), "%s/%d", root, p->pid);
+    if ((mkdir(path, 0755) < 0) && (errno != EEXIST))
+        die("cannot create", path);
+
+    write_stat(p, false);
+    write_status(p, false);
+
+    len = snprintf(buf, sizeof(buf), "/usr/bin/%s%c--worker=%d%c", command(p), 0, p->pid, 0);
+    snprintf(path, sizeof(path), "%s/%d/cmdline", root, p->pid);
+    write_file(path, buf, (size_t)len);
+
+    len = snprintf(buf, sizeof(buf), "%s\n", command(p));
+    snprintf(path, sizeof(path), "%s/%d/comm", root, p->pid);
+    write_file(path, buf, (size_t)len);
+}
+
+static void remove_proc(const fake_proc_t *p) {
+    static const char *const files[] = { "stat", "status", "cmdline", "comm" };
+    char path[PATH_MAX];
+    size_t i;
+
+    for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%d/%s", root, p->pid, files[i]);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/%d", root, p->pid);
+    rmdir(path);
+}
+
+static void write_system(uint64_t tick) {
+    char path[PATH_MAX], buf[512];
+    int len;
+
+    /* A busy but healthy machine, iowait grows a little every tick */
+    len = snprintf(buf, sizeof(buf), "cpu  %llu 0 %llu %llu %llu 0 0 0 0 0\n",
+        (unsigned long long)(1000 + tick * 40), (unsigned long long)(500 + tick * 10),
+        (unsigned long long)(10000 + tick * 48), (unsigned long long)(100 + tick * 2));
+    snprintf(path, sizeof(path), "%s/stat", root);
+    replace_file(path, buf, (size_t)len);
+
+    len = snprintf(buf, sizeof(buf),
+        "MemTotal:       16384000 kB\nMemFree:         4096000 kB\n"
+        "MemAvailable:    8192000 kB\nSwapTotal:       4096000 kB\n"
+        "SwapFree:        4000000 kB\n");
+    snprintf(path, sizeof(path), "%s/meminfo", root);
+    replace_file(path, buf, (size_t)len);
+}
+
+static void tick(uint64_t n, double churn, double faulting, uint64_t growth) {
+    const uint64_t now = uptime_ticks();
+    int i;
+
+    for (i = 0; i < nprocs; i++) {
+        fake_proc_t *p = &procs[i];
+
+        if (percent() < churn) {
+            remove_proc(p);
+            create_proc(p, now);
+            continue;
+        }
+        if (percent() < faulting) {
+            const uint64_t minor = growth ? rand64() % (2 * growth + 1) : 0;
+
+            p->min_fault += minor;
+            p->maj_fault += minor / 100;
+            p->rss += minor / 2;
+            write_stat(p, true);
+        }
+    }
+    write_system(n);
+}
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: procfs_fixture [-n procs] [-c churn%%] [-f faulting%%] [-g growth]\n"
+        "                      [-i secs] [-t ticks] [-s seed] [-D] dir\n"
+        "  -n procs     processes in the tree (default 1000)\n"
+        "  -c churn     percent of processes replaced per tick (default 1)\n"
+        "  -f faulting  percent of processes faulting per tick (default 10)\n"
+        "  -g growth    average minor faults per faulting process per tick (default 100)\n"
+        "  -i secs      seconds between ticks (default 1)\n"
+        "  -t ticks     0 only creates the tree (default), -1 runs until killed\n"
+        "  -s seed      random seed (default 1)\n"
+        "  -D           tick in the background, print the background PID\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    double churn = 1.0, faulting = 10.0, interval = 1.0;
+    uint64_t growth = 100, n;
+    long ticks = 0;
+    bool background = false;
+    char path[PATH_MAX];
+    int c, i;
+
+    while ((c = getopt(argc, argv, "n:c:f:g:i:t:s:D")) != -1) {
+        switch (c) {
+        case 'n': nprocs = atoi(optarg); break;
+        case 'c': churn = atof(optarg); break;
+        case 'f': faulting = atof(optarg); break;
+        case 'g': growth = strtoull(optarg, NULL, 10); break;
+        case 'i': interval = atof(optarg); break;
+        case 't': ticks = atol(optarg); break;
+        case 's': rng = strtoull(optarg, NULL, 10) | 1; break;
+        case 'D': background = true; break;
+        default: usage();
+        }
+    }
+    if ((optind != argc - 1) || (nprocs < 1) || (interval < 0.0))
+        usage();
+    root = argv[optind];
+
+    if ((mkdir(root, 0755) < 0) && (errno != EEXIST))
+        die("cannot create", root);
+    snprintf(path, sizeof(path), "%s/sys", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sys/kernel", root);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sys/kernel/pid_max", root);
+    {
+        char buf[32];
+        const int len = snprintf(buf, sizeof(buf), "%d\n", PID_MAX);
+
+        write_file(path, buf, (size_t)len);
+    }
+
+    if ((procs = calloc((size_t)nprocs, sizeof(*procs))) == NULL) {
+        fprintf(stderr, "procfs_fixture: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    /* Started long ago, so none of them look like they are warming up */
+    for (i = 0; i < nprocs; i++)
+        create_proc(&procs[i], 0);
+    write_system(0);
+
+    if (ticks == 0)
+        return EXIT_SUCCESS;
+    if (background) {
+        const pid_t pid = fork();
+
+        if (pid < 0)
+            die("cannot fork for", root);
+        if (pid > 0) {
+            printf("%d\n", (int)pid);
+            return EXIT_SUCCESS;
+        }
+        fclose(stdout);
+    }
+
+    signal(SIGTERM, handle_stop);
+    signal(SIGINT, handle_stop);
+    for (n = 1; !stop && ((ticks < 0) || (n <= (uint64_t)ticks)); n++) {
+        const struct timespec ts = {
+            (time_t)interval,
+            (long)((interval - (double)(time_t)interval) * 1e9)
+        };
+
+        nanosleep(&ts, NULL);
+        if (!stop)
+            tick(n, churn, faulting, growth);
+    }
+    free(procs);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,206 @@
+/*
+ * Consistency stress test for the PageFaultStat shared memory ring.
+ *
+ * One writer publishes frames of varying size as fast as it can
+ * while forked readers follow the ring with the reader library in
+ * shmring.h. Every frame is filled with a pattern derived from its
+ * frame number, so a reader that ever returns a torn or mismatched
+ * copy is caught. Half the readers always read the latest frame,
+ * the others try to follow every frame and count what they miss.
+ * Every OVERSIZE_EVERY'th frame is bigger than a slot, readers must
+ * get SHMRING_ERR_SKIPPED for exactly those and the ring header must
+ * count every one of them.
+ *
+ * Build: make build/shmring_stress, or make shmring-stress to run it
+ * Usage: ./shmring_stress [readers] [seconds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "shmring.h"
+
+#define RING_NAME   "pagefaultstat-stress"
+#define MAX_FRAME   (256 * 1024)
+#define OVERSIZE_EVERY  (64)
+#define OVERSIZE    (SHMRING_SLOT_SIZE + 4096)
+
+int shmring_open(const char *name);
+void shmring_publish(const char *data, const size_t len);
+void shmring_close(void);
+
+typedef struct {
+    long reads;     /* frames copied and verified */
+    long bad;       /* frames that failed verification */
+    long missed;    /* frames overwritten before a follower got them */
+    long busy;      /* reads that gave up retrying */
+    long skipped;   /* oversized frames reported as skipped */
+} stats_t;
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t frame_len(uint64_t frame) {
+    if (frame % OVERSIZE_EVERY == 0)
+        return SHMRING_SLOT_SIZE + 1 + (size_t)(frame % (OVERSIZE - SHMRING_SLOT_SIZE - 1));
+    return 16 + (size_t)((frame * 2654435761ULL) % (MAX_FRAME - 16));
+}
+
+static void fill(unsigned char *buf, uint64_t frame, size_t len) {
+    size_t i;
+
+    memcpy(buf, &frame, sizeof(frame));
+    memcpy(buf + 8, &len, sizeof(uint64_t));
+    for (i = 16; i < len; i++)
+        buf[i] = (unsigned char)(frame * 131 + i);
+}
+
+static bool check(const unsigned char *buf, uint64_t frame, int64_t len) {
+    uint64_t f, l;
+    int64_t i;
+
+    if (len < 16)
+        return false;
+    memcpy(&f, buf, sizeof(f));
+    memcpy(&l, buf + 8, sizeof(l));
+    if (f != frame || (int64_t)l != len || (size_t)len != frame_len(frame))
+        return false;
+    for (i = 16; i < len; i++)
+        if (buf[i] != (unsigned char)(frame * 131 + i))
+            return false;
+    return true;
+}
+
+static void reader(stats_t *st, bool follow, double end) {
+    static unsigned char buf[MAX_FRAME];
+    shmring_reader_t r;
+    uint64_t next = 0;
+
+    if (shmring_reader_open(&r, RING_NAME) < 0) {
+        st->bad++;
+        return;
+    }
+    while (now() < end) {
+        uint64_t frame = 0;
+        int64_t len;
+
+        if (follow) {
+            if (next == 0)
+                next = shmring_head(&r);
+            if (next == 0)
+                continue;
+            frame = next;
+            len = shmring_read_frame(&r, frame, buf, sizeof(buf), NULL);
+            if (len == SHMRING_ERR_NONE)
+                continue;
+            if (len == SHMRING_ERR_GONE) {
+                /* Lapped by the writer, skip to the latest frame */
+                uint64_t head = shmring_head(&r);
+
+                st->missed += head - next;
+                next = head;
+                continue;
+            }
+            next++;
+        } else {
+            len = shmring_read_latest(&r, buf, sizeof(buf), &frame);
+            if (len == SHMRING_ERR_NONE)
+                continue;
+        }
+        if (len == SHMRING_ERR_BUSY) {
+            st->busy++;
+            continue;
+        }
+        if (len == SHMRING_ERR_SKIPPED) {
+            if (frame_len(frame) > SHMRING_SLOT_SIZE)
+                st->skipped++;
+            else
+                st->bad++;
+            continue;
+        }
+        if (check(buf, frame, len))
+            st->reads++;
+        else
+            st->bad++;
+    }
+    shmring_reader_close(&r);
+}
+
+int main(int argc, char **argv) {
+    static unsigned char buf[OVERSIZE];
+    shmring_reader_t r;
+    uint64_t skipped = 0, oversized = 0;
+    int nreaders = argc > 1 ? atoi(argv[1]) : 4;
+    double secs = argc > 2 ? atof(argv[2]) : 5.0;
+    stats_t *stats, total;
+    uint64_t frame = 0;
+    double end;
+    int i;
+
+    if (nreaders < 1)
+        nreaders = 1;
+    stats = mmap(NULL, sizeof(*stats) * nreaders, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(stats, 0, sizeof(*stats) * nreaders);
+
+    if (shmring_open(RING_NAME) < 0)
+        return 1;
+
+    end = now() + secs;
+    for (i = 0; i < nreaders; i++) {
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            reader(&stats[i], i & 1, end);
+            _exit(0);
+        }
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+    }
+
+    while (now() < end) {
+        frame++;
+        /* Oversized frames are never copied, so are not filled */
+        if (frame_len(frame) > SHMRING_SLOT_SIZE)
+            oversized++;
+        else
+            fill(buf, frame, frame_len(frame));
+        shmring_publish((const char *)buf, frame_len(frame));
+    }
+    while (wait(NULL) > 0)
+        ;
+    if (shmring_reader_open(&r, RING_NAME) == 0) {
+        skipped = shmring_skipped(&r);
+        shmring_reader_close(&r);
+    }
+    shmring_close();
+    shm_unlink(RING_NAME);
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < nreaders; i++) {
+        printf("reader %2d (%s): %ld frames ok, %ld bad, %ld missed, %ld busy, %ld skipped\n",
+            i, (i & 1) ? "follow" : "latest",
+            stats[i].reads, stats[i].bad, stats[i].missed, stats[i].busy, stats[i].skipped);
+        total.reads += stats[i].reads;
+        total.bad += stats[i].bad;
+    }
+    printf("writer published %llu frames, readers verified %ld, %ld inconsistent\n",
+        (unsigned long long)frame, total.reads, total.bad);
+    printf("writer published %llu oversized frames, ring counted %llu skipped\n",
+        (unsigned long long)oversized, (unsigned long long)skipped);
+    return (total.bad || skipped != oversized) ? 1 : 0;
+}
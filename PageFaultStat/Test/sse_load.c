@@ -0,0 +1,200 @@
+/*
+ * Load generator for the PageFaultStat web UI (-W port).
+ *
+ * Opens many concurrent /api/stream subscribers plus a stream of
+ * /api/snapshot requests against localhost and reports how many
+ * SSE frames each subscriber received.
+ *
+ * With a stalled count, that many subscribers stop reading, one
+ * at a time spread over the first half of the run, with a small
+ * receive buffer so they back up quickly. Every other subscriber
+ * must still be receiving frames at the end, else the exit status
+ * is non-zero: stalled subscribers must not starve the others.
+ *
+ * Build: make build/sse_load, make sse-load runs it against a sampler
+ * Usage: ./sse_load [port] [clients] [seconds] [stalled]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+typedef struct {
+    int fd;
+    long frames;
+    int tail;       /* trailing newlines seen, "\n\n" ends a frame */
+    int in_body;    /* response header has been read */
+    double stall_at; /* when it stops reading, 0 if never */
+    double last;    /* when it last completed a frame */
+} client_t;
+
+static int connect_local(int port) {
+    struct sockaddr_in addr;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Fetch one snapshot, returns body size or -1 */
+static long snapshot(int port) {
+    static const char req[] = "GET /api/snapshot HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    char buf[65536];
+    long total = 0;
+    ssize_t n;
+    int fd = connect_local(port);
+
+    if (fd < 0)
+        return -1;
+    if (write(fd, req, sizeof(req) - 1) < 0) {
+        close(fd);
+        return -1;
+    }
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        total += n;
+    close(fd);
+    return total;
+}
+
+int main(int argc, char **argv) {
+    static const char req[] = "GET /api/stream HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    int port = argc > 1 ? atoi(argv[1]) : 8080;
+    int nclients = argc > 2 ? atoi(argv[2]) : 500;
+    double secs = argc > 3 ? atof(argv[3]) : 10.0;
+    int nstalled = argc > 4 ? atoi(argv[4]) : 0;
+    struct epoll_event ev, events[256];
+    struct rlimit rl;
+    client_t *clients;
+    long min = -1, max = 0, sum = 0, snaps = 0, snap_fail = 0;
+    int i, efd, failed = 0, starved = 0;
+    double start, end, t_snap = 0.0;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)nclients + 64) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    clients = calloc(nclients, sizeof(*clients));
+    efd = epoll_create1(0);
+    if (!clients || efd < 0) {
+        perror("setup");
+        return 1;
+    }
+
+    start = now();
+    for (i = 0; i < nclients; i++) {
+        if (i < nstalled)
+            clients[i].stall_at = start + secs / 2 * (i + 1) / nstalled;
+        clients[i].last = start;
+        clients[i].fd = connect_local(port);
+        if (clients[i].fd < 0 ||
+            write(clients[i].fd, req, sizeof(req) - 1) < 0) {
+            failed++;
+            clients[i].fd = -1;
+            continue;
+        }
+        if (clients[i].stall_at > 0.0) {
+            int rcvbuf = 65536;
+
+            setsockopt(clients[i].fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        }
+        ev.events = EPOLLIN;
+        ev.data.ptr = &clients[i];
+        epoll_ctl(efd, EPOLL_CTL_ADD, clients[i].fd, &ev);
+    }
+    printf("%d subscribers connected, %d failed\n", nclients - failed, failed);
+
+    end = now() + secs;
+    while (now() < end) {
+        int n = epoll_wait(efd, events, 256, 100);
+
+        for (i = 0; i < n; i++) {
+            client_t *c = events[i].data.ptr;
+            char buf[65536];
+            ssize_t j, got;
+
+            if (c->stall_at > 0.0 && now() >= c->stall_at) {
+                /* Stop reading, keep the connection open */
+                epoll_ctl(efd, EPOLL_CTL_DEL, c->fd, NULL);
+                continue;
+            }
+            got = read(c->fd, buf, sizeof(buf));
+            if (got <= 0) {
+                epoll_ctl(efd, EPOLL_CTL_DEL, c->fd, NULL);
+                close(c->fd);
+                c->fd = -1;
+                continue;
+            }
+            for (j = 0; j < got; j++) {
+                if (buf[j] == '\n') {
+                    if (++c->tail == 2) {
+                        if (c->in_body) {
+                            c->frames++;
+                            c->last = now();
+                        }
+                        c->in_body = 1;
+                    }
+                } else if (buf[j] != '\r') {
+                    c->tail = 0;
+                }
+            }
+        }
+        /* Mix in snapshot requests, ~20 per second */
+        if (now() - t_snap > 0.05) {
+            double t0 = now();
+
+            if (snapshot(port) < 0)
+                snap_fail++;
+            else
+                snaps++;
+            t_snap = t0;
+        }
+    }
+
+    for (i = 0; i < nclients; i++) {
+        if (clients[i].stall_at <= 0.0 && now() - clients[i].last > 3.0)
+            starved++;
+        if (clients[i].fd < 0 && clients[i].frames == 0)
+            continue;
+        if (min < 0 || clients[i].frames < min)
+            min = clients[i].frames;
+        if (clients[i].frames > max)
+            max = clients[i].frames;
+        sum += clients[i].frames;
+        if (clients[i].fd >= 0)
+            close(clients[i].fd);
+    }
+    printf("frames per subscriber: min %ld, avg %.1f, max %ld\n",
+        min < 0 ? 0 : min, (nclients - failed) ? (double)sum / (nclients - failed) : 0.0, max);
+    printf("snapshots: %ld ok, %ld failed\n", snaps, snap_fail);
+    if (nstalled)
+        printf("%d stalled subscribers, %d others without a frame in the last 3 s\n",
+            nstalled, starved);
+
+    free(clients);
+    close(efd);
+    return (failed || starved) ? 1 : 0;
+}
@@ -0,0 +1,641 @@
+/*
+ * Accuracy validation of PageFaultStat against kernel ground truth.
+ *
+ * Runs fault_workload in a series of modes while PageFaultStat samples
+ * it (-J frames, -p on the workload's name so forked children are
+ * followed too), and compares what the sampler reported with what the
+ * kernel accounted:
+ *
+ *   wait4()     ru_minflt/ru_majflt of the workload plus every child it
+ *               reaped, the total for the whole process tree
+ *   taskstats   the per task exit records of the TASKSTATS generic
+ *               netlink family, summed per thread group, the truth per
+ *               PID (needs root or CAP_NET_ADMIN, skipped otherwise)
+ *
+ * The sampler can only report what it saw at its last sample of a
+ * process, the faults between that sample and the exit are missed by
+ * design. That tail is the error bound: for a process that lived at
+ * least one interval it is its peak per-interval delta, as if it kept
+ * faulting at its highest observed rate until it exited, and it must
+ * have been seen. A process that lived for less than one interval is
+ * sampled once at most, anywhere in its life, so all it did after that
+ * sample is within the bound. A process is explained when it was not
+ * over-counted and its missed faults are within its bound, the bound of
+ * the totals is the sum of the per-process bounds. Without taskstats
+ * lifetimes are unknown, missed faults beyond the peak deltas of the
+ * seen processes are then only reported, not failed. Two consistency
+ * checks need no ground truth: a process' sum of deltas must equal its
+ * last total, and a frame's delta totals must equal the sum of its
+ * processes' deltas.
+ *
+ * Everything goes to the output directory, the report also to
+ * report.json. The exit status is non-zero when anything is unexplained.
+ *
+ * Build: make validate (or cc -O2 -o validate validate.c)
+ * Usage: ./validate [-P sampler] [-W workload] [-o dir] [-m modes]
+ *                   [-s size] [-d secs] [-i interval] [-T]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/taskstats.h>
+
+#define NLA_DATA(na)        ((void *)((char *)(na) + NLA_HDRLEN))
+#define GENL_BUF            65536
+
+/* Workload modes and their rates, spawn is in children per second */
+typedef struct {
+    const char *mode;
+    const char *rate;
+} run_mode_t;
+
+static const run_mode_t run_modes[] = {
+    { "anon",       "20000" },
+    { "file-read",  "2000" },
+    { "cow",        "20000" },
+    { "dontneed",   "20000" },
+    { "shm",        "20000" },
+    { "spawn",      "20" },
+};
+
+/* Faults of one process as the kernel and the sampler saw them */
+typedef struct {
+    pid_t pid;
+    pid_t ppid;
+    char comm[TS_COMM_LEN];
+    double lifetime;            /* seconds, from taskstats */
+    bool exited;                /* has a taskstats record */
+    bool seen;                  /* in at least one frame */
+    bool in_tree;
+    uint64_t t_major, t_minor;  /* ground truth */
+    int64_t s_major, s_minor;   /* last totals the sampler reported */
+    int64_t d_major, d_minor;   /* sum of the sampler's deltas */
+    int64_t p_major, p_minor;   /* peak per-interval deltas */
+    int64_t b_major, b_minor;   /* faults it may have missed */
+} proc_t;
+
+typedef struct {
+    proc_t *procs;
+    size_t nprocs, capacity;
+    uint64_t frames;
+    uint64_t frame_mismatches;
+} run_t;
+
+static const char *sampler = "./build/PageFaultStat";
+static const char *workload = "./Test/fault_workload";
+static const char *out_dir = "validate-out";
+static const char *size = "32M";
+static const char *duration = "5";
+static char *modes;
+static int interval = 1;
+static bool use_taskstats = true;
+static volatile sig_atomic_t stop;
+
+static proc_t *proc_get(run_t *r, pid_t pid) {
+    size_t i;
+
+    for (i = 0; i < r->nprocs; i++) {
+        if (r->procs[i].pid == pid)
+            return &r->procs[i];
+    }
+    if (r->nprocs == r->capacity) {
+        const size_t n = r->capacity ? r->capacity * 2 : 64;
+        proc_t *p = realloc(r->procs, n * sizeof(*p));
+
+        if (!p) {
+            fprintf(stderr, "validate: out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        r->procs = p;
+        r->capacity = n;
+    }
+    memset(&r->procs[r->nprocs], 0, sizeof(r->procs[0]));
+    r->procs[r->nprocs].pid = pid;
+    return &r->procs[r->nprocs++];
+}
+
+static int genl_send(int fd, uint16_t type, uint8_t cmd, uint16_t attr, const void *data, size_t len) {
+    struct {
+        struct nlmsghdr n;
+        struct genlmsghdr g;
+        char buf[256];
+    } msg;
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK };
+    struct nlattr *na;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    msg.n.nlmsg_type = type;
+    msg.n.nlmsg_flags = NLM_F_REQUEST;
+    msg.n.nlmsg_pid = (uint32_t)getpid();
+    msg.g.cmd = cmd;
+    msg.g.version = 1;
+    na = (struct nlattr *)((char *)&msg + msg.n.nlmsg_len);
+    na->nla_type = attr;
+    na->nla_len = (uint16_t)(NLA_HDRLEN + len);
+    memcpy(NLA_DATA(na), data, len);
+    msg.n.nlmsg_len += NLA_ALIGN(na->nla_len);
+
+    return sendto(fd, &msg, msg.n.nlmsg_len, 0, (struct sockaddr *)&addr, sizeof(addr)) < 0 ? -1 : 0;
+}
+
+/* Open a netlink socket registered for the exit records of every CPU */
+static int taskstats_open(void) {
+    static char buf[GENL_BUF];
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK };
+    const int rcvbuf = 4 * 1024 * 1024;
+    struct nlmsghdr *n;
+    struct nlattr *na;
+    char cpumask[32];
+    uint16_t family = 0;
+    ssize_t len;
+    int fd, rem;
+
+    if ((fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC)) < 0)
+        return -1;
+    (void)setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        goto fail;
+
+    if (genl_send(fd, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, CTRL_ATTR_FAMILY_NAME,
+                  TASKSTATS_GENL_NAME, sizeof(TASKSTATS_GENL_NAME)) < 0)
+        goto fail;
+    if ((len = recv(fd, buf, sizeof(buf), 0)) < 0)
+        goto fail;
+    n = (struct nlmsghdr *)buf;
+    if (!NLMSG_OK(n, (size_t)len) || (n->nlmsg_type == NLMSG_ERROR))
+        goto fail;
+    na = (struct nlattr *)((char *)NLMSG_DATA(n) + GENL_HDRLEN);
+    rem = (int)(n->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN));
+    while (rem >= NLA_HDRLEN) {
+        if (na->nla_type == CTRL_ATTR_FAMILY_ID)
+            family = *(uint16_t *)NLA_DATA(na);
+        rem -= NLA_ALIGN(na->nla_len);
+        na = (struct nlattr *)((char *)na + NLA_ALIGN(na->nla_len));
+    }
+    if (!family)
+        goto fail;
+
+    snprintf(cpumask, sizeof(cpumask), "0-%ld", sysconf(_SC_NPROCESSORS_CONF) - 1);
+    if (genl_send(fd, family, TASKSTATS_CMD_GET, TASKSTATS_CMD_ATTR_REGISTER_CPUMASK,
+                  cpumask, strlen(cpumask) + 1) < 0)
+        goto fail;
+    /* An error reply, EPERM without CAP_NET_ADMIN, arrives straight away */
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+
+        if ((poll(&pfd, 1, 100) == 1) && ((len = recv(fd, buf, sizeof(buf), MSG_PEEK)) > 0)) {
+            n = (struct nlmsghdr *)buf;
+            if (NLMSG_OK(n, (size_t)len) && (n->nlmsg_type == NLMSG_ERROR) &&
+                ((struct nlmsgerr *)NLMSG_DATA(n))->error) {
+                errno = -((struct nlmsgerr *)NLMSG_DATA(n))->error;
+                goto fail;
+            }
+        }
+    }
+    return fd;
+fail:
+    close(fd);
+    return -1;
+}
+
+/* One exit record, a thread's own counters, summed into its thread group */
+static void taskstats_record(run_t *r, const struct taskstats *ts, size_t len, pid_t tid) {
+    pid_t tgid = tid;
+    proc_t *p;
+
+    if ((len >= offsetof(struct taskstats, ac_tgid) + sizeof(ts->ac_tgid)) && ts->ac_tgid)
+        tgid = (pid_t)ts->ac_tgid;
+    p = proc_get(r, tgid);
+    p->exited = true;
+    p->t_minor += ts->ac_minflt;
+    p->t_major += ts->ac_majflt;
+    if (tgid == tid) {
+        p->ppid = (pid_t)ts->ac_ppid;
+        p->lifetime = (double)ts->ac_etime / 1e6;
+        memcpy(p->comm, ts->ac_comm, sizeof(p->comm));
+        p->comm[sizeof(p->comm) - 1] = '\0';
+    }
+}
+
+/* Drain the exit records, waiting up to timeout_ms for the first one */
+static void taskstats_read(int fd, run_t *r, int timeout_ms) {
+    static char buf[GENL_BUF];
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    ssize_t len;
+
+    while (poll(&pfd, 1, timeout_ms) == 1) {
+        struct nlmsghdr *n;
+
+        timeout_ms = 0;
+        if ((len = recv(fd, buf, sizeof(buf), 0)) < 0) {
+            if (errno == ENOBUFS)
+                fprintf(stderr, "validate: taskstats records were dropped\n");
+            continue;
+        }
+        for (n = (struct nlmsghdr *)buf; NLMSG_OK(n, (size_t)len); n = NLMSG_NEXT(n, len)) {
+            struct nlattr *na = (struct nlattr *)((char *)NLMSG_DATA(n) + GENL_HDRLEN);
+            int rem = (int)(n->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN));
+
+            if (n->nlmsg_type == NLMSG_ERROR)
+                continue;
+            for (; rem >= NLA_HDRLEN; rem -= NLA_ALIGN(na->nla_len),
+                 na = (struct nlattr *)((char *)na + NLA_ALIGN(na->nla_len))) {
+                struct nlattr *nested = NLA_DATA(na);
+                int nrem = na->nla_len - NLA_HDRLEN;
+                pid_t tid = 0;
+
+                /* The thread group aggregates would count threads twice */
+                if (na->nla_type != TASKSTATS_TYPE_AGGR_PID)
+                    continue;
+                for (; nrem >= NLA_HDRLEN; nrem -= NLA_ALIGN(nested->nla_len),
+                     nested = (struct nlattr *)((char *)nested + NLA_ALIGN(nested->nla_len))) {
+                    if (nested->nla_type == TASKSTATS_TYPE_PID)
+                        tid = *(pid_t *)NLA_DATA(nested);
+                    else if ((nested->nla_type == TASKSTATS_TYPE_STATS) && tid)
+                        taskstats_record(r, NLA_DATA(nested), nested->nla_len - NLA_HDRLEN, tid);
+                }
+            }
+        }
+    }
+}
+
+/* The workload and everything it forked, the records cover the whole system */
+static void mark_tree(run_t *r, pid_t root) {
+    bool changed = true;
+    size_t i, j;
+
+    for (i = 0; i < r->nprocs; i++)
+        r->procs[i].in_tree = (r->procs[i].pid == root);
+    while (changed) {
+        changed = false;
+        for (i = 0; i < r->nprocs; i++) {
+            if (r->procs[i].in_tree || !r->procs[i].exited)
+                continue;
+            for (j = 0; j < r->nprocs; j++) {
+                if (r->procs[j].in_tree && (r->procs[j].pid == r->procs[i].ppid)) {
+                    r->procs[i].in_tree = changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/* Per process totals and deltas out of the processes array of every frame */
+static void read_frames(const char *path, run_t *r) {
+    static const char key[] = "{\"pid\":";
+    char *line = NULL;
+    size_t len = 0;
+    FILE *fp = fopen(path, "r");
+
+    if (!fp)
+        return;
+    while (getline(&line, &len, fp) > 0) {
+        long long t_dmaj = 0, t_dmin = 0, sum_dmaj = 0, sum_dmin = 0;
+        const char *p, *totals = strstr(line, "\"totals\":");
+
+        r->frames++;
+        for (p = strstr(line, key); p && (!totals || p < totals); p = strstr(p + 1, key)) {
+            long long maj, min, dmaj, dmin;
+            int pid;
+            proc_t *pr;
+
+            if (sscanf(p, "{\"pid\":%d,\"major\":%lld,\"minor\":%lld,\"deltaMajor\":%lld,\"deltaMinor\":%lld",
+                       &pid, &maj, &min, &dmaj, &dmin) != 5)
+                continue;
+            pr = proc_get(r, (pid_t)pid);
+            pr->seen = true;
+            pr->s_major = maj;
+            pr->s_minor = min;
+            pr->d_major += dmaj;
+            pr->d_minor += dmin;
+            if (dmaj > pr->p_major)
+                pr->p_major = dmaj;
+            if (dmin > pr->p_minor)
+                pr->p_minor = dmin;
+            sum_dmaj += dmaj;
+            sum_dmin += dmin;
+        }
+        if (totals && (sscanf(totals, "\"totals\":{\"major\":%*[0-9],\"minor\":%*[0-9],\"deltaMajor\":%lld,\"deltaMinor\":%lld",
+                              &t_dmaj, &t_dmin) == 2) &&
+            ((t_dmaj != sum_dmaj) || (t_dmin != sum_dmin)))
+            r->frame_mismatches++;
+    }
+    free(line);
+    fclose(fp);
+}
+
+/* Faults the sampler may have missed for a process, see above */
+static void proc_bound(proc_t *p) {
+    if (p->exited && (p->lifetime < (double)interval)) {
+        p->b_major = p->t_major > (uint64_t)p->s_major ? (int64_t)p->t_major - p->s_major : 0;
+        p->b_minor = p->t_minor > (uint64_t)p->s_minor ? (int64_t)p->t_minor - p->s_minor : 0;
+    } else {
+        p->b_major = p->p_major;
+        p->b_minor = p->p_minor;
+    }
+}
+
+static pid_t spawn(char *const argv[], const char *name) {
+    char path[PATH_MAX];
+    pid_t pid;
+
+    snprintf(path, sizeof(path), "%s/%s", out_dir, name);
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            close(fd);
+        }
+        execv(argv[0], argv);
+        fprintf(stderr, "validate: cannot run %s: %s\n", argv[0], strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+static void stop_sampler(pid_t pid) {
+    int i;
+
+    kill(pid, SIGTERM);
+    for (i = 0; i < 50; i++) {
+        if (waitpid(pid, NULL, WNOHANG) != 0)
+            return;
+        usleep(100000);
+    }
+    kill(pid, SIGKILL);
+    (void)waitpid(pid, NULL, 0);
+}
+
+static void handle_stop(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static void json_counts(FILE *fp, const char *name, long long major, long long minor) {
+    fprintf(fp, "\"%s\":{\"major\":%lld,\"minor\":%lld}", name, major, minor);
+}
+
+/* Run one mode and append its result to report.json, returns the unexplained count */
+static int validate_mode(const run_mode_t *m, int ts_fd, FILE *report, bool first) {
+    char frames[PATH_MAX + 32], name[64], file[PATH_MAX], ivl[16];
+    const char *wname = strrchr(workload, '/') ? strrchr(workload, '/') + 1 : workload;
+    run_t r = { 0 };
+    struct rusage ru;
+    long long s_maj = 0, s_min = 0, b_maj = 0, b_min = 0, t_maj = 0, t_min = 0;
+    int status, nprocs = 0, nseen = 0, nshort = 0, unexplained = 0, delta_mismatches = 0;
+    pid_t sampler_pid, workload_pid;
+    size_t i;
+
+    snprintf(frames, sizeof(frames), "%s/%s.ndjson", out_dir, m->mode);
+    snprintf(file, sizeof(file), "%s/fault_workload.bin", out_dir);
+    snprintf(ivl, sizeof(ivl), "%d", interval);
+    {
+        char *const sargv[] = {
+            (char *)sampler, "-J", "-o", frames, "-p", (char *)wname, ivl, NULL
+        };
+
+        snprintf(name, sizeof(name), "%s-sampler.txt", m->mode);
+        sampler_pid = spawn(sargv, name);
+    }
+    /* The sampler's first sample is its baseline, the workload must not be in it */
+    usleep(500000);
+    if (ts_fd >= 0)
+        taskstats_read(ts_fd, &r, 0);
+    free(r.procs);
+    memset(&r, 0, sizeof(r));
+    {
+        char *const wargv[] = {
+            (char *)workload, "-m", (char *)m->mode, "-s", (char *)size, "-r", (char *)m->rate,
+            "-d", (char *)duration, "-p", file, NULL
+        };
+
+        snprintf(name, sizeof(name), "%s-workload.txt", m->mode);
+        workload_pid = spawn(wargv, name);
+    }
+    if ((sampler_pid < 0) || (workload_pid < 0)) {
+        fprintf(stderr, "validate: cannot start %s\n", m->mode);
+        exit(EXIT_FAILURE);
+    }
+
+    for (;;) {
+        const pid_t ret = wait4(workload_pid, &status, WNOHANG, &ru);
+
+        if (ret == workload_pid)
+            break;
+        if (stop)
+            kill(workload_pid, SIGTERM);
+        if (ts_fd >= 0)
+            taskstats_read(ts_fd, &r, 100);
+        else
+            usleep(100000);
+    }
+    if (ts_fd >= 0)
+        taskstats_read(ts_fd, &r, 200);
+    /* One more sample after the exit, so no frame is lost to the stop */
+    usleep((useconds_t)interval * 1000000 + 200000);
+    stop_sampler(sampler_pid);
+    read_frames(frames, &r);
+
+    if (ts_fd >= 0) {
+        mark_tree(&r, workload_pid);
+    } else {
+        /* Without taskstats only the tree as a whole is known */
+        for (i = 0; i < r.nprocs; i++)
+            r.procs[i].in_tree = r.procs[i].seen;
+    }
+
+    for (i = 0; i < r.nprocs; i++) {
+        proc_t *p = &r.procs[i];
+
+        if (!p->in_tree)
+            continue;
+        proc_bound(p);
+        nprocs++;
+        nshort += p->exited && (p->lifetime < (double)interval);
+        b_maj += p->b_major;
+        b_min += p->b_minor;
+        if (p->seen) {
+            nseen++;
+            s_maj += p->s_major;
+            s_min += p->s_minor;
+            if ((p->d_major != p->s_major) || (p->d_minor != p->s_minor))
+                delta_mismatches++;
+        }
+        if (p->exited) {
+            const long long m_maj = (long long)p->t_major - p->s_major;
+            const long long m_min = (long long)p->t_minor - p->s_minor;
+
+            t_maj += (long long)p->t_major;
+            t_min += (long long)p->t_minor;
+            if ((m_maj < 0) || (m_min < 0) || (m_maj > p->b_major) || (m_min > p->b_minor))
+                unexplained++;
+        }
+    }
+
+    printf("%-10s %6d %5d %5d %9ld %9lld %9lld %7lld %5ld %5lld %5lld %3d\n",
+        m->mode, nprocs, nseen, nshort,
+        ru.ru_minflt, s_min, (long long)ru.ru_minflt - s_min, b_min,
+        ru.ru_majflt, s_maj, (long long)ru.ru_majflt - s_maj, unexplained);
+    if (ts_fd >= 0 && ((t_min != ru.ru_minflt) || (t_maj != ru.ru_majflt)))
+        printf("%-10s taskstats %lld minor %lld major, wait4 %ld minor %ld major\n",
+            "", t_min, t_maj, ru.ru_minflt, ru.ru_majflt);
+    if (delta_mismatches || r.frame_mismatches)
+        printf("%-10s %d processes' deltas do not add up to their totals, %llu frames' totals do not add up\n",
+            "", delta_mismatches, (unsigned long long)r.frame_mismatches);
+
+    fprintf(report, "%s{\"mode\":\"%s\",\"rate\":%s,\"exitStatus\":%d,\"frames\":%llu,"
+        "\"truth\":\"%s\",\"processes\":%d,\"seen\":%d,\"shortLived\":%d,",
+        first ? "" : ",", m->mode, m->rate, WIFEXITED(status) ? WEXITSTATUS(status) : -1,
+        (unsigned long long)r.frames, ts_fd >= 0 ? "taskstats" : "wait4",
+        nprocs, nseen, nshort);
+    json_counts(report, "wait4", ru.ru_majflt, ru.ru_minflt);
+    fputc(',', report);
+    if (ts_fd >= 0) {
+        json_counts(report, "taskstats", t_maj, t_min);
+        fputc(',', report);
+    }
+    json_counts(report, "sampler", s_maj, s_min);
+    fputc(',', report);
+    json_counts(report, "missed", ru.ru_majflt - s_maj, ru.ru_minflt - s_min);
+    fputc(',', report);
+    json_counts(report, "bound", b_maj, b_min);
+    fprintf(report, ",\"deltaMismatches\":%d,\"frameMismatches\":%llu,\"unexplained\":%d,\"pids\":[",
+        delta_mismatches, (unsigned long long)r.frame_mismatches, unexplained);
+    first = true;
+    for (i = 0; i < r.nprocs; i++) {
+        const proc_t *p = &r.procs[i];
+
+        if (!p->in_tree)
+            continue;
+        fprintf(report, "%s{\"pid\":%d,\"seen\":%s,\"seenMajor\":%lld,\"seenMinor\":%lld,"
+            "\"boundMajor\":%lld,\"boundMinor\":%lld",
+            first ? "" : ",", (int)p->pid, p->seen ? "true" : "false",
+            (long long)p->s_major, (long long)p->s_minor,
+            (long long)p->b_major, (long long)p->b_minor);
+        if (p->exited)
+            fprintf(report, ",\"command\":\"%s\",\"lifetime\":%.3f,\"truthMajor\":%llu,\"truthMinor\":%llu,"
+                "\"missedMajor\":%lld,\"missedMinor\":%lld",
+                p->comm, p->lifetime, (unsigned long long)p->t_major, (unsigned long long)p->t_minor,
+                (long long)p->t_major - p->s_major, (long long)p->t_minor - p->s_minor);
+        fputc('}', report);
+        first = false;
+    }
+    fprintf(report, "]}");
+    free(r.procs);
+
+    return unexplained + delta_mismatches + (int)r.frame_mismatches +
+        (((long long)ru.ru_minflt < s_min) || ((long long)ru.ru_majflt < s_maj) ||
+         ((ts_fd >= 0) && (((long long)ru.ru_minflt - s_min > b_min) ||
+                           ((long long)ru.ru_majflt - s_maj > b_maj))));
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: validate [-P sampler] [-W workload] [-o dir] [-m modes] [-s size]\n"
+        "                [-d secs] [-i interval] [-T]\n"
+        "  -P sampler   PageFaultStat binary (default ./build/PageFaultStat)\n"
+        "  -W workload  fault_workload binary (default ./Test/fault_workload)\n"
+        "  -o dir       output directory (default validate-out)\n"
+        "  -m modes     comma separated fault_workload modes (default all of\n"
+        "               anon,file-read,cow,dontneed,shm,spawn)\n"
+        "  -s size      workload footprint (default 32M)\n"
+        "  -d secs      seconds per mode (default 5)\n"
+        "  -i interval  sampler interval in seconds (default 1)\n"
+        "  -T           no taskstats, compare the totals against wait4() only\n"
+        "  The table shows per mode the processes in the workload's tree, how many\n"
+        "  the sampler saw and how many lived less than one interval, then the minor\n"
+        "  and major faults wait4() reported, sampled, missed and the bound of the\n"
+        "  missed ones, and the number of processes not within their bound.\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    const size_t nmodes = sizeof(run_modes) / sizeof(run_modes[0]);
+    char path[PATH_MAX];
+    FILE *report;
+    size_t i;
+    int c, ts_fd = -1, failed = 0;
+    bool first = true;
+
+    while ((c = getopt(argc, argv, "P:W:o:m:s:d:i:T")) != -1) {
+        switch (c) {
+        case 'P': sampler = optarg; break;
+        case 'W': workload = optarg; break;
+        case 'o': out_dir = optarg; break;
+        case 'm': modes = optarg; break;
+        case 's': size = optarg; break;
+        case 'd': duration = optarg; break;
+        case 'i': interval = atoi(optarg); break;
+        case 'T': use_taskstats = false; break;
+        default: usage();
+        }
+    }
+    if ((optind != argc) || (interval < 1))
+        usage();
+    if ((mkdir(out_dir, 0755) < 0) && (errno != EEXIST)) {
+        fprintf(stderr, "validate: cannot create %s: %s\n", out_dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (use_taskstats && ((ts_fd = taskstats_open()) < 0))
+        fprintf(stderr, "validate: no taskstats (%s), comparing totals against wait4() only\n",
+            strerror(errno));
+
+    snprintf(path, sizeof(path), "%s/report.json", out_dir);
+    if ((report = fopen(path, "w")) == NULL) {
+        fprintf(stderr, "validate: cannot create %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(report, "{\"interval\":%d,\"size\":\"%s\",\"duration\":%s,\"runs\":[", interval, size, duration);
+
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+    printf("%-10s %6s %5s %5s %9s %9s %9s %7s %5s %5s %5s %3s\n",
+        "mode", "procs", "seen", "short", "minor", "sampled", "missed", "bound",
+        "major", "smpl", "miss", "bad");
+    for (i = 0; (i < nmodes) && !stop; i++) {
+        if (modes) {
+            const size_t len = strlen(run_modes[i].mode);
+            const char *p;
+
+            for (p = strstr(modes, run_modes[i].mode); p; p = strstr(p + 1, run_modes[i].mode)) {
+                if (((p == modes) || (p[-1] == ',')) && ((p[len] == ',') || (p[len] == '\0')))
+                    break;
+            }
+            if (!p)
+                continue;
+        }
+        failed += validate_mode(&run_modes[i], ts_fd, report, first);
+        first = false;
+        fflush(stdout);
+    }
+    fprintf(report, "],\"failed\":%d,\"interrupted\":%s}\n", failed, stop ? "true" : "false");
+    fclose(report);
+    if (ts_fd >= 0)
+        close(ts_fd);
+    printf("%s, report in %s\n", failed ? "accuracy NOT within bounds" : "all within bounds", path);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
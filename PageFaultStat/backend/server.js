@@ -225,121 +225,457 @@ function parseMeminfo(data) {
   };
 }
 
-// API endpoint to get current fault statistics
-app.get('/api/stats', async (req, res) => {
-  try {
-    // Check if faultstat executable exists
-    if (!fs.existsSync(FAULTSTAT_PATH)) {
-      return res.status(500).json({ 
-        error: 'PageFaultStat executable not found. Please build it first using "make".',
-        path: FAULTSTAT_PATH
-      });
+// One long-lived sampler child streams a JSON frame per second (-J) and the
+// API answers from the latest frames instead of running a cold scan per
+// request. Responses are memoised per frame, so concurrent requests for the
+// same data share one computation.
+const SAMPLER_HISTORY = 60;		// frames kept, enough for a 60 s interval
+const SAMPLER_RESTART_MAX_MS = 30000;
+const SAMPLER_WAIT_MS = 5000;
+const SAMPLER_STALE_MS = 3000;		// three sample intervals without a frame
+
+const sampler = {
+  child: null,
+  frames: [],		// most recent last
+  seq: 0,		// frames received since the backend started
+  waiters: [],		// resolved on the next frame
+  restartMs: 1000,
+  lastError: null,
+  lastFrameAt: 0,	// Date.now() of the latest frame
+  memo: new Map(),	// response cache, cleared on every frame
+  rows: new Map(),	// pid -> pushed row of the latest frame
+  clients: new Set()	// /api/events subscribers
+};
+
+// Fields of a process pushed to /api/events subscribers
+const PUSH_FIELDS = ['major', 'minor', 'deltaMajor', 'deltaMinor', 'swap', 'user', 'command',
+  'reason', 'confidence', 'anomaly'];
+const PUSH_MAX_BUFFERED = 1 << 20;	// bytes queued before a slow client is dropped
+const PUSH_HEARTBEAT_MS = 15000;
+
+// Load testing the dashboard: FAULTSTAT_SYNTHETIC=50000 replaces the sampler
+// with frames of that many made-up processes, a few percent faulting and
+// a few coming and going every second
+const SYNTHETIC_PROCESSES = parseInt(process.env.FAULTSTAT_SYNTHETIC, 10) || 0;
+const SYNTHETIC_COMMANDS = ['postgres', 'java', 'node', 'python3', 'chrome', 'nginx', 'redis-server', 'bash'];
+const SYNTHETIC_USERS = ['root', 'www-data', 'postgres', 'alice', 'bob'];
+
+function startSyntheticFeed(count) {
+  let nextPid = 1000;
+  const spawnProc = () => {
+    const pid = nextPid++;
+    return {
+      pid,
+      major: 0,
+      minor: 0,
+      deltaMajor: 0,
+      deltaMinor: 0,
+      swap: 0,
+      user: SYNTHETIC_USERS[pid % SYNTHETIC_USERS.length],
+      command: `${SYNTHETIC_COMMANDS[pid % SYNTHETIC_COMMANDS.length]}-${pid}`
+    };
+  };
+  let procs = Array.from({ length: count }, spawnProc);
+
+  const tick = () => {
+    const totals = { major: 0, minor: 0, deltaMajor: 0, deltaMinor: 0 };
+    procs = procs.map(proc => (Math.random() < 0.002 ? spawnProc() : proc)).map(proc => {
+      const faulting = Math.random() < 0.05;
+      const deltaMajor = faulting ? Math.floor(Math.random() * 50) : 0;
+      const deltaMinor = faulting ? Math.floor(Math.random() * 5000) : 0;
+      const next = {
+        ...proc,
+        major: proc.major + deltaMajor,
+        minor: proc.minor + deltaMinor,
+        deltaMajor,
+        deltaMinor
+      };
+      totals.major += next.major;
+      totals.minor += next.minor;
+      totals.deltaMajor += deltaMajor;
+      totals.deltaMinor += deltaMinor;
+      return next;
+    });
+    onSamplerFrame({ timestamp: Math.floor(Date.now() / 1000), totals, processes: procs });
+  };
+
+  tick();
+  console.log(`[Sampler] Synthetic feed of ${count} processes`);
+  return { synthetic: setInterval(tick, 1000) };
+}
+
+function startSampler() {
+  if (sampler.child) {
+    return;
+  }
+  if (SYNTHETIC_PROCESSES > 0) {
+    sampler.child = startSyntheticFeed(SYNTHETIC_PROCESSES);
+    return;
+  }
+  if (!fs.existsSync(FAULTSTAT_PATH)) {
+    return;
+  }
+
+  let command, args;
+  if (isWindows) {
+    command = 'wsl';
+    args = ['-d', 'Ubuntu', '/mnt/d/RVCE/EL-2025/OS/PageFaultStat/build/PageFaultStat', '-J'];
+  } else {
+    command = FAULTSTAT_PATH;
+    args = ['-J'];
+  }
+
+  const child = spawn(command, args, { stdio: ['ignore', 'pipe', 'pipe'] });
+  let partial = '';
+  sampler.child = child;
+
+  child.stdout.on('data', (chunk) => {
+    const lines = (partial + chunk.toString()).split('\n');
+    partial = lines.pop();
+    for (const line of lines) {
+      if (!line.startsWith('{')) continue;
+      try {
+        onSamplerFrame(JSON.parse(line));
+      } catch (err) {
+        console.error(`[Sampler] Bad frame: ${err.message}`);
+      }
     }
+  });
 
-    // Setup command based on OS
-    let command, args;
-    if (isWindows) {
-      // Try different WSL path formats
-      // Option 1: /mnt/host/e (Docker Desktop WSL)
-      // Option 2: /mnt/e (Ubuntu WSL)
-      // We'll use wsl -d Ubuntu to force Ubuntu distribution
-      command = 'wsl';
-      args = ['-d', 'Ubuntu', '/mnt/d/RVCE/EL-2025/OS/PageFaultStat/build/PageFaultStat', '-j'];
+  child.stderr.on('data', (chunk) => {
+    sampler.lastError = chunk.toString().trim();
+  });
+
+  child.on('error', (err) => {
+    sampler.lastError = err.message;
+  });
+
+  child.on('close', (code) => {
+    console.error(`[Sampler] PageFaultStat exited (code ${code}), restarting in ${sampler.restartMs} ms`);
+    sampler.child = null;
+    setTimeout(startSampler, sampler.restartMs);
+    sampler.restartMs = Math.min(sampler.restartMs * 2, SAMPLER_RESTART_MAX_MS);
+  });
+
+  console.log(`[Sampler] Started ${command} ${args.join(' ')} (pid ${child.pid})`);
+}
+
+function pushRow(proc) {
+  const row = { pid: proc.pid };
+  for (const field of PUSH_FIELDS) {
+    if (proc[field] !== undefined) row[field] = proc[field];
+  }
+  return row;
+}
+
+function rowChanged(a, b) {
+  return PUSH_FIELDS.some(field => a[field] !== b[field]);
+}
+
+function keyframeEvent() {
+  const latest = sampler.frames[sampler.frames.length - 1];
+  const body = {
+    seq: sampler.seq,
+    timestamp: latest.timestamp,
+    totals: latest.totals,
+    memory: latest.memory,
+    processes: [...sampler.rows.values()]
+  };
+  return `id: ${sampler.seq}\nevent: keyframe\ndata: ${JSON.stringify(body)}\n\n`;
+}
+
+function pushWrite(res, data) {
+  if (res.writableLength > PUSH_MAX_BUFFERED) {
+    // Too far behind, it gets a fresh keyframe when it reconnects
+    res.end();
+    sampler.clients.delete(res);
+    return;
+  }
+  res.write(data);
+}
+
+// Diff the frame against the last one and push it, once for all subscribers
+function pushFrame(frame) {
+  const upserts = [];
+  const born = [];
+  const died = [];
+  const rows = new Map();
+
+  for (const proc of frame.processes || []) {
+    const row = pushRow(proc);
+    const old = sampler.rows.get(proc.pid);
+    rows.set(proc.pid, row);
+    if (!old) {
+      born.push(proc.pid);
+      upserts.push(row);
+    } else if (rowChanged(old, row)) {
+      upserts.push(row);
+    }
+  }
+  for (const pid of sampler.rows.keys()) {
+    if (!rows.has(pid)) died.push(pid);
+  }
+  sampler.rows = rows;
+
+  if (sampler.clients.size === 0) return;
+  const body = {
+    seq: sampler.seq,
+    timestamp: frame.timestamp,
+    totals: frame.totals,
+    memory: frame.memory,
+    upserts,
+    born,
+    died
+  };
+  const data = `id: ${sampler.seq}\nevent: delta\ndata: ${JSON.stringify(body)}\n\n`;
+  let keyframe = null;
+  sampler.clients.forEach(res => {
+    if (res.needsKeyframe) {
+      // Connected before there was a frame to start from
+      keyframe = keyframe || keyframeEvent();
+      res.needsKeyframe = false;
+      pushWrite(res, keyframe);
     } else {
-      command = FAULTSTAT_PATH;
-      args = ['-j'];
+      pushWrite(res, data);
     }
+  });
+}
 
-    const faultstat = spawn(command, args);
-    let jsonOutput = '';
-    let errorOutput = '';
+function onSamplerFrame(frame) {
+  sampler.frames.push(frame);
+  if (sampler.frames.length > SAMPLER_HISTORY) {
+    sampler.frames.shift();
+  }
+  sampler.seq++;
+  sampler.lastFrameAt = Date.now();
+  sampler.restartMs = 1000;
+  sampler.memo.clear();
+  pushFrame(frame);
+
+  const waiters = sampler.waiters;
+  sampler.waiters = [];
+  waiters.forEach(resolve => resolve(frame));
+}
 
-    faultstat.stdout.on('data', (data) => {
-      jsonOutput += data.toString();
-    });
+// Resolves with the next frame, or rejects with a 503 if none arrives in time
+function nextSamplerFrame() {
+  startSampler();
+  return new Promise((resolve, reject) => {
+    const timer = setTimeout(() => {
+      const err = new Error(sampler.lastError || 'Timed out waiting for PageFaultStat');
+      err.status = 503;
+      sampler.waiters = sampler.waiters.filter(w => w !== waiter);
+      reject(err);
+    }, SAMPLER_WAIT_MS);
+    const waiter = (frame) => {
+      clearTimeout(timer);
+      resolve(frame);
+    };
+    sampler.waiters.push(waiter);
+  });
+}
 
-    faultstat.stderr.on('data', (data) => {
-      errorOutput += data.toString();
-    });
+// Latest frame, waiting for a fresh one after a (re)start or when the last is
+// stale. A sampler that is still running but has gone quiet is hung, it is
+// killed so the close handler restarts it
+function latestSamplerFrame() {
+  const age = Date.now() - sampler.lastFrameAt;
+  if (sampler.frames.length > 0 && age <= SAMPLER_STALE_MS) {
+    return Promise.resolve(sampler.frames[sampler.frames.length - 1]);
+  }
+  const child = sampler.child;
+  if (sampler.frames.length > 0 && child && child.pid && child.exitCode === null && !child.killed) {
+    sampler.lastError = `No frame from PageFaultStat for ${age} ms`;
+    console.error(`[Sampler] ${sampler.lastError}, restarting it`);
+    child.kill('SIGKILL');
+  }
+  return nextSamplerFrame();
+}
 
-    faultstat.on('close', async (code) => {
-      if (code !== 0 && code !== null) {
-        console.error('PageFaultStat exited with code:', code);
-        console.error('Error output:', errorOutput);
-        return res.status(500).json({ 
-          error: 'PageFaultStat execution failed',
-          code: code,
-          stderr: errorOutput
-        });
-      }
+// Compute a response once per frame and key, concurrent callers share it
+function samplerMemo(key, compute) {
+  const memoKey = `${sampler.seq}:${key}`;
+  if (!sampler.memo.has(memoKey)) {
+    const promise = Promise.resolve().then(compute);
+    // Failures are not cached
+    promise.catch(() => sampler.memo.delete(memoKey));
+    sampler.memo.set(memoKey, promise);
+  }
+  return sampler.memo.get(memoKey);
+}
 
-      try {
-        // Parse JSON output from PageFaultStat
-        // The output may have text before JSON and multiple JSON objects
-        // Find the last complete JSON object
-        const lines = jsonOutput.split('\n');
-        let lastJsonLine = '';
-        
-        for (let i = lines.length - 1; i >= 0; i--) {
-          const line = lines[i].trim();
-          if (line.startsWith('{') && line.endsWith('}')) {
-            lastJsonLine = line;
-            break;
-          }
-        }
+// Host details that do not change while the backend runs
+let staticInfo = null;
+function getStaticInfo() {
+  if (!staticInfo) {
+    staticInfo = Promise.all([getSystemInfo(), getCPUInfo()]).then(([systemInfo, cpuInfo]) => ({
+      systemInfo,
+      cpuInfo,
+      uptimeAt: Date.now()
+    }));
+  }
+  return staticInfo;
+}
 
-        if (!lastJsonLine) {
-          throw new Error('No valid JSON found in output');
-        }
+// Memory in MB from the sampler's memory object, as parseMeminfo() reports it
+function frameMemoryInfo(frame) {
+  const memory = frame.memory;
+  if (!memory) {
+    return getMemoryInfo();
+  }
+  return Promise.resolve({
+    memoryUsage: Math.round((memory.total - memory.available) / 1024),
+    memoryTotal: Math.round(memory.total / 1024),
+    swapUsage: Math.round((memory.swapTotal - memory.swapFree) / 1024),
+    swapTotal: Math.round(memory.swapTotal / 1024)
+  });
+}
 
-        const data = JSON.parse(lastJsonLine);
-        const memoryInfo = await getMemoryInfo();
-        const systemInfo = await getSystemInfo();
-        const cpuInfo = await getCPUInfo();
-
-        // Transform the data to match expected format
-        const response = {
-          ...systemInfo,
-          cpu_info: cpuInfo,
-          total_faults: data.totals?.major + data.totals?.minor || 0,
-          major_faults: data.totals?.major || 0,
-          minor_faults: data.totals?.minor || 0,
-          faults_per_second: (data.totals?.deltaMajor || 0) + (data.totals?.deltaMinor || 0),
-          top_processes: (data.processes || []).map(proc => ({
-            pid: proc.pid,
-            name: proc.command,
-            user: proc.user,
-            major_faults: proc.major || 0,
-            minor_faults: proc.minor || 0,
-            total_faults: (proc.major || 0) + (proc.minor || 0)
-          })).sort((a, b) => b.total_faults - a.total_faults),
-          timestamp: data.timestamp,
-          ...memoryInfo
-        };
+// PID column width, as pid_max_digits() in the sampler
+let pidWidth = 0;
+function getPidWidth() {
+  if (!pidWidth) {
+    pidWidth = 6;
+    try {
+      const digits = fs.readFileSync('/proc/sys/kernel/pid_max', 'utf8').trim().length;
+      pidWidth = Math.max(6, digits);
+    } catch (err) {
+      // keep the default
+    }
+  }
+  return pidWidth;
+}
 
-        res.json(response);
-      } catch (parseError) {
-        console.error('JSON parse error:', parseError);
-        console.error('Raw output:', jsonOutput);
-        return res.status(500).json({ 
-          error: 'Failed to parse PageFaultStat output',
-          details: parseError.message,
-          rawOutput: jsonOutput.substring(0, 500)
-        });
-      }
-    });
+// Same units and width as int64_to_str() in the sampler
+function int64ToStr(val) {
+  const v = Math.max(0, val);
+  let s = v, unit = ' ';
+  if (v >= 1e12) { s = v / 1e9; unit = 'G'; }
+  else if (v >= 1e9) { s = v / 1e6; unit = 'M'; }
+  else if (v >= 1e6) { s = v / 1e3; unit = 'k'; }
+  return Math.round(s).toString().padStart(6) + unit;
+}
 
-    faultstat.on('error', (error) => {
-      console.error('Failed to start PageFaultStat:', error);
-      res.status(500).json({ 
-        error: 'Failed to start PageFaultStat',
-        details: error.message
+// -p semantics: a PID, or a command name prefix of the basename
+function processWanted(proc, filters) {
+  if (filters.length === 0) return true;
+  return filters.some(filter => {
+    if (/^\d+$/.test(filter)) return proc.pid === Number(filter);
+    const cmd = proc.command || '';
+    const name = filter.includes('/') ? cmd : path.basename(cmd.split(' ')[0]);
+    return name.startsWith(filter.split(' ')[0]);
+  });
+}
+
+// One sample in the sampler's text format, deltas averaged per second over
+// the frames, one a second
+function renderTextSample(frames, filters, arrows) {
+  const width = getPidWidth();
+  const latest = frames[frames.length - 1];
+  const deltas = new Map();
+
+  for (const frame of frames) {
+    for (const proc of frame.processes || []) {
+      const d = deltas.get(proc.pid) || { major: 0, minor: 0 };
+      d.major += proc.deltaMajor || 0;
+      d.minor += proc.deltaMinor || 0;
+      deltas.set(proc.pid, d);
+    }
+  }
+
+  const rows = (latest.processes || [])
+    .filter(proc => processWanted(proc, filters))
+    .map(proc => ({ proc, d: deltas.get(proc.pid) }))
+    .filter(({ d }) => d.major + d.minor !== 0)
+    .map(({ proc, d }) => ({ proc, d: { major: d.major / frames.length, minor: d.minor / frames.length } }))
+    .sort((a, b) => (b.proc.major + b.proc.minor) - (a.proc.major + a.proc.minor));
+
+  let text = ` ${'PID'.padStart(width)}  Major   Minor  +Major  +Minor    Swap  ${arrows ? 'D ' : ''}User       Command\n`;
+  let tMajor = 0, tMinor = 0, tdMajor = 0, tdMinor = 0;
+  for (const { proc, d } of rows) {
+    const delta = d.major + d.minor;
+    const arrow = arrows ? (delta < 0 ? 'v ' : (delta > 0 ? '^ ' : '  ')) : '';
+    text += ` ${String(proc.pid).padStart(width)} ${int64ToStr(proc.major)} ${int64ToStr(proc.minor)}` +
+      ` ${int64ToStr(d.major)} ${int64ToStr(d.minor)} ${int64ToStr(proc.swap)}` +
+      ` ${arrow}${(proc.user || '').slice(0, 10).padEnd(10)} ${proc.command}\n`;
+    tMajor += proc.major;
+    tMinor += proc.minor;
+    tdMajor += d.major;
+    tdMinor += d.minor;
+  }
+  text += ` ${'Total:'.padStart(width)} ${int64ToStr(tMajor)} ${int64ToStr(tMinor)} ${int64ToStr(tdMajor)} ${int64ToStr(tdMinor)}\n\n`;
+  return text;
+}
+
+// Push channel: a keyframe of every process on connect, then per frame only
+// the rows that changed plus the PIDs that were born or died
+app.get('/api/events', (req, res) => {
+  res.writeHead(200, {
+    'Content-Type': 'text/event-stream',
+    'Cache-Control': 'no-cache',
+    'Connection': 'keep-alive'
+  });
+  res.write('retry: 2000\n\n');
+
+  startSampler();
+  if (sampler.frames.length > 0) {
+    res.write(keyframeEvent());
+  } else {
+    res.needsKeyframe = true;
+  }
+  sampler.clients.add(res);
+
+  const heartbeat = setInterval(() => res.write(': heartbeat\n\n'), PUSH_HEARTBEAT_MS);
+  req.on('close', () => {
+    clearInterval(heartbeat);
+    sampler.clients.delete(res);
+  });
+});
+
+// API endpoint to get current fault statistics
+app.get('/api/stats', async (req, res) => {
+  try {
+    // Check if faultstat executable exists
+    if (!fs.existsSync(FAULTSTAT_PATH)) {
+      return res.status(500).json({ 
+        error: 'PageFaultStat executable not found. Please build it first using "make".',
+        path: FAULTSTAT_PATH
       });
+    }
+
+    const frame = await latestSamplerFrame();
+    const response = await samplerMemo('stats', async () => {
+      const [{ systemInfo, cpuInfo, uptimeAt }, memoryInfo] =
+        await Promise.all([getStaticInfo(), frameMemoryInfo(frame)]);
+
+      return {
+        ...systemInfo,
+        uptime: systemInfo.uptime + Math.floor((Date.now() - uptimeAt) / 1000),
+        cpu_info: cpuInfo,
+        total_faults: frame.totals?.major + frame.totals?.minor || 0,
+        major_faults: frame.totals?.major || 0,
+        minor_faults: frame.totals?.minor || 0,
+        faults_per_second: (frame.totals?.deltaMajor || 0) + (frame.totals?.deltaMinor || 0),
+        top_processes: (frame.processes || []).map(proc => ({
+          pid: proc.pid,
+          name: proc.command,
+          user: proc.user,
+          major_faults: proc.major || 0,
+          minor_faults: proc.minor || 0,
+          total_faults: (proc.major || 0) + (proc.minor || 0)
+        })).sort((a, b) => b.total_faults - a.total_faults),
+        timestamp: frame.timestamp,
+        ...memoryInfo
+      };
     });
 
+    res.json(response);
   } catch (err) {
     console.error('Server error:', err);
-    res.status(500).json({ error: 'Internal server error', details: err.message });
+    res.status(err.status || 500).json({
+      error: err.status ? 'PageFaultStat sampler unavailable' : 'Internal server error',
+      details: err.message
+    });
   }
 });
 
@@ -354,6 +690,9 @@ app.get('/api/health', (req, res) => {
 });
 
 // API endpoint to get raw terminal output
+// Rendered from the sampler's frames in the text mode format, an interval of
+// n seconds averages the deltas of the last n frames, more than one sample waits
+// for fresh frames
 app.get('/api/raw-output', async (req, res) => {
   try {
     // Check if faultstat executable exists
@@ -365,111 +704,32 @@ app.get('/api/raw-output', async (req, res) => {
     }
 
     // Get query parameters
-    const interval = parseFloat(req.query.interval) || 1.0;
-    const samples = parseInt(req.query.samples) || 0;
+    const interval = Math.min(SAMPLER_HISTORY, Math.max(1, Math.round(parseFloat(req.query.interval) || 1.0)));
+    const samples = Math.max(1, parseInt(req.query.samples) || 1);
     const processName = req.query.process || '';
     const showAll = req.query.showAll === 'true';
-
-    console.log(`[API] Received request - interval: ${interval}, samples: ${samples}, process: ${processName}, showAll: ${showAll}`);
-
-    // Setup command based on OS
-    let command, args;
-    if (isWindows) {
-      command = 'wsl';
-      args = ['-d', 'Ubuntu', '/mnt/d/RVCE/EL-2025/OS/PageFaultStat/build/PageFaultStat'];
-      
-      // Add -a flag if showAll is enabled
-      if (showAll) {
-        args.push('-a');
-      }
-      
-      // Add -p flag if process name is specified
-      if (processName) {
-        args.push('-p', processName);
-      }
-      
-      // Always add interval
-      args.push(interval.toString());
-      // Only add samples if > 0 (0 means continuous, which is the default)
-      if (samples > 0) {
-        args.push(samples.toString());
-      }
-    } else {
-      command = FAULTSTAT_PATH;
-      args = [];
-      
-      // Add -a flag if showAll is enabled
-      if (showAll) {
-        args.push('-a');
-      }
-      
-      // Add -p flag if process name is specified
-      if (processName) {
-        args.push('-p', processName);
-      }
-      
-      // Always add interval
-      args.push(interval.toString());
-      // Only add samples if > 0 (0 means continuous, which is the default)
-      if (samples > 0) {
-        args.push(samples.toString());
-      }
-    }
-
-    console.log(`[API] Executing command: ${command} ${args.join(' ')}`);
-
-    const faultstat = spawn(command, args);
-    let output = '';
-    let errorOutput = '';
-    let dataReceived = false;
-
-    // For continuous mode (samples = 0), kill after first output
-    const shouldKillAfterOutput = samples === 0;
-
-    faultstat.stdout.on('data', (data) => {
-      output += data.toString();
-      
-      // If continuous mode and we got data, kill the process after a short delay
-      if (shouldKillAfterOutput && !dataReceived) {
-        dataReceived = true;
-        // Give it a moment to finish the current output, then kill
-        setTimeout(() => {
-          faultstat.kill();
-        }, 100);
-      }
-    });
-
-    faultstat.stderr.on('data', (data) => {
-      errorOutput += data.toString();
-    });
-
-    faultstat.on('close', (code) => {
-      // Code will be null if killed, which is expected for continuous mode
-      if (code !== 0 && code !== null) {
-        console.error(`[API] PageFaultStat exited with code: ${code}`);
-        console.error(`[API] Error output: ${errorOutput}`);
-        return res.status(500).json({ 
-          error: 'PageFaultStat execution failed',
-          code: code,
-          stderr: errorOutput
-        });
+    const filters = processName.split(',').map(f => f.trim()).filter(Boolean);
+
+    await latestSamplerFrame();
+    const output = await samplerMemo(`raw:${interval}:${samples}:${processName}:${showAll}`, async () => {
+      let text = 'Change in page faults (average per second):\n';
+      text += renderTextSample(sampler.frames.slice(-interval), filters, showAll);
+      for (let i = 1; i < samples; i++) {
+        for (let n = 0; n < interval; n++) {
+          await nextSamplerFrame();
+        }
+        text += renderTextSample(sampler.frames.slice(-interval), filters, showAll);
       }
-
-      console.log(`[API] Successfully executed, output length: ${output.length} chars`);
-      res.json({ output, timestamp: new Date().toISOString() });
-    });
-
-    faultstat.on('error', (error) => {
-      console.error(`[API] Failed to start PageFaultStat: ${error.message}`);
-      res.status(500).json({ 
-        error: 'Failed to start PageFaultStat',
-        details: error.message
-      });
+      return text;
     });
 
+    res.json({ output, timestamp: new Date().toISOString() });
   } catch (err) {
     console.error(`[API] Internal server error: ${err.message}`);
-    res.status(500).json({ error: 'Internal server error', details: err.message });
+    res.status(err.status || 500).json({
+      error: err.status ? 'PageFaultStat sampler unavailable' : 'Internal server error',
+      details: err.message
+    });
   }
 });
 
@@ -1405,8 +1665,55 @@ app.post('/api/safe-terminate', async (req, res) => {
   }
 });
 
-// API endpoint to get fault reasoning metrics for processes
-// Used by the Reason tab for threshold-based major page fault analysis
+// Descriptions of the reasons the sampler classifies faults with
+const FAULT_REASONS = {
+  swap_pressure: 'Swap pressure caused by frequent memory eviction',
+  memory_thrashing: 'Memory thrashing detected - frequent page swapping',
+  warm_up: 'Application warm-up phase - loading initial pages into memory',
+  memory_growth: 'Memory growth - faulting in newly allocated pages',
+  memory_pressure: 'System memory pressure forcing page evictions',
+  file_backed: 'File-backed memory access - reading data from disk',
+  normal: 'Normal page fault activity during memory access'
+};
+
+// Supporting details for a classified process
+function faultReasonDetails(proc, memory) {
+  const details = [];
+
+  switch (proc.reason) {
+    case 'swap_pressure':
+      details.push(`System swap ${Math.round(memory.swapPressure)}% used`);
+      if (proc.swap > 0) details.push(`Process has ${Math.round(proc.swap / 1024)}MB in swap`);
+      break;
+    case 'memory_thrashing':
+      details.push(`High CPU I/O wait: ${Math.round(memory.ioWait)}%`);
+      details.push(`${proc.deltaMajor} major faults in the last sample`);
+      break;
+    case 'warm_up':
+      details.push(`Process started recently (${proc.age}s ago)`);
+      details.push('Initial page loading phase in progress');
+      break;
+    case 'memory_growth':
+      details.push(`Resident set growing, now ${Math.round(proc.rss / 1024)}MB`);
+      details.push(`${proc.deltaMinor} minor faults in the last sample`);
+      break;
+    case 'memory_pressure':
+      details.push(`High memory utilization: ${Math.round(memory.memPressure)}%`);
+      break;
+    case 'file_backed':
+      details.push(`RSS usage: ${Math.round(proc.rss / 1024)}MB`);
+      details.push('Likely accessing memory-mapped files or large data sets');
+      break;
+    default:
+      details.push('No critical memory pressure indicators detected');
+  }
+  if (proc.anomaly) details.push('Thrash onset detected by the sampler');
+  return details;
+}
+
+// API endpoint to get fault reasoning for processes
+// The sampler classifies every faulting process each tick, this is a lookup
+// in the latest frame
 app.post('/api/fault-reasoning', async (req, res) => {
   const { pids } = req.body;
   
@@ -1414,353 +1721,75 @@ app.post('/api/fault-reasoning', async (req, res) => {
     return res.status(400).json({ error: 'Invalid PIDs array' });
   }
 
-  console.log(`[API] Fault reasoning request for PIDs: ${pids.join(', ')}`);
-
   try {
-    // Get system-wide metrics first
-    const memInfo = await getMemoryInfo();
-    
-    // Calculate swap pressure percentage
-    const swapPressure = memInfo.swapTotal > 0 
-      ? Math.round((memInfo.swapUsage / memInfo.swapTotal) * 100) 
-      : 0;
-    
-    // Get CPU I/O wait from /proc/stat
-    const cpuIoWait = await getCpuIoWait();
-    
-    // Get per-process metrics
-    const processMetrics = await Promise.all(
-      pids.map(pid => getProcessMetrics(pid))
-    );
-    
-    // Build result with reasoning
+    const frame = await latestSamplerFrame();
+    const memory = frame.memory || {};
+    const byPid = new Map((frame.processes || []).map(proc => [proc.pid, proc]));
+    const systemMetrics = {
+      swapPressure: Math.round(memory.swapPressure || 0),
+      cpuIoWait: Math.round(memory.ioWait || 0),
+      memoryUsage: Math.round(((memory.total || 0) - (memory.available || 0)) / 1024),
+      memoryTotal: Math.round((memory.total || 0) / 1024),
+      swapUsage: Math.round(((memory.swapTotal || 0) - (memory.swapFree || 0)) / 1024),
+      swapTotal: Math.round((memory.swapTotal || 0) / 1024)
+    };
+
     const results = {};
-    for (let i = 0; i < pids.length; i++) {
-      const pid = pids[i];
-      const metrics = processMetrics[i];
-      
-      if (metrics) {
-        const reasoning = generateFaultReasoning(metrics, swapPressure, cpuIoWait, memInfo);
-        results[pid] = {
-          ...metrics,
-          swapPressure,
-          cpuIoWait,
-          ...reasoning
-        };
-      } else {
+    for (const pid of pids) {
+      const proc = byPid.get(Number(pid));
+
+      if (!proc) {
         results[pid] = {
           exists: false,
           reason: 'Process no longer running',
           category: 'unknown',
           confidence: 'Low'
         };
+        continue;
       }
+
+      // No faults in the last sample, nothing to classify
+      const category = proc.reason || 'normal';
+      results[pid] = {
+        pid: proc.pid,
+        name: proc.command,
+        exists: true,
+        majorFaults: proc.major,
+        minorFaults: proc.minor,
+        rssMB: Math.round((proc.rss || 0) / 1024),
+        vmSwapKB: proc.swap,
+        runtimeSeconds: proc.age,
+        isWarmingUp: category === 'warm_up',
+        hasSwapUsage: proc.swap > 1024,
+        swapPressure: systemMetrics.swapPressure,
+        cpuIoWait: systemMetrics.cpuIoWait,
+        reason: FAULT_REASONS[category] || FAULT_REASONS.normal,
+        category,
+        confidence: proc.confidence || 'Low',
+        details: proc.reason ? faultReasonDetails(proc, memory)
+          : ['No page faults in the last sample'],
+        metrics: {
+          swapPressure: systemMetrics.swapPressure,
+          cpuIoWait: systemMetrics.cpuIoWait,
+          memPressure: Math.round(memory.memPressure || 0),
+          rssMB: Math.round((proc.rss || 0) / 1024),
+          vmSwapKB: proc.swap,
+          runtimeSeconds: proc.age
+        }
+      };
     }
     
-    res.json({ 
-      processes: results,
-      systemMetrics: {
-        swapPressure,
-        cpuIoWait,
-        memoryUsage: memInfo.memoryUsage,
-        memoryTotal: memInfo.memoryTotal,
-        swapUsage: memInfo.swapUsage,
-        swapTotal: memInfo.swapTotal
-      }
-    });
+    res.json({ processes: results, systemMetrics });
     
   } catch (err) {
     console.error(`[API] Fault reasoning error: ${err.message}`);
-    res.status(500).json({ error: 'Internal server error', details: err.message });
+    res.status(err.status || 500).json({
+      error: err.status ? 'PageFaultStat sampler unavailable' : 'Internal server error',
+      details: err.message
+    });
   }
 });
 
-// Get CPU I/O wait percentage from /proc/stat
-function getCpuIoWait() {
-  return new Promise((resolve) => {
-    const runCommand = (cmd, args) => {
-      const proc = spawn(cmd, args);
-      let data = '';
-      proc.stdout.on('data', chunk => { data += chunk.toString(); });
-      proc.on('close', () => resolve(parseCpuIoWait(data)));
-      proc.on('error', () => resolve(0));
-    };
-
-    if (isWindows) {
-      runCommand('wsl', ['-d', 'Ubuntu', 'cat', '/proc/stat']);
-    } else {
-      runCommand('cat', ['/proc/stat']);
-    }
-  });
-}
-
-function parseCpuIoWait(data) {
-  // Format: cpu user nice system idle iowait irq softirq steal guest guest_nice
-  const cpuLine = data.split('\n').find(line => line.startsWith('cpu '));
-  if (!cpuLine) return 0;
-  
-  const parts = cpuLine.split(/\s+/);
-  if (parts.length < 6) return 0;
-  
-  const user = parseInt(parts[1]) || 0;
-  const nice = parseInt(parts[2]) || 0;
-  const system = parseInt(parts[3]) || 0;
-  const idle = parseInt(parts[4]) || 0;
-  const iowait = parseInt(parts[5]) || 0;
-  
-  const total = user + nice + system + idle + iowait;
-  if (total === 0) return 0;
-  
-  return Math.round((iowait / total) * 100);
-}
-
-// Get per-process metrics from /proc/[pid]/stat and /proc/[pid]/statm
-function getProcessMetrics(pid) {
-  return new Promise((resolve) => {
-    if (isWindows) {
-      // Run a single WSL command that gets all needed info
-      const script = `
-        if [ -d /proc/${pid} ]; then
-          echo "EXISTS:yes"
-          cat /proc/${pid}/stat 2>/dev/null | head -1
-          echo "---STATM---"
-          cat /proc/${pid}/statm 2>/dev/null | head -1
-          echo "---STATUS---"
-          cat /proc/${pid}/status 2>/dev/null | grep -E "^(Name|VmRSS|VmSwap|State):"
-        else
-          echo "EXISTS:no"
-        fi
-      `;
-      
-      const wsl = spawn('wsl', ['-d', 'Ubuntu', 'bash', '-c', script]);
-      let data = '';
-      
-      wsl.stdout.on('data', chunk => { data += chunk.toString(); });
-      wsl.on('close', () => {
-        const result = parseProcessMetrics(pid, data);
-        resolve(result);
-      });
-      wsl.on('error', () => resolve(null));
-    } else {
-      // Direct file reads on Linux
-      const statPath = `/proc/${pid}/stat`;
-      const statmPath = `/proc/${pid}/statm`;
-      const statusPath = `/proc/${pid}/status`;
-      
-      Promise.all([
-        fs.promises.readFile(statPath, 'utf8').catch(() => ''),
-        fs.promises.readFile(statmPath, 'utf8').catch(() => ''),
-        fs.promises.readFile(statusPath, 'utf8').catch(() => '')
-      ]).then(([stat, statm, status]) => {
-        const data = `EXISTS:yes\n${stat}\n---STATM---\n${statm}\n---STATUS---\n${status}`;
-        resolve(parseProcessMetrics(pid, data));
-      }).catch(() => resolve(null));
-    }
-  });
-}
-
-function parseProcessMetrics(pid, data) {
-  if (!data.includes('EXISTS:yes')) {
-    return null;
-  }
-  
-  const lines = data.split('\n');
-  let stat = '';
-  let statm = '';
-  let name = '';
-  let vmRss = 0;
-  let vmSwap = 0;
-  let state = '';
-  
-  let section = 'stat';
-  for (const line of lines) {
-    if (line.includes('---STATM---')) {
-      section = 'statm';
-      continue;
-    }
-    if (line.includes('---STATUS---')) {
-      section = 'status';
-      continue;
-    }
-    if (line.startsWith('EXISTS:')) continue;
-    
-    if (section === 'stat' && line.trim() && !stat) {
-      stat = line.trim();
-    } else if (section === 'statm' && line.trim() && !statm) {
-      statm = line.trim();
-    } else if (section === 'status') {
-      if (line.startsWith('Name:')) name = line.split(':')[1].trim();
-      if (line.startsWith('VmRSS:')) vmRss = parseInt(line.split(':')[1].trim()) || 0;
-      if (line.startsWith('VmSwap:')) vmSwap = parseInt(line.split(':')[1].trim()) || 0;
-      if (line.startsWith('State:')) state = line.split(':')[1].trim().charAt(0);
-    }
-  }
-  
-  // Parse /proc/[pid]/stat
-  // Format: pid (comm) state ppid pgrp session tty_nr tpgid flags minflt cminflt majflt cmajflt utime stime cutime cstime priority nice num_threads itrealvalue starttime vsize rss ...
-  let startTime = 0;
-  let majflt = 0;
-  let minflt = 0;
-  let utime = 0;
-  let stime = 0;
-  let vsize = 0;
-  let rss = 0;
-  
-  if (stat) {
-    // Handle comm which can contain spaces and parentheses
-    const commEnd = stat.lastIndexOf(')');
-    if (commEnd > 0) {
-      const afterComm = stat.substring(commEnd + 2).split(/\s+/);
-      // afterComm[0] = state, [1] = ppid, [2] = pgrp, [3] = session, [4] = tty_nr, [5] = tpgid, 
-      // [6] = flags, [7] = minflt, [8] = cminflt, [9] = majflt, [10] = cmajflt,
-      // [11] = utime, [12] = stime, [13] = cutime, [14] = cstime, [15] = priority,
-      // [16] = nice, [17] = num_threads, [18] = itrealvalue, [19] = starttime,
-      // [20] = vsize, [21] = rss
-      minflt = parseInt(afterComm[7]) || 0;
-      majflt = parseInt(afterComm[9]) || 0;
-      utime = parseInt(afterComm[11]) || 0;
-      stime = parseInt(afterComm[12]) || 0;
-      startTime = parseInt(afterComm[19]) || 0;
-      vsize = parseInt(afterComm[20]) || 0;
-      rss = parseInt(afterComm[21]) || 0;
-    }
-  }
-  
-  // Parse /proc/[pid]/statm for more accurate RSS
-  // Format: size resident shared text lib data dt
-  let rssPages = 0;
-  if (statm) {
-    const parts = statm.split(/\s+/);
-    rssPages = parseInt(parts[1]) || 0;
-  }
-  
-  // Calculate runtime in seconds (approximate)
-  // starttime is in clock ticks since boot, we need uptime to calculate actual runtime
-  // For now, use a heuristic: if starttime is recent (small), process is new
-  const uptimeClockTicks = Date.now() / 10; // rough approximation
-  const runtimeTicks = uptimeClockTicks - startTime;
-  const runtimeSeconds = Math.max(0, Math.round(runtimeTicks / 100)); // CLK_TCK is usually 100
-  
-  // Determine if process is in warm-up phase (running < 60 seconds)
-  const isWarmingUp = runtimeSeconds < 60;
-  
-  // Calculate RSS in MB (page size is typically 4KB)
-  const rssMB = Math.round((rssPages * 4) / 1024);
-  
-  // Determine if process has significant swap usage
-  const hasSwapUsage = vmSwap > 1000; // > 1MB in swap
-  
-  return {
-    pid,
-    name: name || `pid:${pid}`,
-    exists: true,
-    state,
-    majorFaults: majflt,
-    minorFaults: minflt,
-    rssMB,
-    vmSwapKB: vmSwap,
-    runtimeSeconds,
-    isWarmingUp,
-    hasSwapUsage,
-    cpuTime: utime + stime
-  };
-}
-
-// Generate reasoning for page faults based on collected metrics
-function generateFaultReasoning(metrics, swapPressure, cpuIoWait, memInfo) {
-  const reasons = [];
-  let confidence = 'Medium';
-  let category = 'unknown';
-  let primaryReason = '';
-  
-  // Rule 1: Swap Pressure - High swap usage indicates memory eviction
-  // If system swap usage > 50% AND process has swap usage, likely swap pressure
-  if (swapPressure > 50 && metrics.hasSwapUsage) {
-    reasons.push('High system swap pressure detected');
-    reasons.push(`Process has ${Math.round(metrics.vmSwapKB / 1024)}MB in swap`);
-    category = 'swap_pressure';
-    primaryReason = 'Swap pressure caused by frequent memory eviction';
-    confidence = 'High';
-  }
-  // Rule 2: Swap pressure alone (system-wide)
-  else if (swapPressure > 70) {
-    reasons.push('Severe system-wide swap pressure');
-    category = 'swap_pressure';
-    primaryReason = 'System under high swap pressure, causing page evictions';
-    confidence = 'High';
-  }
-  
-  // Rule 3: Application warm-up phase
-  // New processes often generate many page faults as they load code/data
-  if (metrics.isWarmingUp && !category) {
-    reasons.push(`Process started recently (${metrics.runtimeSeconds}s ago)`);
-    reasons.push('Initial page loading phase in progress');
-    category = 'warm_up';
-    primaryReason = 'Application warm-up phase - loading initial pages into memory';
-    confidence = metrics.majorFaults > 5000 ? 'Medium' : 'High';
-  }
-  
-  // Rule 4: Memory thrashing detection
-  // High I/O wait combined with high fault rate suggests thrashing
-  if (cpuIoWait > 20 && metrics.majorFaults > 2000) {
-    if (!category || category === 'unknown') {
-      category = 'memory_thrashing';
-      primaryReason = 'Memory thrashing detected - frequent page swapping';
-      confidence = 'High';
-    }
-    reasons.push(`High CPU I/O wait: ${cpuIoWait}%`);
-    reasons.push('System spending significant time on disk I/O');
-  }
-  
-  // Rule 5: File-backed memory access
-  // If RSS is high but no swap pressure, likely accessing file-backed pages
-  if (metrics.rssMB > 500 && swapPressure < 30 && !metrics.hasSwapUsage) {
-    if (!category || category === 'unknown') {
-      category = 'file_backed';
-      primaryReason = 'File-backed memory access - reading data from disk';
-      confidence = 'Medium';
-    }
-    reasons.push(`High RSS usage: ${metrics.rssMB}MB`);
-    reasons.push('Likely accessing memory-mapped files or large data sets');
-  }
-  
-  // Rule 6: Low memory available
-  const memPressure = memInfo.memoryTotal > 0 
-    ? Math.round((memInfo.memoryUsage / memInfo.memoryTotal) * 100) 
-    : 0;
-  if (memPressure > 85) {
-    reasons.push(`High memory utilization: ${memPressure}%`);
-    if (!category || category === 'unknown') {
-      category = 'memory_pressure';
-      primaryReason = 'System memory pressure forcing page evictions';
-      confidence = 'High';
-    }
-  }
-  
-  // Default reasoning if no specific pattern matched
-  if (!primaryReason) {
-    primaryReason = 'Normal page fault activity during memory access';
-    category = 'normal';
-    confidence = 'Medium';
-    reasons.push('No critical memory pressure indicators detected');
-  }
-  
-  return {
-    reason: primaryReason,
-    category,
-    confidence,
-    details: reasons,
-    metrics: {
-      swapPressure,
-      cpuIoWait,
-      memPressure,
-      rssMB: metrics.rssMB,
-      vmSwapKB: metrics.vmSwapKB,
-      runtimeSeconds: metrics.runtimeSeconds
-    }
-  };
-}
-
 // Start server
 app.listen(PORT, () => {
   console.log(`╔════════════════════════════════════════════════════╗`);
@@ -1776,4 +1805,6 @@ app.listen(PORT, () => {
     console.log(`\n⚠️  WARNING: PageFaultStat executable not found!`);
     console.log(`   Run 'make' in the project root to build it.\n`);
   }
+
+  startSampler();
 });
@@ -1,5 +1,8 @@
-import { useCallback, useEffect, useMemo, useRef, useState } from 'react';
+import { memo, useCallback, useEffect, useMemo, useRef, useState } from 'react';
 import { CartesianGrid, Legend, Line, LineChart, ReferenceLine, ResponsiveContainer, Tooltip, XAxis, YAxis } from 'recharts';
+import { getSnapshot, subscribe } from '../store/faultStore';
+import { useProcessTable } from '../workers/useProcessTable';
+import { useVirtualWindow } from './virtualWindow';
 import './AnalyserTab.css';
 
 const API_URL = 'http://localhost:5000/api';
@@ -20,6 +23,96 @@ const PROTECTED_PROCESSES = [
 
 const PROTECTED_USERS = ['root', 'system', 'kernel'];
 
+// Estimated height of a process table row, measured once rows mount
+const TABLE_ROW_HEIGHT = 61;
+
+// One process table row, only re-rendered when what it shows changes
+const ProcessRow = memo(({
+  rowRef,
+  rowKey,
+  pid,
+  name,
+  user,
+  totalFaults,
+  sampleCount,
+  isTerminated,
+  processAlive,
+  isTerminating,
+  onTerminate
+}) => {
+  // Determine if user is root based on displayed user value
+  const isRootUser = user.toLowerCase() === 'root';
+
+  return (
+    <tr 
+      ref={rowRef}
+      className={`
+        process-row
+        ${isTerminating ? 'terminating' : ''} 
+        ${isTerminated || !processAlive ? 'terminated' : ''}
+        ${isRootUser ? 'root-process' : ''}
+      `}
+    >
+      <td className="col-pid">
+        <span className="pid-value">{pid}</span>
+      </td>
+      <td className="col-name">
+        <span className="process-name-text">{name}</span>
+      </td>
+      <td className="col-user">
+        <span className={`user-badge ${isRootUser ? 'user-root' : 'user-normal'}`}>
+          {user}
+        </span>
+      </td>
+      <td className="col-faults">
+        <span className="fault-count">{totalFaults}</span>
+        {sampleCount > 0 && (
+          <span className="fault-rate">
+            ({Math.round(totalFaults / sampleCount * 10) / 10}/int)
+          </span>
+        )}
+      </td>
+      <td className="col-status">
+        {isTerminated ? (
+          <span className="status-badge terminated">Terminated</span>
+        ) : !processAlive ? (
+          <span className="status-badge terminated">Gone</span>
+        ) : (
+          <span className="status-badge running">Running</span>
+        )}
+      </td>
+      <td className="col-action">
+        {isTerminated ? (
+          <span className="action-done">✓ Done</span>
+        ) : !processAlive ? (
+          <span className="action-done">⚫ Process Exited</span>
+        ) : isRootUser ? (
+          <div className="protected-action">
+            <button 
+              className="btn btn-small btn-terminate btn-disabled"
+              disabled={true}
+              title="Cannot terminate root process"
+            >
+              🔒 Terminate
+            </button>
+            <span className="protected-label">Protected (root process)</span>
+          </div>
+        ) : isTerminating ? (
+          <span className="terminating-spinner">⏳ Verifying...</span>
+        ) : (
+          <button 
+            className="btn btn-small btn-terminate btn-active"
+            onClick={() => onTerminate(rowKey)}
+            title="Terminate this process"
+          >
+            🗑️ Terminate
+          </button>
+        )}
+      </td>
+    </tr>
+  );
+});
+
 const AnalyserTab = ({ 
   runData, 
   onClearRun, 
@@ -37,7 +130,6 @@ const AnalyserTab = ({
   const [processFilter, setProcessFilter] = useState('');
   const [hideTerminated, setHideTerminated] = useState(true);
   const [processUsers, setProcessUsers] = useState({});
-  const fetchUsersPending = useRef(false);
   const processUsersRef = useRef(processUsers);
   
   // Reason Modal state
@@ -51,7 +143,6 @@ const AnalyserTab = ({
   
   // Process liveness tracking for safe termination
   const [processLiveness, setProcessLiveness] = useState({});
-  const validationPending = useRef(false);
   
   // Keep ref in sync with state
   useEffect(() => {
@@ -94,150 +185,80 @@ const AnalyserTab = ({
           user: userInfo?.user || proc.user || 'unknown',
           isRoot: userInfo?.isRoot || (proc.user?.toLowerCase() === 'root') || false
         };
-      })
-      .sort((a, b) => {
-        if (sortBy === 'name') {
-          return sortOrder === 'desc' 
-            ? (b[sortBy] || '').localeCompare(a[sortBy] || '')
-            : (a[sortBy] || '').localeCompare(b[sortBy] || '');
-        }
-        const aVal = a[sortBy] || 0;
-        const bVal = b[sortBy] || 0;
-        return sortOrder === 'desc' ? bVal - aVal : aVal - bVal;
       });
-  }, [runData?.processes, sortBy, sortOrder, terminatedPids, processUsers]);
+  }, [runData?.processes, terminatedPids, processUsers]);
 
   // Active processes (not terminated)
   const activeProcesses = useMemo(() => {
     return sessionProcesses.filter(p => p.status !== 'terminated');
   }, [sessionProcesses]);
 
-  // Filtered processes for display
-  const filteredProcesses = useMemo(() => {
-    let result = sessionProcesses;
-    
-    // Filter by hide terminated
-    if (hideTerminated) {
-      result = result.filter(proc => proc.status !== 'terminated');
-    }
-    
-    // Filter by search term
-    if (processFilter) {
-      const filter = processFilter.toLowerCase();
-      result = result.filter(proc => 
-        proc.name?.toLowerCase().includes(filter) ||
-        String(proc.pid).includes(filter) ||
-        proc.user?.toLowerCase().includes(filter)
-      );
-    }
-    
-    return result;
-  }, [sessionProcesses, processFilter, hideTerminated]);
+  // Filtered and sorted processes for display, off the main thread for large sessions
+  const filteredProcesses = useProcessTable(sessionProcesses, {
+    sortBy,
+    sortOrder,
+    filter: processFilter,
+    hideTerminated
+  });
 
-  // Fetch user information for all processes
+  // Only the rows in view of the table are rendered
+  const tableScrollRef = useRef(null);
+  const tableBodyRef = useRef(null);
+  const tableWindow = useVirtualWindow(tableScrollRef, tableBodyRef, filteredProcesses.length, {
+    rowHeight: TABLE_ROW_HEIGHT
+  });
+
+  // Fill in users from the pushed process table, no request needed
   useEffect(() => {
-    const fetchProcessUsers = async () => {
-      if (!runData?.processes || Object.keys(runData.processes).length === 0) return;
-      if (fetchUsersPending.current) return;
-      
-      // Get all unique PIDs that we haven't fetched yet
-      const allPids = Object.values(runData.processes)
-        .map(proc => proc.pid)
-        .filter(pid => pid !== undefined && pid !== null);
-      
-      // Only fetch PIDs we don't have yet (use ref to avoid stale closure)
-      const pidsToFetch = allPids.filter(pid => !processUsersRef.current[pid]);
-      
-      if (pidsToFetch.length === 0) return;
-      
-      fetchUsersPending.current = true;
-      console.log('[AnalyserTab] Fetching users for PIDs:', pidsToFetch);
-      
-      try {
-        const response = await fetch(`${API_URL}/process-users`, {
-          method: 'POST',
-          headers: { 'Content-Type': 'application/json' },
-          body: JSON.stringify({ pids: pidsToFetch })
-        });
-        
-        if (response.ok) {
-          const data = await response.json();
-          console.log('[AnalyserTab] Received user data:', data);
-          if (data.users) {
-            setProcessUsers(prev => ({ ...prev, ...data.users }));
-          }
-        } else {
-          console.error('[AnalyserTab] Failed to fetch users:', response.status);
-        }
-      } catch (err) {
-        console.error('[AnalyserTab] Error fetching process users:', err);
-      } finally {
-        fetchUsersPending.current = false;
+    if (!runData?.processes) return;
+    const { rows } = getSnapshot();
+    const users = {};
+
+    Object.values(runData.processes).forEach(proc => {
+      if (processUsersRef.current[proc.pid]) return;
+      const row = rows.get(proc.pid);
+      if (row?.user) {
+        users[proc.pid] = {
+          user: row.user,
+          isRoot: row.user.toLowerCase() === 'root',
+          exists: true
+        };
       }
-    };
-    
-    // Fetch immediately
-    fetchProcessUsers();
-    
-    // Also set up a periodic refresh every 5 seconds for new processes
-    const interval = setInterval(fetchProcessUsers, 5000);
-    
-    return () => clearInterval(interval);
-  }, [runData?.processes]); // Remove processUsers from dependencies to avoid stale closure
+    });
+    if (Object.keys(users).length > 0) {
+      setProcessUsers(prev => ({ ...prev, ...users }));
+    }
+  }, [runData?.processes]);
 
-  // Continuous process liveness validation
+  // Process liveness from the push channel's death events
   // Ensures only live processes appear in termination list
+  const runPidsRef = useRef(new Set());
   useEffect(() => {
-    const validateProcessLiveness = async () => {
-      if (validationPending.current) return;
-      if (!runData?.processes || Object.keys(runData.processes).length === 0) return;
-      
-      // Get all PIDs that are not already marked as terminated
-      const pidsToValidate = Object.values(runData.processes)
-        .filter(proc => !terminatedPids.has(proc.pid))
-        .map(proc => proc.pid)
-        .filter(pid => pid !== undefined && pid !== null);
-      
-      if (pidsToValidate.length === 0) return;
-      
-      validationPending.current = true;
-      
-      try {
-        const response = await fetch(`${API_URL}/validate-processes`, {
-          method: 'POST',
-          headers: { 'Content-Type': 'application/json' },
-          body: JSON.stringify({ pids: pidsToValidate })
-        });
-        
-        if (response.ok) {
-          const data = await response.json();
-          if (data.processes) {
-            setProcessLiveness(prev => ({ ...prev, ...data.processes }));
-            
-            // Auto-mark dead processes as terminated
-            Object.entries(data.processes).forEach(([pid, status]) => {
-              if (!status.alive && !terminatedPids.has(parseInt(pid))) {
-                console.log(`[AnalyserTab] Process ${pid} detected as dead`);
-                setTerminatedPids(prev => new Set([...prev, parseInt(pid)]));
-              }
-            });
-          }
-        }
-      } catch (err) {
-        console.error('[AnalyserTab] Error validating process liveness:', err);
-      } finally {
-        validationPending.current = false;
-      }
-    };
-    
-    // Validate immediately
-    validateProcessLiveness();
-    
-    // Then validate every 3 seconds for real-time updates
-    const interval = setInterval(validateProcessLiveness, 3000);
-    
-    return () => clearInterval(interval);
-  }, [runData?.processes, terminatedPids]);
+    runPidsRef.current = new Set(Object.values(runData?.processes || {}).map(proc => proc.pid));
+  }, [runData?.processes]);
+
+  useEffect(() => subscribe((event) => {
+    let dead;
+
+    if (event.type === 'delta') {
+      dead = event.died.filter(pid => runPidsRef.current.has(pid));
+    } else if (event.type === 'keyframe') {
+      // Anything that went while disconnected
+      const { rows } = getSnapshot();
+      dead = [...runPidsRef.current].filter(pid => !rows.has(pid));
+    } else {
+      return;
+    }
+    if (dead.length === 0) return;
+
+    const now = Date.now();
+    setProcessLiveness(prev => {
+      const next = { ...prev };
+      dead.forEach(pid => { next[pid] = { alive: false, timestamp: now }; });
+      return next;
+    });
+    setTerminatedPids(prev => new Set([...prev, ...dead]));
+  }), []);
 
   // Calculate graph data from run samples (recalculated excluding terminated processes)
   const graphData = useMemo(() => {
@@ -457,6 +478,16 @@ const AnalyserTab = ({
     });
   };
 
+  // Stable handler for the memoised rows, looks the row up at click time
+  const requestTerminationRef = useRef(requestTermination);
+  requestTerminationRef.current = requestTermination;
+  const filteredProcessesRef = useRef(filteredProcesses);
+  filteredProcessesRef.current = filteredProcesses;
+  const onTerminateRow = useCallback((key) => {
+    const proc = filteredProcessesRef.current.find(p => p.key === key);
+    if (proc) requestTerminationRef.current(proc);
+  }, []);
+
   // Execute process termination with pre-validation
   const executeTermination = async () => {
     if (!confirmDialog?.proc) return;
@@ -679,6 +710,7 @@ const AnalyserTab = ({
       memory_thrashing: { icon: '🔄', label: 'Memory Thrashing', color: '#ff7b72' },
       memory_pressure: { icon: '⚠️', label: 'Memory Pressure', color: '#d29922' },
       warm_up: { icon: '🚀', label: 'Application Warm-up', color: '#58a6ff' },
+      memory_growth: { icon: '📈', label: 'Memory Growth', color: '#d29922' },
       file_backed: { icon: '📁', label: 'File-backed Access', color: '#8b949e' },
       normal: { icon: '✅', label: 'Normal Activity', color: '#7ee787' },
       unknown: { icon: '❓', label: 'Unknown', color: '#8b949e' }
@@ -1144,7 +1176,7 @@ const AnalyserTab = ({
           </div>
         </div>
 
-        <div className="process-table-container">
+        <div className="process-table-container" ref={tableScrollRef}>
           <table className="process-table">
             <thead>
               <tr>
@@ -1156,85 +1188,36 @@ const AnalyserTab = ({
                 <th className="col-action">Action</th>
               </tr>
             </thead>
-            <tbody>
+            <tbody ref={tableBodyRef}>
               {filteredProcesses.length > 0 ? (
-                filteredProcesses.map((proc) => {
-                  const isTerminating = terminatingPid === proc.pid;
-                  const isTerminated = proc.status === 'terminated';
-                  // Determine if user is root based on displayed user value
-                  const displayedUser = proc.user || 'unknown';
-                  const isRootUser = displayedUser.toLowerCase() === 'root';
-                  const totalFaults = getProcessTotalFaults(proc);
-                  const processAlive = isProcessAlive(proc.pid);
-                  
-                  return (
-                    <tr 
+                <>
+                  {tableWindow.padTop > 0 && (
+                    <tr className="table-spacer">
+                      <td colSpan="6" style={{ height: tableWindow.padTop }} />
+                    </tr>
+                  )}
+                  {filteredProcesses.slice(tableWindow.first, tableWindow.last).map((proc, idx) => (
+                    <ProcessRow
                       key={proc.key}
-                      className={`
-                        ${isTerminating ? 'terminating' : ''} 
-                        ${isTerminated || !processAlive ? 'terminated' : ''}
-                        ${isRootUser ? 'root-process' : ''}
-                      `}
-                    >
-                      <td className="col-pid">
-                        <span className="pid-value">{proc.pid}</span>
-                      </td>
-                      <td className="col-name">
-                        <span className="process-name-text">{proc.name}</span>
-                      </td>
-                      <td className="col-user">
-                        <span className={`user-badge ${isRootUser ? 'user-root' : 'user-normal'}`}>
-                          {displayedUser}
-                        </span>
-                      </td>
-                      <td className="col-faults">
-                        <span className="fault-count">{totalFaults}</span>
-                        {proc.samples && proc.samples.length > 0 && (
-                          <span className="fault-rate">
-                            ({Math.round(totalFaults / proc.samples.length * 10) / 10}/int)
-                          </span>
-                        )}
-                      </td>
-                      <td className="col-status">
-                        {isTerminated ? (
-                          <span className="status-badge terminated">Terminated</span>
-                        ) : !processAlive ? (
-                          <span className="status-badge terminated">Gone</span>
-                        ) : (
-                          <span className="status-badge running">Running</span>
-                        )}
-                      </td>
-                      <td className="col-action">
-                        {isTerminated ? (
-                          <span className="action-done">✓ Done</span>
-                        ) : !processAlive ? (
-                          <span className="action-done">⚫ Process Exited</span>
-                        ) : isRootUser ? (
-                          <div className="protected-action">
-                            <button 
-                              className="btn btn-small btn-terminate btn-disabled"
-                              disabled={true}
-                              title="Cannot terminate root process"
-                            >
-                              🔒 Terminate
-                            </button>
-                            <span className="protected-label">Protected (root process)</span>
-                          </div>
-                        ) : isTerminating ? (
-                          <span className="terminating-spinner">⏳ Verifying...</span>
-                        ) : (
-                          <button 
-                            className="btn btn-small btn-terminate btn-active"
-                            onClick={() => requestTermination(proc)}
-                            title="Terminate this process"
-                          >
-                            🗑️ Terminate
-                          </button>
-                        )}
-                      </td>
+                      rowRef={idx === 0 ? tableWindow.measureRef : undefined}
+                      rowKey={proc.key}
+                      pid={proc.pid}
+                      name={proc.name}
+                      user={proc.user || 'unknown'}
+                      totalFaults={getProcessTotalFaults(proc)}
+                      sampleCount={proc.samples?.length || 0}
+                      isTerminated={proc.status === 'terminated'}
+                      processAlive={isProcessAlive(proc.pid)}
+                      isTerminating={terminatingPid === proc.pid}
+                      onTerminate={onTerminateRow}
+                    />
+                  ))}
+                  {tableWindow.padBottom > 0 && (
+                    <tr className="table-spacer">
+                      <td colSpan="6" style={{ height: tableWindow.padBottom }} />
                     </tr>
-                  );
-                })
+                  )}
+                </>
               ) : (
                 <tr>
                   <td colSpan="6" className="no-processes-row">
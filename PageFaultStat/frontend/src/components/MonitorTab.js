@@ -1,9 +1,32 @@
-import { useCallback, useEffect, useRef, useState } from 'react';
+import { memo, useCallback, useEffect, useRef, useState } from 'react';
 import { CartesianGrid, Line, LineChart, ReferenceLine, ResponsiveContainer, Tooltip, XAxis, YAxis } from 'recharts';
+import { formatSample, getSnapshot, processWanted, subscribe } from '../store/faultStore';
+import { useVirtualWindow } from './virtualWindow';
 import './MonitorTab.css';
 
 const API_URL = 'http://localhost:5000/api';
 
+// Terminal lines kept, the oldest are dropped beyond this
+const MAX_OUTPUT_LINES = 100000;
+const OUTPUT_LINE_HEIGHT = 18;
+
+// Terminal colouring, applied one line at a time
+const highlightOutput = (text) => {
+  if (!text) return '';
+  
+  return text
+    .replace(/(={10,}|-{10,})/g, '<span class="hl-separator">$1</span>')
+    .replace(/\b(PID|PPID|Process|Command|Minor|Major|Total|USER)\b/g, '<span class="hl-header">$1</span>')
+    .replace(/\b(\d+\.?\d*)(%)?\b/g, '<span class="hl-number">$1$2</span>')
+    .replace(/\b(Error|WARNING|CRITICAL|Failed)\b/gi, '<span class="hl-error">$&</span>')
+    .replace(/\b(Success|OK|Running|Active)\b/gi, '<span class="hl-success">$&</span>');
+};
+
+// One terminal line, keyed by sample and PID so appending never re-renders it
+const OutputLine = memo(({ lineRef, text }) => (
+  <div ref={lineRef} className="output-line" dangerouslySetInnerHTML={{ __html: highlightOutput(text) }} />
+));
+
 const MonitorTab = ({ 
   isMonitoring, 
   setIsMonitoring, 
@@ -29,17 +52,18 @@ const MonitorTab = ({
   const [exportError, setExportError] = useState(null);
   
   // Data collection
-  const [liveOutput, setLiveOutput] = useState([]);
+  const [liveOutput, setLiveOutput] = useState([]);	// { key, text } per terminal line
   const [executionCount, setExecutionCount] = useState(0);
   const [lastUpdate, setLastUpdate] = useState(null);
   
   const terminalRef = useRef(null);
-  const intervalRef = useRef(null);
+  const outputRef = useRef(null);
+  const sampleSeqRef = useRef(0);
   const shouldExecuteImmediately = useRef(true);
+  const pendingPidsRef = useRef(new Set());	// faulted since the last sample
+  const lastSampleRef = useRef(0);
   
   const MIN_INTERVAL = 0.5;
-  const MAX_CONSECUTIVE_ERRORS = 5;
-  const consecutiveErrorsRef = useRef(0);
 
   // Fetch available processes
   const fetchProcesses = async () => {
@@ -61,222 +85,121 @@ const MonitorTab = ({
     }
   };
 
-  // Parse output for process fault data
-  const parseOutputData = (text) => {
-    const parseMetric = (value) => {
-      if (value === undefined || value === null) return 0;
-      const trimmed = String(value).trim();
-      if (!trimmed) return 0;
-
-      const suffix = trimmed.slice(-1).toLowerCase();
-      const base = parseFloat(trimmed);
-      if (Number.isNaN(base)) return 0;
-
-      const multipliers = { k: 1000, m: 1000000, g: 1000000000 };
-      return multipliers[suffix] ? base * multipliers[suffix] : base;
-    };
-
-    const parseTextLine = (line) => {
-      const cleanLine = line.replace(/\u001b\[[0-9;]*m/g, '').trim();
-      if (!cleanLine) return null;
-
-      const multiPattern = /^\s*(\d+)\s+([-\d\.a-zA-Z]+)\s+([-\d\.a-zA-Z]+)\s+([-\d\.a-zA-Z]+)\s+([-\d\.a-zA-Z]+)\s+([-\d\.a-zA-Z]+)\s+(?:[v^]\s+)?(\S+)\s+(.+)$/;
-      const singlePattern = /^\s*(\d+)\s+([-\d\.a-zA-Z]+)\s+([-\d\.a-zA-Z]+)\s+([-\d\.a-zA-Z]+)\s+(?:[v^]\s+)?(\S+)\s+(.+)$/;
-
-      let match = cleanLine.match(multiPattern);
-      if (match) {
-        return {
-          pid: parseInt(match[1], 10),
-          major: parseMetric(match[2]),
-          minor: parseMetric(match[3]),
-          user: match[7],
-          name: match[8]
-        };
-      }
-
-      match = cleanLine.match(singlePattern);
-      if (match) {
-        return {
-          pid: parseInt(match[1], 10),
-          major: parseMetric(match[2]),
-          minor: parseMetric(match[3]),
-          user: match[5],
-          name: match[6]
-        };
-      }
-
-      return null;
-    };
-
-    const results = {
-      timestamp: new Date().toISOString(),
-      processes: [],
-      totalMajor: 0,
-      totalMinor: 0
+  // Take a sample from the pushed process table: the processes that
+  // faulted since the last sample, as the text mode would list them
+  const takeSample = useCallback(() => {
+    const { rows } = getSnapshot();
+    const filters = processName.split(',').map(f => f.trim()).filter(Boolean);
+    const sampleRows = [...pendingPidsRef.current]
+      .map(pid => rows.get(pid))
+      .filter(row => row && processWanted(row, filters))
+      .sort((a, b) => (b.major + b.minor) - (a.major + a.minor));
+    pendingPidsRef.current = new Set();
+
+    // Lines of this sample: title, header, one per process, total, blank
+    const seq = ++sampleSeqRef.current;
+    const text = ('Change in page faults (average per second):\n' + formatSample(sampleRows, showAll)).split('\n');
+    text.pop();
+    const lines = text.map((line, idx) => ({
+      key: (idx >= 2 && idx - 2 < sampleRows.length) ? `${seq}:${sampleRows[idx - 2].pid}` : `${seq}#${idx}`,
+      text: line
+    }));
+    const parsedData = {
+      processes: sampleRows.map(row => ({
+        pid: row.pid,
+        major: row.major || 0,
+        minor: row.minor || 0,
+        user: row.user,
+        name: row.command
+      })),
+      totalMajor: sampleRows.reduce((sum, row) => sum + (row.major || 0), 0),
+      totalMinor: sampleRows.reduce((sum, row) => sum + (row.minor || 0), 0)
     };
+    const now = new Date();
 
-    // Try JSON format first
-    const jsonMatch = text.match(/"totals":\s*\{[^}]+\}/);
-    if (jsonMatch) {
-      try {
-        const jsonStr = text.match(/\{[\s\S]*"processes"[\s\S]*\}/);
-        if (jsonStr) {
-          const data = JSON.parse(jsonStr[0]);
-          results.totalMajor = data.totals?.major || 0;
-          results.totalMinor = data.totals?.minor || 0;
-          
-          if (data.processes) {
-            results.processes = data.processes.map(p => ({
-              pid: p.pid,
-              name: p.command || p.name,
-              user: p.user,
-              major: p.major || 0,
-              minor: p.minor || 0
-            }));
-          }
-          return results;
-        }
-      } catch (e) {
-        // Fall through to text parsing
-      }
-    }
-
-    // Parse text format
-    const lines = text.split('\n');
-    for (const line of lines) {
-      const parsed = parseTextLine(line);
-      if (parsed) {
-        results.processes.push({
-          pid: parsed.pid,
-          major: parsed.major,
-          minor: parsed.minor,
-          user: parsed.user,
-          name: parsed.name
-        });
-        results.totalMajor += parsed.major;
-        results.totalMinor += parsed.minor;
-      }
-    }
-
-    return results;
-  };
-
-  // Execute monitoring command
-  const executeCommand = useCallback(async () => {
-    if (isPaused) return;
-
-    try {
-      setIsLoading(true);
-      setError(null);
-      
-      const processParam = processName ? `&process=${encodeURIComponent(processName)}` : '';
-      const showAllParam = showAll ? '&showAll=true' : '';
-      const response = await fetch(
-        `${API_URL}/raw-output?interval=${interval}&samples=1${processParam}${showAllParam}`
-      );
-      const data = await response.json();
-
-      if (!response.ok) {
-        throw new Error(data.error || 'Failed to fetch output');
-      }
+    setIsLoading(false);
+    setError(null);
 
-      setIsConnected(true);
-      consecutiveErrorsRef.current = 0;
+    // Calculate per-interval faults and update runData
+    updateRunData(prev => {
+      const newSamples = [...prev.samples];
+      const newProcesses = { ...prev.processes };
+      const newPrevFaults = { ...prev.previousFaults };
       
-      // Parse the output data
-      const parsedData = parseOutputData(data.output);
-      const now = new Date();
-      
-      // Calculate per-interval faults and update runData
-      updateRunData(prev => {
-        const newSamples = [...prev.samples];
-        const newProcesses = { ...prev.processes };
-        const newPrevFaults = { ...prev.previousFaults };
+      // Calculate delta for each process
+      parsedData.processes.forEach(proc => {
+        const key = `${proc.pid}-${proc.name}`;
+        const prevMajor = newPrevFaults[key]?.major || 0;
+        const deltaFaults = proc.major - prevMajor;
         
-        // Calculate delta for each process
-        parsedData.processes.forEach(proc => {
-          const key = `${proc.pid}-${proc.name}`;
-          const prevMajor = newPrevFaults[key]?.major || 0;
-          const deltaFaults = proc.major - prevMajor;
-          
-          // Store current as previous for next iteration
-          newPrevFaults[key] = { major: proc.major, minor: proc.minor };
-          
-          // Update process tracking
-          if (!newProcesses[key]) {
-            newProcesses[key] = {
-              pid: proc.pid,
-              name: proc.name,
-              user: proc.user || 'unknown',
-              samples: [],
-              totalMajor: 0,
-              totalMinor: 0
-            };
-          } else if (proc.user && proc.user !== 'unknown' && newProcesses[key].user === 'unknown') {
-            // Update user if we get it later
-            newProcesses[key].user = proc.user;
-          }
-          
-          // Only add positive delta
-          const perIntervalFaults = Math.max(0, deltaFaults);
-          newProcesses[key].samples.push({
-            timestamp: now.toISOString(),
-            majorFaults: perIntervalFaults,
-            cumulativeMajor: proc.major
-          });
-          newProcesses[key].totalMajor = proc.major;
-          newProcesses[key].totalMinor = proc.minor;
-        });
+        // Store current as previous for next iteration
+        newPrevFaults[key] = { major: proc.major, minor: proc.minor };
         
-        // Add to overall samples
-        let totalDeltaMajor = 0;
-        parsedData.processes.forEach(proc => {
-          const key = `${proc.pid}-${proc.name}`;
-          const lastSample = newProcesses[key]?.samples.slice(-1)[0];
-          if (lastSample) {
-            totalDeltaMajor += lastSample.majorFaults;
-          }
-        });
+        // Update process tracking
+        if (!newProcesses[key]) {
+          newProcesses[key] = {
+            pid: proc.pid,
+            name: proc.name,
+            user: proc.user || 'unknown',
+            samples: [],
+            totalMajor: 0,
+            totalMinor: 0
+          };
+        } else if (proc.user && proc.user !== 'unknown' && newProcesses[key].user === 'unknown') {
+          // Update user if we get it later
+          newProcesses[key].user = proc.user;
+        }
         
-        newSamples.push({
+        // Only add positive delta
+        const perIntervalFaults = Math.max(0, deltaFaults);
+        newProcesses[key].samples.push({
           timestamp: now.toISOString(),
-          time: now.toLocaleTimeString(),
-          intervalIndex: newSamples.length + 1,
-          majorFaults: totalDeltaMajor,
-          totalMajor: parsedData.totalMajor,
-          totalMinor: parsedData.totalMinor,
-          processCount: parsedData.processes.length
+          majorFaults: perIntervalFaults,
+          cumulativeMajor: proc.major
         });
-        
-        return {
-          ...prev,
-          samples: newSamples,
-          processes: newProcesses,
-          previousFaults: newPrevFaults,
-          endTime: now.toISOString()
-        };
+        newProcesses[key].totalMajor = proc.major;
+        newProcesses[key].totalMinor = proc.minor;
       });
       
-      // Update live display
-      setLiveOutput(prev => [...prev, data.output]);
-      setExecutionCount(prev => prev + 1);
-      setLastUpdate(now);
+      // Add to overall samples
+      let totalDeltaMajor = 0;
+      parsedData.processes.forEach(proc => {
+        const key = `${proc.pid}-${proc.name}`;
+        const lastSample = newProcesses[key]?.samples.slice(-1)[0];
+        if (lastSample) {
+          totalDeltaMajor += lastSample.majorFaults;
+        }
+      });
       
-      setTimeout(scrollToBottom, 50);
-
-    } catch (err) {
-      setIsConnected(false);
-      setError(err.message);
-      consecutiveErrorsRef.current += 1;
+      newSamples.push({
+        timestamp: now.toISOString(),
+        time: now.toLocaleTimeString(),
+        intervalIndex: newSamples.length + 1,
+        majorFaults: totalDeltaMajor,
+        totalMajor: parsedData.totalMajor,
+        totalMinor: parsedData.totalMinor,
+        processCount: parsedData.processes.length
+      });
       
-      if (consecutiveErrorsRef.current >= MAX_CONSECUTIVE_ERRORS) {
-        setIsMonitoring(false);
-        setLiveOutput(prev => [...prev, `\n⚠️ Auto-refresh stopped: Too many consecutive errors.\n`]);
-      }
-    } finally {
-      setIsLoading(false);
-    }
-  }, [processName, showAll, interval, isPaused, updateRunData, setIsMonitoring]);
+      return {
+        ...prev,
+        samples: newSamples,
+        processes: newProcesses,
+        previousFaults: newPrevFaults,
+        endTime: now.toISOString()
+      };
+    });
+    
+    // Update live display
+    setLiveOutput(prev => {
+      const next = prev.concat(lines);
+      return next.length > MAX_OUTPUT_LINES ? next.slice(next.length - MAX_OUTPUT_LINES) : next;
+    });
+    setExecutionCount(prev => prev + 1);
+    setLastUpdate(now);
+    
+    setTimeout(scrollToBottom, 50);
+  }, [processName, showAll, updateRunData]);
 
   // Toggle pause/resume
   const togglePause = () => {
@@ -301,7 +224,7 @@ const MonitorTab = ({
     setLiveOutput([]);
     setExecutionCount(0);
     setError(null);
-    consecutiveErrorsRef.current = 0;
+    pendingPidsRef.current = new Set();
     setIsPaused(false);
     shouldExecuteImmediately.current = true;
     setIsMonitoring(true);
@@ -312,11 +235,6 @@ const MonitorTab = ({
     setIsMonitoring(false);
     setIsPaused(false);
     
-    if (intervalRef.current) {
-      clearInterval(intervalRef.current);
-      intervalRef.current = null;
-    }
-    
     updateRunData(prev => ({
       ...prev,
       endTime: new Date().toISOString()
@@ -329,44 +247,45 @@ const MonitorTab = ({
     setError(null);
   };
 
-  // Effect for monitoring interval
+  // Effect for monitoring: follow the push channel and sample every interval
   useEffect(() => {
-    if (isMonitoring && !isPaused && !showSettings) {
-      const safeInterval = Math.max(interval, MIN_INTERVAL);
-      
-      if (intervalRef.current) {
-        clearInterval(intervalRef.current);
-        intervalRef.current = null;
-      }
-      
-      if (shouldExecuteImmediately.current) {
-        executeCommand();
-        shouldExecuteImmediately.current = false;
-      }
-      
-      intervalRef.current = setInterval(() => {
-        executeCommand();
-      }, safeInterval * 1000);
-    } else {
-      if (intervalRef.current) {
-        clearInterval(intervalRef.current);
-        intervalRef.current = null;
-      }
+    if (!isMonitoring || isPaused || showSettings) {
+      return undefined;
     }
+    const safeInterval = Math.max(interval, MIN_INTERVAL) * 1000;
 
-    return () => {
-      if (intervalRef.current) {
-        clearInterval(intervalRef.current);
-        intervalRef.current = null;
+    setIsLoading(true);
+    return subscribe((event) => {
+      const { connected } = getSnapshot();
+
+      setIsConnected(connected);
+      if (event.type === 'status') {
+        setError(connected ? null : 'Lost connection to the backend, reconnecting...');
+        return;
       }
-    };
-  }, [isMonitoring, isPaused, showSettings, interval, executeCommand]);
+
+      event.faulted.forEach(pid => pendingPidsRef.current.add(pid));
+      const now = Date.now();
+      // Ticks come every second, allow for jitter
+      if (shouldExecuteImmediately.current || now - lastSampleRef.current >= safeInterval - 250) {
+        shouldExecuteImmediately.current = false;
+        lastSampleRef.current = now;
+        takeSample();
+      }
+    });
+  }, [isMonitoring, isPaused, showSettings, interval, takeSample]);
 
   // Fetch processes on mount
   useEffect(() => {
     fetchProcesses();
   }, []);
 
+  // Only the terminal lines in view are rendered
+  const outputWindow = useVirtualWindow(terminalRef, outputRef, liveOutput.length, {
+    rowHeight: OUTPUT_LINE_HEIGHT,
+    overscan: 20
+  });
+
   // Calculate live statistics
   const liveStats = {
     samples: runData.samples.length,
@@ -392,17 +311,6 @@ const MonitorTab = ({
   }));
 
   // Highlight output text
-  const highlightOutput = (text) => {
-    if (!text) return '';
-    
-    return text
-      .replace(/(={10,}|-{10,})/g, '<span class="hl-separator">$1</span>')
-      .replace(/\b(PID|PPID|Process|Command|Minor|Major|Total|USER)\b/g, '<span class="hl-header">$1</span>')
-      .replace(/\b(\d+\.?\d*)(%)?\b/g, '<span class="hl-number">$1$2</span>')
-      .replace(/\b(Error|WARNING|CRITICAL|Failed)\b/gi, '<span class="hl-error">$&</span>')
-      .replace(/\b(Success|OK|Running|Active)\b/gi, '<span class="hl-success">$&</span>');
-  };
-
   const sanitizeFilename = (name) => {
     const trimmed = (name || '').trim();
     if (!trimmed) return 'fault-data';
@@ -716,10 +624,17 @@ const MonitorTab = ({
                     <span>Initializing monitoring...</span>
                   </div>
                 )}
-                <pre 
-                  className="output-text"
-                  dangerouslySetInnerHTML={{ __html: highlightOutput(liveOutput.join('')) }}
-                />
+                <div className="output-text" ref={outputRef}>
+                  <div style={{ height: outputWindow.padTop }} />
+                  {liveOutput.slice(outputWindow.first, outputWindow.last).map((line, idx) => (
+                    <OutputLine
+                      key={line.key}
+                      lineRef={idx === 0 ? outputWindow.measureRef : undefined}
+                      text={line.text}
+                    />
+                  ))}
+                  <div style={{ height: outputWindow.padBottom }} />
+                </div>
                 {error && (
                   <div className="error-box">
                     <div className="error-header">
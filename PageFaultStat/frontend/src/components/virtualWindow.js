@@ -0,0 +1,66 @@
+import { useCallback, useLayoutEffect, useRef, useState } from 'react';
+
+// Windowed rendering for long lists of equal height rows: only the rows in
+// view of the scroll container plus `overscan` on each side are mounted,
+// the rest is stood in for by padding above and below. The row height
+// starts as an estimate and is measured from the first mounted row.
+export function useVirtualWindow(scrollRef, listRef, count, { rowHeight: estimate, overscan = 10 }) {
+  const [view, setView] = useState({ top: 0, height: 0 });
+  const [rowHeight, setRowHeight] = useState(estimate);
+  const updateRef = useRef(() => {});
+
+  useLayoutEffect(() => {
+    const scroller = scrollRef.current;
+    if (!scroller) return undefined;
+    let frame = 0;
+
+    const update = () => {
+      frame = 0;
+      const list = listRef.current;
+      // Scroll position relative to the top of the list
+      const offset = list
+        ? list.getBoundingClientRect().top - scroller.getBoundingClientRect().top + scroller.scrollTop
+        : 0;
+      const top = scroller.scrollTop - offset;
+      const height = scroller.clientHeight;
+      setView(prev => (prev.top === top && prev.height === height) ? prev : { top, height });
+    };
+    const schedule = () => {
+      if (!frame) frame = requestAnimationFrame(update);
+    };
+
+    updateRef.current = update;
+    update();
+    scroller.addEventListener('scroll', schedule, { passive: true });
+    const observer = typeof ResizeObserver === 'function' ? new ResizeObserver(schedule) : null;
+    if (observer) observer.observe(scroller);
+    return () => {
+      scroller.removeEventListener('scroll', schedule);
+      if (observer) observer.disconnect();
+      if (frame) cancelAnimationFrame(frame);
+      updateRef.current = () => {};
+    };
+  }, [scrollRef, listRef]);
+
+  // Content above the list can come and go as rows are added
+  useLayoutEffect(() => {
+    updateRef.current();
+  }, [count]);
+
+  const measureRef = useCallback((node) => {
+    if (node && node.offsetHeight > 0) {
+      setRowHeight(prev => (prev === node.offsetHeight ? prev : node.offsetHeight));
+    }
+  }, []);
+
+  const first = Math.min(count, Math.max(0, Math.floor(view.top / rowHeight) - overscan));
+  const last = Math.max(first, Math.min(count, Math.ceil((view.top + view.height) / rowHeight) + overscan));
+
+  return {
+    first,
+    last,
+    padTop: first * rowHeight,
+    padBottom: (count - last) * rowHeight,
+    measureRef
+  };
+}
@@ -0,0 +1,183 @@
+import { useSyncExternalStore } from 'react';
+
+const API_URL = 'http://localhost:5000/api';
+
+// Local copy of the sampler's process table, kept up to date from the
+// /api/events push channel: a keyframe on connect, then per tick only the
+// rows that changed and the PIDs that were born or died. Work per tick
+// scales with activity, not with the number of processes.
+const state = {
+  connected: false,
+  seq: 0,
+  timestamp: null,
+  totals: null,
+  memory: null,
+  rows: new Map(),	// pid -> { pid, major, minor, deltaMajor, deltaMinor, swap, user, command, ... }
+  active: new Set()	// pids with faults in the last tick
+};
+
+let snapshot = { ...state };
+let source = null;
+let pending = null;	// event waiting for the next animation frame
+const listeners = new Set();
+
+const isActive = (row) => (row.deltaMajor || 0) + (row.deltaMinor || 0) !== 0;
+const EVENT_RANK = { status: 0, delta: 1, keyframe: 2 };
+
+function flush() {
+  const event = pending;
+  pending = null;
+  snapshot = { ...state };
+  listeners.forEach(listener => listener(event));
+}
+
+// Hidden tabs get no animation frames, flush those on a timer instead
+function scheduleFlush() {
+  if (typeof requestAnimationFrame === 'function' && !document.hidden) {
+    requestAnimationFrame(flush);
+  } else {
+    setTimeout(flush, 0);
+  }
+}
+
+// Listeners hear once per animation frame: ticks applied in between are
+// merged into one event, with `faulted` the PIDs active in any of them
+function publish(event) {
+  if (!pending) {
+    pending = { ...event, faulted: new Set(state.active) };
+    scheduleFlush();
+    return;
+  }
+  if (EVENT_RANK[event.type] > EVENT_RANK[pending.type]) pending.type = event.type;
+  pending.born = pending.born.concat(event.born);
+  pending.died = pending.died.concat(event.died);
+  pending.changed = pending.changed.concat(event.changed);
+  state.active.forEach(pid => pending.faulted.add(pid));
+}
+
+function applyKeyframe(frame) {
+  state.rows = new Map();
+  state.active = new Set();
+  for (const row of frame.processes) {
+    state.rows.set(row.pid, row);
+    if (isActive(row)) state.active.add(row.pid);
+  }
+  state.seq = frame.seq;
+  state.timestamp = frame.timestamp;
+  state.totals = frame.totals;
+  state.memory = frame.memory;
+  publish({ type: 'keyframe', born: frame.processes.map(row => row.pid), died: [], changed: [] });
+}
+
+function applyDelta(delta) {
+  if (delta.seq !== state.seq + 1) {
+    // Missed a tick, start again from a keyframe
+    reconnect();
+    return;
+  }
+  for (const row of delta.upserts) {
+    state.rows.set(row.pid, row);
+    if (isActive(row)) state.active.add(row.pid);
+    else state.active.delete(row.pid);
+  }
+  for (const pid of delta.died) {
+    state.rows.delete(pid);
+    state.active.delete(pid);
+  }
+  state.seq = delta.seq;
+  state.timestamp = delta.timestamp;
+  state.totals = delta.totals;
+  state.memory = delta.memory;
+  publish({
+    type: 'delta',
+    born: delta.born,
+    died: delta.died,
+    changed: delta.upserts.map(row => row.pid)
+  });
+}
+
+function connect() {
+  source = new EventSource(`${API_URL}/events`);
+  source.addEventListener('keyframe', (e) => applyKeyframe(JSON.parse(e.data)));
+  source.addEventListener('delta', (e) => applyDelta(JSON.parse(e.data)));
+  source.onopen = () => {
+    state.connected = true;
+    publish({ type: 'status', born: [], died: [], changed: [] });
+  };
+  source.onerror = () => {
+    // EventSource reconnects by itself and the server sends a new keyframe
+    state.connected = false;
+    publish({ type: 'status', born: [], died: [], changed: [] });
+  };
+}
+
+function reconnect() {
+  if (source) source.close();
+  state.seq = 0;
+  connect();
+}
+
+function disconnect() {
+  if (source) source.close();
+  source = null;
+  state.connected = false;
+}
+
+// Listen for store events, the connection is open while anyone listens
+export function subscribe(listener) {
+  listeners.add(listener);
+  if (!source) connect();
+  return () => {
+    listeners.delete(listener);
+    if (listeners.size === 0) disconnect();
+  };
+}
+
+export function getSnapshot() {
+  return snapshot;
+}
+
+// Re-renders on every applied tick
+export function useFaultStore() {
+  return useSyncExternalStore(subscribe, getSnapshot);
+}
+
+// Same units and width as int64_to_str() in the sampler
+function int64ToStr(val) {
+  const v = Math.max(0, val || 0);
+  let s = v, unit = ' ';
+  if (v >= 1e12) { s = v / 1e9; unit = 'G'; }
+  else if (v >= 1e9) { s = v / 1e6; unit = 'M'; }
+  else if (v >= 1e6) { s = v / 1e3; unit = 'k'; }
+  return Math.round(s).toString().padStart(6) + unit;
+}
+
+// -p semantics: a PID, or a command name prefix of the basename
+export function processWanted(row, filters) {
+  if (filters.length === 0) return true;
+  return filters.some(filter => {
+    if (/^\d+$/.test(filter)) return row.pid === Number(filter);
+    const cmd = row.command || '';
+    const name = filter.includes('/') ? cmd : cmd.split(' ')[0].split('/').pop();
+    return name.startsWith(filter.split(' ')[0]);
+  });
+}
+
+// One sample in the sampler's text mode format
+export function formatSample(rows, arrows) {
+  const width = 7;
+  let text = ` ${'PID'.padStart(width)}  Major   Minor  +Major  +Minor    Swap  ${arrows ? 'D ' : ''}User       Command\n`;
+  let tMajor = 0, tMinor = 0, tdMajor = 0, tdMinor = 0;
+
+  for (const row of rows) {
+    text += ` ${String(row.pid).padStart(width)} ${int64ToStr(row.major)} ${int64ToStr(row.minor)}` +
+      ` ${int64ToStr(row.deltaMajor)} ${int64ToStr(row.deltaMinor)} ${int64ToStr(row.swap)}` +
+      ` ${(row.user || '').slice(0, 10).padEnd(10)} ${row.command}\n`;
+    tMajor += row.major || 0;
+    tMinor += row.minor || 0;
+    tdMajor += row.deltaMajor || 0;
+    tdMinor += row.deltaMinor || 0;
+  }
+  text += ` ${'Total:'.padStart(width)} ${int64ToStr(tMajor)} ${int64ToStr(tMinor)} ${int64ToStr(tdMajor)} ${int64ToStr(tdMinor)}\n\n`;
+  return text;
+}
@@ -0,0 +1,7 @@
+/* eslint-disable no-restricted-globals */
+import { sortAndFilter } from './processTable';
+
+self.onmessage = ({ data }) => {
+  const order = sortAndFilter(data.packed, data.options);
+  self.postMessage({ id: data.id, order }, [order.buffer]);
+};
@@ -0,0 +1,61 @@
+import { useEffect, useMemo, useRef, useState } from 'react';
+import { packRows, sortAndFilter, transferList } from './processTable';
+
+// Below this many rows a round trip to the worker costs more than sorting
+const WORKER_MIN_ROWS = 2000;
+
+// Sorted and filtered view of `processes`. Large tables are sorted off the
+// main thread and the previous answer is shown until the worker replies,
+// so rows can be one round trip (a few tens of ms) behind the input.
+export function useProcessTable(processes, { sortBy, sortOrder, filter, hideTerminated }) {
+  const workerRef = useRef(null);
+  const requestRef = useRef(0);
+  const sentRef = useRef(new Map());	// request id -> processes it was sent
+  const [result, setResult] = useState({ id: 0, rows: null });
+  const useWorker = processes.length >= WORKER_MIN_ROWS && typeof Worker === 'function';
+
+  useEffect(() => {
+    if (typeof Worker !== 'function') return undefined;
+    const worker = new Worker(new URL('./processTable.worker.js', import.meta.url));
+    const sent = sentRef.current;
+
+    worker.onmessage = ({ data }) => {
+      const rows = sent.get(data.id);
+      // Answers come back in order, anything older is moot
+      for (const id of sent.keys()) {
+        if (id <= data.id) sent.delete(id);
+      }
+      if (!rows) return;
+      const sorted = Array.from(data.order, idx => rows[idx]);
+      setResult(prev => (data.id > prev.id ? { id: data.id, rows: sorted } : prev));
+    };
+    workerRef.current = worker;
+    return () => {
+      worker.terminate();
+      workerRef.current = null;
+      sent.clear();
+    };
+  }, []);
+
+  useEffect(() => {
+    if (!useWorker || !workerRef.current) return;
+    const id = ++requestRef.current;
+    const packed = packRows(processes);
+
+    sentRef.current.set(id, processes);
+    workerRef.current.postMessage({
+      id,
+      packed,
+      options: { sortBy, sortOrder, filter, hideTerminated }
+    }, transferList(packed));
+  }, [useWorker, processes, sortBy, sortOrder, filter, hideTerminated]);
+
+  // Small tables, and large ones until the worker first answers
+  const inlineRows = useMemo(() => {
+    if (useWorker && result.rows) return null;
+    const order = sortAndFilter(packRows(processes), { sortBy, sortOrder, filter, hideTerminated });
+    return Array.from(order, idx => processes[idx]);
+  }, [useWorker, result.rows, processes, sortBy, sortOrder, filter, hideTerminated]);
+
+  return inlineRows || result.rows;
+}
@@ -0,0 +1,494 @@
+/*
+ * Streaming thrash onset detection for PageFaultStat
+ *
+ * Every process and the system as a whole have two series, the
+ * major fault rate and the swap growth rate. Each series keeps an
+ * EWMA baseline with an EWMA variance and a one sided CUSUM of the
+ * standardised excess over the baseline, all O(1) state. An onset
+ * is raised on a single large spike (z-score) or on a sustained
+ * shift (CUSUM), as long as the rate is also above an absolute
+ * floor so idle series with no variance do not fire on noise. The
+ * baseline is frozen while a series is anomalous and the event ends
+ * once the rate has been back near the baseline for a few samples.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+
+#define ANOMALY_ALPHA		(0.05)	/* baseline smoothing, ~20 samples */
+#define ANOMALY_WARMUP		(10)	/* samples before detecting */
+#define ANOMALY_Z_SPIKE		(8.0)	/* z-score of a single sample onset */
+#define ANOMALY_CUSUM_K		(0.5)	/* CUSUM slack, in sigmas */
+#define ANOMALY_CUSUM_H		(8.0)	/* CUSUM onset threshold, in sigmas */
+#define ANOMALY_Z_CALM		(2.0)	/* z-score counted as back to normal */
+#define ANOMALY_CALM		(3)	/* calm samples that end an event */
+#define ANOMALY_MAX_EVENTS	(64)	/* events kept per tick */
+#define ANOMALY_LOG_LINE	(4096)	/* room for one event log line */
+
+#define ANOMALY_MAJOR		(0)
+#define ANOMALY_SWAP		(1)
+#define ANOMALY_METRICS		(2)
+
+/* Per metric tuning */
+typedef struct {
+	const char	*name;		/* metric name in events */
+	double		floor;		/* rate an onset needs at least, per second */
+	double		min_sigma;	/* smallest sigma used for z-scores */
+} anomaly_metric_t;
+
+static const anomaly_metric_t anomaly_metrics[ANOMALY_METRICS] = {
+	{ "major",	10.0,	1.0 },	/* major faults per second */
+	{ "swap",	1024.0,	64.0 },	/* swap growth, kB per second */
+};
+
+typedef struct {
+	float		mean;		/* EWMA baseline */
+	float		var;		/* EWMA variance */
+	float		cusum;		/* one sided CUSUM, in sigmas */
+	uint16_t	n;		/* samples, saturates */
+	uint8_t		calm;		/* calm samples while active */
+	bool		active;		/* in an anomaly */
+} anomaly_series_t;
+
+typedef struct {
+	pid_t		pid;		/* process, 0 = empty */
+	uint32_t	gen;		/* tick last seen in */
+	uint64_t	start_time;	/* to tell a reused pid */
+	anomaly_series_t series[ANOMALY_METRICS];
+} anomaly_entry_t;
+
+static bool anomaly_on;			/* detector running */
+static anomaly_entry_t *anomaly_table;	/* open addressing, linear probing */
+static size_t anomaly_size;		/* table size, power of 2 */
+static size_t anomaly_used;		/* entries in use */
+static anomaly_entry_t anomaly_system;	/* system wide series */
+static uint32_t anomaly_gen;		/* tick count */
+static double anomaly_last;		/* time of the previous tick */
+static size_t anomaly_nactive;		/* processes with an active anomaly */
+
+static anomaly_event_t anomaly_events[ANOMALY_MAX_EVENTS];	/* this tick */
+static size_t anomaly_nevents;
+static uint64_t anomaly_dropped;	/* events beyond ANOMALY_MAX_EVENTS */
+static anomaly_event_t anomaly_last_onset;	/* most recent onset */
+static bool anomaly_have_onset;
+
+static const char *anomaly_log_path;	/* event log, NULL if none */
+static int anomaly_log_fd = -1;
+static strbuf_t anomaly_log_buf;
+
+/*
+ *  anomaly_set_log()
+ *	append events to a log file
+ */
+void anomaly_set_log(const char *path)
+{
+	anomaly_log_path = path;
+}
+
+/*
+ *  anomaly_hash()
+ *	hash a pid into the table
+ */
+static inline size_t anomaly_hash(const pid_t pid)
+{
+	return ((size_t)pid * 2654435761UL) & (anomaly_size - 1);
+}
+
+/*
+ *  anomaly_resize()
+ *	grow the table to size entries and rehash
+ */
+static int anomaly_resize(const size_t size)
+{
+	anomaly_entry_t *table, *old = anomaly_table;
+	const size_t old_size = anomaly_size;
+	size_t i;
+
+	if ((table = heap_calloc(size, sizeof(*table))) == NULL) {
+		out_of_memory("allocating anomaly detector");
+		return -1;
+	}
+	anomaly_table = table;
+	anomaly_size = size;
+	for (i = 0; i < old_size; i++) {
+		size_t h;
+
+		if (!old[i].pid)
+			continue;
+		for (h = anomaly_hash(old[i].pid); anomaly_table[h].pid; h = (h + 1) & (size - 1))
+			;
+		anomaly_table[h] = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+/*
+ *  anomaly_find()
+ *	find a pid's entry, NULL if it has none
+ */
+static anomaly_entry_t *anomaly_find(const pid_t pid)
+{
+	size_t h;
+
+	if (!anomaly_table)
+		return NULL;
+	for (h = anomaly_hash(pid); anomaly_table[h].pid; h = (h + 1) & (anomaly_size - 1)) {
+		if (anomaly_table[h].pid == pid)
+			return &anomaly_table[h];
+	}
+	return NULL;
+}
+
+/*
+ *  anomaly_get()
+ *	find or add a pid's entry, *added is set if it is new
+ */
+static anomaly_entry_t *anomaly_get(const pid_t pid, bool * const added)
+{
+	size_t h;
+
+	*added = false;
+	if (((anomaly_used + 1) * 2 > anomaly_size) && (anomaly_resize(anomaly_size * 2) < 0))
+		return NULL;
+	for (h = anomaly_hash(pid); anomaly_table[h].pid; h = (h + 1) & (anomaly_size - 1)) {
+		if (anomaly_table[h].pid == pid)
+			return &anomaly_table[h];
+	}
+	(void)memset(&anomaly_table[h], 0, sizeof(anomaly_table[h]));
+	anomaly_table[h].pid = pid;
+	anomaly_used++;
+	*added = true;
+	return &anomaly_table[h];
+}
+
+/*
+ *  anomaly_remove()
+ *	remove the entry at slot i, shifting back any entries
+ *	that probed past it so no tombstones are needed
+ */
+static void anomaly_remove(size_t i)
+{
+	const size_t mask = anomaly_size - 1;
+	size_t j = i;
+
+	for (;;) {
+		size_t h;
+
+		j = (j + 1) & mask;
+		if (!anomaly_table[j].pid)
+			break;
+		h = anomaly_hash(anomaly_table[j].pid);
+		/* Entry at j can move to i if its home is not in (i, j] */
+		if (((j > i) && ((h <= i) || (h > j))) ||
+		    ((j < i) && ((h <= i) && (h > j)))) {
+			anomaly_table[i] = anomaly_table[j];
+			i = j;
+		}
+	}
+	anomaly_table[i].pid = 0;
+	anomaly_used--;
+}
+
+/*
+ *  anomaly_init()
+ *	start detecting, the table and log buffer are sized
+ *	up front so that nothing is allocated after warm-up,
+ *	the table allows for twice npids processes of churn
+ */
+int anomaly_init(const size_t npids, const double now)
+{
+	size_t size;
+
+	for (size = 1024; size < npids * 4; size <<= 1)
+		;
+	if (anomaly_resize(size) < 0)
+		return -1;
+	if (anomaly_log_path) {
+		if (strbuf_reserve(&anomaly_log_buf, ANOMALY_LOG_LINE) < 0)
+			return -1;
+		anomaly_log_fd = open(anomaly_log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (anomaly_log_fd < 0) {
+			(void)fprintf(stderr, "Cannot open %s: errno=%d (%s)\n",
+				anomaly_log_path, errno, strerror(errno));
+			return -1;
+		}
+	}
+	anomaly_last = now;
+	anomaly_on = true;
+	return 0;
+}
+
+/*
+ *  anomaly_enabled()
+ *	true if the detector is running
+ */
+bool anomaly_enabled(void)
+{
+	return anomaly_on;
+}
+
+/*
+ *  anomaly_event()
+ *	record an onset or end event
+ */
+static void anomaly_event(
+	const bool onset,
+	const pid_t pid,
+	const char *cmd,
+	const int metric,
+	const double value,
+	const anomaly_series_t * const s,
+	const double z,
+	const double now)
+{
+	anomaly_event_t *ev;
+
+	if (anomaly_nevents >= ANOMALY_MAX_EVENTS) {
+		anomaly_dropped++;
+		return;
+	}
+	ev = &anomaly_events[anomaly_nevents++];
+	ev->onset = onset;
+	ev->pid = pid;
+	ev->metric = anomaly_metrics[metric].name;
+	ev->value = value;
+	ev->baseline = s->mean;
+	ev->z = z;
+	ev->time = now;
+	(void)snprintf(ev->cmd, sizeof(ev->cmd), "%s", cmd);
+	if (onset) {
+		anomaly_last_onset = *ev;
+		anomaly_have_onset = true;
+	}
+}
+
+/*
+ *  anomaly_series_update()
+ *	feed one rate into a series, may raise an event
+ */
+static void anomaly_series_update(
+	anomaly_series_t * const s,
+	const int metric,
+	const double x,
+	const pid_t pid,
+	const char *cmd,
+	const double now)
+{
+	const anomaly_metric_t * const m = &anomaly_metrics[metric];
+	double sigma = sqrt(s->var), z, diff, incr, xb;
+
+	if (sigma < m->min_sigma)
+		sigma = m->min_sigma;
+	if (sigma < 0.1 * s->mean)
+		sigma = 0.1 * s->mean;
+	z = (x - s->mean) / sigma;
+
+	if (s->n >= ANOMALY_WARMUP) {
+		const float cusum = s->cusum + (float)(z - ANOMALY_CUSUM_K);
+
+		s->cusum = (cusum > 0.0f) ? cusum : 0.0f;
+		if (!s->active) {
+			if ((x >= m->floor) &&
+			    ((z >= ANOMALY_Z_SPIKE) || (s->cusum >= ANOMALY_CUSUM_H))) {
+				s->active = true;
+				s->calm = 0;
+				anomaly_event(true, pid, cmd, metric, x, s, z, now);
+			}
+		} else if (z < ANOMALY_Z_CALM) {
+			if (++s->calm >= ANOMALY_CALM) {
+				s->active = false;
+				s->cusum = 0.0f;
+				anomaly_event(false, pid, cmd, metric, x, s, z, now);
+			}
+		} else {
+			s->calm = 0;
+		}
+	}
+	if (s->active)
+		return;		/* Keep the baseline from learning the anomaly */
+
+	/* Clamp what the baseline learns so a slow ramp still stands out */
+	xb = ((s->n >= ANOMALY_WARMUP) && (z > 4.0)) ? s->mean + (4.0 * sigma) : x;
+	if (s->n == 0) {
+		s->mean = (float)xb;
+		s->var = 0.0f;
+	} else {
+		diff = xb - s->mean;
+		incr = ANOMALY_ALPHA * diff;
+		s->mean += (float)incr;
+		s->var = (float)((1.0 - ANOMALY_ALPHA) * (s->var + (diff * incr)));
+	}
+	if (s->n < UINT16_MAX)
+		s->n++;
+}
+
+/*
+ *  anomaly_update()
+ *	feed the deltas of this tick to the detector
+ */
+void anomaly_update(fault_info_t * const fault_info_new, const double now)
+{
+	const double interval = now - anomaly_last;
+	double sys[ANOMALY_METRICS] = { 0.0, 0.0 };
+	fault_info_t *fault_info;
+	size_t i;
+	int m;
+
+	if (!anomaly_on)
+		return;
+	anomaly_nevents = 0;
+	anomaly_gen++;
+	anomaly_nactive = 0;
+
+	for (fault_info = fault_info_new; fault_info; fault_info = fault_info->next) {
+		anomaly_entry_t *e;
+		double x[ANOMALY_METRICS];
+		bool added;
+
+		if ((e = anomaly_get(fault_info->pid, &added)) == NULL)
+			break;
+		e->gen = anomaly_gen;
+		/* First sight, or the pid was reused, the deltas are not rates */
+		if (added || (e->start_time != fault_info->start_time)) {
+			if (!added)
+				(void)memset(e->series, 0, sizeof(e->series));
+			e->start_time = fault_info->start_time;
+			continue;
+		}
+		x[ANOMALY_MAJOR] = (double)fault_info->d_maj_fault;
+		x[ANOMALY_SWAP] = (fault_info->d_vm_swap > 0) ? (double)fault_info->d_vm_swap : 0.0;
+		for (m = 0; m < ANOMALY_METRICS; m++) {
+			if (interval > 0.0)
+				x[m] /= interval;
+			sys[m] += x[m];
+			anomaly_series_update(&e->series[m], m, x[m], fault_info->pid,
+				(fault_info->proc && fault_info->proc->cmdline) ?
+				fault_info->proc->cmdline : "<unknown>", now);
+		}
+		if (e->series[ANOMALY_MAJOR].active || e->series[ANOMALY_SWAP].active)
+			anomaly_nactive++;
+	}
+	for (m = 0; m < ANOMALY_METRICS; m++)
+		anomaly_series_update(&anomaly_system.series[m], m, sys[m], 0, "<system>", now);
+	anomaly_last = now;
+
+	/* Drop processes that have gone, closing any open event */
+	for (i = 0; i < anomaly_size; ) {
+		anomaly_entry_t * const e = &anomaly_table[i];
+
+		if (!e->pid || (e->gen == anomaly_gen)) {
+			i++;
+			continue;
+		}
+		for (m = 0; m < ANOMALY_METRICS; m++) {
+			if (e->series[m].active)
+				anomaly_event(false, e->pid, "<exited>", m, 0.0, &e->series[m], 0.0, now);
+		}
+		anomaly_remove(i);	/* may shift another entry into i */
+	}
+
+	if (anomaly_log_fd >= 0) {
+		for (i = 0; i < anomaly_nevents; i++) {
+			strbuf_reset(&anomaly_log_buf);
+			if ((anomaly_event_json(&anomaly_log_buf, &anomaly_events[i]) < 0) ||
+			    (strbuf_append(&anomaly_log_buf, "\n", 1) < 0))
+				break;
+			if (write(anomaly_log_fd, anomaly_log_buf.buf, anomaly_log_buf.len) < 0)
+				break;
+		}
+	}
+}
+
+/*
+ *  anomaly_active()
+ *	true if a process has an active anomaly
+ */
+bool anomaly_active(const pid_t pid)
+{
+	const anomaly_entry_t *e;
+
+	if (!anomaly_on || ((e = anomaly_find(pid)) == NULL))
+		return false;
+	return e->series[ANOMALY_MAJOR].active || e->series[ANOMALY_SWAP].active;
+}
+
+/*
+ *  anomaly_system_active()
+ *	true if the system as a whole has an active anomaly
+ */
+bool anomaly_system_active(void)
+{
+	return anomaly_system.series[ANOMALY_MAJOR].active ||
+	       anomaly_system.series[ANOMALY_SWAP].active;
+}
+
+/*
+ *  anomaly_get_state()
+ *	active processes, dropped events and the last onset,
+ *	returns false if there has not been an onset yet
+ */
+bool anomaly_get_state(size_t * const nactive, uint64_t * const dropped, anomaly_event_t * const last)
+{
+	*nactive = anomaly_nactive;
+	*dropped = anomaly_dropped;
+	if (anomaly_have_onset)
+		*last = anomaly_last_onset;
+	return anomaly_have_onset;
+}
+
+/*
+ *  anomaly_event_json()
+ *	serialise an event as a JSON object
+ */
+int anomaly_event_json(strbuf_t * const sb, const anomaly_event_t * const ev)
+{
+	int ret = 0;
+
+	ret |= strbuf_printf(sb, "{\"type\":\"%s\",\"pid\":%d,\"command\":",
+		ev->onset ? "onset" : "end", ev->pid);
+	ret |= strbuf_json_str(sb, ev->cmd);
+	ret |= strbuf_printf(sb, ",\"metric\":\"%s\",\"value\":%.3f,\"baseline\":%.3f"
+		",\"z\":%.2f,\"timestamp\":%.3f}",
+		ev->metric, ev->value, ev->baseline, ev->z, ev->time);
+	return ret ? -1 : 0;
+}
+
+/*
+ *  anomaly_json_events()
+ *	append this tick's events as a JSON array member
+ */
+int anomaly_json_events(strbuf_t * const sb)
+{
+	size_t i;
+	int ret = 0;
+
+	ret |= strbuf_printf(sb, "\"events\":[");
+	for (i = 0; i < anomaly_nevents; i++) {
+		if (i)
+			ret |= strbuf_append(sb, ",", 1);
+		ret |= anomaly_event_json(sb, &anomaly_events[i]);
+	}
+	ret |= strbuf_printf(sb, "],\"anomalies\":{\"active\":%zu,\"system\":%s,\"dropped\":%" PRIu64 "},",
+		anomaly_nactive, anomaly_system_active() ? "true" : "false", anomaly_dropped);
+	return ret ? -1 : 0;
+}
+
+/*
+ *  anomaly_cleanup()
+ *	free detector state
+ */
+void anomaly_cleanup(void)
+{
+	if (anomaly_log_fd >= 0)
+		(void)close(anomaly_log_fd);
+	anomaly_log_fd = -1;
+	strbuf_free(&anomaly_log_buf);
+	free(anomaly_table);
+	anomaly_table = NULL;
+	anomaly_size = 0;
+	anomaly_used = 0;
+	anomaly_on = false;
+}
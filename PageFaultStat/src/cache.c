@@ -7,6 +7,12 @@
 
 #include "faultstat.h"
 
+#define UNAME_SPARES		(32)
+
+static proc_info_t *proc_info_cache;	/* free list of proc_info_t */
+static uint64_t proc_cache_gen;		/* current scan generation */
+static uname_cache_t *uname_spare;	/* spare uname cache items */
+
 /*
  *  fault_cache_alloc()
  *	allocate a fault_info_t, first try the cache of
@@ -25,7 +31,7 @@ fault_info_t *fault_cache_alloc(void)
 		return fault_info;
 	}
 
-	if ((fault_info = calloc(1, sizeof(*fault_info))) == NULL) {
+	if ((fault_info = heap_calloc(1, sizeof(*fault_info))) == NULL) {
 		out_of_memory("allocating page fault tracking information");
 		return NULL;
 	}
@@ -39,6 +45,10 @@ fault_info_t *fault_cache_alloc(void)
  */
 inline void fault_cache_free(fault_info_t * const fault_info)
 {
+	if (fault_info->threads) {
+		fault_cache_free_list(fault_info->threads);
+		fault_info->threads = NULL;
+	}
 	fault_info->next = fault_info_cache;
 	fault_info_cache = fault_info;
 }
@@ -90,6 +100,57 @@ void fault_cache_cleanup(void)
 	}
 }
 
+/*
+ *  proc_cache_alloc()
+ *	allocate a proc_info_t, first try the free list
+ *	of unused proc_info's, if none available fall back
+ *	to calloc
+ */
+static proc_info_t *proc_cache_alloc(void)
+{
+	proc_info_t *p;
+
+	if (proc_info_cache) {
+		p = proc_info_cache;
+		proc_info_cache = proc_info_cache->next;
+
+		(void)memset(p, 0, sizeof(*p));
+		return p;
+	}
+	return heap_calloc(1, sizeof(*p));
+}
+
+/*
+ *  proc_cache_free()
+ *	free a proc_info_t and its command line
+ *	by adding it to the proc_info_cache free list
+ */
+static void proc_cache_free(proc_info_t * const p)
+{
+	str_cache_free(p->cmdline);
+	p->cmdline = NULL;
+	p->next = proc_info_cache;
+	proc_info_cache = p;
+}
+
+/*
+ *  proc_cache_prealloc()
+ *	create some spare proc_info_t items on the free list
+ */
+void proc_cache_prealloc(const size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		proc_info_t *p;
+
+		if ((p = calloc(1, sizeof(*p))) == NULL)
+			break;
+		p->next = proc_info_cache;
+		proc_info_cache = p;
+	}
+}
+
 /*
  *  proc_cache_hash_pid()
  *	hash a process id
@@ -111,19 +172,19 @@ static proc_info_t *proc_cache_add_at_hash_index(
 {
 	proc_info_t *p;
 
-	if ((p = calloc(1, sizeof(*p))) == NULL) {
+	if ((p = proc_cache_alloc()) == NULL) {
 		out_of_memory("allocating proc cache");
 		return NULL;
 	}
 
 	p->pid = pid;
+	p->gen = proc_cache_gen;
 	p->cmdline = get_pid_cmdline(pid);
 	if (p->cmdline == NULL)
 		p->kernel_thread = true;
 
 	if ((p->cmdline == NULL) || (opt_flags & OPT_CMD_COMM)) {
-		if (p->cmdline)
-			free(p->cmdline);
+		str_cache_free(p->cmdline);
 		p->cmdline = get_pid_comm(pid);
 	}
 	p->next = proc_cache_hash[h];
@@ -142,9 +203,12 @@ proc_info_t *proc_cache_find_by_pid(const pid_t pid)
 	const unsigned long h = proc_cache_hash_pid(pid);
 	proc_info_t *p;
 
-	for (p = proc_cache_hash[h]; p; p = p->next)
-		if (p->pid == pid)
+	for (p = proc_cache_hash[h]; p; p = p->next) {
+		if (p->pid == pid) {
+			p->gen = proc_cache_gen;
 			return p;
+		}
+	}
 
 	/*
 	 *  Not found, so add it and return it if it is a legitimate
@@ -156,6 +220,44 @@ proc_info_t *proc_cache_find_by_pid(const pid_t pid)
 	return proc_cache_add_at_hash_index(h, pid);
 }
 
+/*
+ *  proc_cache_new_gen()
+ *	start a new scan generation, processes not looked
+ *	up during the scan are dropped by proc_cache_sweep()
+ */
+void proc_cache_new_gen(void)
+{
+	proc_cache_gen++;
+}
+
+/*
+ *  proc_cache_sweep()
+ *	drop cached processes that were not seen in the
+ *	latest scan so the cache does not grow without
+ *	bound and recycled pids get fresh information.
+ *	Must only be called once no fault_info_t from an
+ *	older scan refers to the cache any more
+ */
+void proc_cache_sweep(void)
+{
+	size_t i;
+
+	for (i = 0; i < PROC_HASH_TABLE_SIZE; i++) {
+		proc_info_t **l = &proc_cache_hash[i];
+
+		while (*l) {
+			proc_info_t *p = *l;
+
+			if (p->gen == proc_cache_gen) {
+				l = &p->next;
+				continue;
+			}
+			*l = p->next;
+			proc_cache_free(p);
+		}
+	}
+}
+
 /*
  *  proc_cache_cleanup()
  *	free up proc cache hash table
@@ -170,11 +272,19 @@ void proc_cache_cleanup(void)
 		while (p) {
 			proc_info_t *next = p->next;
 
-			free(p->cmdline);
+			str_cache_free(p->cmdline);
 			free(p);
 
 			p = next;
 		}
+		proc_cache_hash[i] = NULL;
+	}
+
+	while (proc_info_cache) {
+		proc_info_t *next = proc_info_cache->next;
+
+		free(proc_info_cache);
+		proc_info_cache = next;
 	}
 }
 
@@ -204,18 +314,27 @@ uname_cache_t *uname_cache_find(const uid_t uid)
 			return uname;
 	}
 
-	if ((uname = calloc(1, sizeof(*uname))) == NULL) {
+	if (uname_spare) {
+		uname = uname_spare;
+		uname_spare = uname_spare->next;
+	} else if ((uname = heap_calloc(1, sizeof(*uname))) == NULL) {
 		out_of_memory("allocating pwd cache item");
 		return NULL;
 	}
 
-	if ((pw = getpwuid(uid)) == NULL) {
+	/*
+	 *  getpwuid() may allocate and do I/O through NSS, so
+	 *  once a hardened run has warmed up unknown uids are
+	 *  just named by number
+	 */
+	if (((opt_flags & OPT_HARDEN) && harden_is_warmed_up()) ||
+	    ((pw = getpwuid(uid)) == NULL)) {
 		char buf[16];
 
 		(void)snprintf(buf, sizeof(buf), "%i", uid);
-		uname->name = strdup(buf);
+		uname->name = str_cache_dup(buf);
 	} else {
-		uname->name = strdup(pw->pw_name);
+		uname->name = str_cache_dup(pw->pw_name);
 	}
 
 	if (uname->name == NULL) {
@@ -231,6 +350,31 @@ uname_cache_t *uname_cache_find(const uid_t uid)
 	return uname;
 }
 
+/*
+ *  uname_cache_prealloc()
+ *	load all known users into the uname cache and
+ *	keep some spare items for users that turn up later
+ */
+void uname_cache_prealloc(void)
+{
+	struct passwd *pw;
+	size_t i;
+
+	setpwent();
+	while ((pw = getpwent()) != NULL)
+		(void)uname_cache_find(pw->pw_uid);
+	endpwent();
+
+	for (i = 0; i < UNAME_SPARES; i++) {
+		uname_cache_t *uname;
+
+		if ((uname = calloc(1, sizeof(*uname))) == NULL)
+			break;
+		uname->next = uname_spare;
+		uname_spare = uname;
+	}
+}
+
 /*
  *  uname_cache_cleanup()
  *	free cache
@@ -245,9 +389,17 @@ void uname_cache_cleanup(void)
 		while (u) {
 			uname_cache_t *next = u->next;
 
-			free(u->name);
+			str_cache_free(u->name);
 			free(u);
 			u = next;
 		}
+		uname_cache[i] = NULL;
+	}
+
+	while (uname_spare) {
+		uname_cache_t *next = uname_spare->next;
+
+		free(uname_spare);
+		uname_spare = next;
 	}
 }
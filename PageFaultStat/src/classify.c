@@ -0,0 +1,279 @@
+/*
+ * Page fault classifier for PageFaultStat
+ *
+ * Gives every process that faulted in a sample a likely reason and
+ * a confidence, from data the sampler already holds: the fault, swap
+ * and rss deltas and the start time from the stat read, plus the
+ * system memory and iowait state read once per tick from
+ * /proc/meminfo and /proc/stat. Rules are checked in order and the
+ * first that matches wins, each process costs O(1) per tick.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+#include <time.h>
+
+#define CLASSIFY_SWAP_PCT	(50.0)	/* swap in use that counts as pressure */
+#define CLASSIFY_SWAP_SEVERE	(70.0)	/* swap in use that is pressure on its own */
+#define CLASSIFY_SWAP_LOW	(30.0)	/* swap in use that is no pressure */
+#define CLASSIFY_SWAP_KB	(1024)	/* process swap that counts, kB */
+#define CLASSIFY_MEM_PCT	(85.0)	/* memory in use that counts as pressure */
+#define CLASSIFY_IOWAIT_PCT	(20.0)	/* iowait that counts as thrashing */
+#define CLASSIFY_THRASH_RATE	(100.0)	/* major faults per second when thrashing */
+#define CLASSIFY_WARMUP_SECS	(60.0)	/* age of a process still warming up */
+#define CLASSIFY_WARMUP_RATE	(1000.0)	/* major faults per second, warm-up less sure */
+#define CLASSIFY_GROWTH_RATE	(1024.0)	/* rss growth, kB per second */
+#define CLASSIFY_GROWTH_MINOR	(256.0)	/* minor faults per second backing growth */
+
+static const char * const classify_reasons[REASON_MAX] = {
+	"none",
+	"normal",
+	"swap_pressure",
+	"memory_thrashing",
+	"warm_up",
+	"memory_growth",
+	"memory_pressure",
+	"file_backed",
+};
+
+static const char * const classify_confidences[] = {
+	"Low",
+	"Medium",
+	"High",
+};
+
+static bool classify_on;		/* classifier running */
+static double classify_hz;		/* clock ticks per second */
+static double classify_uptime;		/* seconds since boot at this tick */
+static double classify_last;		/* time of the previous tick */
+static uint64_t classify_cpu_total;	/* /proc/stat cpu time at the last tick */
+static uint64_t classify_cpu_iowait;
+static classify_system_t classify_sys;	/* system state at this tick */
+
+/*
+ *  classify_read_cpu()
+ *	total and iowait cpu time from /proc/stat, false if unreadable
+ */
+static bool classify_read_cpu(uint64_t * const total, uint64_t * const iowait)
+{
+	/* The cpu line is first, no need to read the whole file */
+	char buffer[512];
+	char path[PATH_MAX];
+	uint64_t val[8];
+	int i;
+
+	(void)snprintf(path, sizeof(path), "%s/stat", proc_root);
+	if (read_file(path, buffer, sizeof(buffer)) <= 0)
+		return false;
+	if (sscanf(buffer, "cpu %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+		   " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+		   &val[0], &val[1], &val[2], &val[3],
+		   &val[4], &val[5], &val[6], &val[7]) != 8)
+		return false;
+
+	/* user nice system idle iowait irq softirq steal */
+	*total = 0;
+	for (i = 0; i < 8; i++)
+		*total += val[i];
+	*iowait = val[4];
+	return true;
+}
+
+/*
+ *  classify_read_meminfo()
+ *	memory and swap sizes from /proc/meminfo
+ */
+static void classify_read_meminfo(classify_system_t * const sys)
+{
+	char buffer[4096];
+	char path[PATH_MAX];
+	const char *ptr;
+	int got_fields = 0;
+
+	(void)snprintf(path, sizeof(path), "%s/meminfo", proc_root);
+	if (read_file(path, buffer, sizeof(buffer)) <= 0)
+		return;
+
+	for (ptr = buffer; ptr && *ptr; ptr = strchr(ptr, '\n'), ptr = ptr ? ptr + 1 : NULL) {
+		int64_t *field = NULL;
+
+		if (!strncmp(ptr, "MemTotal:", 9))
+			field = &sys->mem_total;
+		else if (!strncmp(ptr, "MemAvailable:", 13))
+			field = &sys->mem_available;
+		else if (!strncmp(ptr, "SwapTotal:", 10))
+			field = &sys->swap_total;
+		else if (!strncmp(ptr, "SwapFree:", 9))
+			field = &sys->swap_free;
+		if (!field)
+			continue;
+		if (sscanf(strchr(ptr, ':') + 1, "%" SCNd64, field) == 1)
+			got_fields++;
+		if (got_fields == 4)
+			break;
+	}
+
+	sys->mem_pressure = (sys->mem_total > 0) ?
+		100.0 * (double)(sys->mem_total - sys->mem_available) / (double)sys->mem_total : 0.0;
+	sys->swap_pressure = (sys->swap_total > 0) ?
+		100.0 * (double)(sys->swap_total - sys->swap_free) / (double)sys->swap_total : 0.0;
+}
+
+/*
+ *  classify_read_uptime()
+ *	seconds since boot, in the same clock as process start times
+ */
+static double classify_read_uptime(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_BOOTTIME, &ts) < 0)
+		return 0.0;
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+/*
+ *  classify_init()
+ *	start classifying, replays have no system state to go on
+ */
+int classify_init(const double now)
+{
+	const long hz = sysconf(_SC_CLK_TCK);
+
+	if (opt_flags & OPT_REPLAY)
+		return 0;
+	classify_hz = (hz > 0) ? (double)hz : 100.0;
+	(void)classify_read_cpu(&classify_cpu_total, &classify_cpu_iowait);
+	classify_last = now;
+	classify_on = true;
+	return 0;
+}
+
+/*
+ *  classify_enabled()
+ *	true if the classifier is running
+ */
+bool classify_enabled(void)
+{
+	return classify_on;
+}
+
+/*
+ *  classify_age()
+ *	seconds a process has been running
+ */
+double classify_age(const fault_info_t * const fault_info)
+{
+	const double age = classify_uptime - ((double)fault_info->start_time / classify_hz);
+
+	return (age > 0.0) ? age : 0.0;
+}
+
+/*
+ *  classify_process()
+ *	pick the reason for a process' faults this tick
+ */
+static void classify_process(fault_info_t * const fault_info, const double interval)
+{
+	const classify_system_t * const sys = &classify_sys;
+	const double maj_rate = (double)fault_info->d_maj_fault / interval;
+	const double min_rate = (double)fault_info->d_min_fault / interval;
+	const double rss_rate = (double)fault_info->d_rss / interval;
+	const bool swapped = fault_info->vm_swap > CLASSIFY_SWAP_KB;
+
+	if ((fault_info->d_maj_fault <= 0) && (fault_info->d_min_fault <= 0)) {
+		fault_info->reason = REASON_NONE;
+		fault_info->confidence = CONFIDENCE_LOW;
+		return;
+	}
+
+	if ((sys->swap_pressure > CLASSIFY_SWAP_PCT) && swapped) {
+		fault_info->reason = REASON_SWAP_PRESSURE;
+		fault_info->confidence = CONFIDENCE_HIGH;
+	} else if ((sys->swap_pressure > CLASSIFY_SWAP_SEVERE) && (maj_rate > 0.0)) {
+		fault_info->reason = REASON_SWAP_PRESSURE;
+		fault_info->confidence = CONFIDENCE_MEDIUM;
+	} else if ((sys->io_wait > CLASSIFY_IOWAIT_PCT) && (maj_rate >= CLASSIFY_THRASH_RATE)) {
+		fault_info->reason = REASON_MEMORY_THRASHING;
+		fault_info->confidence = anomaly_active(fault_info->pid) ?
+			CONFIDENCE_HIGH : CONFIDENCE_MEDIUM;
+	} else if (classify_age(fault_info) < CLASSIFY_WARMUP_SECS) {
+		fault_info->reason = REASON_WARM_UP;
+		fault_info->confidence = (maj_rate >= CLASSIFY_WARMUP_RATE) ?
+			CONFIDENCE_MEDIUM : CONFIDENCE_HIGH;
+	} else if (rss_rate >= CLASSIFY_GROWTH_RATE) {
+		fault_info->reason = REASON_MEMORY_GROWTH;
+		fault_info->confidence = (min_rate >= CLASSIFY_GROWTH_MINOR) ?
+			CONFIDENCE_HIGH : CONFIDENCE_MEDIUM;
+	} else if ((sys->mem_pressure > CLASSIFY_MEM_PCT) && (maj_rate > 0.0)) {
+		fault_info->reason = REASON_MEMORY_PRESSURE;
+		fault_info->confidence = CONFIDENCE_HIGH;
+	} else if ((maj_rate > 0.0) && (sys->swap_pressure < CLASSIFY_SWAP_LOW) && !swapped) {
+		fault_info->reason = REASON_FILE_BACKED;
+		fault_info->confidence = CONFIDENCE_MEDIUM;
+	} else {
+		fault_info->reason = REASON_NORMAL;
+		fault_info->confidence = CONFIDENCE_MEDIUM;
+	}
+}
+
+/*
+ *  classify_update()
+ *	refresh the system state and classify the processes of
+ *	this tick, fault_deltas() has to have been run on the sample
+ */
+void classify_update(fault_info_t * const fault_info_new, const double now)
+{
+	double interval = now - classify_last;
+	uint64_t total, iowait;
+	fault_info_t *fault_info;
+
+	if (!classify_on)
+		return;
+	if (interval <= 0.0)
+		interval = 1.0;
+	classify_last = now;
+
+	classify_read_meminfo(&classify_sys);
+	if (classify_read_cpu(&total, &iowait)) {
+		classify_sys.io_wait = ((total > classify_cpu_total) && (iowait >= classify_cpu_iowait)) ?
+			100.0 * (double)(iowait - classify_cpu_iowait) /
+			(double)(total - classify_cpu_total) : 0.0;
+		classify_cpu_total = total;
+		classify_cpu_iowait = iowait;
+	}
+	classify_uptime = classify_read_uptime();
+
+	for (fault_info = fault_info_new; fault_info; fault_info = fault_info->next)
+		classify_process(fault_info, interval);
+}
+
+/*
+ *  classify_reason_name()
+ *	JSON name of a reason
+ */
+const char *classify_reason_name(const int reason)
+{
+	return ((reason >= 0) && (reason < REASON_MAX)) ? classify_reasons[reason] : "unknown";
+}
+
+/*
+ *  classify_confidence_name()
+ *	JSON name of a confidence
+ */
+const char *classify_confidence_name(const int confidence)
+{
+	return ((confidence >= 0) && ((size_t)confidence < SIZEOF_ARRAY(classify_confidences))) ?
+		classify_confidences[confidence] : "Low";
+}
+
+/*
+ *  classify_get_system()
+ *	system state of the last tick
+ */
+void classify_get_system(classify_system_t * const sys)
+{
+	*sys = classify_sys;
+}
@@ -9,14 +9,18 @@
 
 /* Forward declarations for static arrays */
 static const attr_vals_t attr_vals[] = {
-	/*  Major  Minor  dMajor dMinor Swap */
-	{ { true,  true,  false, false, false } }, /* SORT_MAJOR_MINOR */
-	{ { true,  false, false, false, false } }, /* SORT_MAJOR */
-	{ { false, true,  false, false, false } }, /* SORT_MINOR */
-	{ { false, false, true,  true,  false } }, /* SORT_D_MAJOR_MINOR */
-	{ { false, false, true,  false, false } }, /* SORT_D_MAJOR */
-	{ { false, false, false, true,  false } }, /* SORT_D_MINOR */
-	{ { false, false, false, false, true  } }, /* SORT_SWAP */
+	/*  Major  Minor  dMajor dMinor Swap   Pct */
+	{ { true,  true,  false, false, false, false } }, /* SORT_MAJOR_MINOR */
+	{ { true,  false, false, false, false, false } }, /* SORT_MAJOR */
+	{ { false, true,  false, false, false, false } }, /* SORT_MINOR */
+	{ { false, false, true,  true,  false, false } }, /* SORT_D_MAJOR_MINOR */
+	{ { false, false, true,  false, false, false } }, /* SORT_D_MAJOR */
+	{ { false, false, false, true,  false, false } }, /* SORT_D_MINOR */
+	{ { false, false, false, false, true,  false } }, /* SORT_SWAP */
+	{ { false, false, false, false, false, true  } }, /* SORT_P50 */
+	{ { false, false, false, false, false, true  } }, /* SORT_P90 */
+	{ { false, false, false, false, false, true  } }, /* SORT_P99 */
+	{ { false, false, false, false, false, true  } }, /* SORT_PMAX */
 };
 
 /*
@@ -0,0 +1,874 @@
+/*
+ * Fault address sampling for PageFaultStat (-F pid)
+ *
+ * /proc only has counts. With -F the major and minor page fault
+ * software events of each thread of one process are sampled with
+ * perf_event_open(2), a sample carrying the faulting address and
+ * the instruction that faulted, and standing for a period of faults.
+ * Addresses are attributed to the mappings of /proc/$PID/maps, the
+ * VMAs of one file counted together, so a sample shows how much of
+ * the faulting is heap, stack, anonymous memory or which files.
+ *
+ * Both events of a thread write to one ring buffer that is read in
+ * place each tick. The maps index, the VMAs sorted by address, is
+ * overlaid with the VMAs of the ring's mmap records, newest first, so
+ * a mapping that came and went within a tick is still found. The
+ * maps are read again to fold those in once a tick, and when an
+ * address is in neither, at most FAULTMAP_REFRESH_MAX times a tick.
+ *
+ * Each tick the exact fault counts of the events set the sample
+ * period of the next, the weight of each of its samples, so the
+ * samples of all threads stay near the --fault-rate budget however
+ * fast the process faults. A period falls at most
+ * FAULTMAP_PERIOD_DECAY times a tick, a quiet tick does not leave
+ * the next burst sampled at every fault, and the kernel throttles
+ * events beyond perf_event_max_sample_rate.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define FAULTMAP_RATE_DEFAULT	(1000)	/* samples/s, all threads */
+#define FAULTMAP_RATE_MAX	(100000)
+#define FAULTMAP_MAX_THREADS	(64)
+#define FAULTMAP_RING_PAGES	(16)	/* data pages, a power of 2 */
+#define FAULTMAP_SAMPLE_SIZE	(32)	/* header, id, ip, addr */
+#define FAULTMAP_MAX_MAPPINGS	(4096)
+#define FAULTMAP_HASH_SIZE	(509)
+#define FAULTMAP_RECENT		(256)	/* VMAs of mmap records kept */
+#define FAULTMAP_REFRESH_MAX	(2)	/* maps reads a tick */
+#define FAULTMAP_PERIOD_INITIAL	(100)	/* faults a sample, first tick */
+#define FAULTMAP_PERIOD_DECAY	(4)
+
+/* A VMA of the maps index */
+typedef struct {
+	uint64_t	start;		/* first address */
+	uint64_t	end;		/* address after the last */
+	uint64_t	pgoff;		/* file offset of start */
+	uint32_t	mapping;	/* index in faultmap_maps */
+} faultmap_vma_t;
+
+/* The events of a sampled thread */
+typedef struct {
+	struct perf_event_mmap_page *ring;	/* shared by both events */
+	uint64_t	id_maj;		/* sample id of the major fault event */
+	uint64_t	count_maj;	/* major faults at the last tick */
+	uint64_t	count_min;	/* minor faults at the last tick */
+	pid_t		tid;		/* thread id */
+	int		fd_maj;		/* major fault event */
+	int		fd_min;		/* minor fault and mmap event, owns the ring */
+	bool		seen;		/* in the task directory this tick */
+} faultmap_thread_t;
+
+static pid_t faultmap_pid;
+static uint32_t faultmap_rate = FAULTMAP_RATE_DEFAULT;
+static uint64_t faultmap_period_maj;	/* faults a sample */
+static uint64_t faultmap_period_min;
+static uint64_t faultmap_last_period_maj;	/* of the last tick's samples */
+static uint64_t faultmap_last_period_min;
+static bool faultmap_user_only;		/* exclude_kernel, perf_event_paranoid >= 2 */
+static bool faultmap_exited;
+static int faultmap_errno;		/* why the last thread was not opened */
+
+static faultmap_thread_t faultmap_threads[FAULTMAP_MAX_THREADS];
+static size_t faultmap_nthreads;
+static uint32_t faultmap_skipped;
+static size_t faultmap_page_size;
+static size_t faultmap_ring_size;	/* bytes of ring data */
+
+static faultmap_vma_t *faultmap_vmas;
+static size_t faultmap_nvmas;
+static size_t faultmap_vmas_alloc;
+static faultmap_vma_t faultmap_recent[FAULTMAP_RECENT];	/* from mmap records */
+static size_t faultmap_nrecent;
+static size_t faultmap_recent_next;	/* slot of the next, oldest when full */
+static unsigned int faultmap_refreshes;	/* maps reads this tick */
+
+static faultmap_mapping_t *faultmap_maps;
+static uint32_t faultmap_nmaps;
+static uint32_t faultmap_maps_alloc;
+static uint32_t faultmap_hash[FAULTMAP_HASH_SIZE];	/* mapping + 1, 0 if none */
+static const faultmap_mapping_t **faultmap_sorted;
+static size_t faultmap_nsorted;
+static size_t faultmap_sorted_alloc;
+
+static uint64_t faultmap_tick;
+static double faultmap_time;		/* of the last tick */
+static uint64_t faultmap_d_maj_fault;	/* counted in the last tick */
+static uint64_t faultmap_d_min_fault;
+static uint64_t faultmap_samples;
+static uint64_t faultmap_lost;
+static uint64_t faultmap_throttled;
+
+/*
+ *  faultmap_set_pid()
+ *	parse -F, the process to sample
+ */
+int faultmap_set_pid(const char *arg)
+{
+	char *end;
+	long pid;
+
+	errno = 0;
+	pid = strtol(arg, &end, 10);
+	if (errno || *end || (pid < 1) || (pid > INT_MAX))
+		return -1;
+	faultmap_pid = (pid_t)pid;
+	opt_flags |= OPT_FAULT_MAP;
+	return 0;
+}
+
+/*
+ *  faultmap_set_rate()
+ *	parse --fault-rate, samples per second for the process
+ */
+int faultmap_set_rate(const char *arg)
+{
+	char *end;
+	long rate;
+
+	errno = 0;
+	rate = strtol(arg, &end, 10);
+	if (errno || *end || (rate < 2) || (rate > FAULTMAP_RATE_MAX))
+		return -1;
+	faultmap_rate = (uint32_t)rate;
+	return 0;
+}
+
+/*
+ *  faultmap_enabled()
+ *	true if -F is in use
+ */
+bool faultmap_enabled(void)
+{
+	return (opt_flags & OPT_FAULT_MAP) != 0;
+}
+
+/*
+ *  faultmap_hash_name()
+ *	hash a mapping name
+ */
+static unsigned long faultmap_hash_name(const char *name)
+{
+	unsigned long h = 5381;
+
+	while (*name)
+		h = (h * 33) ^ (unsigned char)*name++;
+	return h % FAULTMAP_HASH_SIZE;
+}
+
+/*
+ *  faultmap_mapping()
+ *	index of a mapping name, added if new, the
+ *	names past the cap are counted as [other]
+ */
+static int faultmap_mapping(const char *name, uint32_t * const mapping)
+{
+	const unsigned long h = faultmap_hash_name(name);
+	faultmap_mapping_t *m;
+	uint32_t i;
+
+	for (i = faultmap_hash[h]; i; i = faultmap_maps[i - 1].next) {
+		if (!strcmp(faultmap_maps[i - 1].name, name)) {
+			*mapping = i - 1;
+			return 0;
+		}
+	}
+	if ((faultmap_nmaps >= FAULTMAP_MAX_MAPPINGS) && strcmp(name, "[other]"))
+		return faultmap_mapping("[other]", mapping);
+
+	if (faultmap_nmaps == faultmap_maps_alloc) {
+		const uint32_t alloc = faultmap_maps_alloc ? faultmap_maps_alloc * 2 : 64;
+		faultmap_mapping_t *tmp = heap_realloc(faultmap_maps, alloc * sizeof(*tmp));
+
+		if (!tmp) {
+			out_of_memory("allocating fault mappings");
+			return -1;
+		}
+		faultmap_maps = tmp;
+		faultmap_maps_alloc = alloc;
+	}
+	m = &faultmap_maps[faultmap_nmaps];
+	(void)memset(m, 0, sizeof(*m));
+	if ((m->name = heap_strdup(name)) == NULL) {
+		out_of_memory("allocating fault mapping name");
+		return -1;
+	}
+	m->next = faultmap_hash[h];
+	faultmap_hash[h] = ++faultmap_nmaps;
+	*mapping = faultmap_nmaps - 1;
+
+	return 0;
+}
+
+/*
+ *  faultmap_name()
+ *	name of a mapping
+ */
+const char *faultmap_name(const uint32_t mapping)
+{
+	return (mapping < faultmap_nmaps) ? faultmap_maps[mapping].name : "";
+}
+
+/*
+ *  faultmap_vma_add()
+ *	add a line of /proc/$PID/maps to the index,
+ *	start-end perms offset dev inode [name]
+ */
+static int faultmap_vma_add(const char *line, size_t * const n)
+{
+	faultmap_vma_t *vma;
+	uint64_t start, end, pgoff = 0;
+	const char *ptr;
+	char *next;
+	int field;
+
+	start = strtoull(line, &next, 16);
+	if (*next != '-')
+		return 0;
+	end = strtoull(next + 1, &next, 16);
+	ptr = next;
+	for (field = 0; field < 4; field++) {
+		while (*ptr == ' ')
+			ptr++;
+		if (field == 1)
+			pgoff = strtoull(ptr, NULL, 16);
+		while (*ptr && (*ptr != ' '))
+			ptr++;
+	}
+	while (*ptr == ' ')
+		ptr++;
+
+	if (*n == faultmap_vmas_alloc) {
+		const size_t alloc = faultmap_vmas_alloc ? faultmap_vmas_alloc * 2 : 256;
+		faultmap_vma_t *tmp = heap_realloc(faultmap_vmas, alloc * sizeof(*tmp));
+
+		if (!tmp) {
+			out_of_memory("allocating maps index");
+			return -1;
+		}
+		faultmap_vmas = tmp;
+		faultmap_vmas_alloc = alloc;
+	}
+	vma = &faultmap_vmas[*n];
+	vma->start = start;
+	vma->end = end;
+	vma->pgoff = pgoff;
+	if (faultmap_mapping(*ptr ? ptr : "[anon]", &vma->mapping) < 0)
+		return -1;
+	(*n)++;
+
+	return 0;
+}
+
+/*
+ *  faultmap_refresh()
+ *	read the maps index again, -1 if it could not
+ *	be or has been read too often this tick
+ */
+static int faultmap_refresh(void)
+{
+	static char buf[65536];
+	char path[PATH_MAX];
+	size_t len = 0, n = 0;
+	ssize_t got;
+	int fd, ret = 0;
+
+	if (faultmap_refreshes >= FAULTMAP_REFRESH_MAX)
+		return -1;
+	faultmap_refreshes++;
+
+	(void)snprintf(path, sizeof(path), "%s/%i/maps", proc_root, faultmap_pid);
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return -1;
+	while ((got = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) {
+		char *line = buf, *eol;
+
+		len += (size_t)got;
+		buf[len] = '\0';
+		while ((eol = strchr(line, '\n')) != NULL) {
+			*eol = '\0';
+			if (faultmap_vma_add(line, &n) < 0) {
+				ret = -1;
+				goto out;
+			}
+			line = eol + 1;
+		}
+		len -= (size_t)(line - buf);
+		(void)memmove(buf, line, len);
+		/* No line is this long, skip it */
+		if (len == sizeof(buf) - 1)
+			len = 0;
+	}
+out:
+	(void)close(fd);
+	faultmap_nvmas = n;
+	faultmap_nrecent = 0;
+
+	return ret;
+}
+
+/*
+ *  faultmap_vma_find()
+ *	VMA holding an address, the newest mmap
+ *	record's first, NULL if none
+ */
+static const faultmap_vma_t *faultmap_vma_find(const uint64_t addr)
+{
+	size_t i, lo = 0, hi = faultmap_nvmas;
+
+	for (i = 0; i < faultmap_nrecent; i++) {
+		const faultmap_vma_t * const vma =
+			&faultmap_recent[(faultmap_recent_next + FAULTMAP_RECENT - 1 - i) % FAULTMAP_RECENT];
+
+		if ((addr >= vma->start) && (addr < vma->end))
+			return vma;
+	}
+
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		const faultmap_vma_t * const vma = &faultmap_vmas[mid];
+
+		if (addr < vma->start)
+			hi = mid;
+		else if (addr >= vma->end)
+			lo = mid + 1;
+		else
+			return vma;
+	}
+	return NULL;
+}
+
+/*
+ *  faultmap_sample()
+ *	attribute a sample to its mapping
+ */
+static void faultmap_sample(const bool major, const uint64_t ip, const uint64_t addr)
+{
+	const faultmap_vma_t *vma, *ip_vma;
+	faultmap_mapping_t *m;
+	uint32_t mapping;
+
+	faultmap_samples++;
+	vma = faultmap_vma_find(addr);
+	if (!vma && (faultmap_refresh() == 0))
+		vma = faultmap_vma_find(addr);
+	if (vma)
+		mapping = vma->mapping;
+	else if (faultmap_mapping("[unmapped]", &mapping) < 0)
+		return;
+	ip_vma = faultmap_vma_find(ip);
+
+	m = &faultmap_maps[mapping];
+	if (m->tick != faultmap_tick) {
+		m->d_maj_fault = 0;
+		m->d_min_fault = 0;
+		m->tick = faultmap_tick;
+	}
+	/* Periods change between ticks, after the rings are drained */
+	if (major) {
+		m->maj_fault += faultmap_period_maj;
+		m->d_maj_fault += faultmap_period_maj;
+	} else {
+		m->min_fault += faultmap_period_min;
+		m->d_min_fault += faultmap_period_min;
+	}
+	if (ip_vma) {
+		m->ip_mapping = ip_vma->mapping + 1;
+		m->ip_offset = ip - ip_vma->start + ip_vma->pgoff;
+	} else {
+		m->ip_mapping = 0;
+		m->ip_offset = ip;
+	}
+}
+
+/*
+ *  faultmap_recent_add()
+ *	overlay the VMA of an mmap record,
+ *	pid, tid, addr, len, pgoff, filename
+ */
+static void faultmap_recent_add(const struct perf_event_header * const hdr)
+{
+	const uint64_t * const val = (const uint64_t *)(hdr + 1);
+	const char *name = (const char *)(val + 4);
+	const size_t max = hdr->size - sizeof(*hdr) - 4 * sizeof(uint64_t);
+	faultmap_vma_t * const vma = &faultmap_recent[faultmap_recent_next];
+
+	if ((hdr->size < sizeof(*hdr) + 4 * sizeof(uint64_t)) || !memchr(name, '\0', max))
+		return;
+	if (!strcmp(name, "//anon"))
+		name = "[anon]";
+	if (faultmap_mapping(name, &vma->mapping) < 0)
+		return;
+	vma->start = val[1];
+	vma->end = val[1] + val[2];
+	vma->pgoff = val[3];
+	faultmap_recent_next = (faultmap_recent_next + 1) % FAULTMAP_RECENT;
+	if (faultmap_nrecent < FAULTMAP_RECENT)
+		faultmap_nrecent++;
+}
+
+/*
+ *  faultmap_record()
+ *	handle a record of a thread's ring
+ */
+static void faultmap_record(const faultmap_thread_t * const thread, const struct perf_event_header * const hdr)
+{
+	/* id, ip, addr as asked for by sample_type */
+	const uint64_t * const val = (const uint64_t *)(hdr + 1);
+
+	switch (hdr->type) {
+	case PERF_RECORD_SAMPLE:
+		if (hdr->size >= sizeof(*hdr) + 3 * sizeof(uint64_t))
+			faultmap_sample(val[0] == thread->id_maj, val[1], val[2]);
+		break;
+	case PERF_RECORD_MMAP:
+		faultmap_recent_add(hdr);
+		break;
+	case PERF_RECORD_LOST:
+		faultmap_lost += val[1];
+		break;
+	case PERF_RECORD_THROTTLE:
+		faultmap_throttled++;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ *  faultmap_drain()
+ *	read a thread's ring in place, only a record
+ *	wrapping around the end of the ring is copied
+ */
+static void faultmap_drain(const faultmap_thread_t * const thread)
+{
+	static uint64_t wrapped[8192];	/* records are at most 64 KB */
+	struct perf_event_mmap_page * const page = thread->ring;
+	const char * const data = (const char *)page + faultmap_page_size;
+	const uint64_t head = __atomic_load_n(&page->data_head, __ATOMIC_ACQUIRE);
+	uint64_t tail = page->data_tail;
+
+	while (tail < head) {
+		/* Records are 8 byte aligned, a header never wraps */
+		const size_t off = (size_t)(tail & (faultmap_ring_size - 1));
+		const struct perf_event_header *hdr = (const struct perf_event_header *)(data + off);
+		const size_t size = hdr->size;
+
+		if (size < sizeof(*hdr))
+			break;
+		if (off + size > faultmap_ring_size) {
+			const size_t part = faultmap_ring_size - off;
+
+			(void)memcpy(wrapped, data + off, part);
+			(void)memcpy((char *)wrapped + part, data, size - part);
+			hdr = (const struct perf_event_header *)wrapped;
+		}
+		faultmap_record(thread, hdr);
+		tail += size;
+	}
+	__atomic_store_n(&page->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+/*
+ *  faultmap_event_open()
+ *	open a page fault event of a thread
+ */
+static int faultmap_event_open(const pid_t tid, const uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	(void)memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_SOFTWARE;
+	attr.config = config;
+	/* PERF_SAMPLE_PERIOD would have every software event sampled */
+	attr.sample_type = PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_IP | PERF_SAMPLE_ADDR;
+	attr.sample_period = (config == PERF_COUNT_SW_PAGE_FAULTS_MAJ) ?
+		faultmap_period_maj : faultmap_period_min;
+	attr.exclude_kernel = faultmap_user_only;
+	attr.exclude_hv = 1;
+	/* New mappings, once per thread */
+	attr.mmap = attr.mmap_data = (config == PERF_COUNT_SW_PAGE_FAULTS_MIN);
+
+	return (int)syscall(SYS_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+/*
+ *  faultmap_thread_add()
+ *	open the events and ring of a thread, faults in the
+ *	kernel are left out if perf_event_paranoid wants it
+ */
+static int faultmap_thread_add(const pid_t tid)
+{
+	faultmap_thread_t * const thread = &faultmap_threads[faultmap_nthreads];
+	void *ring;
+
+	thread->fd_min = faultmap_event_open(tid, PERF_COUNT_SW_PAGE_FAULTS_MIN);
+	if ((thread->fd_min < 0) && ((errno == EACCES) || (errno == EPERM)) && !faultmap_user_only) {
+		faultmap_user_only = true;
+		thread->fd_min = faultmap_event_open(tid, PERF_COUNT_SW_PAGE_FAULTS_MIN);
+	}
+	if (thread->fd_min < 0) {
+		faultmap_errno = errno;
+		return -1;
+	}
+	if ((thread->fd_maj = faultmap_event_open(tid, PERF_COUNT_SW_PAGE_FAULTS_MAJ)) < 0) {
+		faultmap_errno = errno;
+		goto err_min;
+	}
+	ring = mmap(NULL, faultmap_page_size + faultmap_ring_size,
+		PROT_READ | PROT_WRITE, MAP_SHARED, thread->fd_min, 0);
+	if (ring == MAP_FAILED) {
+		faultmap_errno = errno;
+		goto err_maj;
+	}
+	if ((ioctl(thread->fd_maj, PERF_EVENT_IOC_SET_OUTPUT, thread->fd_min) < 0) ||
+	    (ioctl(thread->fd_maj, PERF_EVENT_IOC_ID, &thread->id_maj) < 0)) {
+		faultmap_errno = errno;
+		(void)munmap(ring, faultmap_page_size + faultmap_ring_size);
+		goto err_maj;
+	}
+
+	thread->ring = ring;
+	thread->count_maj = 0;
+	thread->count_min = 0;
+	thread->tid = tid;
+	thread->seen = true;
+	faultmap_nthreads++;
+	return 0;
+
+err_maj:
+	(void)close(thread->fd_maj);
+err_min:
+	(void)close(thread->fd_min);
+	return -1;
+}
+
+/*
+ *  faultmap_thread_count()
+ *	add the faults of a thread since the last tick
+ */
+static void faultmap_thread_count(faultmap_thread_t * const thread)
+{
+	uint64_t count;
+
+	if ((read(thread->fd_maj, &count, sizeof(count)) == sizeof(count)) &&
+	    (count >= thread->count_maj)) {
+		faultmap_d_maj_fault += count - thread->count_maj;
+		thread->count_maj = count;
+	}
+	if ((read(thread->fd_min, &count, sizeof(count)) == sizeof(count)) &&
+	    (count >= thread->count_min)) {
+		faultmap_d_min_fault += count - thread->count_min;
+		thread->count_min = count;
+	}
+}
+
+/*
+ *  faultmap_thread_remove()
+ *	drain, count and close the events of a thread
+ */
+static void faultmap_thread_remove(const size_t i)
+{
+	faultmap_thread_t * const thread = &faultmap_threads[i];
+
+	faultmap_drain(thread);
+	faultmap_thread_count(thread);
+	(void)munmap(thread->ring, faultmap_page_size + faultmap_ring_size);
+	(void)close(thread->fd_maj);
+	(void)close(thread->fd_min);
+	*thread = faultmap_threads[--faultmap_nthreads];
+}
+
+/*
+ *  faultmap_period()
+ *	faults a sample so that the last tick's faults
+ *	would have given the event its share of the budget,
+ *	no more samples than half a ring holds
+ */
+static uint64_t faultmap_period(const uint64_t faults, const uint64_t period, const double secs)
+{
+	const double ring = (double)faultmap_ring_size / (2 * FAULTMAP_SAMPLE_SIZE);
+	double want = (double)faultmap_rate / 2.0 * secs;
+	uint64_t next;
+
+	if (want > ring)
+		want = ring;
+	if (want < 1.0)
+		want = 1.0;
+	next = (uint64_t)((double)faults / want);
+	if (next < period / FAULTMAP_PERIOD_DECAY)
+		next = period / FAULTMAP_PERIOD_DECAY;
+	return next ? next : 1;
+}
+
+/*
+ *  faultmap_set_periods()
+ *	sample period of the next tick for all threads
+ */
+static void faultmap_set_periods(const double secs)
+{
+	const uint64_t period_maj = faultmap_period(faultmap_d_maj_fault, faultmap_period_maj, secs);
+	const uint64_t period_min = faultmap_period(faultmap_d_min_fault, faultmap_period_min, secs);
+	size_t i;
+
+	for (i = 0; i < faultmap_nthreads; i++) {
+		if (period_maj != faultmap_period_maj)
+			(void)ioctl(faultmap_threads[i].fd_maj, PERF_EVENT_IOC_PERIOD, &period_maj);
+		if (period_min != faultmap_period_min)
+			(void)ioctl(faultmap_threads[i].fd_min, PERF_EVENT_IOC_PERIOD, &period_min);
+	}
+	faultmap_period_maj = period_maj;
+	faultmap_period_min = period_min;
+}
+
+/*
+ *  faultmap_threads_sync()
+ *	open the events of new threads and close
+ *	those of threads that went away
+ */
+static void faultmap_threads_sync(void)
+{
+	static char dents[16384];
+	char path[PATH_MAX];
+	size_t i;
+	long nread;
+	int fd;
+
+	for (i = 0; i < faultmap_nthreads; i++)
+		faultmap_threads[i].seen = false;
+	faultmap_skipped = 0;
+
+	(void)snprintf(path, sizeof(path), "%s/%i/task", proc_root, faultmap_pid);
+	if ((fd = open(path, O_RDONLY | O_DIRECTORY)) < 0) {
+		faultmap_exited = true;
+	} else {
+		while ((nread = syscall(SYS_getdents64, fd, dents, sizeof(dents))) > 0) {
+			long off;
+
+			for (off = 0; off < nread; ) {
+				const struct linux_dirent64 *entry =
+					(const struct linux_dirent64 *)(dents + off);
+				pid_t tid;
+
+				off += entry->d_reclen;
+				if (!isdigit(entry->d_name[0]))
+					continue;
+				tid = (pid_t)strtoul(entry->d_name, NULL, 10);
+				for (i = 0; i < faultmap_nthreads; i++) {
+					if (faultmap_threads[i].tid == tid)
+						break;
+				}
+				if (i < faultmap_nthreads)
+					faultmap_threads[i].seen = true;
+				else if (faultmap_nthreads == FAULTMAP_MAX_THREADS)
+					faultmap_skipped++;
+				else
+					(void)faultmap_thread_add(tid);
+			}
+		}
+		(void)close(fd);
+	}
+
+	for (i = faultmap_nthreads; i-- > 0; ) {
+		if (!faultmap_threads[i].seen)
+			faultmap_thread_remove(i);
+	}
+}
+
+/*
+ *  faultmap_open()
+ *	read the maps of the -F process and start sampling its threads
+ */
+int faultmap_open(void)
+{
+	if (!faultmap_enabled())
+		return 0;
+
+	faultmap_page_size = (size_t)sysconf(_SC_PAGESIZE);
+	faultmap_ring_size = faultmap_page_size * FAULTMAP_RING_PAGES;
+	faultmap_period_maj = FAULTMAP_PERIOD_INITIAL;
+	faultmap_period_min = FAULTMAP_PERIOD_INITIAL;
+	faultmap_time = gettime_to_double();
+
+	if (faultmap_refresh() < 0) {
+		(void)fprintf(stderr, "Cannot read the mappings of PID %i: %s\n",
+			faultmap_pid, strerror(errno));
+		return -1;
+	}
+	faultmap_refreshes = 0;
+	faultmap_errno = ESRCH;
+	faultmap_threads_sync();
+	if (!faultmap_nthreads) {
+		(void)fprintf(stderr, "Cannot sample the page faults of PID %i: %s%s\n",
+			faultmap_pid, strerror(faultmap_errno),
+			((faultmap_errno == EACCES) || (faultmap_errno == EPERM)) ?
+			" (see /proc/sys/kernel/perf_event_paranoid, or run with CAP_PERFMON)" : "");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ *  faultmap_compare()
+ *	most major, then minor, faults in the sample first
+ */
+static int faultmap_compare(const void *p1, const void *p2)
+{
+	const faultmap_mapping_t * const m1 = *(const faultmap_mapping_t * const *)p1;
+	const faultmap_mapping_t * const m2 = *(const faultmap_mapping_t * const *)p2;
+
+	if (m1->d_maj_fault != m2->d_maj_fault)
+		return (m1->d_maj_fault < m2->d_maj_fault) ? 1 : -1;
+	if (m1->d_min_fault != m2->d_min_fault)
+		return (m1->d_min_fault < m2->d_min_fault) ? 1 : -1;
+	return strcmp(m1->name, m2->name);
+}
+
+/*
+ *  faultmap_update()
+ *	take the samples of the last tick
+ */
+void faultmap_update(void)
+{
+	const double now = gettime_to_double();
+	uint32_t i;
+
+	if (!faultmap_enabled())
+		return;
+	faultmap_tick++;
+	faultmap_d_maj_fault = 0;
+	faultmap_d_min_fault = 0;
+	faultmap_samples = 0;
+	faultmap_lost = 0;
+	faultmap_throttled = 0;
+	faultmap_refreshes = 0;
+
+	for (i = 0; i < faultmap_nthreads; i++) {
+		faultmap_drain(&faultmap_threads[i]);
+		faultmap_thread_count(&faultmap_threads[i]);
+	}
+	if (!faultmap_exited)
+		faultmap_threads_sync();
+	faultmap_last_period_maj = faultmap_period_maj;
+	faultmap_last_period_min = faultmap_period_min;
+	faultmap_set_periods(now - faultmap_time);
+	faultmap_time = now;
+	/* Fold the mmap records into the index */
+	if (faultmap_nrecent && !faultmap_exited)
+		(void)faultmap_refresh();
+
+	/* The rows point into faultmap_maps, that only moves while draining */
+	faultmap_nsorted = 0;
+	if (faultmap_sorted_alloc < faultmap_maps_alloc) {
+		const faultmap_mapping_t **tmp =
+			heap_realloc(faultmap_sorted, faultmap_maps_alloc * sizeof(*tmp));
+
+		if (!tmp) {
+			out_of_memory("allocating fault mapping rows");
+			return;
+		}
+		faultmap_sorted = tmp;
+		faultmap_sorted_alloc = faultmap_maps_alloc;
+	}
+	for (i = 0; i < faultmap_nmaps; i++) {
+		if (faultmap_maps[i].tick == faultmap_tick)
+			faultmap_sorted[faultmap_nsorted++] = &faultmap_maps[i];
+	}
+	qsort(faultmap_sorted, faultmap_nsorted, sizeof(*faultmap_sorted), faultmap_compare);
+}
+
+/*
+ *  faultmap_rows()
+ *	mappings that faulted in the last tick, most
+ *	faults first, and the state of the sampling
+ */
+size_t faultmap_rows(const faultmap_mapping_t * const ** const map_rows, faultmap_stats_t * const stats)
+{
+	stats->pid = faultmap_pid;
+	stats->threads = (uint32_t)faultmap_nthreads;
+	stats->threads_skipped = faultmap_skipped;
+	stats->period_maj = faultmap_last_period_maj;
+	stats->period_min = faultmap_last_period_min;
+	stats->d_maj_fault = faultmap_d_maj_fault;
+	stats->d_min_fault = faultmap_d_min_fault;
+	stats->samples = faultmap_samples;
+	stats->lost = faultmap_lost;
+	stats->throttled = faultmap_throttled;
+	stats->user_only = faultmap_user_only;
+	stats->exited = faultmap_exited;
+
+	*map_rows = faultmap_sorted;
+	return faultmap_nsorted;
+}
+
+/*
+ *  faultmap_json()
+ *	append the -F breakdown as a JSON object member
+ */
+int faultmap_json(strbuf_t * const sb)
+{
+	const faultmap_mapping_t * const *map_rows;
+	faultmap_stats_t st;
+	const size_t n = faultmap_rows(&map_rows, &st);
+	size_t i;
+	int ret = 0;
+
+	ret |= strbuf_printf(sb, "\"faultMap\":{\"pid\":%d,\"threads\":%" PRIu32
+		",\"threadsSkipped\":%" PRIu32 ",\"deltaMajor\":%" PRIu64
+		",\"deltaMinor\":%" PRIu64 ",\"periodMajor\":%" PRIu64
+		",\"periodMinor\":%" PRIu64 ",\"samples\":%" PRIu64 ",\"lost\":%" PRIu64 ",\"throttled\":%" PRIu64
+		",\"userOnly\":%s,\"exited\":%s,\"mappings\":[",
+		st.pid, st.threads, st.threads_skipped,
+		st.d_maj_fault, st.d_min_fault, st.period_maj, st.period_min,
+		st.samples, st.lost, st.throttled,
+		st.user_only ? "true" : "false", st.exited ? "true" : "false");
+	for (i = 0; i < n; i++) {
+		const faultmap_mapping_t * const m = map_rows[i];
+
+		ret |= strbuf_printf(sb, "%s{\"mapping\":", i ? "," : "");
+		ret |= strbuf_json_str(sb, m->name);
+		ret |= strbuf_printf(sb, ",\"major\":%" PRIu64 ",\"minor\":%" PRIu64
+			",\"deltaMajor\":%" PRIu64 ",\"deltaMinor\":%" PRIu64,
+			m->maj_fault, m->min_fault, m->d_maj_fault, m->d_min_fault);
+		if (m->ip_mapping) {
+			ret |= strbuf_printf(sb, ",\"ipMapping\":");
+			ret |= strbuf_json_str(sb, faultmap_name(m->ip_mapping - 1));
+		}
+		ret |= strbuf_printf(sb, ",\"ipOffset\":%" PRIu64 "}", m->ip_offset);
+	}
+	ret |= strbuf_printf(sb, "]},");
+	return ret ? -1 : 0;
+}
+
+/*
+ *  faultmap_close()
+ *	stop sampling and free the index
+ */
+void faultmap_close(void)
+{
+	uint32_t i;
+
+	while (faultmap_nthreads)
+		faultmap_thread_remove(faultmap_nthreads - 1);
+	for (i = 0; i < faultmap_nmaps; i++)
+		free(faultmap_maps[i].name);
+	free(faultmap_maps);
+	faultmap_maps = NULL;
+	faultmap_nmaps = 0;
+	faultmap_maps_alloc = 0;
+	free(faultmap_vmas);
+	faultmap_vmas = NULL;
+	faultmap_nvmas = 0;
+	faultmap_vmas_alloc = 0;
+	free(faultmap_sorted);
+	faultmap_sorted = NULL;
+	faultmap_nsorted = 0;
+	faultmap_sorted_alloc = 0;
+}
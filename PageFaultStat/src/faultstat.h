@@ -48,6 +48,7 @@
 
 #define UNAME_HASH_TABLE_SIZE	(521)
 #define PROC_HASH_TABLE_SIZE 	(503)
+#define FAULT_INDEX_SIZE	(4096)	/* last sample index, power of 2 */
 
 #define OPT_CMD_SHORT		(0x00000001)
 #define OPT_CMD_LONG		(0x00000002)
@@ -60,6 +61,16 @@
 #define OPT_WEB_UI		(0x00000080)
 #define OPT_JSON		(0x00000100)
 #define OPT_ONCE		(0x00000200)
+#define OPT_HARDEN		(0x00000400)
+#define OPT_STREAM		(0x00000800)
+#define OPT_SHM_RING		(0x00001000)
+#define OPT_RECORD		(0x00002000)
+#define OPT_REPLAY		(0x00004000)
+#define OPT_BENCH		(0x00008000)
+#define OPT_PROFILE		(0x00010000)
+#define OPT_TREE		(0x00020000)
+#define OPT_THREADS		(0x00040000)
+#define OPT_FAULT_MAP		(0x00080000)
 
 #define SORT_MAJOR_MINOR	(0x00)
 #define SORT_MAJOR		(0x01)
@@ -68,14 +79,19 @@
 #define SORT_D_MAJOR		(0x04)
 #define SORT_D_MINOR		(0x05)
 #define SORT_SWAP		(0x06)
-#define SORT_END		(0x07)
+#define SORT_P50		(0x07)
+#define SORT_P90		(0x08)
+#define SORT_P99		(0x09)
+#define SORT_PMAX		(0x0a)
+#define SORT_END		(0x0b)
 
 #define ATTR_MAJOR		(0x00)
 #define ATTR_MINOR		(0x01)
 #define ATTR_D_MAJOR		(0x02)
 #define ATTR_D_MINOR		(0x03)
 #define ATTR_SWAP		(0x04)
-#define ATTR_MAX		(0x05)
+#define ATTR_PCT		(0x05)
+#define ATTR_MAX		(0x06)
 
 #define SIZEOF_ARRAY(a)		(sizeof(a) / sizeof(a[0]))
 
@@ -84,12 +100,35 @@ typedef struct {
 	bool	attr[ATTR_MAX];
 } attr_vals_t;
 
+/* getdents64 record, not exported by glibc headers */
+struct linux_dirent64 {
+	uint64_t	d_ino;
+	int64_t		d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char		d_name[];
+};
+
 /* process specific information */
 typedef struct proc_info {
 	struct proc_info *next;		/* next in hash */
 	char		*cmdline;	/* Process name from cmdline */
 	pid_t		pid;		/* PID */
 	bool		kernel_thread;	/* true if process is kernel thread */
+	bool		have_status;	/* true if status fields below are valid */
+	uid_t		uid;		/* last Uid read from status */
+	struct uname_cache_t *uname;	/* last uname for uid */
+	int64_t		vm_swap;	/* last VmSwap read from status */
+	bool		have_stat;	/* true if stat fields below are valid */
+	pid_t		ppid;		/* last parent read from stat */
+	int64_t		min_fault;	/* last minor fault count read from stat */
+	int64_t		cmin_fault;	/* last reaped children's minor faults */
+	int64_t		maj_fault;	/* last major fault count read from stat */
+	int64_t		cmaj_fault;	/* last reaped children's major faults */
+	uint64_t	start_time;	/* last start time read from stat */
+	int64_t		rss;		/* last RSS read from stat */
+	uint64_t	gen;		/* scan generation last seen in */
+	bool		threads_shown;	/* -H threads read in the last sample */
 } proc_info_t;
 
 /* UID cache */
@@ -102,28 +141,284 @@ typedef struct uname_cache_t {
 /* page fault information per process */
 typedef struct fault_info_t {
 	pid_t		pid;		/* process id */
+	pid_t		ppid;		/* parent process id */
 	uid_t		uid;		/* process' UID */
 	proc_info_t 	*proc;		/* cached process info */
 	uname_cache_t	*uname;		/* cached uname info */
 
 	int64_t		min_fault;	/* minor page faults */
 	int64_t		maj_fault;	/* major page faults */
+	int64_t		cmin_fault;	/* minor page faults of reaped children */
+	int64_t		cmaj_fault;	/* major page faults of reaped children */
 	int64_t		vm_swap;	/* pages swapped */
 	int64_t		d_min_fault;	/* delta in minor page faults */
 	int64_t		d_maj_fault;	/* delta in major page faults */
+	int64_t		d_vm_swap;	/* delta in pages swapped */
+	int64_t		pct_maj_fault;	/* major fault rate percentile sorted on */
+	int64_t		pct_min_fault;	/* minor fault rate percentile sorted on */
+	int64_t		rss;		/* resident set size, kB */
+	int64_t		d_rss;		/* delta in resident set size */
+	uint64_t	start_time;	/* start time, clock ticks since boot */
+	uint8_t		reason;		/* REASON_*, set by the classifier */
+	uint8_t		confidence;	/* CONFIDENCE_* */
+	char		comm[16];	/* thread name of a -H thread row, else "" */
+
+	struct fault_info_t *threads;	/* -H thread rows, busiest first */
 
-	struct fault_info_t *d_next;	/* sorted deltas by total */
 	struct fault_info_t *s_next;	/* sorted by total */
+	struct fault_info_t *i_next;	/* next in the last sample index */
 	struct fault_info_t *next;	/* for free list */
-	bool		alive;		/* true if proc is alive */
 } fault_info_t;
 
+/* Process tree index node, see tree.c */
+typedef struct tree_node {
+	struct tree_node *next;		/* next in hash */
+	struct tree_node *parent;	/* parent, NULL if not indexed */
+	struct tree_node *child;	/* first child, children in pid order */
+	struct tree_node *sibling;	/* next child of the parent */
+	proc_info_t	*proc;		/* cached process info */
+	uname_cache_t	*uname;		/* cached uname info */
+	pid_t		pid;		/* process id */
+	pid_t		ppid;		/* parent process id */
+	uint64_t	start_time;	/* to tell a reused pid */
+	int64_t		maj_fault;	/* major page faults */
+	int64_t		min_fault;	/* minor page faults */
+	int64_t		cmaj_fault;	/* major page faults of reaped children */
+	int64_t		cmin_fault;	/* minor page faults of reaped children */
+	int64_t		d_maj_fault;	/* delta in major page faults */
+	int64_t		d_min_fault;	/* delta in minor page faults */
+	int64_t		sub_maj_fault;	/* subtree major faults, reaped included */
+	int64_t		sub_min_fault;	/* subtree minor faults, reaped included */
+	int64_t		d_sub_maj_fault;	/* delta in subtree major faults */
+	int64_t		d_sub_min_fault;	/* delta in subtree minor faults */
+	int64_t		vm_swap;	/* pages swapped */
+	uint32_t	nsub;		/* processes in the subtree */
+	uint64_t	gen;		/* tick last seen in */
+	uint64_t	member_gen;	/* tick last in a -P subtree */
+	uint64_t	sub_gen;	/* tick the subtree sums are from */
+	bool		collapsed;	/* children hidden in the tree view */
+} tree_node_t;
+
+/* Visible row of the tree view */
+typedef struct {
+	const tree_node_t *node;
+	int		depth;		/* 0 for a -P root */
+} tree_row_t;
+
+/* Faults of a mapping of the -F process, see faultmap.c */
+typedef struct {
+	char		*name;		/* path, [heap], [stack], [anon], ... */
+	uint64_t	maj_fault;	/* estimated major faults so far */
+	uint64_t	min_fault;	/* estimated minor faults so far */
+	uint64_t	d_maj_fault;	/* estimated major faults in the sample */
+	uint64_t	d_min_fault;	/* estimated minor faults in the sample */
+	uint64_t	tick;		/* sample the deltas are from */
+	uint64_t	ip_offset;	/* last faulting instruction, offset in ip_mapping */
+	uint32_t	ip_mapping;	/* mapping of that instruction + 1, 0 if none */
+	uint32_t	next;		/* next in name hash + 1, 0 if last */
+} faultmap_mapping_t;
+
+/* State of the -F sampling */
+typedef struct {
+	pid_t		pid;		/* process sampled */
+	uint32_t	threads;	/* threads sampled */
+	uint32_t	threads_skipped;	/* threads over the cap, not sampled */
+	uint64_t	d_maj_fault;	/* major faults counted in the last sample */
+	uint64_t	d_min_fault;	/* minor faults counted in the last sample */
+	uint64_t	period_maj;	/* major faults a sample stands for */
+	uint64_t	period_min;	/* minor faults a sample stands for */
+	uint64_t	samples;	/* samples in the last sample */
+	uint64_t	lost;		/* records dropped in the last sample */
+	uint64_t	throttled;	/* kernel throttled events in the last sample */
+	bool		user_only;	/* faults in the kernel not sampled */
+	bool		exited;		/* process has gone */
+} faultmap_stats_t;
+
 typedef struct pid_list {
 	struct pid_list	*next;		/* next in list */
 	char 		*name;		/* process name */
 	pid_t		pid;		/* process id */
 } pid_list_t;
 
+/* CPU budget governor degradation level */
+typedef struct {
+	int		scale;		/* sample interval multiplier */
+	unsigned int	status_every;	/* read status every n ticks */
+} governor_level_t;
+
+/* CPU budget governor state for reporting */
+typedef struct {
+	double		budget;		/* budget, % of one CPU */
+	double		cpu_percent;	/* smoothed sampler CPU usage */
+	int		level;		/* degradation level */
+	int		scale;		/* sample interval multiplier */
+	unsigned int	status_every;	/* read status every n ticks */
+} governor_state_t;
+
+/* Self-profiling phases of a tick, see profile.c */
+#define PROFILE_READDIR		(0)	/* getdents64 of /proc */
+#define PROFILE_STAT		(1)	/* process lookup, /proc/$PID/stat */
+#define PROFILE_STATUS		(2)	/* /proc/$PID/status */
+#define PROFILE_DELTA		(3)	/* fault deltas */
+#define PROFILE_ANALYSE		(4)	/* history, anomaly, classify */
+#define PROFILE_SORT		(5)	/* sorting in the dumps */
+#define PROFILE_RENDER		(6)	/* JSON, text, recording output */
+#define PROFILE_OTHER		(7)	/* everything else */
+#define PROFILE_PHASES		(8)
+
+/* Cost of the last complete tick */
+typedef struct {
+	uint64_t	ns[PROFILE_PHASES];	/* per phase */
+	uint64_t	tick_ns;	/* whole tick */
+	uint64_t	tick_p99_ns;	/* p99 of all ticks so far */
+	uint64_t	syscalls;	/* system calls */
+	uint64_t	bytes;		/* bytes read or written */
+} profile_tick_t;
+
+/*
+ *  Profiling probes, a flag test when --profile is off
+ *  and compiled out completely with NO_PROFILE
+ */
+#if defined(NO_PROFILE)
+#define PROFILE_PHASE(phase)		do { } while (0)
+#define PROFILE_IO(syscalls, bytes)	do { } while (0)
+#else
+#define PROFILE_PHASE(phase)		\
+	do { if (opt_flags & OPT_PROFILE) profile_phase(phase); } while (0)
+#define PROFILE_IO(syscalls, bytes)	\
+	do { if (opt_flags & OPT_PROFILE) profile_io(syscalls, bytes); } while (0)
+#endif
+
+/* Log-linear histogram, see hist.c */
+#define HIST_SUB_BITS		(4)
+#define HIST_SUB		(1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP		(40)
+#define HIST_BUCKETS		(HIST_SUB + ((HIST_MAX_EXP - HIST_SUB_BITS) * HIST_SUB))
+
+#define HIST_P50		(0)
+#define HIST_P90		(1)
+#define HIST_P99		(2)
+#define HIST_MAX		(3)
+#define HIST_PCTS		(4)
+
+typedef struct {
+	uint64_t	count;		/* values added */
+	int64_t		max;		/* largest value */
+	uint16_t	lo, hi;		/* range of buckets in use */
+	uint32_t	buckets[HIST_BUCKETS];
+} hist_t;
+
+/* Fault rate percentiles, HIST_P50 .. HIST_MAX */
+typedef struct {
+	int64_t		major[HIST_PCTS];	/* major faults per second */
+	int64_t		minor[HIST_PCTS];	/* minor faults per second */
+} history_pcts_t;
+
+/* Fault rates over the history windows */
+#define HISTORY_5M		(0)
+#define HISTORY_1H		(1)
+#define HISTORY_WINDOWS		(2)
+
+typedef struct {
+	double		major[HISTORY_WINDOWS];	/* major faults per second */
+	double		minor[HISTORY_WINDOWS];	/* minor faults per second */
+} history_rates_t;
+
+/* Fault classifier reasons and confidence */
+#define REASON_NONE		(0x00)	/* not classified, no faults */
+#define REASON_NORMAL		(0x01)
+#define REASON_SWAP_PRESSURE	(0x02)
+#define REASON_MEMORY_THRASHING	(0x03)
+#define REASON_WARM_UP		(0x04)
+#define REASON_MEMORY_GROWTH	(0x05)
+#define REASON_MEMORY_PRESSURE	(0x06)
+#define REASON_FILE_BACKED	(0x07)
+#define REASON_MAX		(0x08)
+
+#define CONFIDENCE_LOW		(0x00)
+#define CONFIDENCE_MEDIUM	(0x01)
+#define CONFIDENCE_HIGH		(0x02)
+
+/* System memory state used by the classifier */
+typedef struct {
+	int64_t		mem_total;	/* MemTotal, kB */
+	int64_t		mem_available;	/* MemAvailable, kB */
+	int64_t		swap_total;	/* SwapTotal, kB */
+	int64_t		swap_free;	/* SwapFree, kB */
+	double		mem_pressure;	/* % of memory in use */
+	double		swap_pressure;	/* % of swap in use */
+	double		io_wait;	/* % of CPU time in iowait this tick */
+} classify_system_t;
+
+/* Anomaly detector event */
+typedef struct {
+	bool		onset;		/* true for an onset, false for an end */
+	pid_t		pid;		/* process, 0 = system wide */
+	const char	*metric;	/* "major" or "swap" */
+	double		value;		/* rate that raised the event */
+	double		baseline;	/* baseline rate */
+	double		z;		/* z-score of the rate */
+	double		time;		/* when, seconds since the epoch */
+	char		cmd[64];	/* command */
+} anomaly_event_t;
+
+/* Growable output buffer */
+typedef struct {
+	char		*buf;		/* nul terminated data */
+	size_t		len;		/* bytes used */
+	size_t		size;		/* bytes allocated */
+} strbuf_t;
+
+/* Sampler self statistics for hardened mode */
+typedef struct {
+	int64_t		maj_fault;	/* sampler's own major faults */
+	int64_t		min_fault;	/* sampler's own minor faults */
+	uint64_t	heap_allocs;	/* heap allocations after warm-up */
+	bool		mem_locked;	/* true if memory is locked */
+} harden_stats_t;
+
+/* Keyframe index entry of a recording */
+typedef struct {
+	uint64_t	offset;		/* file offset of the frame */
+	uint64_t	timestamp;	/* ms since the epoch */
+	uint64_t	frame;		/* frame number */
+} record_index_t;
+
+/* A memory mapped recording */
+typedef struct {
+	uint8_t		*map;		/* whole file, private mapping */
+	size_t		len;		/* file size */
+	uint64_t	start;		/* recording start, ms since the epoch */
+	uint32_t	interval;	/* sample interval, ms */
+	record_index_t	*index;		/* keyframes, from the index or a scan */
+	size_t		nindex;		/* number of keyframes */
+} replay_file_t;
+
+/* One process of a decoded frame */
+typedef struct {
+	pid_t		pid;		/* process id */
+	uid_t		uid;		/* process' UID */
+	int64_t		maj_fault;	/* major page faults */
+	int64_t		min_fault;	/* minor page faults */
+	int64_t		vm_swap;	/* swap */
+	char		*user;		/* user name in the mapping, NULL if none */
+	char		*cmd;		/* command in the mapping, NULL if none */
+} replay_entry_t;
+
+/* Frame decoder, one per thread of decoding */
+typedef struct {
+	const replay_file_t *file;	/* recording being decoded */
+	const uint8_t	*ptr;		/* next frame */
+	bool		have_key;	/* a keyframe has been decoded */
+	char		**dict;		/* strings by id - 1 */
+	size_t		ndict, dict_alloc;
+	replay_entry_t	*entries;	/* decoded frame, sorted by pid */
+	replay_entry_t	*prev;		/* frame before, decode scratch */
+	size_t		nentries, nprev, alloc;
+	uint64_t	frame;		/* frame number decoded */
+	uint64_t	timestamp;	/* its time, ms since the epoch */
+} replay_decoder_t;
+
 typedef struct {
 	void (*df_setup)(void);		/* display setup */
 	void (*df_endwin)(void);	/* display end */
@@ -149,6 +444,8 @@ extern int rows;
 extern int cols;
 extern int cury;
 extern int sort_by;
+extern const char *proc_root;
+extern bool proc_root_custom;
 
 /* Display functions */
 void display_restore(void);
@@ -171,11 +468,18 @@ extern const display_funcs_t df_top;
 /* Process and fault functions */
 int fault_get_all_pids(fault_info_t ** const fault_info, size_t * const npids);
 int fault_get_by_proc(const pid_t pid, fault_info_t ** const fault_info);
-void fault_delta(fault_info_t * const fault_new, fault_info_t *const fault_old_list);
-int fault_dump(fault_info_t * const fault_info_old, fault_info_t * const fault_info_new, const bool one_shot);
-int fault_dump_json(fault_info_t * const fault_info_old, fault_info_t * const fault_info_new);
-int fault_dump_diff(fault_info_t * const fault_info_old, fault_info_t * const fault_info_new);
+int fault_get_all_stats(fault_info_t ** const fault_info, size_t * const npids);
+int fault_get_stat(const pid_t pid, fault_info_t ** const fault_info);
+void fault_deltas(fault_info_t * const fault_info_new, fault_info_t * const fault_info_old);
+int fault_dump(fault_info_t * const fault_info_new, const bool one_shot);
+int fault_json_frame(fault_info_t * const fault_info_new, strbuf_t * const sb);
+int fault_dump_json(fault_info_t * const fault_info_new);
+int fault_dump_diff(fault_info_t * const fault_info_new);
+int fault_dump_tree(void);
+int fault_set_thread_threshold(const char *arg);
+void fault_threads(fault_info_t * const fault_info_new);
 bool fault_should_insert_before(const fault_info_t *lhs, const fault_info_t *rhs);
+bool fault_pid_wanted(const pid_t pid, char *cmdline);
 
 /* Cache functions */
 fault_info_t *fault_cache_alloc(void);
@@ -184,12 +488,17 @@ void fault_cache_free_list(fault_info_t *fault_info);
 void fault_cache_prealloc(const size_t n);
 void fault_cache_cleanup(void);
 proc_info_t *proc_cache_find_by_pid(const pid_t pid);
+void proc_cache_prealloc(const size_t n);
+void proc_cache_new_gen(void);
+void proc_cache_sweep(void);
 void proc_cache_cleanup(void);
 uname_cache_t *uname_cache_find(const uid_t uid);
+void uname_cache_prealloc(void);
 void uname_cache_cleanup(void);
 
 /* Utility functions */
 void out_of_memory(const char *msg);
+ssize_t read_file(const char *path, char *buf, const size_t buflen);
 int pid_max_digits(void);
 int getattr(const int index);
 void handle_sigwinch(int sig);
@@ -208,7 +517,147 @@ void pid_list_cleanup(void);
 int parse_pid_list(char * const arg);
 void show_usage(void);
 
+/* CPU budget governor */
+int governor_set_budget(const double percent);
+bool governor_enabled(void);
+void governor_tick_begin(void);
+void governor_tick_end(void);
+int governor_interval_scale(void);
+bool governor_read_status(const pid_t pid);
+void governor_get_state(governor_state_t * const state);
+
+/* Output buffers and NDJSON streaming */
+int strbuf_reserve(strbuf_t * const sb, const size_t len);
+void strbuf_reset(strbuf_t * const sb);
+void strbuf_free(strbuf_t * const sb);
+int strbuf_append(strbuf_t * const sb, const char *data, const size_t len);
+int strbuf_printf(strbuf_t * const sb, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+int strbuf_json_str(strbuf_t * const sb, const char *str);
+void ndjson_set_path(const char *path);
+int ndjson_emit(const strbuf_t * const frame);
+void ndjson_close(void);
+void ndjson_get_stats(uint64_t * const seq, uint64_t * const dropped);
+
+/* Hardened mode */
+void *heap_calloc(const size_t nmemb, const size_t size);
+void *heap_realloc(void *ptr, const size_t size);
+char *heap_strdup(const char *str);
+char *str_cache_dup(const char *str);
+void str_cache_free(char *str);
+int harden_set_sched(const char *arg);
+int harden_set_cpu(const char *arg);
+int harden_setup(const size_t npids);
+void harden_warmed_up(void);
+void harden_shutdown(void);
+bool harden_is_warmed_up(void);
+void harden_get_stats(harden_stats_t * const stats);
+void harden_report(void);
+void harden_cleanup(void);
+
+/* Histograms */
+void hist_reset(hist_t * const h);
+void hist_add(hist_t * const h, const int64_t val);
+void hist_merge(hist_t * const dst, const hist_t * const src);
+void hist_percentiles(const hist_t * const h, int64_t pct[HIST_PCTS]);
+
+/* Self-profiling */
+int profile_enable(void);
+void profile_phase(const int phase);
+void profile_io(const unsigned int syscalls, const size_t bytes);
+void profile_tick_begin(void);
+void profile_tick_end(void);
+bool profile_get_last(profile_tick_t * const tick);
+const char *profile_name(const int phase);
+void profile_report(void);
+
+/* Fault history */
+int history_set_pids(const char *arg);
+bool history_enabled(void);
+int history_init(const double now);
+void history_update(fault_info_t * const fault_info_new, const double now);
+void history_get_rates(const pid_t pid, history_rates_t * const rates);
+void history_get_system_rates(history_rates_t * const rates);
+bool history_get_percentiles(const pid_t pid, history_pcts_t * const pcts);
+void history_get_system_percentiles(history_pcts_t * const pcts);
+void history_get_usage(size_t * const used, size_t * const capacity, size_t * const untracked);
+void history_cleanup(void);
+
+/* Anomaly detection */
+void anomaly_set_log(const char *path);
+int anomaly_init(const size_t npids, const double now);
+bool anomaly_enabled(void);
+void anomaly_update(fault_info_t * const fault_info_new, const double now);
+bool anomaly_active(const pid_t pid);
+bool anomaly_system_active(void);
+bool anomaly_get_state(size_t * const nactive, uint64_t * const dropped, anomaly_event_t * const last);
+int anomaly_event_json(strbuf_t * const sb, const anomaly_event_t * const ev);
+int anomaly_json_events(strbuf_t * const sb);
+void anomaly_cleanup(void);
+
+/* Fault classifier */
+int classify_init(const double now);
+bool classify_enabled(void);
+void classify_update(fault_info_t * const fault_info_new, const double now);
+const char *classify_reason_name(const int reason);
+const char *classify_confidence_name(const int confidence);
+double classify_age(const fault_info_t * const fault_info);
+void classify_get_system(classify_system_t * const sys);
+
+/* Process tree tracking */
+int tree_set_roots(char * const arg);
+bool tree_enabled(void);
+int tree_init(const size_t npids);
+int tree_update(fault_info_t ** const fault_info_list, size_t * const npids);
+bool tree_status_wanted(const pid_t pid, const pid_t ppid);
+size_t tree_rows(const tree_row_t ** const out, size_t * const selected);
+bool tree_key(const int ch);
+int tree_json(strbuf_t * const sb);
+void tree_cleanup(void);
+
+/* Fault address sampling */
+int faultmap_set_pid(const char *arg);
+int faultmap_set_rate(const char *arg);
+bool faultmap_enabled(void);
+int faultmap_open(void);
+void faultmap_update(void);
+size_t faultmap_rows(const faultmap_mapping_t * const ** const map_rows, faultmap_stats_t * const stats);
+const char *faultmap_name(const uint32_t mapping);
+int faultmap_json(strbuf_t * const sb);
+void faultmap_close(void);
+
+/* Shared memory ring */
+int shmring_open(const char *name);
+void shmring_publish(const char *data, const size_t len);
+void shmring_close(void);
+
+/* Binary recording */
+uint32_t record_crc32(const void *data, const size_t len);
+int record_open(const char *path, const double interval);
+int record_frame(const fault_info_t * const fault_info_list);
+void record_close(void);
+
+/* Recording replay */
+int replay_map_file(const char *path, replay_file_t * const rf);
+void replay_unmap_file(replay_file_t * const rf);
+void replay_decoder_init(replay_decoder_t * const d, const replay_file_t * const rf, const uint64_t offset);
+int replay_decode_next(replay_decoder_t * const d);
+void replay_decoder_free(replay_decoder_t * const d);
+int replay_set_speed(const char *arg);
+int replay_open(const char *path);
+int replay_next(fault_info_t ** const fault_info, size_t * const npids);
+double replay_wait(void);
+double replay_time(void);
+void replay_close(void);
+
+/* Offline queries */
+int query_main(int argc, char **argv);
+
+/* Command wrapping measurement */
+int run_main(int argc, char **argv);
+
 /* Web UI */
 int webui_run(uint16_t port);
+void webui_publish(const strbuf_t * const sb);
+void webui_stop(void);
 
 #endif /* __FAULTSTAT_H__ */
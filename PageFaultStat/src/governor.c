@@ -0,0 +1,168 @@
+/*
+ * CPU budget governor for PageFaultStat
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+#include <time.h>
+
+/*
+ *  Degradation levels, each level roughly halves the
+ *  sampling cost of the previous one, first by widening
+ *  the sample interval and then by only re-reading the
+ *  /proc/$PID/status file of a rotating subset of the
+ *  processes on each tick.
+ */
+static const governor_level_t governor_levels[] = {
+	/* scale  status_every */
+	{  1,	 1 },
+	{  2,	 1 },
+	{  4,	 1 },
+	{  4,	 4 },
+	{  8,	 4 },
+	{  8,	16 },
+	{ 16,	16 },
+};
+
+#define GOVERNOR_LEVEL_MAX	((int)SIZEOF_ARRAY(governor_levels) - 1)
+#define GOVERNOR_SETTLE_TICKS	(3)	/* quiet ticks before stepping down */
+
+static double cpu_budget;		/* % of one CPU, 0.0 = disabled */
+static double cpu_percent;		/* smoothed sampler CPU usage */
+static double tick_cpu_start;		/* thread CPU time at start of tick */
+static double tick_wall_start;		/* wall clock time at end of last tick */
+static bool tick_wall_started;		/* tick_wall_start has been set */
+static int level;			/* current degradation level */
+static int settle;			/* ticks spent under the low watermark */
+static uint64_t ticks;			/* number of ticks governed */
+
+/*
+ *  thread_cpu_time()
+ *	CPU time consumed by the sampling thread in seconds
+ */
+static double thread_cpu_time(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0)
+		return 0.0;
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+/*
+ *  governor_set_budget()
+ *	set CPU budget as a percentage of one CPU,
+ *	returns -1 if the budget is not sane
+ */
+int governor_set_budget(const double percent)
+{
+	if ((percent <= 0.0) || (percent > 100.0))
+		return -1;
+	cpu_budget = percent;
+	return 0;
+}
+
+/*
+ *  governor_enabled()
+ *	true if a CPU budget has been set
+ */
+bool governor_enabled(void)
+{
+	return cpu_budget > 0.0;
+}
+
+/*
+ *  governor_tick_begin()
+ *	mark the start of a sampling tick
+ */
+void governor_tick_begin(void)
+{
+	if (!governor_enabled())
+		return;
+
+	tick_cpu_start = thread_cpu_time();
+	ticks++;
+}
+
+/*
+ *  governor_tick_end()
+ *	account the CPU used in this tick against the wall
+ *	clock time since the previous tick and adjust the
+ *	degradation level to stay inside the budget
+ */
+void governor_tick_end(void)
+{
+	double cpu, wall, now, pct;
+
+	if (!governor_enabled())
+		return;
+
+	cpu = thread_cpu_time() - tick_cpu_start;
+	now = gettime_to_double();
+	wall = now - tick_wall_start;
+	/* First tick has no previous tick to measure the interval from */
+	if (!tick_wall_started || (wall <= 0.0)) {
+		tick_wall_start = now;
+		tick_wall_started = true;
+		return;
+	}
+	tick_wall_start = now;
+
+	pct = 100.0 * cpu / wall;
+	/* Smooth out the odd expensive tick, e.g. a burst of new processes */
+	cpu_percent = (ticks <= 2) ? pct : (cpu_percent + pct) / 2.0;
+
+	if (cpu_percent > cpu_budget) {
+		if (level < GOVERNOR_LEVEL_MAX)
+			level++;
+		settle = 0;
+		cpu_percent /= 2.0;	/* expected cost at the new level */
+	} else if ((level > 0) && (cpu_percent < cpu_budget * 0.4)) {
+		/* Only step down once it is clear we'd still be in budget */
+		if (++settle >= GOVERNOR_SETTLE_TICKS) {
+			level--;
+			settle = 0;
+			cpu_percent *= 2.0;
+		}
+	} else {
+		settle = 0;
+	}
+}
+
+/*
+ *  governor_interval_scale()
+ *	multiplier to apply to the sample interval
+ */
+int governor_interval_scale(void)
+{
+	return governor_levels[level].scale;
+}
+
+/*
+ *  governor_read_status()
+ *	true if /proc/$PID/status for the given pid should be
+ *	read on this tick, otherwise the cached values are used
+ */
+bool governor_read_status(const pid_t pid)
+{
+	const unsigned int every = governor_levels[level].status_every;
+
+	if (every <= 1)
+		return true;
+	return (((uint64_t)pid + ticks) % every) == 0;
+}
+
+/*
+ *  governor_get_state()
+ *	fetch current state for reporting
+ */
+void governor_get_state(governor_state_t * const state)
+{
+	state->budget = cpu_budget;
+	state->cpu_percent = cpu_percent;
+	state->level = level;
+	state->scale = governor_levels[level].scale;
+	state->status_every = governor_levels[level].status_every;
+}
@@ -0,0 +1,379 @@
+/*
+ * Self-protection (hardened mode) for PageFaultStat
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+#include <sched.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#define STR_POOL_SLOT		(256)	/* max string length + 1 in pool */
+#define PREFAULT_STACK_SIZE	(256 * 1024)
+#define HARDEN_MIN_PROCS	(1024)	/* min processes to preallocate for */
+
+static bool warmed_up;			/* true once warm-up tick is done */
+static bool shutting_down;		/* true once sampling has ended */
+static bool mem_locked;			/* true if mlockall succeeded */
+static uint64_t heap_allocs;		/* heap allocations after warm-up */
+static int sched_policy = -1;		/* -1 = leave scheduler alone */
+static int sched_prio;			/* realtime priority */
+static int pin_cpu = -1;		/* -1 = no CPU pinning */
+
+static char *str_pool;			/* preallocated string slots */
+static size_t str_pool_slots;		/* number of slots in str_pool */
+static char *str_pool_free;		/* free list of string slots */
+
+/*
+ *  heap_alloc_accounting()
+ *	count heap allocations made after warm-up
+ */
+static inline void heap_alloc_accounting(void)
+{
+	if (!warmed_up || shutting_down)
+		return;
+	__atomic_add_fetch(&heap_allocs, 1, __ATOMIC_RELAXED);
+#if defined(DEBUG_ALLOC)
+	if (opt_flags & OPT_HARDEN) {
+		warmed_up = false;	/* assert() allocates too */
+		assert(!(opt_flags & OPT_HARDEN));
+	}
+#endif
+}
+
+#if defined(DEBUG_ALLOC)
+/*
+ *  The allocator itself is interposed, so allocations by libc,
+ *  stdio, NSS and ncurses are counted as well as the heap_*()
+ *  ones, which are not counted twice
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+	heap_alloc_accounting();
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	heap_alloc_accounting();
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	heap_alloc_accounting();
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+#endif
+
+/*
+ *  heap_wrapper_accounting()
+ *	count a heap_*() allocation, unless the
+ *	interposed allocator counts it
+ */
+static inline void heap_wrapper_accounting(void)
+{
+#if !defined(DEBUG_ALLOC)
+	heap_alloc_accounting();
+#endif
+}
+
+/*
+ *  heap_calloc()
+ *	calloc that is accounted for in hardened mode
+ */
+void *heap_calloc(const size_t nmemb, const size_t size)
+{
+	heap_wrapper_accounting();
+	return calloc(nmemb, size);
+}
+
+/*
+ *  heap_realloc()
+ *	realloc that is accounted for in hardened mode
+ */
+void *heap_realloc(void *ptr, const size_t size)
+{
+	heap_wrapper_accounting();
+	return realloc(ptr, size);
+}
+
+/*
+ *  heap_strdup()
+ *	strdup that is accounted for in hardened mode
+ */
+char *heap_strdup(const char *str)
+{
+	heap_wrapper_accounting();
+	return strdup(str);
+}
+
+/*
+ *  str_pool_contains()
+ *	true if str is a slot in the string pool
+ */
+static inline bool str_pool_contains(const char *str)
+{
+	return str_pool && (str >= str_pool) &&
+	       (str < str_pool + (str_pool_slots * STR_POOL_SLOT));
+}
+
+/*
+ *  str_cache_dup()
+ *	duplicate a string, using a preallocated slot if
+ *	there is one. Strings that are too long for a slot
+ *	are truncated in hardened mode rather than hitting
+ *	the heap
+ */
+char *str_cache_dup(const char *str)
+{
+	char *slot;
+
+	if (!str_pool_free ||
+	    (!(opt_flags & OPT_HARDEN) && (strlen(str) >= STR_POOL_SLOT)))
+		return heap_strdup(str);
+
+	slot = str_pool_free;
+	(void)memcpy(&str_pool_free, slot, sizeof(str_pool_free));
+	(void)strncpy(slot, str, STR_POOL_SLOT - 1);
+	slot[STR_POOL_SLOT - 1] = '\0';
+
+	return slot;
+}
+
+/*
+ *  str_cache_free()
+ *	free a string from str_cache_dup()
+ */
+void str_cache_free(char *str)
+{
+	if (!str)
+		return;
+	if (!str_pool_contains(str)) {
+		free(str);
+		return;
+	}
+	(void)memcpy(str, &str_pool_free, sizeof(str_pool_free));
+	str_pool_free = str;
+}
+
+/*
+ *  str_pool_prealloc()
+ *	preallocate n string slots
+ */
+static int str_pool_prealloc(const size_t n)
+{
+	size_t i;
+
+	if ((str_pool = calloc(n, STR_POOL_SLOT)) == NULL) {
+		out_of_memory("allocating string pool");
+		return -1;
+	}
+	str_pool_slots = n;
+	for (i = n; i > 0; i--)
+		str_cache_free(str_pool + ((i - 1) * STR_POOL_SLOT));
+
+	return 0;
+}
+
+/*
+ *  harden_set_sched()
+ *	parse realtime scheduling option, fifo[:prio] or rr[:prio]
+ */
+int harden_set_sched(const char *arg)
+{
+	const char *colon = strchr(arg, ':');
+	const size_t len = colon ? (size_t)(colon - arg) : strlen(arg);
+	int min, max;
+
+	if ((len == 4) && !strncmp(arg, "fifo", 4))
+		sched_policy = SCHED_FIFO;
+	else if ((len == 2) && !strncmp(arg, "rr", 2))
+		sched_policy = SCHED_RR;
+	else
+		return -1;
+
+	min = sched_get_priority_min(sched_policy);
+	max = sched_get_priority_max(sched_policy);
+	sched_prio = min;
+	if (colon) {
+		errno = 0;
+		sched_prio = (int)strtol(colon + 1, NULL, 10);
+		if (errno || (sched_prio < min) || (sched_prio > max))
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ *  harden_set_cpu()
+ *	parse CPU to pin the sampler to
+ */
+int harden_set_cpu(const char *arg)
+{
+	errno = 0;
+	pin_cpu = (int)strtol(arg, NULL, 10);
+	if (errno || (pin_cpu < 0) || (pin_cpu >= CPU_SETSIZE))
+		return -1;
+	return 0;
+}
+
+/*
+ *  prefault_stack()
+ *	touch stack pages so they are resident before locking
+ */
+static void __attribute__((noinline)) prefault_stack(void)
+{
+	volatile char stack[PREFAULT_STACK_SIZE];
+	size_t i;
+
+	for (i = 0; i < sizeof(stack); i += 4096)
+		stack[i] = 0;
+}
+
+/*
+ *  harden_setup()
+ *	apply scheduling and pinning options and, in hardened
+ *	mode, preallocate every cache for npids processes and
+ *	lock all current and future memory
+ */
+int harden_setup(const size_t npids)
+{
+	size_t nprocs;
+
+	if (pin_cpu >= 0) {
+		cpu_set_t mask;
+
+		CPU_ZERO(&mask);
+		CPU_SET(pin_cpu, &mask);
+		if (sched_setaffinity(0, sizeof(mask), &mask) < 0) {
+			(void)fprintf(stderr, "sched_setaffinity failed: errno=%d (%s)\n",
+				errno, strerror(errno));
+			return -1;
+		}
+	}
+	if (sched_policy >= 0) {
+		struct sched_param param;
+
+		(void)memset(&param, 0, sizeof(param));
+		param.sched_priority = sched_prio;
+		if (sched_setscheduler(0, sched_policy, &param) < 0) {
+			(void)fprintf(stderr, "sched_setscheduler failed: errno=%d (%s)\n",
+				errno, strerror(errno));
+			return -1;
+		}
+	}
+
+	if (!(opt_flags & OPT_HARDEN))
+		return 0;
+
+	/*
+	 *  Allow for twice the current number of processes (or a
+	 *  sane minimum on quiet systems) to cover churn, the fault
+	 *  lists need room for both the old and new samples
+	 */
+	nprocs = (npids < HARDEN_MIN_PROCS) ? HARDEN_MIN_PROCS : npids * 2;
+	fault_cache_prealloc(nprocs * 2);
+	proc_cache_prealloc(nprocs);
+	if (str_pool_prealloc(nprocs + UNAME_HASH_TABLE_SIZE) < 0)
+		return -1;
+	uname_cache_prealloc();
+
+	prefault_stack();
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		(void)fprintf(stderr, "Warning: mlockall failed: errno=%d (%s), "
+			"continuing unlocked\n", errno, strerror(errno));
+	} else {
+		mem_locked = true;
+	}
+	return 0;
+}
+
+/*
+ *  harden_warmed_up()
+ *	flag the end of warm-up, heap allocations after
+ *	this point are counted
+ */
+void harden_warmed_up(void)
+{
+	warmed_up = true;
+}
+
+/*
+ *  harden_shutdown()
+ *	flag the end of sampling, teardown (e.g. ncurses
+ *	restoring the terminal) may allocate freely
+ */
+void harden_shutdown(void)
+{
+	shutting_down = true;
+}
+
+/*
+ *  harden_is_warmed_up()
+ *	true if warm-up has completed
+ */
+bool harden_is_warmed_up(void)
+{
+	return warmed_up;
+}
+
+/*
+ *  harden_get_stats()
+ *	fetch the sampler's own fault and allocation counts
+ */
+void harden_get_stats(harden_stats_t * const stats)
+{
+	struct rusage usage;
+
+	(void)memset(stats, 0, sizeof(*stats));
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+		stats->maj_fault = usage.ru_majflt;
+		stats->min_fault = usage.ru_minflt;
+	}
+	stats->heap_allocs = heap_allocs;
+	stats->mem_locked = mem_locked;
+}
+
+/*
+ *  harden_report()
+ *	report self statistics at exit in hardened mode
+ */
+void harden_report(void)
+{
+	harden_stats_t stats;
+
+	if (!(opt_flags & OPT_HARDEN))
+		return;
+
+	harden_get_stats(&stats);
+	(void)fprintf(stderr, "%s: self faults: %" PRId64 " major, %" PRId64
+		" minor, %" PRIu64 " heap allocations after warm-up, memory %slocked\n",
+		app_name, stats.maj_fault, stats.min_fault, stats.heap_allocs,
+		stats.mem_locked ? "" : "not ");
+}
+
+/*
+ *  harden_cleanup()
+ *	free the string pool
+ */
+void harden_cleanup(void)
+{
+	free(str_pool);
+	str_pool = NULL;
+	str_pool_free = NULL;
+	str_pool_slots = 0;
+}
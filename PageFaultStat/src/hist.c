@@ -0,0 +1,132 @@
+/*
+ * Log-linear histograms for PageFaultStat
+ *
+ * Values below HIST_SUB get a bucket each, above that every power
+ * of two is split into HIST_SUB linear sub-buckets, so a bucket is
+ * never wider than 1/HIST_SUB of its value (HDR histogram style with
+ * about 3% worst case error). Adding a value is O(1), histograms of
+ * different processes or time ranges merge by adding bucket counts.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+
+/* Percentiles reported for HIST_P50 .. HIST_MAX */
+static const double hist_pcts[HIST_PCTS] = { 50.0, 90.0, 99.0, 100.0 };
+
+/*
+ *  hist_bucket()
+ *	bucket a value falls in
+ */
+static inline size_t hist_bucket(const uint64_t val)
+{
+	int e;
+
+	if (val < HIST_SUB)
+		return (size_t)val;
+	e = 63 - __builtin_clzll(val);
+	if (e >= HIST_MAX_EXP)
+		return HIST_BUCKETS - 1;
+	return (size_t)(HIST_SUB + ((e - HIST_SUB_BITS) * HIST_SUB) +
+		((val >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1)));
+}
+
+/*
+ *  hist_value()
+ *	midpoint of a bucket
+ */
+static uint64_t hist_value(const size_t bucket)
+{
+	uint64_t low;
+	int e;
+
+	if (bucket < HIST_SUB)
+		return bucket;
+	e = (int)((bucket - HIST_SUB) / HIST_SUB) + HIST_SUB_BITS;
+	low = ((uint64_t)HIST_SUB + ((bucket - HIST_SUB) % HIST_SUB)) << (e - HIST_SUB_BITS);
+	return low + ((1ULL << (e - HIST_SUB_BITS)) / 2);
+}
+
+/*
+ *  hist_reset()
+ *	empty a histogram
+ */
+void hist_reset(hist_t * const h)
+{
+	(void)memset(h, 0, sizeof(*h));
+}
+
+/*
+ *  hist_add()
+ *	add a value, negative values count as zero
+ */
+void hist_add(hist_t * const h, const int64_t val)
+{
+	const size_t b = (val > 0) ? hist_bucket((uint64_t)val) : 0;
+
+	if (!h->count) {
+		h->lo = h->hi = (uint16_t)b;
+		h->max = (val > 0) ? val : 0;
+	} else {
+		if (b < h->lo)
+			h->lo = (uint16_t)b;
+		if (b > h->hi)
+			h->hi = (uint16_t)b;
+		if (val > h->max)
+			h->max = val;
+	}
+	h->buckets[b]++;
+	h->count++;
+}
+
+/*
+ *  hist_merge()
+ *	add the counts of src into dst
+ */
+void hist_merge(hist_t * const dst, const hist_t * const src)
+{
+	size_t i;
+
+	if (!src->count)
+		return;
+	if (!dst->count) {
+		*dst = *src;
+		return;
+	}
+	for (i = src->lo; i <= src->hi; i++)
+		dst->buckets[i] += src->buckets[i];
+	if (src->lo < dst->lo)
+		dst->lo = src->lo;
+	if (src->hi > dst->hi)
+		dst->hi = src->hi;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->count += src->count;
+}
+
+/*
+ *  hist_percentiles()
+ *	p50, p90, p99 and max in one pass over the buckets in use
+ */
+void hist_percentiles(const hist_t * const h, int64_t pct[HIST_PCTS])
+{
+	uint64_t seen = 0;
+	size_t i, p = 0;
+
+	(void)memset(pct, 0, sizeof(*pct) * HIST_PCTS);
+	if (!h->count)
+		return;
+	pct[HIST_MAX] = h->max;
+
+	for (i = h->lo; (i <= h->hi) && (p < HIST_MAX); i++) {
+		seen += h->buckets[i];
+		while ((p < HIST_MAX) &&
+		       (seen >= (uint64_t)ceil((hist_pcts[p] / 100.0) * (double)h->count))) {
+			const int64_t val = (int64_t)hist_value(i);
+
+			pct[p++] = (val > h->max) ? h->max : val;
+		}
+	}
+}
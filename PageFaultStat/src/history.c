@@ -0,0 +1,454 @@
+/*
+ * In-memory fault history for PageFaultStat
+ *
+ * Each tracked process and the system as a whole get a slot
+ * holding rings of rollup buckets at 1 second, 10 second and 1
+ * minute resolution. Every sample is folded into the current
+ * bucket of all three rings as it arrives, and running sums over
+ * the last 5 minutes and last hour are kept as buckets close, so
+ * the window rates are read out without walking the rings. Each
+ * slot also keeps histograms of the per second major and minor
+ * fault rates of every sample since the slot was taken, for the
+ * percentiles.
+ *
+ * All slots are allocated up front, the memory used is fixed by
+ * the number of process slots (-k). Processes get a slot the
+ * first time they fault and lose it when they exit.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+
+#define HISTORY_MAJOR		(0)
+#define HISTORY_MINOR		(1)
+#define HISTORY_METRICS		(2)
+
+#define HISTORY_LEVELS		(3)
+#define HISTORY_BUCKETS		(60)	/* buckets per ring */
+#define HISTORY_DEFAULT_PIDS	(256)
+
+/* Running window over one ring, of n buckets including the current one */
+typedef struct {
+	int		level;		/* ring the window is kept on */
+	int		n;		/* buckets in the window */
+} history_window_t;
+
+static const int history_res[HISTORY_LEVELS] = { 1, 10, 60 };
+
+static const history_window_t history_windows[HISTORY_WINDOWS] = {
+	{ 1, 30 },	/* 5 minutes of 10 second buckets */
+	{ 2, 60 },	/* 1 hour of 1 minute buckets */
+};
+
+/* Rollup of the samples that fell into one bucket */
+typedef struct {
+	int64_t		sum[HISTORY_METRICS];
+	int64_t		min[HISTORY_METRICS];
+	int64_t		max[HISTORY_METRICS];
+	uint32_t	count;		/* samples, 0 = empty bucket */
+} history_bucket_t;
+
+typedef struct {
+	pid_t		pid;		/* process, 0 = free or system */
+	uint64_t	gen;		/* tick last seen in */
+	uint64_t	start_time;	/* to tell a reused pid */
+	double		start;		/* time the history starts from */
+	int64_t		t[HISTORY_LEVELS];	/* current bucket, in units of the resolution */
+	int		head[HISTORY_LEVELS];	/* current bucket index */
+	int64_t		win[HISTORY_WINDOWS][HISTORY_METRICS];	/* closed buckets in window */
+	history_bucket_t ring[HISTORY_LEVELS][HISTORY_BUCKETS];
+	hist_t		hist[HISTORY_METRICS];	/* per second rates */
+} history_slot_t;
+
+static size_t history_pids = HISTORY_DEFAULT_PIDS;	/* process slots */
+static bool history_active;		/* history is being kept */
+static history_slot_t *history_slots;	/* process slots */
+static history_slot_t history_system;	/* system totals */
+static size_t *history_free;		/* stack of free slot indexes */
+static size_t history_nfree;
+static int32_t *history_index;		/* pid hash to slot index, -1 = empty */
+static size_t history_index_mask;
+static uint64_t history_gen;		/* tick count */
+static double history_last;		/* time of the previous tick */
+static size_t history_untracked;	/* faulting processes without a slot */
+
+/*
+ *  history_set_pids()
+ *	set the number of process slots, 0 disables history
+ */
+int history_set_pids(const char *arg)
+{
+	char *endptr;
+	long val;
+
+	errno = 0;
+	val = strtol(arg, &endptr, 10);
+	if (errno || (endptr == arg) || *endptr || (val < 0) || (val > 1000000))
+		return -1;
+	history_pids = (size_t)val;
+	return 0;
+}
+
+/*
+ *  history_enabled()
+ *	true if history is being kept
+ */
+bool history_enabled(void)
+{
+	return history_active;
+}
+
+/*
+ *  history_hash()
+ *	hash a pid into the slot index
+ */
+static inline size_t history_hash(const pid_t pid)
+{
+	return ((size_t)pid * 2654435761UL) & history_index_mask;
+}
+
+/*
+ *  history_find()
+ *	find the slot of a pid, NULL if it has none
+ */
+static history_slot_t *history_find(const pid_t pid)
+{
+	size_t h;
+
+	for (h = history_hash(pid); history_index[h] >= 0; h = (h + 1) & history_index_mask) {
+		history_slot_t * const slot = &history_slots[history_index[h]];
+
+		if (slot->pid == pid)
+			return slot;
+	}
+	return NULL;
+}
+
+/*
+ *  history_index_add()
+ *	add a slot to the pid hash
+ */
+static void history_index_add(const size_t i)
+{
+	size_t h;
+
+	for (h = history_hash(history_slots[i].pid); history_index[h] >= 0; h = (h + 1) & history_index_mask)
+		;
+	history_index[h] = (int32_t)i;
+}
+
+/*
+ *  history_bucket_of()
+ *	bucket a time falls in, a sample covers the time up to
+ *	when it was taken so one taken on a bucket boundary
+ *	belongs to the bucket ending there
+ */
+static inline int64_t history_bucket_of(const double now, const int res)
+{
+	return (int64_t)ceil(now / res) - 1;
+}
+
+/*
+ *  history_slot_reset()
+ *	empty a slot, its history starts at the given time
+ */
+static void history_slot_reset(history_slot_t * const slot, const pid_t pid, const double start)
+{
+	int l;
+
+	(void)memset(slot, 0, sizeof(*slot));
+	slot->pid = pid;
+	slot->gen = history_gen;
+	slot->start = start;
+	for (l = 0; l < HISTORY_LEVELS; l++)
+		slot->t[l] = history_bucket_of(start, history_res[l]);
+}
+
+/*
+ *  history_init()
+ *	allocate all the history memory, the first sample
+ *	deltas are measured from now
+ */
+int history_init(const double now)
+{
+	size_t i, n;
+
+	if (history_pids == 0)
+		return 0;
+	history_last = now;
+	history_slot_reset(&history_system, 0, now);
+
+	for (n = 1; n < history_pids * 2; n <<= 1)
+		;
+	history_index_mask = n - 1;
+
+	history_slots = heap_calloc(history_pids, sizeof(*history_slots));
+	history_free = heap_calloc(history_pids, sizeof(*history_free));
+	history_index = heap_calloc(n, sizeof(*history_index));
+	if (!history_slots || !history_free || !history_index) {
+		out_of_memory("allocating history");
+		history_cleanup();
+		return -1;
+	}
+	(void)memset(history_index, 0xff, n * sizeof(*history_index));
+	for (i = 0; i < history_pids; i++)
+		history_free[i] = history_pids - 1 - i;
+	history_nfree = history_pids;
+	history_active = true;
+	return 0;
+}
+
+/*
+ *  history_advance()
+ *	close the current bucket of a ring and start the next,
+ *	keeping the running window sums on this ring up to date
+ */
+static void history_advance(history_slot_t * const slot, const int l)
+{
+	const history_bucket_t * const cur = &slot->ring[l][slot->head[l]];
+	size_t w;
+	int m;
+
+	for (w = 0; w < HISTORY_WINDOWS; w++) {
+		const history_window_t * const hw = &history_windows[w];
+		const history_bucket_t *old;
+
+		if (hw->level != l)
+			continue;
+		/* Oldest bucket in the window drops out as this one closes */
+		old = &slot->ring[l][(slot->head[l] + HISTORY_BUCKETS - (hw->n - 1)) % HISTORY_BUCKETS];
+		for (m = 0; m < HISTORY_METRICS; m++)
+			slot->win[w][m] += cur->sum[m] - old->sum[m];
+	}
+	slot->head[l] = (slot->head[l] + 1) % HISTORY_BUCKETS;
+	(void)memset(&slot->ring[l][slot->head[l]], 0, sizeof(history_bucket_t));
+	slot->t[l]++;
+}
+
+/*
+ *  history_slot_add()
+ *	fold a sample into the current bucket of every ring
+ *	and its rate into the histograms
+ */
+static void history_slot_add(history_slot_t * const slot, const double now, const int64_t val[HISTORY_METRICS])
+{
+	const double interval = now - history_last;
+	int l, m;
+
+	for (m = 0; m < HISTORY_METRICS; m++)
+		hist_add(&slot->hist[m], (interval > 0.0) ?
+			(int64_t)llround((double)val[m] / interval) : val[m]);
+
+	for (l = 0; l < HISTORY_LEVELS; l++) {
+		const int64_t t = history_bucket_of(now, history_res[l]);
+		history_bucket_t *b;
+
+		if (t - slot->t[l] >= HISTORY_BUCKETS) {
+			/* Been away longer than the ring, nothing is left in it */
+			size_t w;
+
+			(void)memset(slot->ring[l], 0, sizeof(slot->ring[l]));
+			for (w = 0; w < HISTORY_WINDOWS; w++) {
+				if (history_windows[w].level == l)
+					(void)memset(slot->win[w], 0, sizeof(slot->win[w]));
+			}
+			slot->t[l] = t;
+		}
+		while (slot->t[l] < t)
+			history_advance(slot, l);
+
+		b = &slot->ring[l][slot->head[l]];
+		for (m = 0; m < HISTORY_METRICS; m++) {
+			b->sum[m] += val[m];
+			if (!b->count || (val[m] < b->min[m]))
+				b->min[m] = val[m];
+			if (!b->count || (val[m] > b->max[m]))
+				b->max[m] = val[m];
+		}
+		b->count++;
+	}
+}
+
+/*
+ *  history_update()
+ *	add the deltas of this tick to the history, fault_deltas()
+ *	has to have been run on the sample
+ */
+void history_update(fault_info_t * const fault_info_new, const double now)
+{
+	int64_t sys[HISTORY_METRICS] = { 0, 0 };
+	fault_info_t *fault_info;
+	bool freed = false;
+	size_t i;
+
+	if (!history_active)
+		return;
+	history_gen++;
+	history_untracked = 0;
+	for (fault_info = fault_info_new; fault_info; fault_info = fault_info->next) {
+		int64_t val[HISTORY_METRICS];
+		history_slot_t *slot;
+
+		val[HISTORY_MAJOR] = fault_info->d_maj_fault;
+		val[HISTORY_MINOR] = fault_info->d_min_fault;
+		sys[HISTORY_MAJOR] += val[HISTORY_MAJOR];
+		sys[HISTORY_MINOR] += val[HISTORY_MINOR];
+
+		if ((slot = history_find(fault_info->pid)) == NULL) {
+			if (!val[HISTORY_MAJOR] && !val[HISTORY_MINOR])
+				continue;
+			if (!history_nfree) {
+				history_untracked++;
+				continue;
+			}
+			i = history_free[--history_nfree];
+			slot = &history_slots[i];
+			history_slot_reset(slot, fault_info->pid, history_last);
+			history_index_add(i);
+		} else if (slot->start_time != fault_info->start_time) {
+			/* The pid was reused, the new process starts afresh */
+			history_slot_reset(slot, fault_info->pid, history_last);
+		}
+		slot->start_time = fault_info->start_time;
+		slot->gen = history_gen;
+		history_slot_add(slot, now, val);
+	}
+	history_slot_add(&history_system, now, sys);
+	history_last = now;
+
+	/* Processes that have gone give up their slots */
+	for (i = 0; i < history_pids; i++) {
+		history_slot_t * const slot = &history_slots[i];
+
+		if (slot->pid && (slot->gen != history_gen)) {
+			slot->pid = 0;
+			history_free[history_nfree++] = i;
+			freed = true;
+		}
+	}
+	if (freed) {
+		(void)memset(history_index, 0xff, (history_index_mask + 1) * sizeof(*history_index));
+		for (i = 0; i < history_pids; i++) {
+			if (history_slots[i].pid)
+				history_index_add(i);
+		}
+	}
+}
+
+/*
+ *  history_slot_rates()
+ *	rates over the running windows of a slot
+ */
+static void history_slot_rates(const history_slot_t * const slot, history_rates_t * const rates)
+{
+	size_t w;
+
+	for (w = 0; w < HISTORY_WINDOWS; w++) {
+		const history_window_t * const hw = &history_windows[w];
+		const int res = history_res[hw->level];
+		const history_bucket_t * const cur = &slot->ring[hw->level][slot->head[hw->level]];
+		/* Closed buckets plus however much of the current one has passed */
+		double span = (double)((hw->n - 1) * res) +
+			(history_last - (double)(slot->t[hw->level] * res));
+
+		if (span > history_last - slot->start)
+			span = history_last - slot->start;
+		if (span <= 0.0) {
+			rates->major[w] = 0.0;
+			rates->minor[w] = 0.0;
+			continue;
+		}
+		rates->major[w] = (double)(slot->win[w][HISTORY_MAJOR] + cur->sum[HISTORY_MAJOR]) / span;
+		rates->minor[w] = (double)(slot->win[w][HISTORY_MINOR] + cur->sum[HISTORY_MINOR]) / span;
+	}
+}
+
+/*
+ *  history_get_rates()
+ *	window rates of a process, zero if it has no history
+ */
+void history_get_rates(const pid_t pid, history_rates_t * const rates)
+{
+	const history_slot_t *slot;
+
+	if (history_active && ((slot = history_find(pid)) != NULL)) {
+		history_slot_rates(slot, rates);
+		return;
+	}
+	(void)memset(rates, 0, sizeof(*rates));
+}
+
+/*
+ *  history_get_system_rates()
+ *	window rates of all processes
+ */
+void history_get_system_rates(history_rates_t * const rates)
+{
+	history_slot_rates(&history_system, rates);
+}
+
+/*
+ *  history_slot_percentiles()
+ *	rate percentiles of a slot
+ */
+static void history_slot_percentiles(const history_slot_t * const slot, history_pcts_t * const pcts)
+{
+	hist_percentiles(&slot->hist[HISTORY_MAJOR], pcts->major);
+	hist_percentiles(&slot->hist[HISTORY_MINOR], pcts->minor);
+}
+
+/*
+ *  history_get_percentiles()
+ *	rate percentiles of a process, returns false and
+ *	zeros if it has no history
+ */
+bool history_get_percentiles(const pid_t pid, history_pcts_t * const pcts)
+{
+	const history_slot_t *slot;
+
+	if (history_active && ((slot = history_find(pid)) != NULL)) {
+		history_slot_percentiles(slot, pcts);
+		return true;
+	}
+	(void)memset(pcts, 0, sizeof(*pcts));
+	return false;
+}
+
+/*
+ *  history_get_system_percentiles()
+ *	rate percentiles of all processes together
+ */
+void history_get_system_percentiles(history_pcts_t * const pcts)
+{
+	history_slot_percentiles(&history_system, pcts);
+}
+
+/*
+ *  history_get_usage()
+ *	process slots in use, capacity and processes that
+ *	faulted but could not be given a slot
+ */
+void history_get_usage(size_t * const used, size_t * const capacity, size_t * const untracked)
+{
+	*used = history_pids - history_nfree;
+	*capacity = history_pids;
+	*untracked = history_untracked;
+}
+
+/*
+ *  history_cleanup()
+ *	free history memory
+ */
+void history_cleanup(void)
+{
+	free(history_slots);
+	free(history_free);
+	free(history_index);
+	history_slots = NULL;
+	history_free = NULL;
+	history_index = NULL;
+	history_nfree = 0;
+	history_active = false;
+}
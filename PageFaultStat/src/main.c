@@ -24,7 +24,9 @@
 
 #include "faultstat.h"
 #include <fcntl.h>
+#include <getopt.h>
 #include <unistd.h>
+#include <sys/resource.h>
 
 /* Global variables */
 uname_cache_t *uname_cache[UNAME_HASH_TABLE_SIZE];
@@ -41,6 +43,8 @@ int rows = 25;
 int cols = 80;
 int cury = 0;
 int sort_by = SORT_MAJOR_MINOR;
+const char *proc_root = "/proc";	/* --proc-root, a fixture tree for benchmarks */
+bool proc_root_custom;
 
 /* Signal handlers array */
 static const int signals[] = {
@@ -92,6 +96,57 @@ static const int signals[] = {
 	-1,
 };
 
+/* Long only options */
+enum {
+	OPT_LONG_PROC_ROOT = 256,
+	OPT_LONG_BENCH,
+	OPT_LONG_PROFILE,
+	OPT_LONG_FAULT_RATE,
+};
+
+static const struct option long_options[] = {
+	{ "proc-root",	required_argument,	NULL,	OPT_LONG_PROC_ROOT },
+	{ "bench",	required_argument,	NULL,	OPT_LONG_BENCH },
+	{ "profile",	no_argument,		NULL,	OPT_LONG_PROFILE },
+	{ "fault-rate",	required_argument,	NULL,	OPT_LONG_FAULT_RATE },
+	{ NULL,		0,			NULL,	0 },
+};
+
+/*
+ *  sample_time()
+ *	time of the sample just taken, the recorded time when replaying
+ */
+static double sample_time(void)
+{
+	return (opt_flags & OPT_REPLAY) ? replay_time() : gettime_to_double();
+}
+
+/*
+ *  bench_report()
+ *	throughput and cost of a --bench run, the initial
+ *	scan is warm-up and is not counted
+ */
+static void bench_report(
+	const long samples,
+	const size_t npids,
+	const double secs,
+	const struct rusage * const start)
+{
+	struct rusage end;
+	double cpu;
+
+	if ((samples < 1) || (getrusage(RUSAGE_SELF, &end) < 0))
+		return;
+	cpu = timeval_to_double(&end.ru_utime) - timeval_to_double(&start->ru_utime) +
+	      timeval_to_double(&end.ru_stime) - timeval_to_double(&start->ru_stime);
+
+	(void)printf("%s bench: %s, %zu pids, %ld samples, %.1f samples/s, "
+		"%.3f ms CPU/sample, %ld kB max RSS\n",
+		app_name, proc_root, npids, samples,
+		(secs > 0.0) ? (double)samples / secs : 0.0,
+		1000.0 * cpu / (double)samples, end.ru_maxrss);
+}
+
 static bool prompt_for_duration(double *duration)
 {
 	char buf[64];
@@ -152,13 +207,23 @@ int main(int argc, char **argv)
 	bool forever = true;
 	long int count = 0;
 	size_t npids;
+	long int webui_port = 0;
+	const char *shm_name = NULL;
+	const char *record_name = NULL;
+	const char *replay_name = NULL;
 	bool duration_from_user = false;
 	bool count_from_user = false;
 
 	df = df_normal;
 
+	if ((argc > 1) && !strcmp(argv[1], "query"))
+		exit(query_main(argc - 1, argv + 1));
+	if ((argc > 1) && !strcmp(argv[1], "run"))
+		exit(run_main(argc - 1, argv + 1));
+
 	for (;;) {
-		int c = getopt(argc, argv, "acdhlp:stTj");
+		int c = getopt_long(argc, argv, "aA:b:cde:F:hH:k:lMo:p:P:r:R:sS:tTw:W:x:jJ",
+			long_options, NULL);
 
 		if (c == -1)
 			break;
@@ -166,31 +231,97 @@ int main(int argc, char **argv)
 		case 'a':
 			opt_flags |= OPT_ARROW;
 			break;
+		case 'A':
+			if (harden_set_cpu(optarg) < 0) {
+				(void)fprintf(stderr, "Invalid CPU specified.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'b':
+			errno = 0;
+			if (governor_set_budget(strtod(optarg, NULL)) < 0 || errno) {
+				(void)fprintf(stderr, "CPU budget must be a percentage > 0 and <= 100.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case 'c':
 			opt_flags |= OPT_CMD_COMM;
 			break;
 		case 'd':
 			opt_flags |= OPT_DIRNAME_STRIP;
 			break;
+		case 'e':
+			anomaly_set_log(optarg);
+			break;
+		case 'F':
+			if (faultmap_set_pid(optarg) < 0) {
+				(void)fprintf(stderr, "Invalid fault sampling pid specified.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case 'h':
 			show_usage();
 			exit(EXIT_SUCCESS);
+		case 'H':
+			if (fault_set_thread_threshold(optarg) < 0) {
+				(void)fprintf(stderr, "Thread fault threshold must be 0 or more.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case 'j':
 			opt_flags |= OPT_JSON | OPT_ONCE;
 			count = 2;
 			duration = 1.0;
 			forever = false;
 			break;
+		case 'J':
+			opt_flags |= OPT_STREAM;
+			count = -1;
+			break;
+		case 'k':
+			if (history_set_pids(optarg) < 0) {
+				(void)fprintf(stderr, "History process slots must be 0 or more.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case 'l':
 			opt_flags |= OPT_CMD_LONG;
 			break;
+		case 'M':
+			opt_flags |= OPT_HARDEN;
+			break;
+		case 'o':
+			ndjson_set_path(optarg);
+			break;
 		case 'p':
 			if (parse_pid_list(optarg) < 0)
 				exit(EXIT_FAILURE);
 			break;
+		case 'P':
+			if (tree_set_roots(optarg) < 0) {
+				(void)fprintf(stderr, "Invalid subtree root pid specified.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'r':
+			replay_name = optarg;
+			opt_flags |= OPT_REPLAY;
+			count = -1;
+			break;
+		case 'R':
+			if (harden_set_sched(optarg) < 0) {
+				(void)fprintf(stderr, "Scheduling policy must be fifo[:prio] or rr[:prio].\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case 's':
 			opt_flags |= OPT_CMD_SHORT;
 			break;
+		case 'S':
+			shm_name = optarg;
+			opt_flags |= OPT_SHM_RING;
+			count = -1;
+			break;
 		case 'T':
 			opt_flags |= OPT_TOP_TOTAL;
 			/* fall through */
@@ -198,6 +329,58 @@ int main(int argc, char **argv)
 			opt_flags |= OPT_TOP;
 			count = -1;
 			break;
+		case 'w':
+			record_name = optarg;
+			opt_flags |= OPT_RECORD;
+			count = -1;
+			break;
+		case 'W':
+			errno = 0;
+			webui_port = strtol(optarg, NULL, 10);
+			if (errno || (webui_port < 1) || (webui_port > 65535)) {
+				(void)fprintf(stderr, "Invalid web UI port specified.\n");
+				exit(EXIT_FAILURE);
+			}
+			opt_flags |= OPT_WEB_UI;
+			count = -1;
+			break;
+		case 'x':
+			if (replay_set_speed(optarg) < 0) {
+				(void)fprintf(stderr, "Replay speed must be 0 (no waiting) or more.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case OPT_LONG_PROC_ROOT:
+			if (access(optarg, R_OK | X_OK) < 0) {
+				(void)fprintf(stderr, "Cannot access proc root %s: %s\n",
+					optarg, strerror(errno));
+				exit(EXIT_FAILURE);
+			}
+			proc_root = optarg;
+			proc_root_custom = true;
+			break;
+		case OPT_LONG_BENCH:
+			errno = 0;
+			count = strtol(optarg, NULL, 10);
+			if (errno || (count < 1)) {
+				(void)fprintf(stderr, "Bench samples must be > 0.\n");
+				exit(EXIT_FAILURE);
+			}
+			opt_flags |= OPT_BENCH;
+			forever = false;
+			break;
+		case OPT_LONG_PROFILE:
+			if (profile_enable() < 0) {
+				(void)fprintf(stderr, "Built without --profile support.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case OPT_LONG_FAULT_RATE:
+			if (faultmap_set_rate(optarg) < 0) {
+				(void)fprintf(stderr, "Fault sample rate must be 2 to 100000 per second.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
 		default:
 			show_usage();
 			exit(EXIT_FAILURE);
@@ -208,6 +391,38 @@ int main(int argc, char **argv)
 		(void)fprintf(stderr, "Cannot have -c, -l, -s at same time.\n");
 		exit(EXIT_FAILURE);
 	}
+	if ((opt_flags & OPT_STREAM) && (opt_flags & (OPT_TOP | OPT_JSON))) {
+		(void)fprintf(stderr, "Cannot have -J with -j, -t or -T.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* -j is one shot, even if a later option runs forever */
+	if (opt_flags & OPT_ONCE)
+		count = 2;
+
+	if ((opt_flags & OPT_REPLAY) && (opt_flags & OPT_RECORD)) {
+		(void)fprintf(stderr, "Cannot have -r with -w.\n");
+		exit(EXIT_FAILURE);
+	}
+	if ((opt_flags & OPT_THREADS) && (opt_flags & OPT_REPLAY)) {
+		(void)fprintf(stderr, "Cannot have -H with -r.\n");
+		exit(EXIT_FAILURE);
+	}
+	/* Samples come from the live process */
+	if ((opt_flags & OPT_FAULT_MAP) && ((opt_flags & OPT_REPLAY) || proc_root_custom)) {
+		(void)fprintf(stderr, "Cannot have -F with -r or --proc-root.\n");
+		exit(EXIT_FAILURE);
+	}
+	/* -p would hide the parents, recordings have none */
+	if ((opt_flags & OPT_TREE) && (pids || (opt_flags & OPT_REPLAY))) {
+		(void)fprintf(stderr, "Cannot have -P with -p or -r.\n");
+		exit(EXIT_FAILURE);
+	}
+	if ((opt_flags & OPT_BENCH) &&
+	    (opt_flags & (OPT_TOP | OPT_JSON | OPT_STREAM | OPT_WEB_UI | OPT_SHM_RING | OPT_RECORD))) {
+		(void)fprintf(stderr, "Cannot have --bench with -j, -J, -t, -T, -S, -w or -W.\n");
+		exit(EXIT_FAILURE);
+	}
 
 	setlocale(LC_ALL, "");
 
@@ -241,7 +456,8 @@ int main(int argc, char **argv)
 		count_from_user = true;
 	}
 
-	const bool interactive_prompt = (argc == 1) && isatty(STDIN_FILENO) && !(opt_flags & OPT_JSON);
+	const bool interactive_prompt = (argc == 1) && isatty(STDIN_FILENO) &&
+		!(opt_flags & (OPT_JSON | OPT_STREAM | OPT_WEB_UI | OPT_SHM_RING | OPT_RECORD));
 	if (interactive_prompt && !duration_from_user) {
 		if (prompt_for_duration(&duration)) {
 			count = -1;
@@ -252,15 +468,22 @@ int main(int argc, char **argv)
 		(void)prompt_for_count(&count, &forever);
 
 	if (count == 0) {
-		if (fault_get_all_pids(&fault_info_new, &npids) == 0) {
-			fault_dump(fault_info_old, fault_info_new, true);
+		if ((fault_get_all_pids(&fault_info_new, &npids) == 0) &&
+		    (tree_update(&fault_info_new, &npids) == 0)) {
+			fault_deltas(fault_info_new, fault_info_old);
+			fault_dump(fault_info_new, true);
 		}
 	} else {
 		struct sigaction new_action;
+		struct rusage bench_usage;
+		strbuf_t frame = { NULL, 0, 0 };
+		long bench_samples = 0;
 		uint64_t t = 1;
-		int i;
+		int i, scale = 1;
 		bool redo = false;
-		double duration_secs = (double)duration, time_start, time_now;
+		bool tree_view = (opt_flags & (OPT_TREE | OPT_TOP)) == (OPT_TREE | OPT_TOP);
+		char pending_key = 0;
+		double duration_secs = (double)duration, time_start, time_now, now;
 
 		if (opt_flags & OPT_TOP)
 			df = df_top;
@@ -269,9 +492,24 @@ int main(int argc, char **argv)
 		 *  the amount of mem infos we alloc during
 		 *  sampling
 		 */
-		if (fault_get_all_pids(&fault_info_old, &npids) < 0)
+		if (opt_flags & OPT_REPLAY) {
+			if ((replay_open(replay_name) < 0) ||
+			    (replay_next(&fault_info_old, &npids) != 0))
+				goto free_cache;
+		} else if ((fault_get_all_pids(&fault_info_old, &npids) < 0) ||
+			   (tree_init(npids) < 0) ||
+			   (tree_update(&fault_info_old, &npids) < 0)) {
 			goto free_cache;
+		}
 		fault_cache_prealloc((npids * 5) / 4);
+		now = sample_time();
+		if ((history_init(now) < 0) || (anomaly_init(npids, now) < 0) ||
+		    (classify_init(now) < 0))
+			goto free_cache;
+		if (faultmap_open() < 0)
+			goto free_cache;
+		if (harden_setup(npids) < 0)
+			goto free_cache;
 
 		if (gettimeofday(&tv1, NULL) < 0) {
 			(void)fprintf(stderr, "gettimeofday failed: errno=%d (%s)\n",
@@ -279,9 +517,23 @@ int main(int argc, char **argv)
 			exit(EXIT_FAILURE);
 		}
 
-		if (!(opt_flags & OPT_TOP))
+		if ((opt_flags & OPT_WEB_UI) && (webui_run((uint16_t)webui_port) < 0))
+			goto free_cache;
+
+		if ((opt_flags & OPT_SHM_RING) && (shmring_open(shm_name) < 0))
+			goto free_cache;
+
+		if ((opt_flags & OPT_RECORD) &&
+		    ((record_open(record_name, duration) < 0) || (record_frame(fault_info_old) < 0)))
+			goto free_cache;
+
+		if (!(opt_flags & (OPT_TOP | OPT_JSON | OPT_STREAM | OPT_WEB_UI | OPT_SHM_RING | OPT_RECORD | OPT_BENCH)))
 			(void)printf("Change in page faults (average per second):\n");
 
+		/* A streaming reader going away is handled by ndjson_emit() */
+		if (opt_flags & OPT_STREAM)
+			(void)signal(SIGPIPE, SIG_IGN);
+
 		(void)memset(&new_action, 0, sizeof(new_action));
 		for (i = 0; signals[i] != -1; i++) {
 			new_action.sa_handler = handle_sig;
@@ -303,22 +555,40 @@ int main(int argc, char **argv)
 		}
 
 		time_now = time_start = gettime_to_double();
+		(void)getrusage(RUSAGE_SELF, &bench_usage);
 
 		df.df_setup();
 		df.df_winsize(true);
 
 		while (!stop_faultstat && (forever || count--)) {
 			struct timeval tv;
+			fd_set rfds;
 			double secs;
-			int nchar;
+			int nchar, ret;
+			char key;
 
 			df.df_clear();
 			cury = 0;
 
+			/* Governor changed the interval, restart the schedule */
+			if (governor_interval_scale() != scale) {
+				scale = governor_interval_scale();
+				duration_secs = (double)duration * scale;
+				time_start = time_now;
+				t = 1;
+			}
+
 			/* Timeout to wait for in the future for this sample */
 			secs = time_start + ((double)t * duration_secs) - time_now;
-			/* Play catch-up, probably been asleep */
-			if (secs < 0.0) {
+			if (opt_flags & OPT_BENCH) {
+				/* Back to back, measuring the cost of a sample */
+				secs = 0.0;
+			} else if (opt_flags & OPT_REPLAY) {
+				/* Replay at the recorded pace, scaled by -x */
+				if (!redo)
+					secs = replay_wait();
+			} else if (secs < 0.0) {
+				/* Play catch-up, probably been asleep */
 				t = ceil((time_now - time_start) / duration_secs);
 				secs = time_start +
 					((double)t * duration_secs) - time_now;
@@ -333,7 +603,27 @@ int main(int argc, char **argv)
 
 			double_to_timeval(secs, &tv);
 retry:
-			if (select(0, NULL, NULL, NULL, &tv) < 0) {
+			/* The tree view takes keys while waiting, to redraw on them */
+			FD_ZERO(&rfds);
+			if (tree_view)
+				FD_SET(STDIN_FILENO, &rfds);
+			ret = select(tree_view ? STDIN_FILENO + 1 : 0, &rfds, NULL, NULL, &tv);
+			if ((ret > 0) && (read(STDIN_FILENO, &key, 1) != 1)) {
+				tree_view = false;	/* No more keys, just wait */
+				goto retry;
+			} else if (ret > 0) {
+				if (tree_key(key)) {
+					df.df_clear();
+					cury = 0;
+					fault_dump_tree();
+					df.df_refresh();
+				} else {
+					pending_key = key;	/* Taken after the wait, as before */
+				}
+				if ((pending_key != 'q') && (pending_key != 'Q') && (pending_key != 27) &&
+				    (timeval_to_double(&tv) > 0.0))
+					goto retry;
+			} else if (ret < 0) {
 				if (errno == EINTR) {
 					if (!resized) {
 						stop_faultstat = true;
@@ -351,10 +641,11 @@ retry:
 			}
 
 			nchar = 0;
-			if ((ioctl(0, FIONREAD, &nchar) == 0) && (nchar > 0)) {
-				char ch;
+			if (pending_key || ((ioctl(0, FIONREAD, &nchar) == 0) && (nchar > 0))) {
+				char ch = pending_key;
 
-				nchar = read(0, &ch, 1);
+				nchar = pending_key ? 1 : read(0, &ch, 1);
+				pending_key = 0;
 				if (nchar == 1) {
 					switch (ch) {
 					case 'q':
@@ -370,40 +661,110 @@ retry:
 						break;
 					case 's':
 						sort_by++;
-						if (sort_by >= SORT_END)
+						/* Percentile keys need the history */
+						if ((sort_by >= SORT_END) ||
+						    ((sort_by >= SORT_P50) && !history_enabled()))
 							sort_by = SORT_MAJOR_MINOR;
 					}
 				}
 			}
 
+			governor_tick_begin();
+			profile_tick_begin();
+
+			if (opt_flags & OPT_REPLAY) {
+				const int replayed = replay_next(&fault_info_new, &npids);
 
-			if (fault_get_all_pids(&fault_info_new, &npids) < 0)
+				if (replayed < 0)
+					goto free_cache;
+				if (replayed > 0)
+					break;	/* End of the recording */
+			} else if ((fault_get_all_pids(&fault_info_new, &npids) < 0) ||
+				   (tree_update(&fault_info_new, &npids) < 0)) {
 				goto free_cache;
+			}
+
+			now = sample_time();
+			PROFILE_PHASE(PROFILE_DELTA);
+			fault_deltas(fault_info_new, fault_info_old);
+			fault_threads(fault_info_new);
+			PROFILE_PHASE(PROFILE_ANALYSE);
+			history_update(fault_info_new, now);
+			anomaly_update(fault_info_new, now);
+			classify_update(fault_info_new, now);
+			faultmap_update();
+
+			/* Serialise once for all frame consumers */
+			PROFILE_PHASE(PROFILE_RENDER);
+			if (opt_flags & (OPT_STREAM | OPT_WEB_UI | OPT_SHM_RING | OPT_BENCH)) {
+				if (fault_json_frame(fault_info_new, &frame) < 0)
+					goto free_cache;
+				if ((opt_flags & OPT_STREAM) && (ndjson_emit(&frame) < 0))
+					goto free_cache;
+				if (opt_flags & OPT_WEB_UI)
+					webui_publish(&frame);
+				if (opt_flags & OPT_SHM_RING)
+					shmring_publish(frame.buf, frame.len);
+			}
 
-			if (opt_flags & OPT_JSON) {
-				fault_dump_json(fault_info_old, fault_info_new);
+			if ((opt_flags & OPT_RECORD) && (record_frame(fault_info_new) < 0))
+				goto free_cache;
+
+			if (opt_flags & OPT_BENCH) {
+				/* Serialised as -J would, but not written */
+			} else if (opt_flags & OPT_STREAM) {
+				/* Frame already written */
+			} else if (opt_flags & OPT_JSON) {
+				fault_dump_json(fault_info_new);
+			} else if (opt_flags & OPT_TREE) {
+				fault_dump_tree();
 			} else if (opt_flags & OPT_TOP_TOTAL) {
-				fault_dump(fault_info_old, fault_info_new, false);
+				fault_dump(fault_info_new, false);
+			} else if ((opt_flags & (OPT_WEB_UI | OPT_SHM_RING | OPT_RECORD)) && !(opt_flags & OPT_TOP)) {
+				/* Serving only, unless an output mode was asked for */
 			} else {
-				fault_dump_diff(fault_info_old, fault_info_new);
+				fault_dump_diff(fault_info_new);
 			}
 
 			df.df_refresh();
 
+			PROFILE_PHASE(PROFILE_OTHER);
 			fault_cache_free_list(fault_info_old);
 			fault_info_old = fault_info_new;
 			fault_info_new = NULL;
+			proc_cache_sweep();
+			harden_warmed_up();
+			governor_tick_end();
+			profile_tick_end();
 			time_now = gettime_to_double();
+			bench_samples++;
 		}
 
+		if (opt_flags & OPT_BENCH)
+			bench_report(bench_samples, npids, time_now - time_start, &bench_usage);
+
 free_cache:
+		harden_shutdown();
 		fault_cache_free_list(fault_info_old);
+		webui_stop();
+		shmring_close();
+		record_close();
+		ndjson_close();
+		faultmap_close();
+		strbuf_free(&frame);
 	}
 
 	display_restore();
+	replay_close();
+	history_cleanup();
+	anomaly_cleanup();
+	tree_cleanup();
+	harden_report();
+	profile_report();
 	uname_cache_cleanup();
 	proc_cache_cleanup();
 	fault_cache_cleanup();
+	harden_cleanup();
 	pid_list_cleanup();
 
 	exit(EXIT_SUCCESS);
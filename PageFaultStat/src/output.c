@@ -0,0 +1,299 @@
+/*
+ * Frame buffers and NDJSON streaming output for PageFaultStat
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+#include <stdarg.h>
+
+#define STRBUF_MIN_SIZE		(64 * 1024)
+
+static int ndjson_fd = -1;		/* stream output fd, -1 = not open */
+static const char *ndjson_path;		/* output path, NULL = stdout */
+static strbuf_t ndjson_pending;		/* unwritten tail of a frame */
+static uint64_t ndjson_seq;		/* frames produced */
+static uint64_t ndjson_dropped;		/* frames dropped on back-pressure */
+
+/*
+ *  strbuf_reserve()
+ *	make room for at least len more bytes
+ */
+int strbuf_reserve(strbuf_t * const sb, const size_t len)
+{
+	size_t size;
+	char *buf;
+
+	if (sb->len + len + 1 <= sb->size)
+		return 0;
+
+	size = sb->size ? sb->size : STRBUF_MIN_SIZE;
+	while (size < sb->len + len + 1)
+		size <<= 1;
+	if ((buf = heap_realloc(sb->buf, size)) == NULL) {
+		out_of_memory("growing output buffer");
+		return -1;
+	}
+	sb->buf = buf;
+	sb->size = size;
+	return 0;
+}
+
+/*
+ *  strbuf_reset()
+ *	empty a buffer, keeping its memory
+ */
+void strbuf_reset(strbuf_t * const sb)
+{
+	sb->len = 0;
+	if (sb->buf)
+		sb->buf[0] = '\0';
+}
+
+/*
+ *  strbuf_free()
+ *	free a buffer's memory
+ */
+void strbuf_free(strbuf_t * const sb)
+{
+	free(sb->buf);
+	(void)memset(sb, 0, sizeof(*sb));
+}
+
+/*
+ *  strbuf_append()
+ *	append len bytes of data
+ */
+int strbuf_append(strbuf_t * const sb, const char *data, const size_t len)
+{
+	if (strbuf_reserve(sb, len) < 0)
+		return -1;
+	(void)memcpy(sb->buf + sb->len, data, len);
+	sb->len += len;
+	sb->buf[sb->len] = '\0';
+	return 0;
+}
+
+/*
+ *  strbuf_printf()
+ *	append formatted text
+ */
+int strbuf_printf(strbuf_t * const sb, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	for (;;) {
+		const size_t avail = sb->size - sb->len;
+
+		va_start(ap, fmt);
+		n = vsnprintf(sb->buf ? sb->buf + sb->len : NULL, sb->buf ? avail : 0, fmt, ap);
+		va_end(ap);
+		if (n < 0)
+			return -1;
+		if (sb->buf && ((size_t)n < avail)) {
+			sb->len += (size_t)n;
+			return 0;
+		}
+		if (strbuf_reserve(sb, (size_t)n) < 0)
+			return -1;
+	}
+}
+
+/*
+ *  strbuf_json_str()
+ *	append a quoted and escaped JSON string
+ */
+int strbuf_json_str(strbuf_t * const sb, const char *str)
+{
+	const unsigned char *ptr;
+
+	if (strbuf_reserve(sb, (strlen(str) * 6) + 2) < 0)
+		return -1;
+
+	sb->buf[sb->len++] = '"';
+	for (ptr = (const unsigned char *)str; *ptr; ptr++) {
+		switch (*ptr) {
+		case '"':
+		case '\\':
+			sb->buf[sb->len++] = '\\';
+			sb->buf[sb->len++] = *ptr;
+			break;
+		case '\n':
+			sb->buf[sb->len++] = '\\';
+			sb->buf[sb->len++] = 'n';
+			break;
+		case '\t':
+			sb->buf[sb->len++] = '\\';
+			sb->buf[sb->len++] = 't';
+			break;
+		default:
+			if (*ptr < 0x20) {
+				sb->len += (size_t)snprintf(sb->buf + sb->len, 7, "\\u%04x", *ptr);
+			} else {
+				sb->buf[sb->len++] = *ptr;
+			}
+			break;
+		}
+	}
+	sb->buf[sb->len++] = '"';
+	sb->buf[sb->len] = '\0';
+
+	return 0;
+}
+
+/*
+ *  ndjson_set_path()
+ *	stream to a file or FIFO rather than stdout
+ */
+void ndjson_set_path(const char *path)
+{
+	ndjson_path = path;
+}
+
+/*
+ *  ndjson_open()
+ *	(re)open the output, a FIFO without a reader fails
+ *	with ENXIO which is not an error, frames are dropped
+ *	until a reader turns up
+ */
+static int ndjson_open(void)
+{
+	struct stat statbuf;
+	int flags;
+
+	if (ndjson_fd >= 0)
+		return 0;
+
+	if (!ndjson_path) {
+		ndjson_fd = STDOUT_FILENO;
+	} else {
+		ndjson_fd = open(ndjson_path, O_WRONLY | O_NONBLOCK | O_APPEND | O_CREAT, 0644);
+		if (ndjson_fd < 0) {
+			if (errno == ENXIO)
+				return -1;
+			(void)fprintf(stderr, "Cannot open %s: errno=%d (%s)\n",
+				ndjson_path, errno, strerror(errno));
+			return -2;
+		}
+	}
+
+	/*
+	 *  Only pipes, FIFOs and sockets can push back, don't
+	 *  change the blocking mode of a shared terminal
+	 */
+	if ((fstat(ndjson_fd, &statbuf) == 0) &&
+	    (S_ISFIFO(statbuf.st_mode) || S_ISSOCK(statbuf.st_mode))) {
+		flags = fcntl(ndjson_fd, F_GETFL);
+		if (flags >= 0)
+			(void)fcntl(ndjson_fd, F_SETFL, flags | O_NONBLOCK);
+	}
+	return 0;
+}
+
+/*
+ *  ndjson_close()
+ *	close the output
+ */
+void ndjson_close(void)
+{
+	if ((ndjson_fd >= 0) && (ndjson_fd != STDOUT_FILENO))
+		(void)close(ndjson_fd);
+	ndjson_fd = -1;
+	strbuf_free(&ndjson_pending);
+}
+
+/*
+ *  ndjson_write()
+ *	write as much of data as the reader will take without
+ *	blocking, returns bytes written or -1 if the reader has gone
+ */
+static ssize_t ndjson_write(const char *data, const size_t len)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		const ssize_t ret = write(ndjson_fd, data + done, len - done);
+
+		PROFILE_IO(1, ret > 0 ? (size_t)ret : 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				break;
+			return -1;
+		}
+		done += (size_t)ret;
+	}
+	return (ssize_t)done;
+}
+
+/*
+ *  ndjson_emit()
+ *	write one newline terminated frame. The sampler never
+ *	waits for the reader, if the previous frame has not been
+ *	fully consumed yet this frame is dropped
+ */
+int ndjson_emit(const strbuf_t * const frame)
+{
+	ssize_t ret;
+
+	ndjson_seq++;
+	ret = ndjson_open();
+	if (ret == -2)
+		return -1;
+	if (ret < 0) {
+		ndjson_dropped++;
+		return 0;
+	}
+
+	if (ndjson_pending.len) {
+		ret = ndjson_write(ndjson_pending.buf, ndjson_pending.len);
+		if (ret < 0)
+			goto reader_gone;
+		if ((size_t)ret < ndjson_pending.len) {
+			(void)memmove(ndjson_pending.buf, ndjson_pending.buf + ret,
+				ndjson_pending.len - (size_t)ret);
+			ndjson_pending.len -= (size_t)ret;
+			ndjson_dropped++;
+			return 0;
+		}
+		strbuf_reset(&ndjson_pending);
+	}
+
+	ret = ndjson_write(frame->buf, frame->len);
+	if (ret < 0)
+		goto reader_gone;
+	if (ret == 0) {
+		ndjson_dropped++;
+		return 0;
+	}
+	/* Never leave a torn frame, the rest goes out next tick */
+	if ((size_t)ret < frame->len)
+		return strbuf_append(&ndjson_pending, frame->buf + ret, frame->len - (size_t)ret);
+	return 0;
+
+reader_gone:
+	strbuf_reset(&ndjson_pending);
+	ndjson_dropped++;
+	if (!ndjson_path) {
+		/* Nobody is listening on stdout any more */
+		stop_faultstat = true;
+		return 0;
+	}
+	/* FIFO reader went away, wait for the next one */
+	(void)close(ndjson_fd);
+	ndjson_fd = -1;
+	return 0;
+}
+
+/*
+ *  ndjson_get_stats()
+ *	frames produced and dropped so far
+ */
+void ndjson_get_stats(uint64_t * const seq, uint64_t * const dropped)
+{
+	*seq = ndjson_seq;
+	*dropped = ndjson_dropped;
+}
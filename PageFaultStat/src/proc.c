@@ -6,6 +6,18 @@
 #define _XOPEN_SOURCE_EXTENDED
 
 #include "faultstat.h"
+#include <time.h>
+#include <sys/syscall.h>
+
+/* -H, expand processes with more faults than this in a sample, -1 = off */
+static long thread_threshold = -1;
+
+/* Last sample by PID, built by fault_deltas() */
+static fault_info_t *fault_index[FAULT_INDEX_SIZE];
+
+/* fault_parse_stat() fields read for the counters, and for all of them */
+#define STAT_FIELDS_FAULTS	(5)
+#define STAT_FIELDS_ALL		(7)
 
 /*
  *  get_proc_self_stat_field()
@@ -51,24 +63,99 @@ static const char *get_proc_self_stat_field(const char *buf, const int num)
 	return ptr;
 }
 
+/*
+ *  fault_parse_stat()
+ *	parse the parent, fault counters, start time and rss
+ *	out of /proc/$PID/stat data, returns the number of
+ *	fields read or -1 if the line is malformed
+ */
+static int fault_parse_stat(const char *buf, fault_info_t * const fault_info)
+{
+	static long page_kb;
+	unsigned long min_fault, cmin_fault, maj_fault, cmaj_fault;
+	uint64_t start_time;
+	long rss;
+	int ppid;
+	const char *ptr;
+	int n;
+
+	if (!page_kb)
+		page_kb = sysconf(_SC_PAGESIZE) / 1024;
+
+	ptr = get_proc_self_stat_field(buf, 4);
+	if (!ptr)
+		return -1;
+
+	/*
+	 *  Fields 4 ppid, 10 minflt, 11 cminflt, 12 majflt,
+	 *  13 cmajflt, 22 starttime and 24 rss
+	 */
+	n = sscanf(ptr, "%d %*d %*d %*d %*d %*u %lu %lu %lu %lu %*u %*u %*d %*d %*d %*d %*d %*d %"
+		SCNu64 " %*u %ld",
+		&ppid, &min_fault, &cmin_fault, &maj_fault, &cmaj_fault, &start_time, &rss);
+	if (n >= STAT_FIELDS_FAULTS) {
+		fault_info->ppid = (pid_t)ppid;
+		fault_info->min_fault = min_fault;
+		fault_info->cmin_fault = cmin_fault;
+		fault_info->maj_fault = maj_fault;
+		fault_info->cmaj_fault = cmaj_fault;
+	}
+	if (n == STAT_FIELDS_ALL) {
+		fault_info->start_time = start_time;
+		fault_info->rss = rss * page_kb;
+	}
+	return n;
+}
+
+/*
+ *  fault_pid_wanted()
+ *	true if there is no -p list or the pid or
+ *	command matches an entry on it
+ */
+bool fault_pid_wanted(const pid_t pid, char *cmdline)
+{
+	pid_list_t *p;
+
+	if (!pids)
+		return true;
+
+	for (p = pids; p; p = p->next) {
+		if (p->pid == pid)
+			return true;
+		if (p->name && cmdline) {
+			char *tmp_cmdline = cmdline;
+
+			if (strchr(p->name, '/') == NULL)
+				tmp_cmdline = basename(cmdline);
+
+		 	if (tmp_cmdline && procnamecmp(p->name, tmp_cmdline) == 0)
+				return true;
+		}
+	}
+	return false;
+}
+
 /*
  *  fault_get_by_proc()
  *	get page fault info for a specific proc
  */
 int fault_get_by_proc(const pid_t pid, fault_info_t ** const fault_info)
 {
-	FILE *fp;
 	fault_info_t *new_fault_info;
 	proc_info_t *proc;
-	unsigned long min_fault, maj_fault, vm_swap;
-	int n;
+	unsigned long vm_swap;
 	char buffer[4096];
 	char path[PATH_MAX];
 	const char *ptr;
 	int got_fields = 0;
+	int n;
 
-	if (getpgid(pid) == 0)
-		return 0;	/* Kernel thread */
+	PROFILE_PHASE(PROFILE_STAT);
+	if (!proc_root_custom) {
+		PROFILE_IO(1, 0);
+		if (getpgid(pid) == 0)
+			return 0;	/* Kernel thread */
+	}
 
 	if ((proc = proc_cache_find_by_pid(pid)) == NULL)
 		return 0;	/* It died before we could get info */
@@ -76,62 +163,78 @@ int fault_get_by_proc(const pid_t pid, fault_info_t ** const fault_info)
 	if (proc->kernel_thread)
 		return 0;	/* Ignore */
 
-	if (pids) {
-		pid_list_t *p;
-
-		for (p = pids; p; p = p->next) {
-			if (p->pid == pid)
-				break;
-			if (p->name) {
-				char *tmp_cmdline = proc->cmdline;
-
-				if (strchr(p->name, '/') == NULL)
-					tmp_cmdline = basename(proc->cmdline);
-
-			 	if (tmp_cmdline && procnamecmp(p->name, tmp_cmdline) == 0)
-					break;
-			}
-		}
-		if (!p)
-			return 0;
-	}
+	if (!fault_pid_wanted(pid, proc->cmdline))
+		return 0;
 
 	if ((new_fault_info = fault_cache_alloc()) == NULL)
 		return -1;
 
-	(void)snprintf(path, sizeof(path), "/proc/%i/stat", pid);
-	if ((fp = fopen(path, "r")) == NULL) {
+	/*
+	 *  Plain read() rather than stdio, fopen() would
+	 *  allocate a FILE for every process on every tick
+	 */
+	(void)snprintf(path, sizeof(path), "%s/%i/stat", proc_root, pid);
+	if (read_file(path, buffer, sizeof(buffer)) <= 0) {
 		fault_cache_free(new_fault_info);
 		return -1;	/* Gone? */
 	}
-	(void)memset(buffer, 0, sizeof(buffer));
-	if (fgets(buffer, sizeof(buffer) - 1, fp) == NULL) {
-		fault_cache_free(new_fault_info);
-		(void)fclose(fp);
-		return -1;
-	}
-	(void)fclose(fp);
-	ptr = get_proc_self_stat_field(buffer, 10);
-	if (!ptr) {
-		fault_cache_free(new_fault_info);
-		return -1;
+
+	/*
+	 *  A short read of the stat file must not turn into zero
+	 *  counters, that would show up as a huge drop and then a
+	 *  huge jump, so carry the last good counters forward
+	 */
+	n = fault_parse_stat(buffer, new_fault_info);
+	if (n < STAT_FIELDS_FAULTS) {
+		if (!proc->have_stat) {
+			fault_cache_free(new_fault_info);
+			return -1;
+		}
+		new_fault_info->ppid = proc->ppid;
+		new_fault_info->min_fault = proc->min_fault;
+		new_fault_info->cmin_fault = proc->cmin_fault;
+		new_fault_info->maj_fault = proc->maj_fault;
+		new_fault_info->cmaj_fault = proc->cmaj_fault;
 	}
-	n = sscanf(ptr, "%lu %*u %lu",
-		&min_fault, &maj_fault);
-	if (n == 2) {
-		new_fault_info->min_fault = min_fault;
-		new_fault_info->maj_fault = maj_fault;
+	if (n < STAT_FIELDS_ALL) {
+		new_fault_info->start_time = proc->start_time;
+		new_fault_info->rss = proc->rss;
 	}
+	proc->have_stat = true;
+	proc->ppid = new_fault_info->ppid;
+	proc->min_fault = new_fault_info->min_fault;
+	proc->cmin_fault = new_fault_info->cmin_fault;
+	proc->maj_fault = new_fault_info->maj_fault;
+	proc->cmaj_fault = new_fault_info->cmaj_fault;
+	proc->start_time = new_fault_info->start_time;
+	proc->rss = new_fault_info->rss;
 
 	new_fault_info->pid = pid;
-	new_fault_info->proc = proc_cache_find_by_pid(pid);
+	new_fault_info->proc = proc;
 	new_fault_info->uid = 0;
 	new_fault_info->uname = NULL;
 	new_fault_info->next = *fault_info;
 	*fault_info = new_fault_info;
 
-	(void)snprintf(path, sizeof(path), "/proc/%i/status", pid);
-	if ((fp = fopen(path, "r")) == NULL)
+	/*
+	 *  When the governor is shedding load the status
+	 *  file is only re-read for a subset of processes
+	 *  per tick, the rest re-use the last values seen
+	 */
+	if (proc->have_status && !governor_read_status(pid)) {
+		new_fault_info->uid = proc->uid;
+		new_fault_info->uname = proc->uname;
+		new_fault_info->vm_swap = proc->vm_swap;
+		return 0;
+	}
+
+	/* Outside the -P subtrees, dropped once the tree is updated */
+	if (!tree_status_wanted(pid, new_fault_info->ppid))
+		return 0;
+
+	PROFILE_PHASE(PROFILE_STATUS);
+	(void)snprintf(path, sizeof(path), "%s/%i/status", proc_root, pid);
+	if (read_file(path, buffer, sizeof(buffer)) < 0)
 		return 0;
 
 	/*
@@ -141,88 +244,356 @@ int fault_get_by_proc(const pid_t pid, fault_info_t ** const fault_info)
 	 *  uname_name() to fetch the uname to handle
 	 *  the NULL uname cases.
 	 */
-	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-		if (!strncmp(buffer, "VmSwap:", 7)) {
-			if (sscanf(buffer + 8, "%lu", &vm_swap) == 1)
+	for (ptr = buffer; ptr && *ptr; ptr = strchr(ptr, '\n'), ptr = ptr ? ptr + 1 : NULL) {
+		if (!strncmp(ptr, "VmSwap:", 7)) {
+			if (sscanf(ptr + 8, "%lu", &vm_swap) == 1)
 				new_fault_info->vm_swap = vm_swap;
 			got_fields++;
-		} else if (!strncmp(buffer, "Uid:", 4)) {
-			if (sscanf(buffer + 5, "%9i", &new_fault_info->uid) == 1) {
+		} else if (!strncmp(ptr, "Uid:", 4)) {
+			if (sscanf(ptr + 5, "%9i", &new_fault_info->uid) == 1) {
 				new_fault_info->uname = uname_cache_find(new_fault_info->uid);
-				if (new_fault_info->uname == NULL) {
-					(void)fclose(fp);
+				if (new_fault_info->uname == NULL)
 					return -1;
-				}
 			}
 			got_fields++;
 		}
 		if (got_fields == 2)
 			break;
 	}
-	(void)fclose(fp);
+
+	proc->uid = new_fault_info->uid;
+	proc->uname = new_fault_info->uname;
+	proc->vm_swap = new_fault_info->vm_swap;
+	proc->have_status = true;
 
 	return 0;
 }
 
 /*
- *  fault_get_all_pids()
- *	scan processes for page fault info
+ *  fault_get_stat()
+ *	get just the parent and fault counters of a process
+ *	from its stat, no cmdline, status or proc cache entry
  */
-int fault_get_all_pids(fault_info_t ** const fault_info, size_t * const npids)
+int fault_get_stat(const pid_t pid, fault_info_t ** const fault_info)
 {
-	DIR *dir;
-	struct dirent *entry;
+	fault_info_t *new_fault_info;
+	char buffer[4096];
+	char path[PATH_MAX];
+
+	PROFILE_PHASE(PROFILE_STAT);
+	if ((new_fault_info = fault_cache_alloc()) == NULL)
+		return -1;
+	(void)snprintf(path, sizeof(path), "%s/%i/stat", proc_root, pid);
+	if ((read_file(path, buffer, sizeof(buffer)) <= 0) ||
+	    (fault_parse_stat(buffer, new_fault_info) < STAT_FIELDS_FAULTS)) {
+		fault_cache_free(new_fault_info);
+		return -1;	/* Gone? */
+	}
+	new_fault_info->pid = pid;
+	new_fault_info->next = *fault_info;
+	*fault_info = new_fault_info;
+
+	return 0;
+}
+
+/*
+ *  fault_scan()
+ *	call get on every process in proc_root
+ */
+static int fault_scan(
+	int (*get)(const pid_t pid, fault_info_t ** const fault_info),
+	fault_info_t ** const fault_info,
+	size_t * const npids)
+{
+	/* getdents64 straight into a static buffer, opendir() mallocs */
+	static char dents[32768];
+	int fd;
+	long nread;
 	*npids = 0;
 
-	if ((dir = opendir("/proc")) == NULL) {
+	PROFILE_PHASE(PROFILE_READDIR);
+	PROFILE_IO(2, 0);	/* open and close */
+	if ((fd = open(proc_root, O_RDONLY | O_DIRECTORY)) < 0) {
 		display_restore();
-		(void)fprintf(stderr, "Cannot read directory /proc\n");
+		(void)fprintf(stderr, "Cannot read directory %s\n", proc_root);
 		return -1;
 	}
 
-	while ((entry = readdir(dir)) != NULL) {
-		pid_t pid;
+	while ((nread = syscall(SYS_getdents64, fd, dents, sizeof(dents))) > 0) {
+		long off;
 
-		if (!isdigit(entry->d_name[0]))
-			continue;
-		pid = (pid_t)strtoul(entry->d_name, NULL, 10);
+		PROFILE_IO(1, (size_t)nread);
 
-		if (fault_get_by_proc(pid, fault_info) < 0)
-			continue;
-		(*npids)++;
+		for (off = 0; off < nread; ) {
+			const struct linux_dirent64 *entry =
+				(const struct linux_dirent64 *)(dents + off);
+			pid_t pid;
+			int ret;
+
+			off += entry->d_reclen;
+			if (!isdigit(entry->d_name[0]))
+				continue;
+			pid = (pid_t)strtoul(entry->d_name, NULL, 10);
+
+			ret = get(pid, fault_info);
+			PROFILE_PHASE(PROFILE_READDIR);
+			if (ret < 0)
+				continue;
+			(*npids)++;
+		}
 	}
+	PROFILE_IO(1, 0);	/* the getdents64 that ended the scan */
 
-	(void)closedir(dir);
+	(void)close(fd);
 
 	return 0;
 }
 
+/*
+ *  fault_get_all_pids()
+ *	scan processes for page fault info
+ */
+int fault_get_all_pids(fault_info_t ** const fault_info, size_t * const npids)
+{
+	proc_cache_new_gen();
+	return fault_scan(fault_get_by_proc, fault_info, npids);
+}
+
+/*
+ *  fault_get_all_stats()
+ *	scan processes for just their parent and fault
+ *	counters, see fault_get_stat()
+ */
+int fault_get_all_stats(fault_info_t ** const fault_info, size_t * const npids)
+{
+	return fault_scan(fault_get_stat, fault_info, npids);
+}
+
 /*
  *  fault_delta()
- *	compute page fault changes
+ *	compute page fault changes against the same process
+ *	in the last sample, or NULL if it was not in it
  */
-void fault_delta(fault_info_t * const fault_new, fault_info_t *const fault_old_list)
+static void fault_delta(fault_info_t * const fault_new, const fault_info_t * const fault_old)
 {
-	fault_info_t *fault_old;
+	if (fault_old) {
+		fault_new->d_min_fault = fault_new->min_fault - fault_old->min_fault;
+		fault_new->d_maj_fault = fault_new->maj_fault - fault_old->maj_fault;
+		fault_new->d_vm_swap = fault_new->vm_swap - fault_old->vm_swap;
+		fault_new->d_rss = fault_new->rss - fault_old->rss;
+	} else {
+		fault_new->d_min_fault = fault_new->min_fault;
+		fault_new->d_maj_fault = fault_new->maj_fault;
+		fault_new->d_vm_swap = fault_new->vm_swap;
+		fault_new->d_rss = 0;
+	}
+}
+
+/*
+ *  fault_find()
+ *	find a process in a list, a reused PID is
+ *	a new process, not a drop in its counters
+ */
+static const fault_info_t *fault_find(
+	const fault_info_t * const fault_new,
+	const fault_info_t * const fault_old_list)
+{
+	const fault_info_t *fault_old;
 
 	for (fault_old = fault_old_list; fault_old; fault_old = fault_old->next) {
-		if (fault_new->pid == fault_old->pid) {
-			fault_new->d_min_fault = fault_new->min_fault - fault_old->min_fault;
-			fault_new->d_maj_fault = fault_new->maj_fault - fault_old->maj_fault;
-			fault_old->alive = true;
-			return;
+		if (fault_new->pid == fault_old->pid)
+			return (fault_new->start_time == fault_old->start_time) ? fault_old : NULL;
+	}
+	return NULL;
+}
+
+/*
+ *  fault_index_find()
+ *	find a process in the last sample index, O(1)
+ *	rather than a walk of the whole last sample
+ */
+static const fault_info_t *fault_index_find(const fault_info_t * const fault_new)
+{
+	const fault_info_t *fault_old;
+
+	for (fault_old = fault_index[(size_t)fault_new->pid & (FAULT_INDEX_SIZE - 1)];
+	     fault_old; fault_old = fault_old->i_next) {
+		if (fault_new->pid == fault_old->pid)
+			return (fault_new->start_time == fault_old->start_time) ? fault_old : NULL;
+	}
+	return NULL;
+}
+
+/*
+ *  fault_deltas()
+ *	compute page fault changes of a whole sample in
+ *	one pass, the dumps and frames use the results.
+ *	The last sample is indexed by PID until it is freed
+ */
+void fault_deltas(fault_info_t * const fault_info_new, fault_info_t * const fault_info_old)
+{
+	fault_info_t *fault_info;
+
+	(void)memset(fault_index, 0, sizeof(fault_index));
+	for (fault_info = fault_info_old; fault_info; fault_info = fault_info->next) {
+		const size_t h = (size_t)fault_info->pid & (FAULT_INDEX_SIZE - 1);
+
+		fault_info->i_next = fault_index[h];
+		fault_index[h] = fault_info;
+	}
+	for (fault_info = fault_info_new; fault_info; fault_info = fault_info->next)
+		fault_delta(fault_info, fault_index_find(fault_info));
+}
+
+/*
+ *  fault_set_thread_threshold()
+ *	parse -H, the faults a process needs in a
+ *	sample before its threads are shown
+ */
+int fault_set_thread_threshold(const char *arg)
+{
+	char *end;
+
+	errno = 0;
+	thread_threshold = strtol(arg, &end, 10);
+	if (errno || *end || (thread_threshold < 0))
+		return -1;
+	opt_flags |= OPT_THREADS;
+	return 0;
+}
+
+/*
+ *  fault_get_threads()
+ *	read the threads of a process from /proc/$PID/task/$TID/stat
+ *	with the process parser, deltas against the last sample's
+ *	threads or zero if they were not read then, in which case
+ *	the busiest overall come first
+ */
+static int fault_get_threads(fault_info_t * const fault_info, const fault_info_t * const fault_old)
+{
+	static char dents[16384];
+	fault_info_t *threads = NULL, *thread, *next, **l;
+	char path[PATH_MAX], buffer[4096];
+	long nread;
+	int fd;
+
+	PROFILE_PHASE(PROFILE_STAT);
+	PROFILE_IO(2, 0);	/* open and close */
+	(void)snprintf(path, sizeof(path), "%s/%i/task", proc_root, fault_info->pid);
+	if ((fd = open(path, O_RDONLY | O_DIRECTORY)) < 0)
+		return 0;	/* Gone */
+
+	while ((nread = syscall(SYS_getdents64, fd, dents, sizeof(dents))) > 0) {
+		long off;
+
+		PROFILE_IO(1, (size_t)nread);
+		for (off = 0; off < nread; ) {
+			const struct linux_dirent64 *entry =
+				(const struct linux_dirent64 *)(dents + off);
+			const char *comm, *comm_end;
+			size_t len;
+
+			off += entry->d_reclen;
+			if (!isdigit(entry->d_name[0]))
+				continue;
+
+			(void)snprintf(path, sizeof(path), "%s/%i/task/%s/stat",
+				proc_root, fault_info->pid, entry->d_name);
+			if (read_file(path, buffer, sizeof(buffer)) <= 0)
+				continue;
+			if ((thread = fault_cache_alloc()) == NULL) {
+				(void)close(fd);
+				fault_cache_free_list(threads);
+				return -1;
+			}
+			if (fault_parse_stat(buffer, thread) < STAT_FIELDS_ALL) {
+				fault_cache_free(thread);
+				continue;
+			}
+
+			/* The thread name is the comm field, in the same line */
+			comm = strchr(buffer, '(');
+			comm_end = strrchr(buffer, ')');
+			if (comm && comm_end && (comm_end > comm)) {
+				len = (size_t)(comm_end - comm - 1);
+				if (len >= sizeof(thread->comm))
+					len = sizeof(thread->comm) - 1;
+				(void)memcpy(thread->comm, comm + 1, len);
+				thread->comm[len] = '\0';
+			}
+			thread->pid = (pid_t)strtoul(entry->d_name, NULL, 10);
+			thread->proc = fault_info->proc;
+			thread->uid = fault_info->uid;
+			thread->uname = fault_info->uname;
+			if (fault_old && fault_old->threads)
+				fault_delta(thread, fault_find(thread, fault_old->threads));
+			thread->next = threads;
+			threads = thread;
 		}
 	}
-	fault_new->d_min_fault = fault_new->min_fault;
-	fault_new->d_maj_fault = fault_new->maj_fault;
+	PROFILE_IO(1, 0);	/* the getdents64 that ended the scan */
+	(void)close(fd);
+
+	/* Busiest first, there are rarely more than a few hundred */
+	for (thread = threads; thread; thread = next) {
+		next = thread->next;
+		for (l = &fault_info->threads; *l; l = &(*l)->next) {
+			if (((*l)->d_maj_fault < thread->d_maj_fault) ||
+			    (((*l)->d_maj_fault == thread->d_maj_fault) &&
+			     ((*l)->d_min_fault < thread->d_min_fault)) ||
+			    (((*l)->d_maj_fault == thread->d_maj_fault) &&
+			     ((*l)->d_min_fault == thread->d_min_fault) &&
+			     ((*l)->maj_fault + (*l)->min_fault < thread->maj_fault + thread->min_fault)))
+				break;
+		}
+		thread->next = *l;
+		*l = thread;
+	}
+	return 0;
+}
+
+/*
+ *  fault_threads()
+ *	read the threads of the processes over the -H threshold,
+ *	and of those shown last time while they keep faulting
+ */
+void fault_threads(fault_info_t * const fault_info_new)
+{
+	fault_info_t *fault_info;
+
+	if (!(opt_flags & OPT_THREADS))
+		return;
+
+	for (fault_info = fault_info_new; fault_info; fault_info = fault_info->next) {
+		proc_info_t * const proc = fault_info->proc;
+		const fault_info_t *fault_old;
+		bool expand;
+
+		if (!proc)
+			continue;
+		expand = (fault_info->d_maj_fault > thread_threshold) ||
+			 (fault_info->d_min_fault > thread_threshold) ||
+			 (proc->threads_shown &&
+			  (fault_info->d_maj_fault + fault_info->d_min_fault > 0));
+		proc->threads_shown = false;
+		if (!expand)
+			continue;
+
+		fault_old = fault_index_find(fault_info);
+		if (fault_get_threads(fault_info, fault_old) < 0)
+			return;
+		proc->threads_shown = true;
+	}
 }
 
 /*
  *  get_cmdline()
  *	get command line if it is defined
  */
-static inline char *get_cmdline(const fault_info_t * const fault_info)
+static inline const char *get_cmdline(const fault_info_t * const fault_info)
 {
+	if (fault_info->comm[0])
+		return fault_info->comm;
 	if (fault_info->proc && fault_info->proc->cmdline)
 		return fault_info->proc->cmdline;
 
@@ -259,18 +630,293 @@ static bool compare(const fault_info_t *f1, const fault_info_t *f2)
 	case SORT_SWAP:
 		return f1->vm_swap < f2->vm_swap;
 		break;
+	case SORT_P50:
+	case SORT_P90:
+	case SORT_P99:
+	case SORT_PMAX:
+		/* Major faults hurt most, minor faults break ties */
+		if (f1->pct_maj_fault != f2->pct_maj_fault)
+			return f1->pct_maj_fault < f2->pct_maj_fault;
+		return f1->pct_min_fault < f2->pct_min_fault;
+		break;
 	default:
 		break;
 	}
 	return true;
 }
 
+/*
+ *  fault_sort()
+ *	merge sort a list linked by s_next in compare() order,
+ *	O(n log n) without allocating, equal ones keep their order
+ */
+static fault_info_t *fault_sort(fault_info_t *list)
+{
+	fault_info_t *a, *b, *slow, *fast, *sorted = NULL, **l = &sorted;
+
+	if (!list || !list->s_next)
+		return list;
+
+	for (slow = list, fast = list->s_next; fast && fast->s_next; fast = fast->s_next->s_next)
+		slow = slow->s_next;
+	b = slow->s_next;
+	slow->s_next = NULL;
+	a = fault_sort(list);
+	b = fault_sort(b);
+
+	while (a && b) {
+		if (compare(a, b)) {
+			*l = b;
+			b = b->s_next;
+		} else {
+			*l = a;
+			a = a->s_next;
+		}
+		l = &(*l)->s_next;
+	}
+	*l = a ? a : b;
+	return sorted;
+}
+
+/*
+ *  fault_sort_pct()
+ *	percentile the sort key is on, -1 if it is not a percentile
+ */
+static inline int fault_sort_pct(void)
+{
+	if ((sort_by < SORT_P50) || (sort_by > SORT_PMAX) || !history_enabled())
+		return -1;
+	return sort_by - SORT_P50;	/* SORT_P50 .. SORT_PMAX follow HIST_P50 .. HIST_MAX */
+}
+
+/*
+ *  fault_sort_key()
+ *	fetch the rate percentiles sorted on, dead processes keep
+ *	the ones fetched while they were alive
+ */
+static void fault_sort_key(fault_info_t * const fault_info)
+{
+	const int pct = fault_sort_pct();
+	history_pcts_t hp;
+
+	if (pct < 0)
+		return;
+	(void)history_get_percentiles(fault_info->pid, &hp);
+	fault_info->pct_maj_fault = hp.major[pct];
+	fault_info->pct_min_fault = hp.minor[pct];
+}
+
+/*
+ *  fault_pct_column()
+ *	rate percentile column shown while sorting on it
+ */
+static const char *fault_pct_column(const fault_info_t * const fault_info, char * const buf, const size_t buflen)
+{
+	char s_maj[12], s_min[12];
+
+	if (fault_sort_pct() < 0)
+		return "";
+	if (fault_info->comm[0]) {
+		/* Thread rows have no history of their own */
+		(void)snprintf(buf, buflen, " %6s %-7s", "", "");
+		return buf;
+	}
+	int64_to_str(fault_info->pct_maj_fault, s_maj, sizeof(s_maj));
+	int64_to_str(fault_info->pct_min_fault, s_min, sizeof(s_min));
+	(void)snprintf(buf, buflen, " %6s/%-7s", s_maj, s_min);
+	return buf;
+}
+
+/*
+ *  fault_arrow()
+ *	direction of the change in faults, "" if not shown
+ */
+static const char *fault_arrow(const fault_info_t * const fault_info)
+{
+	const int64_t delta = fault_info->d_min_fault + fault_info->d_maj_fault;
+
+	if (!(opt_flags & OPT_ARROW))
+		return "";
+#if 0
+	return (delta < 0) ? "\u2193 " : ((delta > 0) ? "\u2191 "  : "  ");
+#endif
+	return (delta < 0) ? "v" : ((delta > 0) ? "^ "  : "  ");
+}
+
+/*
+ *  fault_dump_threads()
+ *	thread rows under a process in the columns of its own row,
+ *	with changes only if changed. Threads read for the first
+ *	time have no deltas yet, so they are all shown
+ */
+static void fault_dump_threads(const fault_info_t * const fault_info, const int pid_size, const bool changed)
+{
+	const fault_info_t *thread, *fault_old;
+	char s_min_fault[12], s_maj_fault[12],
+	     s_d_min_fault[12], s_d_maj_fault[12], s_pct[32];
+	bool all = !changed;
+
+	if (!all) {
+		fault_old = fault_index_find(fault_info);
+		all = !fault_old || !fault_old->threads;
+	}
+	for (thread = fault_info->threads; thread; thread = thread->next) {
+		if (!all && ((thread->d_min_fault + thread->d_maj_fault) == 0))
+			continue;
+		int64_to_str(thread->maj_fault, s_maj_fault, sizeof(s_maj_fault));
+		int64_to_str(thread->min_fault, s_min_fault, sizeof(s_min_fault));
+		int64_to_str(thread->d_maj_fault, s_d_maj_fault, sizeof(s_d_maj_fault));
+		int64_to_str(thread->d_min_fault, s_d_min_fault, sizeof(s_d_min_fault));
+		df.df_printf(" %*d %7s %7s %7s %7s %7s%s %s%-10.10s   \\_ %s\n",
+			pid_size, thread->pid,
+			s_maj_fault, s_min_fault,
+			s_d_maj_fault, s_d_min_fault, "",
+			fault_pct_column(thread, s_pct, sizeof(s_pct)),
+			changed ? "" : fault_arrow(thread),
+			uname_name(thread->uname), thread->comm);
+	}
+}
+
+/*
+ *  fault_dump_map()
+ *	faults by mapping of the -F process, most first,
+ *	with the last instruction that faulted on each
+ */
+static void fault_dump_map(void)
+{
+	const faultmap_mapping_t * const *map_rows;
+	faultmap_stats_t st;
+	size_t i, n;
+	char s_d_maj_fault[12], s_d_min_fault[12], s_ip[64];
+
+	if (!faultmap_enabled())
+		return;
+	n = faultmap_rows(&map_rows, &st);
+
+	df.df_attrset(A_BOLD);
+	df.df_printf("Faults by mapping, PID %d%s: %" PRIu32 " threads",
+		st.pid, st.exited ? " (exited)" : "", st.threads);
+	if (st.threads_skipped)
+		df.df_printf(" (%" PRIu32 " not sampled)", st.threads_skipped);
+	df.df_printf(", %" PRIu64 " major %" PRIu64 " minor faults, %" PRIu64
+		" samples (1 in %" PRIu64 " major, 1 in %" PRIu64 " minor%s)",
+		st.d_maj_fault, st.d_min_fault, st.samples,
+		st.period_maj, st.period_min, st.user_only ? ", user only" : "");
+	if (st.lost || st.throttled)
+		df.df_printf(", %" PRIu64 " lost, %" PRIu64 " throttled", st.lost, st.throttled);
+	df.df_printf("\n");
+	df.df_printf("  +Major  +Minor  Last IP                   Mapping\n");
+	df.df_attrset(A_NORMAL);
+
+	/* In top mode only what fits */
+	if ((opt_flags & OPT_TOP) && (rows - cury > 1) && (n > (size_t)(rows - cury - 1)))
+		n = (size_t)(rows - cury - 1);
+	for (i = 0; i < n; i++) {
+		const faultmap_mapping_t * const m = map_rows[i];
+
+		int64_to_str((int64_t)m->d_maj_fault, s_d_maj_fault, sizeof(s_d_maj_fault));
+		int64_to_str((int64_t)m->d_min_fault, s_d_min_fault, sizeof(s_d_min_fault));
+		if (m->ip_mapping) {
+			const char *name = faultmap_name(m->ip_mapping - 1);
+			const char *base = strrchr(name, '/');
+
+			(void)snprintf(s_ip, sizeof(s_ip), "%s+0x%" PRIx64,
+				base ? base + 1 : name, m->ip_offset);
+		} else {
+			(void)snprintf(s_ip, sizeof(s_ip), "0x%" PRIx64, m->ip_offset);
+		}
+		df.df_printf(" %7s %7s  %-24.24s  %s\n",
+			s_d_maj_fault, s_d_min_fault, s_ip, m->name);
+	}
+	df.df_printf("\n");
+}
+
+/*
+ *  fault_status_lines()
+ *	output top mode status lines above the heading
+ */
+static void fault_status_lines(void)
+{
+	if (governor_enabled()) {
+		governor_state_t gs;
+
+		governor_get_state(&gs);
+		df.df_printf("Governor: CPU %.2f%% of %.2f%% budget, level %d "
+			"(interval x%d, status every %u)\n",
+			gs.cpu_percent, gs.budget, gs.level,
+			gs.scale, gs.status_every);
+	}
+	if (history_enabled()) {
+		history_rates_t hr;
+		size_t used, capacity, untracked;
+
+		history_get_system_rates(&hr);
+		history_get_usage(&used, &capacity, &untracked);
+		df.df_printf("Rates: last 5 min %.2f major/s %.2f minor/s, "
+			"last 1 h %.2f major/s %.2f minor/s (%zu of %zu slots",
+			hr.major[HISTORY_5M], hr.minor[HISTORY_5M],
+			hr.major[HISTORY_1H], hr.minor[HISTORY_1H],
+			used, capacity);
+		if (untracked)
+			df.df_printf(", %zu untracked", untracked);
+		df.df_printf(")\n");
+	}
+	if (anomaly_enabled()) {
+		anomaly_event_t ev;
+		size_t nactive;
+		uint64_t dropped;
+
+		if (anomaly_get_state(&nactive, &dropped, &ev)) {
+			const time_t t = (time_t)ev.time;
+			struct tm tm;
+			char when[16];
+
+			(void)strftime(when, sizeof(when), "%H:%M:%S", localtime_r(&t, &tm));
+			if (nactive || anomaly_system_active())
+				df.df_attrset(A_BOLD);
+			df.df_printf("Thrashing: %zu processes%s, last onset %s PID %d %.20s %s %.0f/s "
+				"(baseline %.1f/s)\n",
+				nactive, anomaly_system_active() ? " and system wide" : "",
+				when, ev.pid, ev.cmd, ev.metric, ev.value, ev.baseline);
+			df.df_attrset(A_NORMAL);
+		}
+	}
+	if (opt_flags & OPT_PROFILE) {
+		profile_tick_t pt;
+
+		if (profile_get_last(&pt)) {
+			int i;
+
+			df.df_printf("Profile: tick %.2f ms (p99 %.2f),",
+				(double)pt.tick_ns / 1e6, (double)pt.tick_p99_ns / 1e6);
+			for (i = 0; i < PROFILE_PHASES; i++)
+				df.df_printf(" %s %.2f", profile_name(i), (double)pt.ns[i] / 1e6);
+			df.df_printf(", %" PRIu64 " syscalls, %" PRIu64 " KB\n",
+				pt.syscalls, pt.bytes / 1024);
+		}
+	}
+	if (opt_flags & OPT_HARDEN) {
+		harden_stats_t hs;
+
+		harden_get_stats(&hs);
+		df.df_printf("Self: %" PRId64 " major, %" PRId64 " minor faults, "
+			"%" PRIu64 " heap allocations after warm-up, memory %slocked\n",
+			hs.maj_fault, hs.min_fault, hs.heap_allocs,
+			hs.mem_locked ? "" : "not ");
+	}
+}
+
 /*
  *  fault_heading()
  *	output heading
  */
 static void fault_heading(const bool one_shot, const int pid_size)
 {
+	const int pct = fault_sort_pct();
+
+	if (opt_flags & OPT_TOP)
+		fault_status_lines();
+
 	if (one_shot) {
 		df.df_printf(" %*.*s  Major   Minor    Swap  User       Command\n",
 			pid_size, pid_size, "PID");
@@ -295,6 +941,14 @@ static void fault_heading(const bool one_shot, const int pid_size)
 		df.df_printf("    ");
 		df.df_attrset(getattr(ATTR_SWAP) | A_BOLD);
 		df.df_printf("Swap");
+		if (pct >= 0) {
+			static const char * const pct_names[] = { "p50", "p90", "p99", "max" };
+			char maj[8];
+
+			(void)snprintf(maj, sizeof(maj), "%sMaj", pct_names[pct]);
+			df.df_attrset(getattr(ATTR_PCT) | A_BOLD);
+			df.df_printf(" %6s/%-7s", maj, "Min");
+		}
 		df.df_attrset(A_BOLD);
 		df.df_printf("  %sUser       Command\n", (opt_flags & OPT_ARROW) ? "D " : "");
 		df.df_attrset(A_NORMAL);
@@ -302,29 +956,53 @@ static void fault_heading(const bool one_shot, const int pid_size)
 }
 
 /*
- *  fault_dump_json()
- *	dump out page fault usage in JSON format
+ *  json_history_rates()
+ *	append history window rates as JSON members
  */
-int fault_dump_json(
-	fault_info_t * const fault_info_old,
-	fault_info_t * const fault_info_new)
+static int json_history_rates(strbuf_t * const sb, const history_rates_t * const hr)
 {
-	fault_info_t *fault_info, **l;
-	fault_info_t *sorted = NULL;
+	return strbuf_printf(sb, ",\"majorRate5m\":%.3f,\"minorRate5m\":%.3f"
+		",\"majorRate1h\":%.3f,\"minorRate1h\":%.3f",
+		hr->major[HISTORY_5M], hr->minor[HISTORY_5M],
+		hr->major[HISTORY_1H], hr->minor[HISTORY_1H]);
+}
+
+/*
+ *  json_history_pcts()
+ *	append fault rate percentiles as JSON members
+ */
+static int json_history_pcts(strbuf_t * const sb, const history_pcts_t * const hp)
+{
+	return strbuf_printf(sb, ",\"majorPercentiles\":{\"p50\":%" PRId64 ",\"p90\":%" PRId64
+		",\"p99\":%" PRId64 ",\"max\":%" PRId64 "}"
+		",\"minorPercentiles\":{\"p50\":%" PRId64 ",\"p90\":%" PRId64
+		",\"p99\":%" PRId64 ",\"max\":%" PRId64 "}",
+		hp->major[HIST_P50], hp->major[HIST_P90], hp->major[HIST_P99], hp->major[HIST_MAX],
+		hp->minor[HIST_P50], hp->minor[HIST_P90], hp->minor[HIST_P99], hp->minor[HIST_MAX]);
+}
+
+/*
+ *  fault_json_frame()
+ *	serialise page fault usage as a single line JSON frame
+ */
+int fault_json_frame(
+	fault_info_t * const fault_info_new,
+	strbuf_t * const sb)
+{
+	fault_info_t *fault_info, *sorted = NULL, **l = &sorted;
 	int64_t	t_min_fault = 0, t_maj_fault = 0;
 	int64_t	t_d_min_fault = 0, t_d_maj_fault = 0;
 	int64_t t_vm_swap = 0;
+	harden_stats_t hs;
 	bool first = true;
+	int ret = 0;
 
+	PROFILE_PHASE(PROFILE_SORT);
 	for (fault_info = fault_info_new; fault_info; fault_info = fault_info->next) {
-		fault_delta(fault_info, fault_info_old);
-		for (l = &sorted; *l; l = &(*l)->s_next) {
-			if (compare(*l, fault_info)) {
-				fault_info->s_next = (*l);
-				break;
-			}
-		}
+		fault_sort_key(fault_info);
+		fault_info->s_next = NULL;
 		*l = fault_info;
+		l = &fault_info->s_next;
 
 		t_min_fault += fault_info->min_fault;
 		t_maj_fault += fault_info->maj_fault;
@@ -333,32 +1011,145 @@ int fault_dump_json(
 		t_vm_swap += fault_info->vm_swap;
 	}
 
-	printf("{\"processes\":[");
+	sorted = fault_sort(sorted);
+
+	PROFILE_PHASE(PROFILE_RENDER);
+	strbuf_reset(sb);
+	ret |= strbuf_printf(sb, "{\"processes\":[");
 	for (fault_info = sorted; fault_info; fault_info = fault_info->s_next) {
-		const char *cmd = get_cmdline(fault_info);
-		
 		if (!first)
-			printf(",");
+			ret |= strbuf_append(sb, ",", 1);
 		first = false;
 
-		printf("{\"pid\":%d,\"major\":%ld,\"minor\":%ld,\"deltaMajor\":%ld,\"deltaMinor\":%ld,\"swap\":%ld,\"user\":\"%s\",\"command\":\"%s\"}",
+		ret |= strbuf_printf(sb, "{\"pid\":%d,\"major\":%" PRId64 ",\"minor\":%" PRId64
+			",\"deltaMajor\":%" PRId64 ",\"deltaMinor\":%" PRId64 ",\"swap\":%" PRId64 ",\"user\":",
 			fault_info->pid,
-			(long)fault_info->maj_fault,
-			(long)fault_info->min_fault,
-			(long)fault_info->d_maj_fault,
-			(long)fault_info->d_min_fault,
-			(long)fault_info->vm_swap,
-			uname_name(fault_info->uname),
-			cmd);
-	}
-
-	printf("],\"totals\":{\"major\":%ld,\"minor\":%ld,\"deltaMajor\":%ld,\"deltaMinor\":%ld,\"swap\":%ld},\"timestamp\":%ld}\n",
-		(long)t_maj_fault,
-		(long)t_min_fault,
-		(long)t_d_maj_fault,
-		(long)t_d_min_fault,
-		(long)t_vm_swap,
-		(long)time(NULL));
+			fault_info->maj_fault,
+			fault_info->min_fault,
+			fault_info->d_maj_fault,
+			fault_info->d_min_fault,
+			fault_info->vm_swap);
+		ret |= strbuf_json_str(sb, uname_name(fault_info->uname));
+		ret |= strbuf_printf(sb, ",\"command\":");
+		ret |= strbuf_json_str(sb, get_cmdline(fault_info));
+		if (history_enabled()) {
+			history_rates_t hr;
+			history_pcts_t hp;
+
+			history_get_rates(fault_info->pid, &hr);
+			ret |= json_history_rates(sb, &hr);
+			(void)history_get_percentiles(fault_info->pid, &hp);
+			ret |= json_history_pcts(sb, &hp);
+		}
+		if (anomaly_active(fault_info->pid))
+			ret |= strbuf_printf(sb, ",\"anomaly\":true");
+		if (classify_enabled()) {
+			ret |= strbuf_printf(sb, ",\"rss\":%" PRId64 ",\"age\":%.0f",
+				fault_info->rss, classify_age(fault_info));
+			if (fault_info->reason != REASON_NONE)
+				ret |= strbuf_printf(sb, ",\"reason\":\"%s\",\"confidence\":\"%s\"",
+					classify_reason_name(fault_info->reason),
+					classify_confidence_name(fault_info->confidence));
+		}
+		if (fault_info->threads) {
+			const fault_info_t *thread;
+
+			ret |= strbuf_printf(sb, ",\"threads\":[");
+			for (thread = fault_info->threads; thread; thread = thread->next) {
+				ret |= strbuf_printf(sb, "%s{\"tid\":%d,\"major\":%" PRId64 ",\"minor\":%" PRId64
+					",\"deltaMajor\":%" PRId64 ",\"deltaMinor\":%" PRId64 ",\"command\":",
+					(thread == fault_info->threads) ? "" : ",", thread->pid,
+					thread->maj_fault, thread->min_fault,
+					thread->d_maj_fault, thread->d_min_fault);
+				ret |= strbuf_json_str(sb, thread->comm);
+				ret |= strbuf_append(sb, "}", 1);
+			}
+			ret |= strbuf_append(sb, "]", 1);
+		}
+		ret |= strbuf_append(sb, "}", 1);
+	}
+
+	ret |= strbuf_printf(sb, "],\"totals\":{\"major\":%" PRId64 ",\"minor\":%" PRId64
+		",\"deltaMajor\":%" PRId64 ",\"deltaMinor\":%" PRId64 ",\"swap\":%" PRId64,
+		t_maj_fault,
+		t_min_fault,
+		t_d_maj_fault,
+		t_d_min_fault,
+		t_vm_swap);
+	if (history_enabled()) {
+		history_rates_t hr;
+		history_pcts_t hp;
+		size_t used, capacity, untracked;
+
+		history_get_system_rates(&hr);
+		ret |= json_history_rates(sb, &hr);
+		history_get_system_percentiles(&hp);
+		ret |= json_history_pcts(sb, &hp);
+		history_get_usage(&used, &capacity, &untracked);
+		ret |= strbuf_printf(sb, "},\"history\":{\"slots\":%zu,\"capacity\":%zu,\"untracked\":%zu",
+			used, capacity, untracked);
+	}
+	ret |= strbuf_append(sb, "},", 2);
+
+	if (classify_enabled()) {
+		classify_system_t cs;
+
+		classify_get_system(&cs);
+		ret |= strbuf_printf(sb, "\"memory\":{\"total\":%" PRId64 ",\"available\":%" PRId64
+			",\"swapTotal\":%" PRId64 ",\"swapFree\":%" PRId64
+			",\"memPressure\":%.1f,\"swapPressure\":%.1f,\"ioWait\":%.1f},",
+			cs.mem_total, cs.mem_available, cs.swap_total, cs.swap_free,
+			cs.mem_pressure, cs.swap_pressure, cs.io_wait);
+	}
+
+	if (governor_enabled()) {
+		governor_state_t gs;
+
+		governor_get_state(&gs);
+		ret |= strbuf_printf(sb, "\"governor\":{\"budget\":%.2f,\"cpuPercent\":%.3f,\"level\":%d,\"intervalScale\":%d,\"statusEvery\":%u},",
+			gs.budget, gs.cpu_percent, gs.level, gs.scale, gs.status_every);
+	}
+
+	if (anomaly_enabled())
+		ret |= anomaly_json_events(sb);
+
+	if (tree_enabled())
+		ret |= tree_json(sb);
+
+	if (faultmap_enabled())
+		ret |= faultmap_json(sb);
+
+	harden_get_stats(&hs);
+	ret |= strbuf_printf(sb, "\"self\":{\"major\":%" PRId64 ",\"minor\":%" PRId64 ",\"heapAllocs\":%" PRIu64 ",\"locked\":%s},",
+		hs.maj_fault, hs.min_fault, hs.heap_allocs,
+		hs.mem_locked ? "true" : "false");
+
+	if (opt_flags & OPT_STREAM) {
+		uint64_t seq, dropped;
+
+		ndjson_get_stats(&seq, &dropped);
+		ret |= strbuf_printf(sb, "\"seq\":%" PRIu64 ",\"dropped\":%" PRIu64 ",",
+			seq + 1, dropped);
+	}
+
+	ret |= strbuf_printf(sb, "\"timestamp\":%ld}\n",
+		(long)((opt_flags & OPT_REPLAY) ? replay_time() : time(NULL)));
+
+	return ret ? -1 : 0;
+}
+
+/*
+ *  fault_dump_json()
+ *	dump out page fault usage in JSON format
+ */
+int fault_dump_json(fault_info_t * const fault_info_new)
+{
+	static strbuf_t sb;
+
+	if (fault_json_frame(fault_info_new, &sb) < 0)
+		return -1;
+	(void)fwrite(sb.buf, 1, sb.len, stdout);
+	(void)fflush(stdout);
 
 	return 0;
 }
@@ -368,28 +1159,23 @@ int fault_dump_json(
  *	dump out page fault usage
  */
 int fault_dump(
-	fault_info_t * const fault_info_old,
 	fault_info_t * const fault_info_new,
 	const bool one_shot)
 {
-	fault_info_t *fault_info, **l;
-	fault_info_t *sorted = NULL;
+	fault_info_t *fault_info, *sorted = NULL, **l = &sorted;
 	int64_t	t_min_fault = 0, t_maj_fault = 0;
 	int64_t	t_d_min_fault = 0, t_d_maj_fault = 0;
 	const int pid_size = pid_max_digits();
 	char s_min_fault[12], s_maj_fault[12],
 	     s_d_min_fault[12], s_d_maj_fault[12],
-	     s_vm_swap[12];
+	     s_vm_swap[12], s_pct[32];
 
+	PROFILE_PHASE(PROFILE_SORT);
 	for (fault_info = fault_info_new; fault_info; fault_info = fault_info->next) {
-		fault_delta(fault_info, fault_info_old);
-		for (l = &sorted; *l; l = &(*l)->s_next) {
-			if (compare(*l, fault_info)) {
-				fault_info->s_next = (*l);
-				break;
-			}
-		}
+		fault_sort_key(fault_info);
+		fault_info->s_next = NULL;
 		*l = fault_info;
+		l = &fault_info->s_next;
 
 		t_min_fault += fault_info->min_fault;
 		t_maj_fault += fault_info->maj_fault;
@@ -398,47 +1184,18 @@ int fault_dump(
 		t_d_maj_fault += fault_info->d_maj_fault;
 	}
 
-	for (fault_info = fault_info_old; fault_info; fault_info = fault_info->next) {
-		if (fault_info->alive)
-			continue;
-
-		/* Process has died, so include it as -ve delta */
-		for (l = &sorted; *l; l = &(*l)->d_next) {
-			if (compare(*l, fault_info)) {
-				fault_info->d_next = (*l);
-				break;
-			}
-		}
-		*l = fault_info;
-
-		t_min_fault += fault_info->min_fault;
-		t_maj_fault += fault_info->maj_fault;
-
-		fault_info->d_min_fault = -fault_info->min_fault;
-		fault_info->d_maj_fault = -fault_info->maj_fault;
-
-		t_d_min_fault += fault_info->d_min_fault;
-		t_d_maj_fault += fault_info->d_maj_fault;
-
-		fault_info->min_fault = 0;
-		fault_info->maj_fault = 0;
-	}
+	sorted = fault_sort(sorted);
 
+	PROFILE_PHASE(PROFILE_RENDER);
 	fault_heading(one_shot, pid_size);
 	for (fault_info = sorted; fault_info; fault_info = fault_info->s_next) {
 		const char *cmd = get_cmdline(fault_info);
 
-		int64_t delta = fault_info->d_min_fault + fault_info->d_maj_fault;
-#if 0
-		const char * const arrow = (delta < 0) ? "\u2193 " :
-						  ((delta > 0) ? "\u2191 "  : "  ");
-#endif
-		const char * const arrow = (delta < 0) ? "v" :
-						  ((delta > 0) ? "^ "  : "  ");
-
 		int64_to_str(fault_info->maj_fault, s_maj_fault, sizeof(s_maj_fault));
 		int64_to_str(fault_info->min_fault, s_min_fault, sizeof(s_min_fault));
 		int64_to_str(fault_info->vm_swap, s_vm_swap, sizeof(s_vm_swap));
+		if (anomaly_active(fault_info->pid))
+			df.df_attrset(A_REVERSE);
 		if (one_shot) {
 			df.df_printf(" %*d %7s %7s %7s %-10.10s %s\n",
 				pid_size, fault_info->pid,
@@ -447,14 +1204,17 @@ int fault_dump(
 		} else {
 			int64_to_str(fault_info->d_maj_fault, s_d_maj_fault, sizeof(s_d_maj_fault));
 			int64_to_str(fault_info->d_min_fault, s_d_min_fault, sizeof(s_d_min_fault));
-			df.df_printf(" %*d %7s %7s %7s %7s %7s %s%-10.10s %s\n",
+			df.df_printf(" %*d %7s %7s %7s %7s %7s%s %s%-10.10s %s\n",
 				pid_size, fault_info->pid,
 				s_maj_fault, s_min_fault,
 				s_d_maj_fault, s_d_min_fault,
 				s_vm_swap,
-				(opt_flags & OPT_ARROW) ? arrow : "",
+				fault_pct_column(fault_info, s_pct, sizeof(s_pct)),
+				fault_arrow(fault_info),
 				uname_name(fault_info->uname), cmd);
 		}
+		df.df_attrset(A_NORMAL);
+		fault_dump_threads(fault_info, pid_size, false);
 	}
 
 	int64_to_str(t_maj_fault, s_maj_fault, sizeof(s_maj_fault));
@@ -466,6 +1226,7 @@ int fault_dump(
 		int64_to_str(t_d_min_fault, s_d_min_fault, sizeof(s_d_min_fault));
 		df.df_printf(" %*s %7s %7s %7s %7s\n\n",
 			pid_size, "Total:", s_maj_fault, s_min_fault, s_d_maj_fault, s_d_min_fault);
+		fault_dump_map();
 	}
 
 	return 0;
@@ -475,31 +1236,24 @@ int fault_dump(
  *  fault_dump_diff()
  *	dump differences between old and new events
  */
-int fault_dump_diff(
-	fault_info_t * const fault_info_old,
-	fault_info_t * const fault_info_new)
+int fault_dump_diff(fault_info_t * const fault_info_new)
 {
-	fault_info_t *fault_info, **l;
-	fault_info_t *sorted_deltas = NULL;
+	fault_info_t *fault_info, *sorted_deltas = NULL, **l = &sorted_deltas;
 	int64_t	t_min_fault = 0, t_maj_fault = 0;
 	int64_t	t_d_min_fault = 0, t_d_maj_fault = 0;
 	const int pid_size = pid_max_digits();
 	char s_min_fault[12], s_maj_fault[12],
 	     s_d_min_fault[12], s_d_maj_fault[12],
-	     s_vm_swap[12];
+	     s_vm_swap[12], s_pct[32];
 
+	PROFILE_PHASE(PROFILE_SORT);
 	for (fault_info = fault_info_new; fault_info; fault_info = fault_info->next) {
-		fault_delta(fault_info, fault_info_old);
+		fault_sort_key(fault_info);
 		if ((fault_info->d_min_fault + fault_info->d_maj_fault) == 0)
 			continue;
-
-		for (l = &sorted_deltas; *l; l = &(*l)->d_next) {
-			if (compare(*l, fault_info)) {
-				fault_info->d_next = (*l);
-				break;
-			}
-		}
+		fault_info->s_next = NULL;
 		*l = fault_info;
+		l = &fault_info->s_next;
 
 		t_min_fault += fault_info->min_fault;
 		t_maj_fault += fault_info->maj_fault;
@@ -508,36 +1262,12 @@ int fault_dump_diff(
 		t_d_maj_fault += fault_info->d_maj_fault;
 	}
 
-	for (fault_info = fault_info_old; fault_info; fault_info = fault_info->next) {
-		if (fault_info->alive)
-			continue;
-
-		/* Process has died, so include it as -ve delta */
-		for (l = &sorted_deltas; *l; l = &(*l)->d_next) {
-			if (compare(*l, fault_info)) {
-				fault_info->d_next = (*l);
-				break;
-			}
-		}
-		*l = fault_info;
-
-		t_min_fault -= fault_info->min_fault;
-		t_maj_fault -= fault_info->maj_fault;
-
-		fault_info->d_min_fault = -fault_info->min_fault;
-		fault_info->d_maj_fault = -fault_info->maj_fault;
-
-		t_d_min_fault += fault_info->d_min_fault;
-		t_d_maj_fault += fault_info->d_maj_fault;
-
-		fault_info->min_fault = 0;
-		fault_info->maj_fault = 0;
-	}
+	sorted_deltas = fault_sort(sorted_deltas);
 
+	PROFILE_PHASE(PROFILE_RENDER);
 	fault_heading(false, pid_size);
-	for (fault_info = sorted_deltas; fault_info; ) {
+	for (fault_info = sorted_deltas; fault_info; fault_info = fault_info->s_next) {
 		const char *cmd = get_cmdline(fault_info);
-		fault_info_t *next = fault_info->d_next;
 
 		int64_to_str(fault_info->maj_fault, s_maj_fault, sizeof(s_maj_fault));
 		int64_to_str(fault_info->min_fault, s_min_fault, sizeof(s_min_fault));
@@ -545,15 +1275,17 @@ int fault_dump_diff(
 		int64_to_str(fault_info->d_min_fault, s_d_min_fault, sizeof(s_d_min_fault));
 		int64_to_str(fault_info->vm_swap, s_vm_swap, sizeof(s_vm_swap));
 
-		df.df_printf(" %*d %7s %7s %7s %7s %7s %-10.10s %s\n",
+		if (anomaly_active(fault_info->pid))
+			df.df_attrset(A_REVERSE);
+		df.df_printf(" %*d %7s %7s %7s %7s %7s%s %-10.10s %s\n",
 			pid_size, fault_info->pid,
 			s_maj_fault, s_min_fault,
 			s_d_maj_fault, s_d_min_fault,
 			s_vm_swap,
+			fault_pct_column(fault_info, s_pct, sizeof(s_pct)),
 			uname_name(fault_info->uname), cmd);
-
-		fault_info->d_next = NULL;	/* Nullify for next round */
-		fault_info = next;
+		df.df_attrset(A_NORMAL);
+		fault_dump_threads(fault_info, pid_size, true);
 	}
 
 	int64_to_str(t_maj_fault, s_maj_fault, sizeof(s_maj_fault));
@@ -562,6 +1294,85 @@ int fault_dump_diff(
 	int64_to_str(t_d_min_fault, s_d_min_fault, sizeof(s_d_min_fault));
 	df.df_printf(" %*s %7s %7s %7s %7s\n\n",
 		pid_size, "Total:", s_maj_fault, s_min_fault, s_d_maj_fault, s_d_min_fault);
+	fault_dump_map();
+
+	return 0;
+}
+
+/*
+ *  fault_dump_tree()
+ *	dump the -P subtrees as a tree, from the index
+ *	alone so the top mode view can be redrawn on a key
+ */
+int fault_dump_tree(void)
+{
+	const tree_row_t *visible;
+	const int pid_size = pid_max_digits();
+	int64_t	t_d_maj_fault = 0, t_d_min_fault = 0;
+	size_t i, n, sel, first = 0, last;
+	char s_d_min_fault[12], s_d_maj_fault[12],
+	     s_sub_min_fault[12], s_sub_maj_fault[12],
+	     s_vm_swap[12];
+
+	PROFILE_PHASE(PROFILE_RENDER);
+	n = tree_rows(&visible, &sel);
+	last = n;
+
+	if (opt_flags & OPT_TOP)
+		fault_status_lines();
+	df.df_attrset(A_BOLD);
+	df.df_printf(" %*.*s  +Major  +Minor  Sub+Major Sub+Minor  Procs    Swap  User       Command\n",
+		pid_size, pid_size, "PID");
+	df.df_attrset(A_NORMAL);
+
+	/* Keep the selected row on the screen, less the total line */
+	if (opt_flags & OPT_TOP) {
+		const size_t room = (rows - cury > 3) ? (size_t)(rows - cury - 3) : 1;
+
+		if (sel >= room)
+			first = sel - room + 1;
+		if (last > first + room)
+			last = first + room;
+	}
+
+	for (i = 0; i < n; i++) {
+		const tree_node_t * const node = visible[i].node;
+
+		/* Subtrees of nested roots are in their parent's */
+		if ((visible[i].depth == 0) && !(node->parent && (node->parent->member_gen == node->member_gen))) {
+			t_d_maj_fault += node->d_sub_maj_fault;
+			t_d_min_fault += node->d_sub_min_fault;
+		}
+		if ((i < first) || (i >= last))
+			continue;
+
+		int64_to_str(node->d_maj_fault, s_d_maj_fault, sizeof(s_d_maj_fault));
+		int64_to_str(node->d_min_fault, s_d_min_fault, sizeof(s_d_min_fault));
+		int64_to_str(node->d_sub_maj_fault, s_sub_maj_fault, sizeof(s_sub_maj_fault));
+		int64_to_str(node->d_sub_min_fault, s_sub_min_fault, sizeof(s_sub_min_fault));
+		int64_to_str(node->vm_swap, s_vm_swap, sizeof(s_vm_swap));
+
+		if ((opt_flags & OPT_TOP) && (i == sel))
+			df.df_attrset(A_REVERSE);
+		else if (anomaly_active(node->pid))
+			df.df_attrset(A_BOLD);
+		df.df_printf(" %*d %7s %7s  %9s %9s %6" PRIu32 " %7s  %-10.10s %*s%s%s\n",
+			pid_size, node->pid,
+			s_d_maj_fault, s_d_min_fault,
+			s_sub_maj_fault, s_sub_min_fault,
+			node->nsub, s_vm_swap,
+			uname_name(node->uname),
+			visible[i].depth * 2, "",
+			node->child ? (node->collapsed ? "+ " : "- ") : "",
+			(node->proc && node->proc->cmdline) ? node->proc->cmdline : "<unknown>");
+		df.df_attrset(A_NORMAL);
+	}
+
+	int64_to_str(t_d_maj_fault, s_d_maj_fault, sizeof(s_d_maj_fault));
+	int64_to_str(t_d_min_fault, s_d_min_fault, sizeof(s_d_min_fault));
+	df.df_printf(" %*s %7s %7s  %9s %9s\n\n",
+		pid_size, "Total:", "", "", s_d_maj_fault, s_d_min_fault);
+	fault_dump_map();
 
 	return 0;
 }
@@ -0,0 +1,215 @@
+/*
+ * Phase level self-profiling for PageFaultStat
+ *
+ * A tick is split into phases, PROFILE_PHASE() marks where the next
+ * one starts and charges the time since the last mark, read from
+ * CLOCK_MONOTONIC_RAW, to the phase that was running. PROFILE_IO()
+ * charges system calls and bytes read or written to it. Switching is
+ * cheaper than nesting begin/end pairs, the per process scan switches
+ * three times for every process. At the end of a tick the time of
+ * every phase goes into a log-linear histogram. Without --profile the
+ * probes are a test of opt_flags, built with NO_PROFILE they are gone.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+#include <time.h>
+
+static const char *const profile_names[PROFILE_PHASES] = {
+	"readdir", "stat", "status", "delta", "analyse", "sort", "render", "other",
+};
+
+typedef struct {
+	uint64_t	ns;		/* time this tick */
+	uint64_t	syscalls;	/* system calls this tick */
+	uint64_t	bytes;		/* bytes read or written this tick */
+	uint64_t	total_ns;	/* over all ticks */
+	uint64_t	total_syscalls;
+	uint64_t	total_bytes;
+	hist_t		hist;		/* ns per tick */
+} profile_phase_t;
+
+static profile_phase_t phases[PROFILE_PHASES];
+static profile_tick_t last;		/* last complete tick */
+static hist_t tick_hist;		/* ns per tick, all phases */
+static uint64_t tick_start;		/* ns at tick begin */
+static uint64_t mark;			/* ns at last phase switch */
+static uint64_t ticks;			/* complete ticks */
+static int current = PROFILE_OTHER;	/* running phase */
+static bool in_tick;
+
+/*
+ *  profile_now()
+ *	raw monotonic time in ns, not slewed by NTP
+ */
+static inline uint64_t profile_now(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ *  profile_enable()
+ *	turn on --profile, -1 if built without it
+ */
+int profile_enable(void)
+{
+#if defined(NO_PROFILE)
+	return -1;
+#else
+	size_t i;
+
+	for (i = 0; i < PROFILE_PHASES; i++)
+		hist_reset(&phases[i].hist);
+	hist_reset(&tick_hist);
+	opt_flags |= OPT_PROFILE;
+	return 0;
+#endif
+}
+
+/*
+ *  profile_phase()
+ *	charge the time since the last switch to the running
+ *	phase and start phase, called by PROFILE_PHASE()
+ */
+void profile_phase(const int phase)
+{
+	uint64_t t;
+
+	if (!in_tick)
+		return;
+	t = profile_now();
+	phases[current].ns += t - mark;
+	mark = t;
+	current = phase;
+}
+
+/*
+ *  profile_io()
+ *	charge system calls and bytes to the running
+ *	phase, called by PROFILE_IO()
+ */
+void profile_io(const unsigned int syscalls, const size_t bytes)
+{
+	if (!in_tick)
+		return;
+	phases[current].syscalls += syscalls;
+	phases[current].bytes += bytes;
+}
+
+/*
+ *  profile_tick_begin()
+ *	start a tick, time until the first switch is "other"
+ */
+void profile_tick_begin(void)
+{
+	size_t i;
+
+	if (!(opt_flags & OPT_PROFILE))
+		return;
+	for (i = 0; i < PROFILE_PHASES; i++) {
+		phases[i].ns = 0;
+		phases[i].syscalls = 0;
+		phases[i].bytes = 0;
+	}
+	current = PROFILE_OTHER;
+	mark = tick_start = profile_now();
+	in_tick = true;
+}
+
+/*
+ *  profile_tick_end()
+ *	close the running phase and account the tick
+ */
+void profile_tick_end(void)
+{
+	int64_t pct[HIST_PCTS];
+	size_t i;
+
+	if (!in_tick)
+		return;
+	profile_phase(PROFILE_OTHER);
+	in_tick = false;
+
+	last.syscalls = 0;
+	last.bytes = 0;
+	for (i = 0; i < PROFILE_PHASES; i++) {
+		profile_phase_t * const p = &phases[i];
+
+		p->total_ns += p->ns;
+		p->total_syscalls += p->syscalls;
+		p->total_bytes += p->bytes;
+		hist_add(&p->hist, (int64_t)p->ns);
+		last.ns[i] = p->ns;
+		last.syscalls += p->syscalls;
+		last.bytes += p->bytes;
+	}
+	last.tick_ns = mark - tick_start;
+	hist_add(&tick_hist, (int64_t)last.tick_ns);
+	hist_percentiles(&tick_hist, pct);
+	last.tick_p99_ns = (uint64_t)pct[HIST_P99];
+	ticks++;
+}
+
+/*
+ *  profile_get_last()
+ *	the last complete tick, false if there is none yet
+ */
+bool profile_get_last(profile_tick_t * const tick)
+{
+	if (!ticks)
+		return false;
+	*tick = last;
+	return true;
+}
+
+/*
+ *  profile_name()
+ *	name of a phase
+ */
+const char *profile_name(const int phase)
+{
+	return profile_names[phase];
+}
+
+/*
+ *  profile_report()
+ *	report the phase costs at exit with --profile
+ */
+void profile_report(void)
+{
+	int64_t pct[HIST_PCTS];
+	uint64_t total_ns = 0;
+	size_t i;
+
+	if (!(opt_flags & OPT_PROFILE) || !ticks)
+		return;
+
+	for (i = 0; i < PROFILE_PHASES; i++)
+		total_ns += phases[i].total_ns;
+	hist_percentiles(&tick_hist, pct);
+	(void)fprintf(stderr, "%s: profile of %" PRIu64 " ticks, %.3f ms per tick "
+		"(p50 %.3f, p90 %.3f, p99 %.3f, max %.3f ms)\n",
+		app_name, ticks, (double)total_ns / (double)ticks / 1e6,
+		(double)pct[HIST_P50] / 1e6, (double)pct[HIST_P90] / 1e6,
+		(double)pct[HIST_P99] / 1e6, (double)pct[HIST_MAX] / 1e6);
+	(void)fprintf(stderr, "  %-8s %9s %9s %9s %9s %9s %6s %10s %10s\n",
+		"phase", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms", "%tick",
+		"calls/tick", "KB/tick");
+	for (i = 0; i < PROFILE_PHASES; i++) {
+		const profile_phase_t * const p = &phases[i];
+
+		hist_percentiles(&p->hist, pct);
+		(void)fprintf(stderr, "  %-8s %9.3f %9.3f %9.3f %9.3f %9.3f %5.1f%% %10.1f %10.1f\n",
+			profile_names[i], (double)p->total_ns / (double)ticks / 1e6,
+			(double)pct[HIST_P50] / 1e6, (double)pct[HIST_P90] / 1e6,
+			(double)pct[HIST_P99] / 1e6, (double)pct[HIST_MAX] / 1e6,
+			total_ns ? 100.0 * (double)p->total_ns / (double)total_ns : 0.0,
+			(double)p->total_syscalls / (double)ticks,
+			(double)p->total_bytes / (double)ticks / 1024.0);
+	}
+}
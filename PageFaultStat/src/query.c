@@ -0,0 +1,754 @@
+/*
+ * Offline queries over recordings for PageFaultStat
+ *
+ *	PageFaultStat query [options] file
+ *
+ * The keyframe index is used to find the segments covering the
+ * time window, which are split between worker threads. Each
+ * worker decodes its segments with its own decoder, turns the
+ * frames into per group fault deltas and the results are merged
+ * in segment order.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+#include <time.h>
+#include <pthread.h>
+
+#define QUERY_GROUP_PID		(0)
+#define QUERY_GROUP_COMM	(1)
+#define QUERY_GROUP_USER	(2)
+
+#define QUERY_SORT_MAJOR	(0)
+#define QUERY_SORT_MINOR	(1)
+#define QUERY_SORT_TOTAL	(2)
+#define QUERY_SORT_TREND	(3)
+
+#define QUERY_MAX_THREADS	(64)
+
+/* Accumulated results for one pid, command or user */
+typedef struct {
+	pid_t		pid;		/* pid, when grouping by pid */
+	const char	*key;		/* command or user, else NULL */
+	const char	*user;		/* user last seen */
+	const char	*cmd;		/* command last seen */
+	uint32_t	hash;		/* hash of pid or key, 0 = empty slot */
+	int64_t		maj_fault;	/* major faults in the window */
+	int64_t		min_fault;	/* minor faults in the window */
+	int64_t		first_half;	/* metric in the first half */
+	int64_t		second_half;	/* metric in the second half */
+	int64_t		frame_val;	/* metric in the frame being summed */
+	uint64_t	frame;		/* frame being summed */
+	bool		in_frame;	/* frame_val holds a sample */
+	hist_t		*hist;		/* per sample histogram, NULL until sampled */
+} query_group_t;
+
+typedef struct {
+	query_group_t	*groups;	/* open addressing table */
+	size_t		n;		/* groups in use */
+	size_t		size;		/* table size, power of 2 */
+} query_map_t;
+
+typedef struct {
+	const replay_file_t *rf;	/* recording */
+	size_t		seg_from;	/* first keyframe segment */
+	size_t		seg_to;		/* one past the last segment */
+	query_map_t	map;		/* results */
+	uint64_t	samples;	/* frames counted */
+	uint64_t	covered;	/* ms covered by counted frames */
+	uint64_t	first_ts;	/* frame before the first counted */
+	uint64_t	last_ts;	/* last counted frame time */
+	int		ret;		/* 0 or -1 on a decode error */
+} query_worker_t;
+
+static uint64_t q_from, q_to, q_mid;	/* window, ms since the epoch */
+static int q_group = QUERY_GROUP_PID;
+static int q_sort = QUERY_SORT_MAJOR;
+static bool q_json;
+
+static const char * const group_names[] = { "pid", "comm", "user" };
+static const char * const sort_names[] = { "major", "minor", "total", "trend" };
+
+/*
+ *  query_hist()
+ *	a group's histogram, allocated on first use
+ */
+static hist_t *query_hist(query_group_t * const g)
+{
+	if (!g->hist && ((g->hist = heap_calloc(1, sizeof(*g->hist))) == NULL))
+		out_of_memory("allocating query histogram");
+	return g->hist;
+}
+
+/*
+ *  query_sample()
+ *	add one sample to a group's histogram
+ */
+static int query_sample(query_group_t * const g, const int64_t val)
+{
+	hist_t * const h = query_hist(g);
+
+	if (!h)
+		return -1;
+	hist_add(h, val);
+	return 0;
+}
+
+static uint32_t query_hash(const pid_t pid, const char *key)
+{
+	uint32_t h = 2166136261U;
+
+	if (!key)
+		h = (h ^ (uint32_t)pid) * 16777619U;
+	else
+		while (*key)
+			h = (h ^ (uint8_t)*key++) * 16777619U;
+	return h ? h : 1;
+}
+
+/*
+ *  query_map_get()
+ *	find or add the group for pid or key
+ */
+static query_group_t *query_map_get(query_map_t * const map, const pid_t pid, const char *key)
+{
+	const uint32_t hash = query_hash(pid, key);
+	size_t i;
+
+	if ((map->n + 1) * 2 > map->size) {
+		const size_t size = map->size ? map->size * 2 : 1024;
+		query_group_t *groups;
+
+		if ((groups = heap_calloc(size, sizeof(*groups))) == NULL) {
+			out_of_memory("allocating query groups");
+			return NULL;
+		}
+		for (i = 0; i < map->size; i++) {
+			size_t j;
+
+			if (!map->groups[i].hash)
+				continue;
+			for (j = map->groups[i].hash & (size - 1); groups[j].hash; j = (j + 1) & (size - 1))
+				;
+			groups[j] = map->groups[i];
+		}
+		free(map->groups);
+		map->groups = groups;
+		map->size = size;
+	}
+
+	for (i = hash & (map->size - 1); map->groups[i].hash; i = (i + 1) & (map->size - 1)) {
+		query_group_t * const g = &map->groups[i];
+
+		if ((g->hash == hash) &&
+		    (key ? (g->key && !strcmp(g->key, key)) : (g->pid == pid)))
+			return g;
+	}
+	map->groups[i].hash = hash;
+	map->groups[i].pid = pid;
+	map->groups[i].key = key;
+	map->n++;
+
+	return &map->groups[i];
+}
+
+static void query_map_free(query_map_t * const map)
+{
+	size_t i;
+
+	for (i = 0; i < map->size; i++)
+		free(map->groups[i].hist);
+	free(map->groups);
+	(void)memset(map, 0, sizeof(*map));
+}
+
+/*
+ *  query_frame()
+ *	accumulate the deltas between the decoder's previous
+ *	and current frame
+ */
+static int query_frame(query_worker_t * const w, const replay_decoder_t * const d, const uint64_t prev_ts)
+{
+	size_t i, j = 0;
+
+	if (!w->samples)
+		w->first_ts = prev_ts;
+	w->samples++;
+	w->covered += d->timestamp - prev_ts;
+	w->last_ts = d->timestamp;
+
+	for (i = 0; i < d->nentries; i++) {
+		const replay_entry_t * const e = &d->entries[i];
+		const char *key = NULL;
+		int64_t d_maj = e->maj_fault, d_min = e->min_fault, val;
+		query_group_t *g;
+
+		while ((j < d->nprev) && (d->prev[j].pid < e->pid))
+			j++;
+		/* A pid seen before, unless it was reused by a new process */
+		if ((j < d->nprev) && (d->prev[j].pid == e->pid) &&
+		    (e->maj_fault >= d->prev[j].maj_fault) &&
+		    (e->min_fault >= d->prev[j].min_fault)) {
+			d_maj -= d->prev[j].maj_fault;
+			d_min -= d->prev[j].min_fault;
+		}
+
+		if (q_group == QUERY_GROUP_COMM)
+			key = e->cmd ? e->cmd : "<unknown>";
+		else if (q_group == QUERY_GROUP_USER)
+			key = e->user ? e->user : "<unknown>";
+		if ((g = query_map_get(&w->map, e->pid, key)) == NULL)
+			return -1;
+		g->user = e->user;
+		g->cmd = e->cmd;
+
+		switch (q_sort) {
+		case QUERY_SORT_MINOR:
+			val = d_min;
+			break;
+		case QUERY_SORT_MAJOR:
+			val = d_maj;
+			break;
+		default:
+			val = d_maj + d_min;
+			break;
+		}
+
+		if (!g->in_frame || (g->frame != d->frame)) {
+			if (g->in_frame && (query_sample(g, g->frame_val) < 0))
+				return -1;
+			g->frame = d->frame;
+			g->frame_val = 0;
+			g->in_frame = true;
+		}
+		g->frame_val += val;
+		g->maj_fault += d_maj;
+		g->min_fault += d_min;
+		if (d->timestamp <= q_mid)
+			g->first_half += val;
+		else
+			g->second_half += val;
+	}
+	return 0;
+}
+
+/*
+ *  query_worker()
+ *	decode a run of keyframe segments. The delta into the
+ *	first frame of the next segment is counted here too as
+ *	the next worker only starts from that frame
+ */
+static void *query_worker(void *arg)
+{
+	query_worker_t * const w = arg;
+	const replay_file_t * const rf = w->rf;
+	const uint64_t end_frame = (w->seg_to < rf->nindex) ?
+		rf->index[w->seg_to].frame : UINT64_MAX;
+	replay_decoder_t d;
+	uint64_t prev_ts = 0;
+	bool first = true;
+	size_t i;
+	int ret;
+
+	replay_decoder_init(&d, rf, rf->index[w->seg_from].offset);
+	while ((ret = replay_decode_next(&d)) == 0) {
+		if (d.timestamp > q_to)
+			break;
+		if (!first && (d.timestamp > q_from) &&
+		    (query_frame(w, &d, prev_ts) < 0)) {
+			ret = -1;
+			break;
+		}
+		first = false;
+		prev_ts = d.timestamp;
+		if (d.frame >= end_frame)
+			break;
+	}
+	if (ret < 0)
+		w->ret = -1;
+
+	/* Flush the last frame of every group */
+	for (i = 0; i < w->map.size; i++) {
+		query_group_t * const g = &w->map.groups[i];
+
+		if (g->hash && g->in_frame && (query_sample(g, g->frame_val) < 0))
+			w->ret = -1;
+		g->in_frame = false;
+	}
+	replay_decoder_free(&d);
+
+	return NULL;
+}
+
+/*
+ *  query_merge()
+ *	merge a worker's groups into the results
+ */
+static int query_merge(query_map_t * const map, const query_map_t * const from)
+{
+	size_t i;
+
+	for (i = 0; i < from->size; i++) {
+		const query_group_t * const f = &from->groups[i];
+		query_group_t *g;
+
+		if (!f->hash)
+			continue;
+		if ((g = query_map_get(map, f->pid, f->key)) == NULL)
+			return -1;
+		g->user = f->user;
+		g->cmd = f->cmd;
+		g->maj_fault += f->maj_fault;
+		g->min_fault += f->min_fault;
+		g->first_half += f->first_half;
+		g->second_half += f->second_half;
+		if (f->hist) {
+			hist_t * const h = query_hist(g);
+
+			if (!h)
+				return -1;
+			hist_merge(h, f->hist);
+		}
+	}
+	return 0;
+}
+
+/*
+ *  query_trend()
+ *	second half over first half of the window, infinite
+ *	for groups that only appear in the second half
+ */
+static double query_trend(const query_group_t * const g)
+{
+	if (g->first_half <= 0)
+		return (g->second_half > 0) ? INFINITY : 0.0;
+	return (double)g->second_half / (double)g->first_half;
+}
+
+static int64_t query_metric(const query_group_t * const g)
+{
+	switch (q_sort) {
+	case QUERY_SORT_MINOR:
+		return g->min_fault;
+	case QUERY_SORT_MAJOR:
+		return g->maj_fault;
+	default:
+		return g->maj_fault + g->min_fault;
+	}
+}
+
+static int query_cmp(const void *p1, const void *p2)
+{
+	const query_group_t * const g1 = *(const query_group_t * const *)p1;
+	const query_group_t * const g2 = *(const query_group_t * const *)p2;
+
+	if (q_sort == QUERY_SORT_TREND) {
+		const double t1 = query_trend(g1), t2 = query_trend(g2);
+
+		if (t1 < t2)
+			return 1;
+		if (t1 > t2)
+			return -1;
+	}
+	if (query_metric(g1) != query_metric(g2))
+		return (query_metric(g1) < query_metric(g2)) ? 1 : -1;
+	return ((g1->maj_fault + g1->min_fault) < (g2->maj_fault + g2->min_fault)) -
+	       ((g1->maj_fault + g1->min_fault) > (g2->maj_fault + g2->min_fault));
+}
+
+/*
+ *  query_parse_time()
+ *	parse a window bound: +N[smh] after the recording start,
+ *	seconds since the epoch, or a local [YYYY-MM-DD ]HH:MM[:SS]
+ *	where a bare time is on the day the recording started
+ */
+static int query_parse_time(const char *arg, const uint64_t start, uint64_t * const ms)
+{
+	static const char * const formats[] = {
+		"%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%H:%M:%S", "%H:%M",
+	};
+	char *end;
+	size_t i;
+
+	errno = 0;
+	if (arg[0] == '+') {
+		double secs = strtod(arg + 1, &end);
+
+		if (errno || (end == arg + 1) || (secs < 0.0))
+			return -1;
+		if (*end == 'm')
+			secs *= 60.0;
+		else if (*end == 'h')
+			secs *= 3600.0;
+		else if (*end && (*end != 's'))
+			return -1;
+		if (*end && end[1])
+			return -1;
+		*ms = start + (uint64_t)(secs * 1000.0);
+		return 0;
+	}
+	if (!strchr(arg, ':')) {
+		const unsigned long long secs = strtoull(arg, &end, 10);
+
+		if (errno || (end == arg) || *end)
+			return -1;
+		*ms = (uint64_t)secs * 1000;
+		return 0;
+	}
+	for (i = 0; i < SIZEOF_ARRAY(formats); i++) {
+		const time_t start_secs = (time_t)(start / 1000);
+		struct tm tm;
+		time_t t;
+
+		(void)localtime_r(&start_secs, &tm);
+		tm.tm_sec = 0;
+		end = strptime(arg, formats[i], &tm);
+		if (!end || *end)
+			continue;
+		tm.tm_isdst = -1;
+		if ((t = mktime(&tm)) == (time_t)-1)
+			return -1;
+		*ms = (uint64_t)t * 1000;
+		return 0;
+	}
+	return -1;
+}
+
+static void query_format_time(const uint64_t ms, char * const buf, const size_t len)
+{
+	const time_t secs = (time_t)(ms / 1000);
+	struct tm tm;
+
+	(void)localtime_r(&secs, &tm);
+	(void)strftime(buf, len, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+static void query_usage(void)
+{
+	(void)printf("Usage: %s query [options] file\n"
+		"Options are:\n"
+		"  -f from\twindow start, HH:MM[:SS], YYYY-MM-DD HH:MM[:SS],\n"
+		"\t\tepoch seconds or +N[s|m|h] after the recording start\n"
+		"  -g group\tgroup by pid (default), comm or user\n"
+		"  -h\t\tshow this help information\n"
+		"  -j\t\tJSON output\n"
+		"  -k count\tshow the top count groups, default 20, 0 = all\n"
+		"  -s key\tsort by major (default), minor, total or trend\n"
+		"  -t to\t\twindow end, same formats as -f\n"
+		"  -T threads\tdecoding threads, default one per CPU\n",
+		app_name);
+}
+
+/*
+ *  query_json_str()
+ *	append a "name":"str" JSON member
+ */
+static void query_json_str(strbuf_t * const sb, const char *sep, const char *name, const char *str)
+{
+	(void)strbuf_printf(sb, "%s\"%s\":", sep, name);
+	(void)strbuf_json_str(sb, str ? str : "<unknown>");
+}
+
+/*
+ *  query_output()
+ *	print the top-K groups
+ */
+static void query_output(
+	query_group_t ** const sorted,
+	const size_t n,
+	const uint64_t samples,
+	const uint64_t covered,
+	const uint64_t first_ts,
+	const uint64_t last_ts)
+{
+	const double secs = covered ? (double)covered / 1000.0 : 1.0;
+	char from[32], to[32];
+	size_t i;
+
+	query_format_time(first_ts, from, sizeof(from));
+	query_format_time(last_ts, to, sizeof(to));
+
+	if (q_json) {
+		strbuf_t sb = { NULL, 0, 0 };
+
+		(void)strbuf_printf(&sb, "{\"window\":{\"from\":%" PRIu64 ",\"to\":%" PRIu64
+			",\"seconds\":%.3f,\"samples\":%" PRIu64 "},\"groupBy\":\"%s\",\"sortBy\":\"%s\",\"results\":[",
+			first_ts / 1000, last_ts / 1000, (double)covered / 1000.0, samples,
+			group_names[q_group], sort_names[q_sort]);
+		for (i = 0; i < n; i++) {
+			const query_group_t * const g = sorted[i];
+			const double trend = query_trend(g);
+			int64_t pct[HIST_PCTS] = { 0, 0, 0, 0 };
+
+			if (g->hist)
+				hist_percentiles(g->hist, pct);
+			(void)strbuf_printf(&sb, "%s{", i ? "," : "");
+			if (q_group == QUERY_GROUP_PID) {
+				(void)strbuf_printf(&sb, "\"pid\":%d", g->pid);
+				query_json_str(&sb, ",", "user", g->user);
+				query_json_str(&sb, ",", "command", g->cmd);
+			} else {
+				query_json_str(&sb, "", group_names[q_group], g->key);
+			}
+			(void)strbuf_printf(&sb, ",\"major\":%" PRId64 ",\"minor\":%" PRId64
+				",\"majorRate\":%.3f,\"minorRate\":%.3f"
+				",\"p50\":%" PRId64 ",\"p90\":%" PRId64 ",\"p99\":%" PRId64 ",\"max\":%" PRId64,
+				g->maj_fault, g->min_fault,
+				(double)g->maj_fault / secs, (double)g->min_fault / secs,
+				pct[HIST_P50], pct[HIST_P90], pct[HIST_P99], pct[HIST_MAX]);
+			if (isinf(trend))
+				(void)strbuf_printf(&sb, ",\"trend\":null}");
+			else
+				(void)strbuf_printf(&sb, ",\"trend\":%.3f}", trend);
+		}
+		(void)strbuf_printf(&sb, "]}\n");
+		(void)fwrite(sb.buf, 1, sb.len, stdout);
+		strbuf_free(&sb);
+		return;
+	}
+
+	(void)printf("Window %s - %s (%.0f seconds, %" PRIu64 " samples), "
+		"percentiles of %s faults per sample\n",
+		from, to, (double)covered / 1000.0, samples,
+		(q_sort == QUERY_SORT_TREND) ? "total" : sort_names[q_sort]);
+	/* Padded as the values below it are */
+	if (q_group == QUERY_GROUP_PID)
+		(void)printf(" %16s", "PID");
+	else
+		(void)printf(" %-16.16s", (q_group == QUERY_GROUP_COMM) ? "Command" : "User");
+	(void)printf(" %10s %10s %9s %9s %7s %7s %7s %7s %7s%s\n",
+		"Major", "Minor", "Major/s", "Minor/s", "p50", "p90", "p99", "Max", "Trend",
+		(q_group == QUERY_GROUP_PID) ? "  User       Command" : "");
+	for (i = 0; i < n; i++) {
+		const query_group_t * const g = sorted[i];
+		const double trend = query_trend(g);
+		int64_t pct[HIST_PCTS] = { 0, 0, 0, 0 };
+		char s_trend[16];
+
+		if (g->hist)
+			hist_percentiles(g->hist, pct);
+		if (isinf(trend))
+			(void)snprintf(s_trend, sizeof(s_trend), "new");
+		else
+			(void)snprintf(s_trend, sizeof(s_trend), "%.2fx", trend);
+
+		if (q_group == QUERY_GROUP_PID)
+			(void)printf(" %16d", g->pid);
+		else
+			(void)printf(" %-16.16s", g->key);
+		(void)printf(" %10" PRId64 " %10" PRId64 " %9.2f %9.2f %7" PRId64 " %7" PRId64
+			" %7" PRId64 " %7" PRId64 " %7s",
+			g->maj_fault, g->min_fault,
+			(double)g->maj_fault / secs, (double)g->min_fault / secs,
+			pct[HIST_P50], pct[HIST_P90], pct[HIST_P99], pct[HIST_MAX], s_trend);
+		if (q_group == QUERY_GROUP_PID)
+			(void)printf("  %-10.10s %s", g->user ? g->user : "<unknown>",
+				g->cmd ? g->cmd : "<unknown>");
+		(void)printf("\n");
+	}
+}
+
+/*
+ *  query_main()
+ *	the query subcommand, argv[0] is "query"
+ */
+int query_main(int argc, char **argv)
+{
+	query_worker_t workers[QUERY_MAX_THREADS];
+	pthread_t threads[QUERY_MAX_THREADS];
+	bool started[QUERY_MAX_THREADS];
+	query_map_t results = { NULL, 0, 0 };
+	query_group_t **sorted = NULL;
+	replay_file_t rf;
+	const char *from_arg = NULL, *to_arg = NULL;
+	long int top_k = 20, nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t samples = 0, covered = 0, first_ts = 0, last_ts = 0;
+	size_t seg_from, seg_to, nsegs, i, n;
+	int ret = EXIT_FAILURE;
+
+	optind = 1;
+	for (;;) {
+		const int c = getopt(argc, argv, "f:g:hjk:s:t:T:");
+		char *end;
+
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'f':
+			from_arg = optarg;
+			break;
+		case 'g':
+			for (i = 0; i < SIZEOF_ARRAY(group_names); i++)
+				if (!strcmp(optarg, group_names[i]))
+					break;
+			if (i == SIZEOF_ARRAY(group_names)) {
+				(void)fprintf(stderr, "Group must be pid, comm or user.\n");
+				return EXIT_FAILURE;
+			}
+			q_group = (int)i;
+			break;
+		case 'h':
+			query_usage();
+			return EXIT_SUCCESS;
+		case 'j':
+			q_json = true;
+			break;
+		case 'k':
+			errno = 0;
+			top_k = strtol(optarg, &end, 10);
+			if (errno || *end || (top_k < 0)) {
+				(void)fprintf(stderr, "Invalid top count.\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 's':
+			for (i = 0; i < SIZEOF_ARRAY(sort_names); i++)
+				if (!strcmp(optarg, sort_names[i]))
+					break;
+			if (i == SIZEOF_ARRAY(sort_names)) {
+				(void)fprintf(stderr, "Sort key must be major, minor, total or trend.\n");
+				return EXIT_FAILURE;
+			}
+			q_sort = (int)i;
+			break;
+		case 't':
+			to_arg = optarg;
+			break;
+		case 'T':
+			errno = 0;
+			nthreads = strtol(optarg, &end, 10);
+			if (errno || *end || (nthreads < 1)) {
+				(void)fprintf(stderr, "Invalid thread count.\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			query_usage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc - 1) {
+		query_usage();
+		return EXIT_FAILURE;
+	}
+
+	if (replay_map_file(argv[optind], &rf) < 0)
+		return EXIT_FAILURE;
+	if (rf.nindex == 0) {
+		(void)fprintf(stderr, "%s has no complete frames\n", argv[optind]);
+		goto unmap;
+	}
+
+	q_from = 0;
+	q_to = UINT64_MAX;
+	if (from_arg && (query_parse_time(from_arg, rf.start, &q_from) < 0)) {
+		(void)fprintf(stderr, "Invalid window start '%s'.\n", from_arg);
+		goto unmap;
+	}
+	if (to_arg && (query_parse_time(to_arg, rf.start, &q_to) < 0)) {
+		(void)fprintf(stderr, "Invalid window end '%s'.\n", to_arg);
+		goto unmap;
+	}
+	if (q_to <= q_from) {
+		(void)fprintf(stderr, "Window end must be after its start.\n");
+		goto unmap;
+	}
+
+	/*
+	 *  Segments from the last keyframe at or before the window
+	 *  start (the base the first delta is taken against) up to
+	 *  the last keyframe inside the window
+	 */
+	for (seg_from = 0; (seg_from + 1 < rf.nindex) && (rf.index[seg_from + 1].timestamp <= q_from); seg_from++)
+		;
+	for (seg_to = seg_from + 1; (seg_to < rf.nindex) && (rf.index[seg_to].timestamp <= q_to); seg_to++)
+		;
+	nsegs = seg_to - seg_from;
+
+	/* Half way through the part of the window actually recorded */
+	q_mid = ((q_from > rf.index[seg_from].timestamp) ? q_from : rf.index[seg_from].timestamp);
+	if (q_to != UINT64_MAX) {
+		q_mid = q_mid + ((q_to - q_mid) / 2);
+	} else {
+		replay_decoder_t d;
+		uint64_t last = rf.index[rf.nindex - 1].timestamp;
+
+		/* Open ended, find the time of the last frame */
+		replay_decoder_init(&d, &rf, rf.index[rf.nindex - 1].offset);
+		while (replay_decode_next(&d) == 0)
+			last = d.timestamp;
+		replay_decoder_free(&d);
+		q_mid = q_mid + ((last - q_mid) / 2);
+	}
+
+	if (nthreads > QUERY_MAX_THREADS)
+		nthreads = QUERY_MAX_THREADS;
+	if ((size_t)nthreads > nsegs)
+		nthreads = (long int)nsegs;
+
+	(void)memset(workers, 0, sizeof(workers));
+	for (i = 0; i < (size_t)nthreads; i++) {
+		workers[i].rf = &rf;
+		workers[i].seg_from = seg_from + ((nsegs * i) / (size_t)nthreads);
+		workers[i].seg_to = seg_from + ((nsegs * (i + 1)) / (size_t)nthreads);
+		started[i] = (i > 0) &&
+			(pthread_create(&threads[i], NULL, query_worker, &workers[i]) == 0);
+	}
+	/* This thread takes the first run, and any that failed to start */
+	for (i = 0; i < (size_t)nthreads; i++) {
+		if (started[i])
+			(void)pthread_join(threads[i], NULL);
+		else
+			(void)query_worker(&workers[i]);
+	}
+
+	/* Merge in segment order so the last seen names win */
+	for (i = 0; i < (size_t)nthreads; i++) {
+		const query_worker_t * const w = &workers[i];
+
+		if (w->ret < 0) {
+			(void)fprintf(stderr, "Recording is corrupt in keyframe segments %zu-%zu\n",
+				w->seg_from, w->seg_to - 1);
+			goto free_results;
+		}
+		if (query_merge(&results, &w->map) < 0)
+			goto free_results;
+		samples += w->samples;
+		covered += w->covered;
+		if (w->samples && !first_ts)
+			first_ts = w->first_ts;
+		if (w->samples)
+			last_ts = w->last_ts;
+	}
+
+	if ((sorted = heap_calloc(results.n + 1, sizeof(*sorted))) == NULL) {
+		out_of_memory("sorting query results");
+		goto free_results;
+	}
+	for (i = 0, n = 0; i < results.size; i++) {
+		if (results.groups[i].hash)
+			sorted[n++] = &results.groups[i];
+	}
+	qsort(sorted, n, sizeof(*sorted), query_cmp);
+	if (top_k && ((size_t)top_k < n))
+		n = (size_t)top_k;
+
+	if (samples == 0) {
+		(void)fprintf(stderr, "No samples in the window\n");
+		goto free_results;
+	}
+	query_output(sorted, n, samples, covered, first_ts, last_ts);
+	ret = EXIT_SUCCESS;
+
+free_results:
+	free(sorted);
+	query_map_free(&results);
+	for (i = 0; i < (size_t)nthreads; i++)
+		query_map_free(&workers[i].map);
+unmap:
+	replay_unmap_file(&rf);
+
+	return ret;
+}
@@ -0,0 +1,512 @@
+/*
+ * Binary recording writer for PageFaultStat, see record.h
+ * for the file format
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+#include "record.h"
+#include <time.h>
+
+#define RECORD_FLUSH_SIZE	(64 * 1024)
+#define RECORD_DICT_MIN		(1024)
+
+/* One pid of a frame, the state deltas are coded against */
+typedef struct {
+	pid_t		pid;		/* process id */
+	uid_t		uid;		/* process' UID */
+	int64_t		maj_fault;	/* major page faults */
+	int64_t		min_fault;	/* minor page faults */
+	int64_t		vm_swap;	/* swap */
+	uint32_t	user_id;	/* user name string id */
+	uint32_t	cmd_id;		/* command string id */
+} record_entry_t;
+
+static int record_fd = -1;		/* recording fd, -1 = not recording */
+static const char *record_path;		/* recording file name */
+static uint64_t record_offset;		/* file offset of the next frame */
+static uint64_t record_frames;		/* frames recorded */
+static uint64_t record_last_ts;		/* timestamp of the previous frame */
+
+static strbuf_t record_out;		/* frames not yet written */
+static strbuf_t record_payload;		/* frame being encoded */
+static strbuf_t record_strings;		/* strings first used this frame */
+static strbuf_t record_pids;		/* scratch for pid sections */
+
+static record_entry_t *record_prev;	/* previous frame, sorted by pid */
+static record_entry_t *record_cur;	/* this frame, sorted by pid */
+static size_t record_nprev, record_ncur, record_nalloc;
+
+static record_index_t *record_index;	/* keyframes */
+static size_t record_nindex, record_index_alloc;
+
+/* String dictionary, open addressing on string contents */
+static strbuf_t dict_buf;		/* the strings, NUL separated */
+static uint32_t *dict_off;		/* offset in dict_buf by id - 1 */
+static uint32_t *dict_hash;		/* ids, 0 = empty */
+static uint32_t dict_count, dict_size;
+static uint32_t record_nstrings;	/* new strings this frame */
+
+static uint32_t crc_table[256];
+
+/*
+ *  record_crc32()
+ *	CRC-32 (IEEE 802.3) of data
+ */
+uint32_t record_crc32(const void *data, const size_t len)
+{
+	const uint8_t *ptr = data;
+	uint32_t crc = 0xffffffff;
+	size_t i;
+
+	if (!crc_table[1]) {
+		uint32_t n;
+
+		for (n = 0; n < 256; n++) {
+			uint32_t c = n;
+			int k;
+
+			for (k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			crc_table[n] = c;
+		}
+	}
+	for (i = 0; i < len; i++)
+		crc = crc_table[(crc ^ ptr[i]) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffff;
+}
+
+/*
+ *  put_varint()
+ *	append an unsigned varint
+ */
+static int put_varint(strbuf_t * const sb, const uint64_t val)
+{
+	uint8_t buf[RECORD_VARINT_MAX];
+
+	return strbuf_append(sb, (const char *)buf, record_varint_put(buf, val));
+}
+
+/*
+ *  dict_hash_str()
+ *	FNV-1a hash of a string
+ */
+static uint32_t dict_hash_str(const char *str)
+{
+	uint32_t h = 2166136261U;
+
+	while (*str)
+		h = (h ^ (uint8_t)*str++) * 16777619U;
+	return h;
+}
+
+/*
+ *  dict_reset()
+ *	forget all strings, done at every keyframe
+ */
+static void dict_reset(void)
+{
+	if (dict_hash)
+		(void)memset(dict_hash, 0, dict_size * sizeof(*dict_hash));
+	dict_count = 0;
+	strbuf_reset(&dict_buf);
+}
+
+/*
+ *  dict_grow()
+ *	double the hash table and re-hash
+ */
+static int dict_grow(void)
+{
+	const uint32_t size = dict_size ? dict_size * 2 : RECORD_DICT_MIN;
+	uint32_t *hash, *off, id;
+
+	if ((hash = heap_calloc(size, sizeof(*hash))) == NULL)
+		return -1;
+	if ((off = heap_realloc(dict_off, size * sizeof(*off))) == NULL) {
+		free(hash);
+		return -1;
+	}
+	for (id = 1; id <= dict_count; id++) {
+		uint32_t i = dict_hash_str(dict_buf.buf + off[id - 1]) & (size - 1);
+
+		while (hash[i])
+			i = (i + 1) & (size - 1);
+		hash[i] = id;
+	}
+	free(dict_hash);
+	dict_hash = hash;
+	dict_off = off;
+	dict_size = size;
+	return 0;
+}
+
+/*
+ *  dict_id()
+ *	id for a string, new strings are added to the dictionary
+ *	and to the strings section of the frame being encoded
+ */
+static uint32_t dict_id(const char *str)
+{
+	uint32_t i;
+	size_t len;
+
+	if (!str)
+		return 0;
+	if (((dict_count + 1) * 2 > dict_size) && (dict_grow() < 0))
+		return 0;
+
+	for (i = dict_hash_str(str) & (dict_size - 1); dict_hash[i]; i = (i + 1) & (dict_size - 1)) {
+		if (!strcmp(dict_buf.buf + dict_off[dict_hash[i] - 1], str))
+			return dict_hash[i];
+	}
+
+	len = strlen(str) + 1;
+	dict_off[dict_count] = (uint32_t)dict_buf.len;
+	if ((strbuf_append(&dict_buf, str, len) < 0) ||
+	    (strbuf_append(&record_strings, str, len) < 0))
+		return 0;
+	record_nstrings++;
+	dict_hash[i] = ++dict_count;
+
+	return dict_count;
+}
+
+static int entry_cmp(const void *p1, const void *p2)
+{
+	const record_entry_t *e1 = p1, *e2 = p2;
+
+	return (e1->pid > e2->pid) - (e1->pid < e2->pid);
+}
+
+/*
+ *  record_write()
+ *	write out buffered frames, always whole frames
+ *	so a crash can only lose the unwritten tail
+ */
+static int record_write(void)
+{
+	size_t done = 0;
+
+	while (done < record_out.len) {
+		const ssize_t ret = write(record_fd, record_out.buf + done, record_out.len - done);
+
+		PROFILE_IO(1, ret > 0 ? (size_t)ret : 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			display_restore();
+			(void)fprintf(stderr, "Cannot write to %s: errno=%d (%s)\n",
+				record_path, errno, strerror(errno));
+			return -1;
+		}
+		done += (size_t)ret;
+	}
+	strbuf_reset(&record_out);
+	return 0;
+}
+
+/*
+ *  record_emit()
+ *	frame the payload and queue it for writing
+ */
+static int record_emit(const uint8_t type)
+{
+	uint8_t hdr[RECORD_FRAME_HDR_SIZE];
+
+	hdr[0] = type;
+	record_put_le32(hdr + 1, (uint32_t)record_payload.len);
+	record_put_le32(hdr + 5, record_crc32(record_payload.buf, record_payload.len));
+	if ((strbuf_append(&record_out, (const char *)hdr, sizeof(hdr)) < 0) ||
+	    (strbuf_append(&record_out, record_payload.buf, record_payload.len) < 0))
+		return -1;
+	record_offset += sizeof(hdr) + record_payload.len;
+	return 0;
+}
+
+/*
+ *  record_open()
+ *	start a recording, interval is the sample interval in seconds
+ */
+int record_open(const char *path, const double interval)
+{
+	uint8_t hdr[RECORD_HEADER_SIZE];
+	struct timespec ts;
+
+	record_path = path;
+	record_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+	if (record_fd < 0) {
+		(void)fprintf(stderr, "Cannot create %s: errno=%d (%s)\n",
+			path, errno, strerror(errno));
+		return -1;
+	}
+
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+	(void)memset(hdr, 0, sizeof(hdr));
+	(void)memcpy(hdr, RECORD_MAGIC, sizeof(RECORD_MAGIC));
+	record_put_le32(hdr + 8, RECORD_VERSION);
+	record_put_le32(hdr + 12, RECORD_KEYFRAME_EVERY);
+	record_put_le64(hdr + 16, ((uint64_t)ts.tv_sec * 1000) + ((uint64_t)ts.tv_nsec / 1000000));
+	record_put_le32(hdr + 24, (uint32_t)(interval * 1000.0));
+
+	strbuf_reset(&record_out);
+	if (strbuf_append(&record_out, (const char *)hdr, sizeof(hdr)) < 0)
+		return -1;
+	record_offset = sizeof(hdr);
+	return record_write();
+}
+
+/*
+ *  record_pid_gaps()
+ *	append the pids in from that are missing from the
+ *	other sorted set as a count and ascending gaps
+ */
+static int record_pid_gaps(
+	const record_entry_t * const from, const size_t nfrom,
+	const record_entry_t * const other, const size_t nother)
+{
+	size_t i, j = 0, n = 0;
+	pid_t last = 0;
+	int ret = 0;
+
+	strbuf_reset(&record_pids);
+	for (i = 0; i < nfrom; i++) {
+		while ((j < nother) && (other[j].pid < from[i].pid))
+			j++;
+		if ((j < nother) && (other[j].pid == from[i].pid))
+			continue;
+		ret |= put_varint(&record_pids, (uint64_t)(from[i].pid - last));
+		last = from[i].pid;
+		n++;
+	}
+	ret |= put_varint(&record_payload, n);
+	ret |= strbuf_append(&record_payload, record_pids.buf, record_pids.len);
+
+	return ret;
+}
+
+/*
+ *  record_frame()
+ *	record one sample of the process list
+ */
+int record_frame(const fault_info_t * const fault_info_list)
+{
+	static const record_entry_t zero;
+	const fault_info_t *fault_info;
+	const bool key = (record_frames % RECORD_KEYFRAME_EVERY) == 0;
+	struct timespec ts;
+	record_entry_t *tmp;
+	uint64_t now_ms;
+	size_t i, j, n;
+	int ret = 0;
+
+	if (record_fd < 0)
+		return 0;
+
+	for (n = 0, fault_info = fault_info_list; fault_info; fault_info = fault_info->next)
+		n++;
+	if (n > record_nalloc) {
+		const size_t nalloc = n + (n / 2);
+
+		if ((tmp = heap_realloc(record_prev, nalloc * sizeof(*tmp))) == NULL)
+			goto oom;
+		record_prev = tmp;
+		if ((tmp = heap_realloc(record_cur, nalloc * sizeof(*tmp))) == NULL)
+			goto oom;
+		record_cur = tmp;
+		record_nalloc = nalloc;
+	}
+
+	if (key)
+		dict_reset();
+	strbuf_reset(&record_strings);
+	record_nstrings = 0;
+
+	for (n = 0, fault_info = fault_info_list; fault_info; fault_info = fault_info->next, n++) {
+		record_entry_t * const e = &record_cur[n];
+
+		e->pid = fault_info->pid;
+		e->uid = fault_info->uid;
+		e->maj_fault = fault_info->maj_fault;
+		e->min_fault = fault_info->min_fault;
+		e->vm_swap = fault_info->vm_swap;
+		e->user_id = fault_info->uname ? dict_id(fault_info->uname->name) : 0;
+		e->cmd_id = fault_info->proc ? dict_id(fault_info->proc->cmdline) : 0;
+	}
+	record_ncur = n;
+	qsort(record_cur, record_ncur, sizeof(*record_cur), entry_cmp);
+
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+	now_ms = ((uint64_t)ts.tv_sec * 1000) + ((uint64_t)ts.tv_nsec / 1000000);
+
+	strbuf_reset(&record_payload);
+	ret |= put_varint(&record_payload, record_frames);
+	ret |= put_varint(&record_payload, key ? now_ms :
+		record_zigzag((int64_t)(now_ms - record_last_ts)));
+	ret |= put_varint(&record_payload, record_nstrings);
+	ret |= strbuf_append(&record_payload, record_strings.buf, record_strings.len);
+
+	if (key) {
+		pid_t last = 0;
+
+		ret |= put_varint(&record_payload, record_ncur);
+		for (i = 0; i < record_ncur; i++) {
+			ret |= put_varint(&record_payload, (uint64_t)(record_cur[i].pid - last));
+			last = record_cur[i].pid;
+		}
+		for (i = 0; i < record_ncur; i++) {
+			const record_entry_t * const e = &record_cur[i];
+
+			ret |= put_varint(&record_payload, (uint64_t)e->maj_fault);
+			ret |= put_varint(&record_payload, (uint64_t)e->min_fault);
+			ret |= put_varint(&record_payload, (uint64_t)e->vm_swap);
+			ret |= put_varint(&record_payload, e->uid);
+			ret |= put_varint(&record_payload, e->user_id);
+			ret |= put_varint(&record_payload, e->cmd_id);
+		}
+	} else {
+		size_t nchanged = 0;
+		ssize_t last = -1;
+
+		ret |= record_pid_gaps(record_prev, record_nprev, record_cur, record_ncur);
+		ret |= record_pid_gaps(record_cur, record_ncur, record_prev, record_nprev);
+
+		/* Changed entries go to the scratch buffer first to count them */
+		strbuf_reset(&record_pids);
+		for (i = 0, j = 0; i < record_ncur; i++) {
+			const record_entry_t * const e = &record_cur[i];
+			const record_entry_t *p = &zero;
+			uint8_t tag = 0;
+
+			while ((j < record_nprev) && (record_prev[j].pid < e->pid))
+				j++;
+			if ((j < record_nprev) && (record_prev[j].pid == e->pid))
+				p = &record_prev[j];
+
+			tag |= (e->maj_fault != p->maj_fault) ? RECORD_TAG_MAJOR : 0;
+			tag |= (e->min_fault != p->min_fault) ? RECORD_TAG_MINOR : 0;
+			tag |= (e->vm_swap != p->vm_swap) ? RECORD_TAG_SWAP : 0;
+			tag |= (e->uid != p->uid) ? RECORD_TAG_UID : 0;
+			tag |= (e->user_id != p->user_id) ? RECORD_TAG_USER : 0;
+			tag |= (e->cmd_id != p->cmd_id) ? RECORD_TAG_CMD : 0;
+			/* New pids must appear even if everything is zero */
+			if (!tag && (p != &zero))
+				continue;
+
+			ret |= put_varint(&record_pids, (uint64_t)((ssize_t)i - last - 1));
+			ret |= strbuf_append(&record_pids, (const char *)&tag, 1);
+			if (tag & RECORD_TAG_MAJOR)
+				ret |= put_varint(&record_pids, record_zigzag(e->maj_fault - p->maj_fault));
+			if (tag & RECORD_TAG_MINOR)
+				ret |= put_varint(&record_pids, record_zigzag(e->min_fault - p->min_fault));
+			if (tag & RECORD_TAG_SWAP)
+				ret |= put_varint(&record_pids, record_zigzag(e->vm_swap - p->vm_swap));
+			if (tag & RECORD_TAG_UID)
+				ret |= put_varint(&record_pids, e->uid);
+			if (tag & RECORD_TAG_USER)
+				ret |= put_varint(&record_pids, e->user_id);
+			if (tag & RECORD_TAG_CMD)
+				ret |= put_varint(&record_pids, e->cmd_id);
+			last = (ssize_t)i;
+			nchanged++;
+		}
+		ret |= put_varint(&record_payload, nchanged);
+		ret |= strbuf_append(&record_payload, record_pids.buf, record_pids.len);
+	}
+
+	if (key) {
+		if (record_nindex == record_index_alloc) {
+			const size_t nalloc = record_index_alloc ? record_index_alloc * 2 : 64;
+			record_index_t *idx;
+
+			if ((idx = heap_realloc(record_index, nalloc * sizeof(*idx))) == NULL)
+				goto oom;
+			record_index = idx;
+			record_index_alloc = nalloc;
+		}
+		record_index[record_nindex].offset = record_offset;
+		record_index[record_nindex].timestamp = now_ms;
+		record_index[record_nindex].frame = record_frames;
+		record_nindex++;
+	}
+
+	ret |= record_emit(key ? RECORD_FRAME_KEY : RECORD_FRAME_DELTA);
+	if (ret)
+		return -1;
+
+	tmp = record_prev;
+	record_prev = record_cur;
+	record_cur = tmp;
+	record_nprev = record_ncur;
+	record_last_ts = now_ms;
+	record_frames++;
+
+	/* Keyframes are always pushed out so they are on disk to seek to */
+	if (key || (record_out.len >= RECORD_FLUSH_SIZE))
+		return record_write();
+	return 0;
+
+oom:
+	out_of_memory("recording frame");
+	return -1;
+}
+
+/*
+ *  record_close()
+ *	write the keyframe index and trailer and close
+ */
+void record_close(void)
+{
+	uint8_t buf[RECORD_INDEX_ENTRY_SIZE];
+	uint64_t index_offset;
+	size_t i;
+	int ret = 0;
+
+	if (record_fd < 0)
+		goto free_bufs;
+
+	index_offset = record_offset;
+	strbuf_reset(&record_payload);
+	ret |= put_varint(&record_payload, record_nindex);
+	for (i = 0; i < record_nindex; i++) {
+		record_put_le64(buf, record_index[i].offset);
+		record_put_le64(buf + 8, record_index[i].timestamp);
+		record_put_le64(buf + 16, record_index[i].frame);
+		ret |= strbuf_append(&record_payload, (const char *)buf, sizeof(buf));
+	}
+	ret |= record_emit(RECORD_FRAME_INDEX);
+
+	record_put_le64(buf, index_offset);
+	(void)memcpy(buf + 8, RECORD_TRAILER_MAGIC, sizeof(RECORD_TRAILER_MAGIC));
+	ret |= strbuf_append(&record_out, (const char *)buf, RECORD_TRAILER_SIZE);
+	if (!ret)
+		(void)record_write();
+
+	(void)close(record_fd);
+	record_fd = -1;
+
+free_bufs:
+	strbuf_free(&record_out);
+	strbuf_free(&record_payload);
+	strbuf_free(&record_strings);
+	strbuf_free(&record_pids);
+	strbuf_free(&dict_buf);
+	free(dict_hash);
+	free(dict_off);
+	free(record_prev);
+	free(record_cur);
+	free(record_index);
+	dict_hash = NULL;
+	dict_off = NULL;
+	dict_size = 0;
+	dict_count = 0;
+	record_prev = NULL;
+	record_cur = NULL;
+	record_index = NULL;
+	record_nalloc = 0;
+	record_nindex = 0;
+	record_index_alloc = 0;
+}
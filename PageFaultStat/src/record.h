@@ -0,0 +1,144 @@
+/*
+ * Binary recording format for PageFaultStat (-w file)
+ *
+ * All fixed size fields are little endian. A recording is:
+ *
+ *	header		magic "PFSREC1\0", u32 version, u32 keyframe
+ *			interval, u64 start time (ms since the epoch),
+ *			u32 sample interval (ms), u32 reserved
+ *	frames		u8 type, u32 payload length, u32 CRC-32 of the
+ *			payload, payload
+ *	index		an 'I' frame listing every keyframe
+ *	trailer		u64 offset of the index frame, magic "PFSIDX1\0"
+ *
+ * Frame payloads are made of LEB128 varints. Signed values are
+ * zigzag encoded first. A payload starts with the frame number,
+ * the timestamp (absolute ms in a keyframe, zigzag ms delta from
+ * the previous frame otherwise) and the strings first used in
+ * this frame as a count followed by NUL terminated strings. String
+ * ids start at 1, 0 means no string, and the dictionary is reset
+ * at every keyframe so decoding can start at any keyframe.
+ *
+ * A keyframe ('K') then holds the pid count, the pids in ascending
+ * order as gaps from the previous pid, and for each pid major,
+ * minor, swap, uid, user string id and command string id.
+ *
+ * A delta frame ('D') holds the removed pids and the added pids
+ * (each a count and ascending gaps) followed by the changed
+ * entries of the new pid set: a count, then for each entry the gap
+ * from the previous changed position, a tag byte of RECORD_TAG_*
+ * bits and the tagged fields in bit order. Counters are zigzag
+ * deltas, ids and uids are stored as is. Added pids start from
+ * all zero, so they are always in the changed list.
+ *
+ * The index payload is a count followed by 24 byte entries of
+ * u64 file offset, u64 timestamp and u64 frame number. A recording
+ * without a trailer (the sampler was killed) is still readable by
+ * walking the frames, a torn last frame fails its CRC.
+ */
+
+#ifndef __RECORD_H__
+#define __RECORD_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RECORD_MAGIC		"PFSREC1"
+#define RECORD_TRAILER_MAGIC	"PFSIDX1"
+#define RECORD_VERSION		(1)
+#define RECORD_KEYFRAME_EVERY	(60)
+
+#define RECORD_HEADER_SIZE	(32)
+#define RECORD_FRAME_HDR_SIZE	(9)
+#define RECORD_INDEX_ENTRY_SIZE	(24)
+#define RECORD_TRAILER_SIZE	(16)
+
+#define RECORD_FRAME_KEY	('K')
+#define RECORD_FRAME_DELTA	('D')
+#define RECORD_FRAME_INDEX	('I')
+
+#define RECORD_TAG_MAJOR	(0x01)
+#define RECORD_TAG_MINOR	(0x02)
+#define RECORD_TAG_SWAP		(0x04)
+#define RECORD_TAG_UID		(0x08)
+#define RECORD_TAG_USER		(0x10)
+#define RECORD_TAG_CMD		(0x20)
+
+#define RECORD_VARINT_MAX	(10)
+
+static inline uint64_t record_zigzag(const int64_t val)
+{
+	return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+}
+
+static inline int64_t record_unzigzag(const uint64_t val)
+{
+	return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
+
+/*
+ *  record_varint_put()
+ *	encode val into buf, returns bytes used
+ */
+static inline size_t record_varint_put(uint8_t * const buf, uint64_t val)
+{
+	size_t n = 0;
+
+	while (val >= 0x80) {
+		buf[n++] = (uint8_t)(val | 0x80);
+		val >>= 7;
+	}
+	buf[n++] = (uint8_t)val;
+	return n;
+}
+
+/*
+ *  record_varint_get()
+ *	decode a varint at *ptr, advances *ptr, returns -1 if
+ *	it runs past end or is too long
+ */
+static inline int record_varint_get(const uint8_t ** const ptr, const uint8_t * const end, uint64_t * const val)
+{
+	const uint8_t *p = *ptr;
+	uint64_t v = 0;
+	int shift;
+
+	for (shift = 0; (p < end) && (shift < 64); shift += 7) {
+		const uint8_t b = *p++;
+
+		v |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			*ptr = p;
+			*val = v;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static inline void record_put_le32(uint8_t * const buf, const uint32_t val)
+{
+	buf[0] = (uint8_t)val;
+	buf[1] = (uint8_t)(val >> 8);
+	buf[2] = (uint8_t)(val >> 16);
+	buf[3] = (uint8_t)(val >> 24);
+}
+
+static inline void record_put_le64(uint8_t * const buf, const uint64_t val)
+{
+	record_put_le32(buf, (uint32_t)val);
+	record_put_le32(buf + 4, (uint32_t)(val >> 32));
+}
+
+static inline uint32_t record_get_le32(const uint8_t * const buf)
+{
+	return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) |
+	       ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static inline uint64_t record_get_le64(const uint8_t * const buf)
+{
+	return (uint64_t)record_get_le32(buf) | ((uint64_t)record_get_le32(buf + 4) << 32);
+}
+
+#endif /* __RECORD_H__ */
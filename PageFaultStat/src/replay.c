@@ -0,0 +1,618 @@
+/*
+ * Recording decoder and replay (-r file) for PageFaultStat,
+ * see record.h for the file format
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+#include "record.h"
+#include <sys/mman.h>
+
+static replay_file_t replay_file;	/* recording being replayed */
+static replay_decoder_t replay_dec;	/* its decoder */
+static double replay_speed = 1.0;	/* 0 = as fast as possible */
+
+/*
+ *  Replay owned process and user objects handed out via the
+ *  fault_info lists, double buffered as the old list still
+ *  points at the previous frame's objects
+ */
+static proc_info_t *replay_procs[2];
+static uname_cache_t *replay_unames[2];
+static size_t replay_alloc[2];
+static int replay_flip;
+
+/*
+ *  replay_frame_check()
+ *	check the frame at ptr, returns its payload length or -1 if
+ *	there is no complete, intact frame of the given type there
+ */
+static int64_t replay_frame_check(
+	const replay_file_t * const rf,
+	const uint8_t * const ptr,
+	uint8_t * const type)
+{
+	uint32_t len;
+
+	if ((size_t)(rf->map + rf->len - ptr) < RECORD_FRAME_HDR_SIZE)
+		return -1;
+	len = record_get_le32(ptr + 1);
+	if ((size_t)(rf->map + rf->len - ptr - RECORD_FRAME_HDR_SIZE) < len)
+		return -1;	/* Torn, the recorder died mid-write */
+	if (record_crc32(ptr + RECORD_FRAME_HDR_SIZE, len) != record_get_le32(ptr + 5))
+		return -1;
+	*type = ptr[0];
+	return len;
+}
+
+/*
+ *  replay_index_add()
+ *	append a keyframe to the index
+ */
+static int replay_index_add(
+	replay_file_t * const rf,
+	size_t * const nalloc,
+	const uint64_t offset,
+	const uint64_t timestamp,
+	const uint64_t frame)
+{
+	if (rf->nindex == *nalloc) {
+		const size_t n = *nalloc ? *nalloc * 2 : 64;
+		record_index_t *idx;
+
+		if ((idx = heap_realloc(rf->index, n * sizeof(*idx))) == NULL) {
+			out_of_memory("allocating recording index");
+			return -1;
+		}
+		rf->index = idx;
+		*nalloc = n;
+	}
+	rf->index[rf->nindex].offset = offset;
+	rf->index[rf->nindex].timestamp = timestamp;
+	rf->index[rf->nindex].frame = frame;
+	rf->nindex++;
+	return 0;
+}
+
+/*
+ *  replay_load_index()
+ *	load the keyframe index from the trailer, or if the
+ *	recording was not closed cleanly rebuild it by walking
+ *	the frames
+ */
+static int replay_load_index(replay_file_t * const rf)
+{
+	const uint8_t *ptr, *end;
+	size_t nalloc = 0;
+	uint64_t i, n;
+	uint8_t type;
+
+	if (rf->len >= RECORD_HEADER_SIZE + RECORD_TRAILER_SIZE) {
+		const uint8_t *trailer = rf->map + rf->len - RECORD_TRAILER_SIZE;
+		const uint64_t offset = record_get_le64(trailer);
+		int64_t len;
+
+		if (!memcmp(trailer + 8, RECORD_TRAILER_MAGIC, sizeof(RECORD_TRAILER_MAGIC)) &&
+		    (offset >= RECORD_HEADER_SIZE) && (offset < rf->len) &&
+		    ((len = replay_frame_check(rf, rf->map + offset, &type)) >= 0) &&
+		    (type == RECORD_FRAME_INDEX)) {
+			ptr = rf->map + offset + RECORD_FRAME_HDR_SIZE;
+			end = ptr + len;
+			if ((record_varint_get(&ptr, end, &n) == 0) &&
+			    (n <= (uint64_t)(end - ptr) / RECORD_INDEX_ENTRY_SIZE)) {
+				for (i = 0; i < n; i++, ptr += RECORD_INDEX_ENTRY_SIZE) {
+					if (replay_index_add(rf, &nalloc,
+						record_get_le64(ptr),
+						record_get_le64(ptr + 8),
+						record_get_le64(ptr + 16)) < 0)
+						return -1;
+				}
+				return 0;
+			}
+		}
+	}
+
+	/* No usable trailer, walk the frame headers */
+	for (ptr = rf->map + RECORD_HEADER_SIZE; ; ) {
+		const int64_t len = replay_frame_check(rf, ptr, &type);
+		const uint8_t *p = ptr + RECORD_FRAME_HDR_SIZE;
+		uint64_t frame, ts;
+
+		if ((len < 0) || (type == RECORD_FRAME_INDEX))
+			break;
+		end = p + len;
+		if ((type == RECORD_FRAME_KEY) &&
+		    (record_varint_get(&p, end, &frame) == 0) &&
+		    (record_varint_get(&p, end, &ts) == 0) &&
+		    (replay_index_add(rf, &nalloc, (uint64_t)(ptr - rf->map), ts, frame) < 0))
+			return -1;
+		ptr = end;
+	}
+	return 0;
+}
+
+/*
+ *  replay_map_file()
+ *	map a recording and load its keyframe index
+ */
+int replay_map_file(const char *path, replay_file_t * const rf)
+{
+	struct stat statbuf;
+	int fd;
+
+	(void)memset(rf, 0, sizeof(*rf));
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		(void)fprintf(stderr, "Cannot open %s: errno=%d (%s)\n",
+			path, errno, strerror(errno));
+		return -1;
+	}
+	if (fstat(fd, &statbuf) < 0) {
+		(void)fprintf(stderr, "Cannot stat %s: errno=%d (%s)\n",
+			path, errno, strerror(errno));
+		(void)close(fd);
+		return -1;
+	}
+	if ((size_t)statbuf.st_size < RECORD_HEADER_SIZE) {
+		(void)fprintf(stderr, "%s is not a recording\n", path);
+		(void)close(fd);
+		return -1;
+	}
+	/*
+	 *  Private and writable so strings can be handed out as the
+	 *  char * the rest of faultstat expects, nothing writes to them
+	 */
+	rf->len = (size_t)statbuf.st_size;
+	rf->map = mmap(NULL, rf->len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	(void)close(fd);
+	if (rf->map == MAP_FAILED) {
+		(void)fprintf(stderr, "Cannot map %s: errno=%d (%s)\n",
+			path, errno, strerror(errno));
+		rf->map = NULL;
+		return -1;
+	}
+	(void)madvise(rf->map, rf->len, MADV_SEQUENTIAL);
+
+	if (memcmp(rf->map, RECORD_MAGIC, sizeof(RECORD_MAGIC)) ||
+	    (record_get_le32(rf->map + 8) != RECORD_VERSION)) {
+		(void)fprintf(stderr, "%s is not a version %d recording\n", path, RECORD_VERSION);
+		replay_unmap_file(rf);
+		return -1;
+	}
+	rf->start = record_get_le64(rf->map + 16);
+	rf->interval = record_get_le32(rf->map + 24);
+
+	if (replay_load_index(rf) < 0) {
+		replay_unmap_file(rf);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ *  replay_unmap_file()
+ *	unmap a recording
+ */
+void replay_unmap_file(replay_file_t * const rf)
+{
+	if (rf->map)
+		(void)munmap(rf->map, rf->len);
+	free(rf->index);
+	(void)memset(rf, 0, sizeof(*rf));
+}
+
+/*
+ *  replay_decoder_init()
+ *	start decoding at a file offset, which has to be a
+ *	keyframe or the start of the frames
+ */
+void replay_decoder_init(
+	replay_decoder_t * const d,
+	const replay_file_t * const rf,
+	const uint64_t offset)
+{
+	(void)memset(d, 0, sizeof(*d));
+	d->file = rf;
+	d->ptr = rf->map + (offset ? offset : RECORD_HEADER_SIZE);
+}
+
+/*
+ *  replay_decoder_free()
+ *	free decoder memory
+ */
+void replay_decoder_free(replay_decoder_t * const d)
+{
+	free(d->dict);
+	free(d->entries);
+	free(d->prev);
+	(void)memset(d, 0, sizeof(*d));
+}
+
+/*
+ *  replay_reserve()
+ *	make room for n entries in both frame buffers
+ */
+static int replay_reserve(replay_decoder_t * const d, const size_t n)
+{
+	const size_t alloc = n + (n / 2) + 16;
+	replay_entry_t *tmp;
+
+	if (n <= d->alloc)
+		return 0;
+	if ((tmp = heap_realloc(d->entries, alloc * sizeof(*tmp))) == NULL)
+		return -1;
+	d->entries = tmp;
+	if ((tmp = heap_realloc(d->prev, alloc * sizeof(*tmp))) == NULL)
+		return -1;
+	d->prev = tmp;
+	d->alloc = alloc;
+	return 0;
+}
+
+/*
+ *  replay_str()
+ *	resolve a string id, returns -1 if it is not in the dictionary
+ */
+static int replay_str(const replay_decoder_t * const d, const uint64_t id, char ** const str)
+{
+	if (id > d->ndict)
+		return -1;
+	*str = id ? d->dict[id - 1] : NULL;
+	return 0;
+}
+
+/*
+ *  replay_decode_next()
+ *	decode the next frame into d->entries, returns 0 on
+ *	success, 1 at the end of the recording (including a
+ *	torn or corrupt last frame) and -1 if a frame that
+ *	passed its CRC does not decode
+ */
+int replay_decode_next(replay_decoder_t * const d)
+{
+	const uint8_t *p, *end;
+	replay_entry_t *tmp;
+	uint64_t frame, ts, n, i, val;
+	int64_t len;
+	uint8_t type;
+
+	if ((len = replay_frame_check(d->file, d->ptr, &type)) < 0)
+		return 1;
+	if ((type != RECORD_FRAME_KEY) && (type != RECORD_FRAME_DELTA))
+		return 1;
+	if ((type == RECORD_FRAME_DELTA) && !d->have_key)
+		return -1;
+
+	p = d->ptr + RECORD_FRAME_HDR_SIZE;
+	end = p + len;
+	if ((record_varint_get(&p, end, &frame) < 0) ||
+	    (record_varint_get(&p, end, &ts) < 0))
+		return -1;
+
+	/* Strings first used in this frame */
+	if (type == RECORD_FRAME_KEY)
+		d->ndict = 0;
+	if (record_varint_get(&p, end, &n) < 0)
+		return -1;
+	for (i = 0; i < n; i++) {
+		const uint8_t *nul = memchr(p, '\0', (size_t)(end - p));
+
+		if (!nul)
+			return -1;
+		if (d->ndict == d->dict_alloc) {
+			const size_t nalloc = d->dict_alloc ? d->dict_alloc * 2 : 1024;
+			char **dict;
+
+			if ((dict = heap_realloc(d->dict, nalloc * sizeof(*dict))) == NULL)
+				return -1;
+			d->dict = dict;
+			d->dict_alloc = nalloc;
+		}
+		d->dict[d->ndict++] = (char *)d->file->map + (p - d->file->map);
+		p = nul + 1;
+	}
+
+	tmp = d->prev;
+	d->prev = d->entries;
+	d->entries = tmp;
+	d->nprev = d->nentries;
+
+	if (type == RECORD_FRAME_KEY) {
+		pid_t pid = 0;
+
+		d->timestamp = ts;
+		if ((record_varint_get(&p, end, &n) < 0) ||
+		    (n > (uint64_t)(end - p)) ||
+		    (replay_reserve(d, (size_t)n) < 0))
+			return -1;
+		for (i = 0; i < n; i++) {
+			if (record_varint_get(&p, end, &val) < 0)
+				return -1;
+			pid += (pid_t)val;
+			d->entries[i].pid = pid;
+		}
+		for (i = 0; i < n; i++) {
+			replay_entry_t * const e = &d->entries[i];
+			uint64_t v[6];
+			int j;
+
+			for (j = 0; j < 6; j++) {
+				if (record_varint_get(&p, end, &v[j]) < 0)
+					return -1;
+			}
+			e->maj_fault = (int64_t)v[0];
+			e->min_fault = (int64_t)v[1];
+			e->vm_swap = (int64_t)v[2];
+			e->uid = (uid_t)v[3];
+			if ((replay_str(d, v[4], &e->user) < 0) ||
+			    (replay_str(d, v[5], &e->cmd) < 0))
+				return -1;
+		}
+		d->nentries = (size_t)n;
+		d->have_key = true;
+	} else {
+		const uint8_t *rem, *add;
+		uint64_t nrem, nadd, rem_pid = 0, add_pid = 0;
+		int64_t pos = -1;
+		size_t j, k;
+
+		d->timestamp += (uint64_t)record_unzigzag(ts);
+
+		/* Removed and added pid lists, merged below */
+		if (record_varint_get(&p, end, &nrem) < 0)
+			return -1;
+		rem = p;
+		for (i = 0; i < nrem; i++) {
+			if (record_varint_get(&p, end, &val) < 0)
+				return -1;
+		}
+		if (record_varint_get(&p, end, &nadd) < 0)
+			return -1;
+		add = p;
+		for (i = 0; i < nadd; i++) {
+			if (record_varint_get(&p, end, &val) < 0)
+				return -1;
+		}
+		if ((nrem > d->nprev) || (nadd > (uint64_t)(end - add)) ||
+		    (replay_reserve(d, d->nprev + (size_t)nadd) < 0))
+			return -1;
+
+		if (nrem) {
+			(void)record_varint_get(&rem, end, &rem_pid);
+			nrem--;
+		} else {
+			rem_pid = 0;
+		}
+		if (nadd) {
+			(void)record_varint_get(&add, end, &add_pid);
+			nadd--;
+		} else {
+			add_pid = 0;
+		}
+		for (j = 0, k = 0; (j < d->nprev) || add_pid; ) {
+			if (add_pid && ((j == d->nprev) || ((pid_t)add_pid < d->prev[j].pid))) {
+				replay_entry_t * const e = &d->entries[k++];
+
+				(void)memset(e, 0, sizeof(*e));
+				e->pid = (pid_t)add_pid;
+				if (nadd) {
+					(void)record_varint_get(&add, end, &val);
+					add_pid += val;
+					nadd--;
+				} else {
+					add_pid = 0;
+				}
+				continue;
+			}
+			if (rem_pid && ((pid_t)rem_pid == d->prev[j].pid)) {
+				j++;
+				if (nrem) {
+					(void)record_varint_get(&rem, end, &val);
+					rem_pid += val;
+					nrem--;
+				} else {
+					rem_pid = 0;
+				}
+				continue;
+			}
+			d->entries[k++] = d->prev[j++];
+		}
+		d->nentries = k;
+
+		/* Changed entries */
+		if (record_varint_get(&p, end, &n) < 0)
+			return -1;
+		for (i = 0; i < n; i++) {
+			replay_entry_t *e;
+			uint8_t tag;
+
+			if (record_varint_get(&p, end, &val) < 0)
+				return -1;
+			pos += (int64_t)val + 1;
+			if ((pos >= (int64_t)d->nentries) || (p >= end))
+				return -1;
+			e = &d->entries[pos];
+			tag = *p++;
+			if ((tag & RECORD_TAG_MAJOR) && (record_varint_get(&p, end, &val) == 0))
+				e->maj_fault += record_unzigzag(val);
+			if ((tag & RECORD_TAG_MINOR) && (record_varint_get(&p, end, &val) == 0))
+				e->min_fault += record_unzigzag(val);
+			if ((tag & RECORD_TAG_SWAP) && (record_varint_get(&p, end, &val) == 0))
+				e->vm_swap += record_unzigzag(val);
+			if ((tag & RECORD_TAG_UID) && (record_varint_get(&p, end, &val) == 0))
+				e->uid = (uid_t)val;
+			if ((tag & RECORD_TAG_USER) && ((record_varint_get(&p, end, &val) < 0) ||
+			    (replay_str(d, val, &e->user) < 0)))
+				return -1;
+			if ((tag & RECORD_TAG_CMD) && ((record_varint_get(&p, end, &val) < 0) ||
+			    (replay_str(d, val, &e->cmd) < 0)))
+				return -1;
+		}
+	}
+
+	d->frame = frame;
+	d->ptr = end;
+	return 0;
+}
+
+/*
+ *  replay_set_speed()
+ *	parse -x, a multiple of the recorded pace, 0 = no waiting
+ */
+int replay_set_speed(const char *arg)
+{
+	char *endptr;
+	double speed;
+
+	errno = 0;
+	speed = strtod(arg, &endptr);
+	if (errno || (endptr == arg) || *endptr || (speed < 0.0))
+		return -1;
+	replay_speed = speed;
+	return 0;
+}
+
+/*
+ *  replay_open()
+ *	open a recording for -r
+ */
+int replay_open(const char *path)
+{
+	if (replay_map_file(path, &replay_file) < 0)
+		return -1;
+	replay_decoder_init(&replay_dec, &replay_file, 0);
+	return 0;
+}
+
+/*
+ *  replay_next()
+ *	decode the next frame into a fault_info list, as
+ *	fault_get_all_pids() would have scanned it. Returns
+ *	0 on success, 1 at the end of the recording
+ */
+int replay_next(fault_info_t ** const fault_info, size_t * const npids)
+{
+	const int ret = replay_decode_next(&replay_dec);
+	size_t i;
+
+	*npids = 0;
+	if (ret > 0)
+		return 1;
+	if (ret < 0) {
+		display_restore();
+		(void)fprintf(stderr, "Recording is corrupt at frame %" PRIu64 "\n",
+			replay_dec.frame + 1);
+		return -1;
+	}
+
+	replay_flip ^= 1;
+	if (replay_dec.nentries > replay_alloc[replay_flip]) {
+		const size_t alloc = replay_dec.alloc;
+		proc_info_t *procs;
+		uname_cache_t *unames;
+
+		if ((procs = heap_realloc(replay_procs[replay_flip], alloc * sizeof(*procs))) == NULL)
+			goto oom;
+		replay_procs[replay_flip] = procs;
+		if ((unames = heap_realloc(replay_unames[replay_flip], alloc * sizeof(*unames))) == NULL)
+			goto oom;
+		replay_unames[replay_flip] = unames;
+		replay_alloc[replay_flip] = alloc;
+	}
+
+	for (i = 0; i < replay_dec.nentries; i++) {
+		const replay_entry_t * const e = &replay_dec.entries[i];
+		proc_info_t * const proc = &replay_procs[replay_flip][i];
+		uname_cache_t * const uname = &replay_unames[replay_flip][i];
+		fault_info_t *new_fault_info;
+
+		if (!fault_pid_wanted(e->pid, e->cmd))
+			continue;
+		if ((new_fault_info = fault_cache_alloc()) == NULL)
+			return -1;
+
+		(void)memset(proc, 0, sizeof(*proc));
+		proc->pid = e->pid;
+		proc->cmdline = e->cmd;
+		uname->next = NULL;
+		uname->name = e->user;
+		uname->uid = e->uid;
+
+		new_fault_info->pid = e->pid;
+		new_fault_info->uid = e->uid;
+		new_fault_info->proc = proc;
+		new_fault_info->uname = e->user ? uname : NULL;
+		new_fault_info->maj_fault = e->maj_fault;
+		new_fault_info->min_fault = e->min_fault;
+		new_fault_info->vm_swap = e->vm_swap;
+		new_fault_info->next = *fault_info;
+		*fault_info = new_fault_info;
+		(*npids)++;
+	}
+	return 0;
+
+oom:
+	out_of_memory("allocating replay processes");
+	return -1;
+}
+
+/*
+ *  replay_wait()
+ *	seconds to wait before the next frame is due
+ */
+double replay_wait(void)
+{
+	const uint8_t *p = replay_dec.ptr + RECORD_FRAME_HDR_SIZE, *end;
+	uint64_t frame, ts, next;
+	int64_t len;
+	uint8_t type;
+
+	if (replay_speed <= 0.0)
+		return 0.0;
+	if ((len = replay_frame_check(&replay_file, replay_dec.ptr, &type)) < 0)
+		return 0.0;
+	end = p + len;
+	if ((record_varint_get(&p, end, &frame) < 0) ||
+	    (record_varint_get(&p, end, &ts) < 0))
+		return 0.0;
+
+	if (type == RECORD_FRAME_KEY)
+		next = ts;
+	else if (type == RECORD_FRAME_DELTA)
+		next = replay_dec.timestamp + (uint64_t)record_unzigzag(ts);
+	else
+		return 0.0;
+
+	return (next > replay_dec.timestamp) ?
+		(double)(next - replay_dec.timestamp) / (1000.0 * replay_speed) : 0.0;
+}
+
+/*
+ *  replay_time()
+ *	time of the frame last replayed, in seconds to the
+ *	millisecond it was recorded with
+ */
+double replay_time(void)
+{
+	return (double)replay_dec.timestamp / 1000.0;
+}
+
+/*
+ *  replay_close()
+ *	free replay state
+ */
+void replay_close(void)
+{
+	int i;
+
+	replay_decoder_free(&replay_dec);
+	replay_unmap_file(&replay_file);
+	for (i = 0; i < 2; i++) {
+		free(replay_procs[i]);
+		free(replay_unames[i]);
+		replay_procs[i] = NULL;
+		replay_unames[i] = NULL;
+		replay_alloc[i] = 0;
+	}
+}
@@ -0,0 +1,691 @@
+/*
+ * Command wrapping measurement for PageFaultStat
+ *
+ *	PageFaultStat run [options] [interval] -- command [args...]
+ *
+ * Like time(1), but for page faults. The command is forked and the
+ * whole process tree under it is sampled, by default every 100 ms.
+ * PageFaultStat makes itself a child subreaper, so descendants that
+ * lose their parent are re-parented to it rather than to init and
+ * stay in the tree. A tree's faults are the faults of its live
+ * members plus those of the children they reaped (cminflt/cmajflt),
+ * plus those of the members PageFaultStat reaped itself, which
+ * getrusage(RUSAGE_CHILDREN) has. At exit the totals, peak and
+ * percentile fault rates, a time series and the rusage of the
+ * command are reported on stderr, and -o writes them as JSON to
+ * compare between builds. Each sample walks only the tree, through
+ * /proc/$PID/task/$TID/children, and reads just the stat of each
+ * member. Kernels without the children files get a scan of the
+ * stat of every process instead.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+#include <time.h>
+#include <sys/syscall.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define RUN_INTERVAL_DEFAULT	(0.1)	/* seconds */
+#define RUN_INTERVAL_MIN	(0.01)	/* seconds */
+#define RUN_SERIES_ROWS		(20)	/* time series rows on stderr */
+
+#define RUN_TREE_UNKNOWN	(0)
+#define RUN_TREE_IN		(1)
+#define RUN_TREE_OUT		(2)
+
+/* One sample of the tree */
+typedef struct {
+	double		t;		/* seconds since the start */
+	int64_t		maj_fault;	/* major faults so far */
+	int64_t		min_fault;	/* minor faults so far */
+	uint32_t	nprocs;		/* live processes in the tree */
+} run_sample_t;
+
+/* Process of a scan, indexed by pid */
+typedef struct {
+	const fault_info_t *fault_info;	/* NULL = empty slot */
+	int		state;		/* RUN_TREE_* */
+} run_slot_t;
+
+static run_sample_t *series;		/* every sample */
+static size_t nseries, series_alloc;
+static hist_t maj_rates, min_rates;	/* faults per second per sample */
+static run_slot_t *slots;		/* open addressing, by pid */
+static size_t nslots;
+static size_t *chain;			/* ancestors being resolved */
+static size_t chain_alloc;
+static pid_t *walk;			/* tree members still to walk */
+static size_t walk_alloc;
+
+/*
+ *  run_now()
+ *	monotonic time in seconds
+ */
+static double run_now(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+/*
+ *  run_handle_sigchld()
+ *	only here to interrupt the sleep between samples
+ */
+static void run_handle_sigchld(int dummy)
+{
+	(void)dummy;
+}
+
+/*
+ *  run_slot()
+ *	slot of pid, or the empty slot it would go in
+ */
+static size_t run_slot(const pid_t pid)
+{
+	size_t i = ((size_t)pid * 2654435761UL) & (nslots - 1);
+
+	while (slots[i].fault_info && (slots[i].fault_info->pid != pid))
+		i = (i + 1) & (nslots - 1);
+	return i;
+}
+
+/*
+ *  run_tree_sample()
+ *	live processes under self, and their faults with those
+ *	of the children they reaped, from one scan of them
+ */
+static int run_tree_sample(
+	fault_info_t * const fault_info_list,
+	const size_t npids,
+	const pid_t self,
+	run_sample_t * const s)
+{
+	const fault_info_t *fault_info;
+	size_t size = 16, i;
+
+	while (size < npids * 2)
+		size <<= 1;
+	if (size > nslots) {
+		free(slots);
+		if ((slots = heap_calloc(size, sizeof(*slots))) == NULL) {
+			out_of_memory("allocating run process index");
+			nslots = 0;
+			return -1;
+		}
+		nslots = size;
+	} else {
+		(void)memset(slots, 0, nslots * sizeof(*slots));
+	}
+	if (npids > chain_alloc) {
+		free(chain);
+		if ((chain = heap_calloc(npids, sizeof(*chain))) == NULL) {
+			out_of_memory("allocating run process chain");
+			chain_alloc = 0;
+			return -1;
+		}
+		chain_alloc = npids;
+	}
+
+	for (fault_info = fault_info_list; fault_info; fault_info = fault_info->next)
+		slots[run_slot(fault_info->pid)].fault_info = fault_info;
+
+	/*
+	 *  Walk up from each process until an ancestor with a
+	 *  known answer, self, or the top, then mark the walk
+	 */
+	for (fault_info = fault_info_list; fault_info; fault_info = fault_info->next) {
+		size_t n = 0, j = run_slot(fault_info->pid);
+		int state = RUN_TREE_UNKNOWN;
+
+		while ((state == RUN_TREE_UNKNOWN) && (n < npids)) {
+			const fault_info_t * const f = slots[j].fault_info;
+
+			if (slots[j].state != RUN_TREE_UNKNOWN) {
+				state = slots[j].state;
+				break;
+			}
+			chain[n++] = j;
+			if (f->ppid == self) {
+				state = RUN_TREE_IN;
+			} else if (f->ppid <= 1) {
+				state = RUN_TREE_OUT;
+			} else {
+				j = run_slot(f->ppid);
+				if (!slots[j].fault_info)
+					state = RUN_TREE_OUT;
+			}
+		}
+		if (state == RUN_TREE_UNKNOWN)
+			state = RUN_TREE_OUT;	/* A loop, pids reused mid-scan */
+		for (i = 0; i < n; i++)
+			slots[chain[i]].state = state;
+		if (state == RUN_TREE_IN) {
+			s->maj_fault += fault_info->maj_fault + fault_info->cmaj_fault;
+			s->min_fault += fault_info->min_fault + fault_info->cmin_fault;
+			s->nprocs++;
+		}
+	}
+	return 0;
+}
+
+/*
+ *  run_reap()
+ *	reap the command and any orphans of its tree,
+ *	true once the command itself has been reaped
+ */
+static bool run_reap(const pid_t child, int * const status, struct rusage * const ru)
+{
+	bool reaped = false;
+	struct rusage r;
+	pid_t pid;
+	int st;
+
+	while ((pid = wait4(-1, &st, WNOHANG, &r)) > 0) {
+		if (pid == child) {
+			*status = st;
+			*ru = r;
+			reaped = true;
+		}
+	}
+	return reaped;
+}
+
+/*
+ *  run_walk_children()
+ *	read the stat of the children of every thread of pid
+ *	and queue them to be walked in turn
+ */
+static int run_walk_children(
+	const pid_t pid,
+	size_t * const nwalk,
+	fault_info_t ** const fault_info_list,
+	size_t * const npids)
+{
+	static char dents[8192];
+	static char buf[65536];
+	char path[PATH_MAX];
+	long nread;
+	int fd;
+
+	(void)snprintf(path, sizeof(path), "%s/%i/task", proc_root, pid);
+	if ((fd = open(path, O_RDONLY | O_DIRECTORY)) < 0)
+		return 0;	/* Gone */
+
+	while ((nread = syscall(SYS_getdents64, fd, dents, sizeof(dents))) > 0) {
+		long off;
+
+		for (off = 0; off < nread; ) {
+			const struct linux_dirent64 *entry =
+				(const struct linux_dirent64 *)(dents + off);
+			char *ptr, *end;
+
+			off += entry->d_reclen;
+			if (!isdigit(entry->d_name[0]))
+				continue;
+			(void)snprintf(path, sizeof(path), "%s/%i/task/%s/children",
+				proc_root, pid, entry->d_name);
+			if (read_file(path, buf, sizeof(buf)) <= 0)
+				continue;
+
+			for (ptr = buf; ; ptr = end) {
+				const pid_t child = (pid_t)strtol(ptr, &end, 10);
+
+				if (end == ptr)
+					break;
+				if (*nwalk == walk_alloc) {
+					const size_t n = walk_alloc ? walk_alloc * 2 : 1024;
+					pid_t *tmp = heap_realloc(walk, n * sizeof(*walk));
+
+					if (!tmp) {
+						(void)close(fd);
+						out_of_memory("allocating run tree walk");
+						return -1;
+					}
+					walk = tmp;
+					walk_alloc = n;
+				}
+				if (fault_get_stat(child, fault_info_list) < 0)
+					continue;	/* Gone */
+				walk[(*nwalk)++] = child;
+				(*npids)++;
+			}
+		}
+	}
+	(void)close(fd);
+
+	return 0;
+}
+
+/*
+ *  run_tree_scan()
+ *	read the stat of the members of the tree under self,
+ *	or of every process if there are no children files
+ */
+static int run_tree_scan(
+	const pid_t self,
+	fault_info_t ** const fault_info_list,
+	size_t * const npids)
+{
+	static int have_children = -1;
+	size_t nwalk = 0, i;
+
+	if (have_children < 0) {
+		char path[PATH_MAX];
+
+		(void)snprintf(path, sizeof(path), "%s/%i/task/%i/children",
+			proc_root, self, self);
+		have_children = (access(path, R_OK) == 0);
+	}
+	if (!have_children)
+		return fault_get_all_stats(fault_info_list, npids);
+
+	*npids = 0;
+	if (run_walk_children(self, &nwalk, fault_info_list, npids) < 0)
+		return -1;
+	/* Breadth first, walk grows as children are found */
+	for (i = 0; i < nwalk; i++) {
+		if (run_walk_children(walk[i], &nwalk, fault_info_list, npids) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ *  run_take_sample()
+ *	scan the tree and add a sample to the series
+ */
+static int run_take_sample(
+	fault_info_t ** const fault_info_old,
+	const pid_t self,
+	const struct rusage * const ru_base,
+	const double t_start)
+{
+	fault_info_t *fault_info_new = NULL;
+	run_sample_t s = { 0.0, 0, 0, 0 };
+	struct rusage ru;
+	size_t npids;
+
+	/* Reaped by us, already gone from the scan below */
+	(void)getrusage(RUSAGE_CHILDREN, &ru);
+	s.maj_fault = ru.ru_majflt - ru_base->ru_majflt;
+	s.min_fault = ru.ru_minflt - ru_base->ru_minflt;
+
+	if (run_tree_scan(self, &fault_info_new, &npids) < 0) {
+		fault_cache_free_list(fault_info_new);
+		return -1;
+	}
+	s.t = run_now() - t_start;
+	if (run_tree_sample(fault_info_new, npids, self, &s) < 0) {
+		fault_cache_free_list(fault_info_new);
+		return -1;
+	}
+	fault_cache_free_list(*fault_info_old);
+	*fault_info_old = fault_info_new;
+
+	if (nseries == series_alloc) {
+		const size_t n = series_alloc ? series_alloc * 2 : 1024;
+		run_sample_t *tmp = heap_realloc(series, n * sizeof(*series));
+
+		if (!tmp) {
+			out_of_memory("allocating run time series");
+			return -1;
+		}
+		series = tmp;
+		series_alloc = n;
+	}
+
+	/*
+	 *  A child reaped between reading its parent and itself
+	 *  can be missed for a sample, keep the totals monotonic
+	 */
+	{
+		static const run_sample_t zero = { 0.0, 0, 0, 0 };
+		const run_sample_t * const prev = nseries ? &series[nseries - 1] : &zero;
+		const double dt = s.t - prev->t;
+
+		if (s.maj_fault < prev->maj_fault)
+			s.maj_fault = prev->maj_fault;
+		if (s.min_fault < prev->min_fault)
+			s.min_fault = prev->min_fault;
+		if (dt > 0.0) {
+			hist_add(&maj_rates, (int64_t)((double)(s.maj_fault - prev->maj_fault) / dt));
+			hist_add(&min_rates, (int64_t)((double)(s.min_fault - prev->min_fault) / dt));
+		}
+	}
+	series[nseries++] = s;
+
+	return 0;
+}
+
+/*
+ *  run_exit_code()
+ *	exit code for the command's wait status, as a shell would
+ */
+static int run_exit_code(const int status)
+{
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+	return EXIT_FAILURE;
+}
+
+/*
+ *  run_report()
+ *	summary, time series and rusage on stderr
+ */
+static void run_report(
+	char * const *cmd,
+	const int status,
+	const double interval,
+	const struct rusage * const ru)
+{
+	const run_sample_t * const last = &series[nseries - 1];
+	const double secs = last->t > 0.0 ? last->t : interval;
+	int64_t maj_pct[HIST_PCTS], min_pct[HIST_PCTS];
+	size_t i, step;
+
+	hist_percentiles(&maj_rates, maj_pct);
+	hist_percentiles(&min_rates, min_pct);
+
+	(void)fprintf(stderr, "%s run: %s", app_name, cmd[0]);
+	for (i = 1; cmd[i]; i++)
+		(void)fprintf(stderr, " %s", cmd[i]);
+	if (WIFSIGNALED(status))
+		(void)fprintf(stderr, "\n  killed by signal %d", WTERMSIG(status));
+	else
+		(void)fprintf(stderr, "\n  exit status %d", run_exit_code(status));
+	(void)fprintf(stderr, ", %.3f s, %zu samples every %.3f s\n",
+		last->t, nseries, interval);
+
+	(void)fprintf(stderr, "  %-6s %12s %12s %10s %10s %10s %10s\n",
+		"", "total", "per sec", "p50/s", "p90/s", "p99/s", "peak/s");
+	(void)fprintf(stderr, "  %-6s %12" PRId64 " %12.1f %10" PRId64 " %10" PRId64
+		" %10" PRId64 " %10" PRId64 "\n",
+		"major", last->maj_fault, (double)last->maj_fault / secs,
+		maj_pct[HIST_P50], maj_pct[HIST_P90], maj_pct[HIST_P99], maj_pct[HIST_MAX]);
+	(void)fprintf(stderr, "  %-6s %12" PRId64 " %12.1f %10" PRId64 " %10" PRId64
+		" %10" PRId64 " %10" PRId64 "\n",
+		"minor", last->min_fault, (double)last->min_fault / secs,
+		min_pct[HIST_P50], min_pct[HIST_P90], min_pct[HIST_P99], min_pct[HIST_MAX]);
+
+	/* At most RUN_SERIES_ROWS rows, the rates are over each row */
+	step = (nseries + RUN_SERIES_ROWS - 1) / RUN_SERIES_ROWS;
+	(void)fprintf(stderr, "  %9s %12s %12s %10s %10s %6s\n",
+		"time s", "major", "minor", "major/s", "minor/s", "procs");
+	for (i = step - 1; ; i += step) {
+		const run_sample_t *s, *prev;
+		double dt;
+
+		if (i >= nseries)
+			i = nseries - 1;
+		s = &series[i];
+		prev = (i >= step) ? &series[i - step] : NULL;
+		dt = prev ? s->t - prev->t : s->t;
+		if (dt <= 0.0)
+			dt = interval;
+		(void)fprintf(stderr, "  %9.3f %12" PRId64 " %12" PRId64 " %10.1f %10.1f %6" PRIu32 "\n",
+			s->t, s->maj_fault, s->min_fault,
+			(double)(s->maj_fault - (prev ? prev->maj_fault : 0)) / dt,
+			(double)(s->min_fault - (prev ? prev->min_fault : 0)) / dt,
+			s->nprocs);
+		if (i == nseries - 1)
+			break;
+	}
+
+	(void)fprintf(stderr, "  rusage: %.3f s user, %.3f s system, %ld kB max RSS, "
+		"%ld major, %ld minor, %ld/%ld voluntary/involuntary switches, "
+		"%ld/%ld blocks in/out\n",
+		timeval_to_double(&ru->ru_utime), timeval_to_double(&ru->ru_stime),
+		ru->ru_maxrss, ru->ru_majflt, ru->ru_minflt, ru->ru_nvcsw, ru->ru_nivcsw,
+		ru->ru_inblock, ru->ru_oublock);
+	if (last->nprocs)
+		(void)fprintf(stderr, "  %" PRIu32 " processes of the tree still running\n",
+			last->nprocs);
+}
+
+/*
+ *  run_json()
+ *	write the result to path, "-" for stdout, as JSON
+ */
+static int run_json(
+	const char *path,
+	char * const *cmd,
+	const int status,
+	const double interval,
+	const struct rusage * const ru)
+{
+	const run_sample_t * const last = &series[nseries - 1];
+	const double secs = last->t > 0.0 ? last->t : interval;
+	int64_t maj_pct[HIST_PCTS], min_pct[HIST_PCTS];
+	strbuf_t sb = { NULL, 0, 0 };
+	FILE *fp;
+	size_t i;
+	int ret = 0;
+
+	hist_percentiles(&maj_rates, maj_pct);
+	hist_percentiles(&min_rates, min_pct);
+
+	ret |= strbuf_printf(&sb, "{\"command\":[");
+	for (i = 0; cmd[i]; i++) {
+		ret |= strbuf_printf(&sb, "%s", i ? "," : "");
+		ret |= strbuf_json_str(&sb, cmd[i]);
+	}
+	ret |= strbuf_printf(&sb, "],\"exitCode\":%d,\"signal\":%d,\"seconds\":%.6f,"
+		"\"interval\":%.3f,\"samples\":%zu,\"running\":%" PRIu32,
+		run_exit_code(status), WIFSIGNALED(status) ? WTERMSIG(status) : 0,
+		last->t, interval, nseries, last->nprocs);
+	ret |= strbuf_printf(&sb, ",\"major\":{\"total\":%" PRId64 ",\"rate\":%.3f,"
+		"\"p50\":%" PRId64 ",\"p90\":%" PRId64 ",\"p99\":%" PRId64 ",\"peak\":%" PRId64 "}",
+		last->maj_fault, (double)last->maj_fault / secs,
+		maj_pct[HIST_P50], maj_pct[HIST_P90], maj_pct[HIST_P99], maj_pct[HIST_MAX]);
+	ret |= strbuf_printf(&sb, ",\"minor\":{\"total\":%" PRId64 ",\"rate\":%.3f,"
+		"\"p50\":%" PRId64 ",\"p90\":%" PRId64 ",\"p99\":%" PRId64 ",\"peak\":%" PRId64 "}",
+		last->min_fault, (double)last->min_fault / secs,
+		min_pct[HIST_P50], min_pct[HIST_P90], min_pct[HIST_P99], min_pct[HIST_MAX]);
+	ret |= strbuf_printf(&sb, ",\"rusage\":{\"utime\":%.6f,\"stime\":%.6f,\"maxrss\":%ld,"
+		"\"majflt\":%ld,\"minflt\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld,"
+		"\"inblock\":%ld,\"oublock\":%ld}",
+		timeval_to_double(&ru->ru_utime), timeval_to_double(&ru->ru_stime),
+		ru->ru_maxrss, ru->ru_majflt, ru->ru_minflt, ru->ru_nvcsw, ru->ru_nivcsw,
+		ru->ru_inblock, ru->ru_oublock);
+
+	/* [seconds, major, minor, processes] per sample */
+	ret |= strbuf_printf(&sb, ",\"series\":[");
+	for (i = 0; i < nseries; i++) {
+		ret |= strbuf_printf(&sb, "%s[%.3f,%" PRId64 ",%" PRId64 ",%" PRIu32 "]",
+			i ? "," : "", series[i].t, series[i].maj_fault,
+			series[i].min_fault, series[i].nprocs);
+	}
+	ret |= strbuf_printf(&sb, "]}\n");
+	if (ret < 0) {
+		strbuf_free(&sb);
+		return -1;
+	}
+
+	if (!strcmp(path, "-")) {
+		fp = stdout;
+	} else if ((fp = fopen(path, "w")) == NULL) {
+		(void)fprintf(stderr, "Cannot create %s: %s\n", path, strerror(errno));
+		strbuf_free(&sb);
+		return -1;
+	}
+	if (fwrite(sb.buf, 1, sb.len, fp) != sb.len)
+		ret = -1;
+	if ((fp != stdout) && (fclose(fp) != 0))
+		ret = -1;
+	if (ret < 0)
+		(void)fprintf(stderr, "Cannot write %s\n", path);
+	strbuf_free(&sb);
+
+	return ret;
+}
+
+static void run_usage(void)
+{
+	(void)printf("Usage: %s run [options] [interval] -- command [args...]\n"
+		"Options are:\n"
+		"  -h\t\tshow this help information\n"
+		"  -o file\twrite the result as JSON to file, - for stdout\n"
+		"  -q\t\tno report on stderr\n"
+		"interval is the sample interval in seconds, default %.1f, at least %.2f\n",
+		app_name, RUN_INTERVAL_DEFAULT, RUN_INTERVAL_MIN);
+}
+
+/*
+ *  run_main()
+ *	the run subcommand, argv[0] is "run"
+ */
+int run_main(int argc, char **argv)
+{
+	fault_info_t *fault_info_old = NULL;
+	struct sigaction sa, sa_int, sa_quit;
+	struct rusage ru_base, ru;
+	const char *json_path = NULL;
+	double interval = RUN_INTERVAL_DEFAULT, t_start, t_next;
+	char **cmd;
+	bool quiet = false, done = false;
+	pid_t self = getpid(), child;
+	int pipefd[2], status = 0, err, ret = EXIT_FAILURE;
+	uint64_t t = 0;
+
+	/* Stop at the interval or the command, their options are not ours */
+	optind = 1;
+	for (;;) {
+		const int c = getopt(argc, argv, "+ho:q");
+
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'h':
+			run_usage();
+			return EXIT_SUCCESS;
+		case 'o':
+			json_path = optarg;
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		default:
+			run_usage();
+			return EXIT_FAILURE;
+		}
+	}
+	if ((optind < argc) && strcmp(argv[optind - 1], "--")) {
+		char *end;
+
+		errno = 0;
+		interval = strtod(argv[optind], &end);
+		if (errno || *end || (interval < RUN_INTERVAL_MIN)) {
+			(void)fprintf(stderr, "Interval must be %.2f or more seconds.\n",
+				RUN_INTERVAL_MIN);
+			return EXIT_FAILURE;
+		}
+		optind++;
+		if ((optind < argc) && !strcmp(argv[optind], "--"))
+			optind++;
+	}
+	if (optind >= argc) {
+		run_usage();
+		return EXIT_FAILURE;
+	}
+	cmd = argv + optind;
+
+	hist_reset(&maj_rates);
+	hist_reset(&min_rates);
+
+	/* Orphans of the tree are re-parented here rather than to init */
+	if (prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0) < 0)
+		(void)fprintf(stderr, "Cannot become a subreaper, orphans of the tree "
+			"will not be followed: %s\n", strerror(errno));
+
+	(void)memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = run_handle_sigchld;
+	(void)sigemptyset(&sa.sa_mask);
+	(void)sigaction(SIGCHLD, &sa, NULL);
+
+	/* As time(1) does, a ^C is for the command */
+	sa.sa_handler = SIG_IGN;
+	(void)sigaction(SIGINT, &sa, &sa_int);
+	(void)sigaction(SIGQUIT, &sa, &sa_quit);
+
+	(void)getrusage(RUSAGE_CHILDREN, &ru_base);
+	if (pipe2(pipefd, O_CLOEXEC) < 0) {
+		(void)fprintf(stderr, "pipe failed: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	t_start = run_now();
+	child = fork();
+	if (child < 0) {
+		(void)fprintf(stderr, "fork failed: %s\n", strerror(errno));
+		(void)close(pipefd[0]);
+		(void)close(pipefd[1]);
+		return EXIT_FAILURE;
+	}
+	if (child == 0) {
+		(void)sigaction(SIGINT, &sa_int, NULL);
+		(void)sigaction(SIGQUIT, &sa_quit, NULL);
+		(void)close(pipefd[0]);
+		(void)execvp(cmd[0], cmd);
+		/* Tell the parent why, the pipe closes on a good exec */
+		err = errno;
+		(void)write(pipefd[1], &err, sizeof(err));
+		_exit(127);
+	}
+
+	(void)close(pipefd[1]);
+	if (read(pipefd[0], &err, sizeof(err)) == sizeof(err)) {
+		(void)fprintf(stderr, "Cannot run %s: %s\n", cmd[0], strerror(err));
+		(void)close(pipefd[0]);
+		(void)waitpid(child, NULL, 0);
+		return 127;
+	}
+	(void)close(pipefd[0]);
+
+	while (!done) {
+		struct timespec ts;
+
+		t_next = t_start + ((double)++t * interval);
+		ts.tv_sec = (time_t)t_next;
+		ts.tv_nsec = (long)((t_next - (double)ts.tv_sec) * 1e9);
+		/* An exit interrupts the sleep with SIGCHLD */
+		if (!(done = run_reap(child, &status, &ru))) {
+			(void)clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+			done = run_reap(child, &status, &ru);
+		}
+		if (run_take_sample(&fault_info_old, self, &ru_base, t_start) < 0) {
+			(void)kill(child, SIGKILL);
+			(void)waitpid(child, NULL, 0);
+			goto free_cache;
+		}
+
+		/* Catch up after a late wake up rather than sample back to back */
+		if (series[nseries - 1].t > (double)t * interval)
+			t = (uint64_t)(series[nseries - 1].t / interval);
+	}
+
+	if (!quiet)
+		run_report(cmd, status, interval, &ru);
+	ret = run_exit_code(status);
+	if (json_path && (run_json(json_path, cmd, status, interval, &ru) < 0))
+		ret = EXIT_FAILURE;
+
+free_cache:
+	fault_cache_free_list(fault_info_old);
+	uname_cache_cleanup();
+	proc_cache_cleanup();
+	fault_cache_cleanup();
+	free(series);
+	free(slots);
+	free(chain);
+	free(walk);
+
+	return ret;
+}
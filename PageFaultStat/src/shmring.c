@@ -0,0 +1,140 @@
+/*
+ * Shared memory snapshot ring writer for PageFaultStat
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+#include "shmring.h"
+#include <time.h>
+
+static shmring_header_t *ring;		/* writer mapping */
+static size_t ring_len;			/* mapping size */
+static bool skip_warned;		/* oversized frame reported */
+
+/*
+ *  shmring_open()
+ *	create (or attach to) the ring /dev/shm/<name>. A ring
+ *	left by an earlier writer with the same geometry is
+ *	re-used so frame numbers keep increasing for readers
+ *	that still have it mapped
+ */
+int shmring_open(const char *name)
+{
+	char path[256];
+	struct stat statbuf;
+	bool reuse;
+	int fd;
+
+	if (name[0] == '/')
+		name++;
+	(void)snprintf(path, sizeof(path), "/dev/shm/%s", name);
+	if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0)
+		goto err;
+
+	ring_len = shmring_size(SHMRING_SLOTS, SHMRING_SLOT_SIZE);
+	if ((fstat(fd, &statbuf) < 0) ||
+	    (((size_t)statbuf.st_size != ring_len) && (ftruncate(fd, (off_t)ring_len) < 0))) {
+		(void)close(fd);
+		goto err;
+	}
+	ring = mmap(NULL, ring_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	(void)close(fd);
+	if (ring == MAP_FAILED) {
+		ring = NULL;
+		goto err;
+	}
+
+	reuse = (ring->magic == SHMRING_MAGIC) &&
+		(ring->version == SHMRING_VERSION) &&
+		(ring->slot_count == SHMRING_SLOTS) &&
+		(ring->slot_size == SHMRING_SLOT_SIZE);
+	if (!reuse) {
+		/* Readers check the magic last, so set it up last */
+		__atomic_store_n(&ring->magic, 0, __ATOMIC_RELEASE);
+		(void)memset((uint8_t *)ring + sizeof(*ring), 0,
+			SHMRING_SLOTS * sizeof(shmring_slot_t));
+		ring->version = SHMRING_VERSION;
+		ring->slot_count = SHMRING_SLOTS;
+		ring->slot_size = SHMRING_SLOT_SIZE;
+		ring->head = 0;
+		ring->skipped = 0;
+		ring->generation = 0;
+	}
+	/* A slot left odd by a writer that died mid-copy is reset */
+	if (reuse) {
+		uint32_t i;
+
+		for (i = 1; i <= ring->slot_count; i++) {
+			shmring_slot_t *slot = shmring_slot(ring, i);
+
+			if (slot->seq & 1)
+				__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+		}
+	}
+	ring->writer_pid = getpid();
+	__atomic_add_fetch(&ring->generation, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+
+	return 0;
+
+err:
+	(void)fprintf(stderr, "Cannot create shared memory ring %s: errno=%d (%s)\n",
+		path, errno, strerror(errno));
+	return -1;
+}
+
+/*
+ *  shmring_publish()
+ *	publish a frame into the next slot. Wait free, the
+ *	writer never looks at what readers are doing
+ */
+void shmring_publish(const char *data, const size_t len)
+{
+	shmring_slot_t *slot;
+	struct timespec ts;
+	uint64_t frame, seq;
+
+	if (!ring)
+		return;
+
+	frame = ring->head + 1;
+	slot = shmring_slot(ring, frame);
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+
+	seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	__atomic_store_n(&slot->frame, frame, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->len, (uint64_t)len, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->timestamp,
+		((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec, __ATOMIC_RELAXED);
+	/* Oversized frames are published as skipped, len > slot_size */
+	if (len <= ring->slot_size)
+		(void)memcpy((uint8_t *)(slot + 1), data, len);
+	else
+		__atomic_add_fetch(&ring->skipped, 1, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->head, frame, __ATOMIC_RELEASE);
+
+	if ((len > ring->slot_size) && !skip_warned) {
+		(void)fprintf(stderr, "Frame of %zu bytes does not fit a %" PRIu64
+			" byte shared memory ring slot, skipping frames that are too big\n",
+			len, ring->slot_size);
+		skip_warned = true;
+	}
+}
+
+/*
+ *  shmring_close()
+ *	detach from the ring, it is left in place for readers
+ */
+void shmring_close(void)
+{
+	if (ring)
+		(void)munmap(ring, ring_len);
+	ring = NULL;
+}
@@ -0,0 +1,257 @@
+/*
+ * Shared memory snapshot ring for PageFaultStat
+ *
+ * The sampler (-S name) publishes every JSON frame into a ring of
+ * fixed size slots in /dev/shm/<name>. Each slot is guarded by a
+ * seqlock: the writer makes the slot sequence odd, copies the frame
+ * in and makes it even again, then advances the ring head. Readers
+ * never write to the mapping, they copy a slot out and retry if the
+ * sequence changed underneath them, so any number of readers can
+ * follow the ring without ever stalling the writer. A frame bigger
+ * than a slot is published with its length but no data, readers get
+ * SHMRING_ERR_SKIPPED for it and the header counts it in skipped.
+ *
+ * This header is also the reader library, it has no dependencies
+ * beyond libc:
+ *
+ *	shmring_reader_t r;
+ *	uint64_t frame;
+ *
+ *	if (shmring_reader_open(&r, "pagefaultstat") == 0) {
+ *		len = shmring_read_latest(&r, buf, sizeof(buf), &frame);
+ *		...
+ *		shmring_reader_close(&r);
+ *	}
+ */
+
+#ifndef __SHMRING_H__
+#define __SHMRING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHMRING_MAGIC		(0x31474e4952534650ULL)	/* "PFSRING1" */
+#define SHMRING_VERSION		(2)
+#define SHMRING_SLOTS		(8)
+#define SHMRING_SLOT_SIZE	(4 * 1024 * 1024)
+
+#define SHMRING_ERR_NONE	(-1)	/* no frame published yet */
+#define SHMRING_ERR_GONE	(-2)	/* frame has been overwritten */
+#define SHMRING_ERR_SIZE	(-3)	/* frame too big for buffer */
+#define SHMRING_ERR_BUSY	(-4)	/* could not get a stable copy */
+#define SHMRING_ERR_SKIPPED	(-5)	/* frame was too big for a slot */
+
+#define SHMRING_RETRIES		(64)
+
+/* Ring header, at the start of the mapping */
+typedef struct {
+	uint64_t	magic;		/* SHMRING_MAGIC */
+	uint32_t	version;	/* SHMRING_VERSION */
+	uint32_t	slot_count;	/* number of slots */
+	uint64_t	slot_size;	/* bytes of frame data per slot */
+	uint64_t	generation;	/* bumped each time a writer attaches */
+	uint64_t	head;		/* latest complete frame, 0 = none */
+	uint64_t	skipped;	/* frames too big for a slot */
+	int32_t		writer_pid;	/* pid of the writer */
+	uint8_t		pad[12];	/* keep slots cache line aligned */
+} shmring_header_t;
+
+/* Slot header, followed by slot_size bytes of frame data */
+typedef struct {
+	uint64_t	seq;		/* seqlock, odd while being written */
+	uint64_t	frame;		/* frame number held */
+	uint64_t	len;		/* frame length, > slot_size if skipped */
+	uint64_t	timestamp;	/* publish time, ns since the epoch */
+	uint8_t		pad[32];
+} shmring_slot_t;
+
+typedef struct {
+	void		*map;		/* whole ring mapping */
+	size_t		map_len;	/* mapping size */
+	shmring_header_t *hdr;		/* ring header */
+} shmring_reader_t;
+
+/*
+ *  shmring_size()
+ *	size of a ring mapping
+ */
+static inline size_t shmring_size(const uint32_t slot_count, const uint64_t slot_size)
+{
+	return sizeof(shmring_header_t) +
+	       ((size_t)slot_count * (sizeof(shmring_slot_t) + (size_t)slot_size));
+}
+
+/*
+ *  shmring_slot()
+ *	slot holding a given frame number
+ */
+static inline shmring_slot_t *shmring_slot(shmring_header_t * const hdr, const uint64_t frame)
+{
+	const size_t index = (size_t)((frame - 1) % hdr->slot_count);
+
+	return (shmring_slot_t *)((uint8_t *)hdr + sizeof(*hdr) +
+		(index * (sizeof(shmring_slot_t) + (size_t)hdr->slot_size)));
+}
+
+/*
+ *  shmring_reader_open()
+ *	map a ring read-only, returns 0 on success, -1 on failure
+ */
+static inline int shmring_reader_open(shmring_reader_t * const r, const char *name)
+{
+	char path[256];
+	struct stat statbuf;
+	int fd;
+
+	(void)memset(r, 0, sizeof(*r));
+	if (name[0] == '/')
+		name++;
+	(void)snprintf(path, sizeof(path), "/dev/shm/%s", name);
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return -1;
+	if ((fstat(fd, &statbuf) < 0) || ((size_t)statbuf.st_size < sizeof(shmring_header_t))) {
+		(void)close(fd);
+		return -1;
+	}
+	r->map_len = (size_t)statbuf.st_size;
+	r->map = mmap(NULL, r->map_len, PROT_READ, MAP_SHARED, fd, 0);
+	(void)close(fd);
+	if (r->map == MAP_FAILED) {
+		r->map = NULL;
+		return -1;
+	}
+	r->hdr = (shmring_header_t *)r->map;
+	if ((r->hdr->magic != SHMRING_MAGIC) ||
+	    (r->hdr->version != SHMRING_VERSION) ||
+	    (r->hdr->slot_count == 0) ||
+	    (shmring_size(r->hdr->slot_count, r->hdr->slot_size) > r->map_len)) {
+		(void)munmap(r->map, r->map_len);
+		r->map = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ *  shmring_reader_close()
+ *	unmap a ring
+ */
+static inline void shmring_reader_close(shmring_reader_t * const r)
+{
+	if (r->map)
+		(void)munmap(r->map, r->map_len);
+	(void)memset(r, 0, sizeof(*r));
+}
+
+/*
+ *  shmring_head()
+ *	latest complete frame number, 0 if none yet
+ */
+static inline uint64_t shmring_head(const shmring_reader_t * const r)
+{
+	return __atomic_load_n(&r->hdr->head, __ATOMIC_ACQUIRE);
+}
+
+/*
+ *  shmring_skipped()
+ *	number of frames published too big for a slot
+ */
+static inline uint64_t shmring_skipped(const shmring_reader_t * const r)
+{
+	return __atomic_load_n(&r->hdr->skipped, __ATOMIC_RELAXED);
+}
+
+/*
+ *  shmring_read_frame()
+ *	copy frame number 'frame' into buf, returns its length or
+ *	one of the SHMRING_ERR_* codes. The copy is only returned
+ *	if the slot sequence was even and unchanged around it
+ */
+static inline int64_t shmring_read_frame(
+	const shmring_reader_t * const r,
+	const uint64_t frame,
+	void * const buf,
+	const size_t buflen,
+	uint64_t * const timestamp)
+{
+	shmring_slot_t *slot;
+	int i;
+
+	if ((frame == 0) || (frame > shmring_head(r)))
+		return SHMRING_ERR_NONE;
+	slot = shmring_slot(r->hdr, frame);
+
+	for (i = 0; i < SHMRING_RETRIES; i++) {
+		const uint64_t seq1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		uint64_t seq2, slot_frame, len, ts;
+
+		if (seq1 & 1)
+			continue;	/* Writer is in this slot */
+
+		slot_frame = __atomic_load_n(&slot->frame, __ATOMIC_RELAXED);
+		len = __atomic_load_n(&slot->len, __ATOMIC_RELAXED);
+		ts = __atomic_load_n(&slot->timestamp, __ATOMIC_RELAXED);
+		if (slot_frame != frame)
+			return (slot_frame > frame) ? SHMRING_ERR_GONE : SHMRING_ERR_NONE;
+		if (len > r->hdr->slot_size) {
+			/* Skipped by the writer, if the slot held still */
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq1)
+				return SHMRING_ERR_SKIPPED;
+			continue;
+		}
+		if (len > buflen)
+			return SHMRING_ERR_SIZE;
+
+		(void)memcpy(buf, (const uint8_t *)(slot + 1), (size_t)len);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+		if (seq1 == seq2) {
+			if (timestamp)
+				*timestamp = ts;
+			return (int64_t)len;
+		}
+		/* Torn copy, if the slot was reused the frame is gone */
+	}
+	return (__atomic_load_n(&slot->frame, __ATOMIC_RELAXED) != frame) ?
+		SHMRING_ERR_GONE : SHMRING_ERR_BUSY;
+}
+
+/*
+ *  shmring_read_latest()
+ *	copy the most recent frame into buf, returns its length
+ *	or one of the SHMRING_ERR_* codes, frame is set to the
+ *	frame number read
+ */
+static inline int64_t shmring_read_latest(
+	const shmring_reader_t * const r,
+	void * const buf,
+	const size_t buflen,
+	uint64_t * const frame)
+{
+	int i;
+
+	*frame = 0;
+	for (i = 0; i < SHMRING_RETRIES; i++) {
+		const uint64_t head = shmring_head(r);
+		int64_t ret;
+
+		if (head == 0)
+			return SHMRING_ERR_NONE;
+		ret = shmring_read_frame(r, head, buf, buflen, NULL);
+		if (ret != SHMRING_ERR_GONE) {
+			*frame = head;
+			return ret;
+		}
+	}
+	return SHMRING_ERR_BUSY;
+}
+
+#endif /* __SHMRING_H__ */
@@ -0,0 +1,523 @@
+/*
+ * Process tree tracking for PageFaultStat (-P)
+ *
+ * Every process of a scan has a node in a pid hash, linked under its
+ * parent (stat field 4) with its children kept in pid order. Nodes
+ * are added, moved and dropped as processes appear, are re-parented
+ * and go away, so a tick only touches what changed. Each -P root's
+ * subtree is summed bottom up, own faults plus those of the children
+ * already reaped (cmajflt/cminflt), and the subtree delta is the
+ * change of that sum: an exiting child's faults move into its
+ * parent's counters rather than being counted twice. Processes
+ * outside the subtrees are dropped from the sample.
+ *
+ * The top mode tree view is drawn from the nodes, so collapsing or
+ * expanding a node only redraws, /proc is not read again.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+
+#define TREE_HASH_TABLE_SIZE	(1021)
+#define TREE_MAX_ROOTS		(64)
+
+static tree_node_t *tree_hash[TREE_HASH_TABLE_SIZE];
+static tree_node_t *tree_free;		/* unused nodes */
+static size_t tree_nnodes;		/* nodes in the hash */
+static pid_t tree_roots_pid[TREE_MAX_ROOTS];
+static size_t tree_nroots;
+static uint64_t tree_gen;		/* current tick */
+static tree_row_t *tree_rows_buf;	/* visible rows */
+static size_t tree_rows_alloc;
+static pid_t tree_selected;		/* pid of the selected row */
+
+/*
+ *  tree_hash_pid()
+ *	hash a process id
+ */
+static inline unsigned long tree_hash_pid(const pid_t pid)
+{
+	return (unsigned long)pid % TREE_HASH_TABLE_SIZE;
+}
+
+/*
+ *  tree_find()
+ *	node of a pid, NULL if not indexed
+ */
+static tree_node_t *tree_find(const pid_t pid)
+{
+	tree_node_t *node;
+
+	for (node = tree_hash[tree_hash_pid(pid)]; node; node = node->next) {
+		if (node->pid == pid)
+			return node;
+	}
+	return NULL;
+}
+
+/*
+ *  tree_set_roots()
+ *	parse the -P list of subtree root pids
+ */
+int tree_set_roots(char * const arg)
+{
+	char *str, *token;
+
+	for (str = arg; (token = strtok(str, ",")) != NULL; str = NULL) {
+		char *end;
+		long pid;
+
+		errno = 0;
+		pid = strtol(token, &end, 10);
+		if (errno || *end || (pid < 1) || (pid > INT_MAX))
+			return -1;
+		if (tree_nroots == TREE_MAX_ROOTS)
+			return -1;
+		tree_roots_pid[tree_nroots++] = (pid_t)pid;
+	}
+	if (!tree_nroots)
+		return -1;
+	opt_flags |= OPT_TREE;
+	tree_selected = tree_roots_pid[0];
+
+	return 0;
+}
+
+/*
+ *  tree_enabled()
+ *	true if -P is in use
+ */
+bool tree_enabled(void)
+{
+	return (opt_flags & OPT_TREE) != 0;
+}
+
+/*
+ *  tree_init()
+ *	spare nodes for the current processes
+ *	and some churn, so ticks rarely allocate
+ */
+int tree_init(const size_t npids)
+{
+	size_t i;
+
+	if (!tree_enabled())
+		return 0;
+	for (i = 0; i < npids * 2; i++) {
+		tree_node_t *node;
+
+		if ((node = heap_calloc(1, sizeof(*node))) == NULL) {
+			out_of_memory("allocating process tree nodes");
+			return -1;
+		}
+		node->next = tree_free;
+		tree_free = node;
+	}
+	return 0;
+}
+
+/*
+ *  tree_unlink()
+ *	take a node off its parent's list of children
+ */
+static void tree_unlink(tree_node_t * const node)
+{
+	tree_node_t **l;
+
+	if (!node->parent)
+		return;
+	for (l = &node->parent->child; *l; l = &(*l)->sibling) {
+		if (*l == node) {
+			*l = node->sibling;
+			break;
+		}
+	}
+	node->parent = NULL;
+	node->sibling = NULL;
+}
+
+/*
+ *  tree_link()
+ *	put a node on a parent's list of children, in pid order
+ */
+static void tree_link(tree_node_t * const node, tree_node_t * const parent)
+{
+	tree_node_t **l;
+
+	for (l = &parent->child; *l && ((*l)->pid < node->pid); l = &(*l)->sibling)
+		;
+	node->sibling = *l;
+	*l = node;
+	node->parent = parent;
+}
+
+/*
+ *  tree_remove()
+ *	drop a node, its children are linked again
+ *	under whoever adopted them when next seen
+ */
+static void tree_remove(tree_node_t * const node)
+{
+	tree_node_t **l, *child, *next;
+
+	for (l = &tree_hash[tree_hash_pid(node->pid)]; *l; l = &(*l)->next) {
+		if (*l == node) {
+			*l = node->next;
+			break;
+		}
+	}
+	tree_unlink(node);
+	for (child = node->child; child; child = next) {
+		next = child->sibling;
+		child->parent = NULL;
+		child->sibling = NULL;
+	}
+	node->child = NULL;
+	node->next = tree_free;
+	tree_free = node;
+	tree_nnodes--;
+}
+
+/*
+ *  tree_add()
+ *	index a new process
+ */
+static tree_node_t *tree_add(const fault_info_t * const fault_info)
+{
+	const unsigned long h = tree_hash_pid(fault_info->pid);
+	tree_node_t *node;
+
+	if (tree_free) {
+		node = tree_free;
+		tree_free = node->next;
+		(void)memset(node, 0, sizeof(*node));
+	} else if ((node = heap_calloc(1, sizeof(*node))) == NULL) {
+		out_of_memory("allocating process tree node");
+		return NULL;
+	}
+	node->pid = fault_info->pid;
+	node->start_time = fault_info->start_time;
+	/* Its faults so far are all new, as fault_delta() has it */
+	node->sub_gen = tree_gen - 1;
+	node->next = tree_hash[h];
+	tree_hash[h] = node;
+	tree_nnodes++;
+
+	return node;
+}
+
+/*
+ *  tree_sum()
+ *	sum a subtree bottom up and mark it as wanted
+ */
+static void tree_sum(tree_node_t * const node)
+{
+	tree_node_t *child;
+	int64_t sub_maj_fault, sub_min_fault;
+
+	/* Nested roots, or a loop from a pid reused mid-scan */
+	if (node->member_gen == tree_gen)
+		return;
+	node->member_gen = tree_gen;
+
+	sub_maj_fault = node->maj_fault + node->cmaj_fault;
+	sub_min_fault = node->min_fault + node->cmin_fault;
+	node->nsub = 1;
+	for (child = node->child; child; child = child->sibling) {
+		tree_sum(child);
+		sub_maj_fault += child->sub_maj_fault;
+		sub_min_fault += child->sub_min_fault;
+		node->nsub += child->nsub;
+	}
+
+	/*
+	 *  A child leaving for a parent outside the subtree takes
+	 *  its faults with it, they were counted while it was in
+	 */
+	if (node->sub_gen == tree_gen - 1) {
+		node->d_sub_maj_fault = sub_maj_fault - node->sub_maj_fault;
+		node->d_sub_min_fault = sub_min_fault - node->sub_min_fault;
+		if (node->d_sub_maj_fault < 0)
+			node->d_sub_maj_fault = 0;
+		if (node->d_sub_min_fault < 0)
+			node->d_sub_min_fault = 0;
+	} else {
+		node->d_sub_maj_fault = 0;
+		node->d_sub_min_fault = 0;
+	}
+	node->sub_maj_fault = sub_maj_fault;
+	node->sub_min_fault = sub_min_fault;
+	node->sub_gen = tree_gen;
+}
+
+/*
+ *  tree_update()
+ *	bring the index up to date with a scan, sum the -P
+ *	subtrees and drop the processes outside them
+ */
+int tree_update(fault_info_t ** const fault_info_list, size_t * const npids)
+{
+	fault_info_t *fault_info, **l;
+	size_t i;
+
+	if (!tree_enabled())
+		return 0;
+	tree_gen++;
+
+	for (fault_info = *fault_info_list; fault_info; fault_info = fault_info->next) {
+		tree_node_t *node = tree_find(fault_info->pid);
+
+		if (node && (node->start_time != fault_info->start_time)) {
+			tree_remove(node);
+			node = NULL;
+		}
+		if (!node && ((node = tree_add(fault_info)) == NULL))
+			return -1;
+		node->d_maj_fault = fault_info->maj_fault - node->maj_fault;
+		node->d_min_fault = fault_info->min_fault - node->min_fault;
+		node->ppid = fault_info->ppid;
+		node->maj_fault = fault_info->maj_fault;
+		node->min_fault = fault_info->min_fault;
+		node->cmaj_fault = fault_info->cmaj_fault;
+		node->cmin_fault = fault_info->cmin_fault;
+		node->vm_swap = fault_info->vm_swap;
+		node->proc = fault_info->proc;
+		node->uname = fault_info->uname;
+		node->gen = tree_gen;
+	}
+
+	/* Gone, as proc_cache_sweep() does it */
+	for (i = 0; i < TREE_HASH_TABLE_SIZE; i++) {
+		tree_node_t *node = tree_hash[i];
+
+		while (node) {
+			tree_node_t *next = node->next;
+
+			if (node->gen != tree_gen)
+				tree_remove(node);
+			node = next;
+		}
+	}
+
+	/* Only new and re-parented processes move */
+	for (fault_info = *fault_info_list; fault_info; fault_info = fault_info->next) {
+		tree_node_t * const node = tree_find(fault_info->pid);
+		tree_node_t *parent = (node->ppid > 0) ? tree_find(node->ppid) : NULL;
+
+		if (parent == node)
+			parent = NULL;
+		if (node->parent == parent)
+			continue;
+		tree_unlink(node);
+		if (parent)
+			tree_link(node, parent);
+	}
+
+	for (i = 0; i < tree_nroots; i++) {
+		tree_node_t * const node = tree_find(tree_roots_pid[i]);
+
+		if (node)
+			tree_sum(node);
+	}
+
+	for (l = fault_info_list; *l; ) {
+		fault_info = *l;
+		if (tree_find(fault_info->pid)->member_gen == tree_gen) {
+			l = &fault_info->next;
+			continue;
+		}
+		*l = fault_info->next;
+		fault_cache_free(fault_info);
+		(*npids)--;
+	}
+	return 0;
+}
+
+/*
+ *  tree_status_wanted()
+ *	false if the last tick's index says a process is
+ *	outside the subtrees, its status need not be read
+ */
+bool tree_status_wanted(const pid_t pid, const pid_t ppid)
+{
+	const tree_node_t *node;
+	size_t i;
+
+	if (!tree_enabled())
+		return true;
+	for (i = 0; i < tree_nroots; i++) {
+		if (tree_roots_pid[i] == pid)
+			return true;
+	}
+	if ((node = tree_find(pid)) && (node->member_gen == tree_gen))
+		return true;
+	if ((node = tree_find(ppid)) == NULL)
+		return true;	/* Not seen yet, can't tell */
+	return node->member_gen == tree_gen;
+}
+
+/*
+ *  tree_rows_add()
+ *	add a node and its children, unless collapsed, to the rows
+ */
+static int tree_rows_add(const tree_node_t * const node, const int depth, size_t * const n)
+{
+	const tree_node_t *child;
+
+	if (*n == tree_rows_alloc) {
+		const size_t alloc = tree_rows_alloc ? tree_rows_alloc * 2 : 256;
+		tree_row_t *tmp = heap_realloc(tree_rows_buf, alloc * sizeof(*tmp));
+
+		if (!tmp) {
+			out_of_memory("allocating process tree rows");
+			return -1;
+		}
+		tree_rows_buf = tmp;
+		tree_rows_alloc = alloc;
+	}
+	tree_rows_buf[*n].node = node;
+	tree_rows_buf[*n].depth = depth;
+	(*n)++;
+
+	if (node->collapsed)
+		return 0;
+	for (child = node->child; child; child = child->sibling) {
+		/* Nested roots draw nodes twice, a loop from a reused pid forever */
+		if ((child->member_gen != tree_gen) || (*n >= tree_nnodes * tree_nroots))
+			continue;
+		if (tree_rows_add(child, depth + 1, n) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ *  tree_rows()
+ *	visible rows of the -P subtrees in pre-order, and
+ *	the index of the selected one
+ */
+size_t tree_rows(const tree_row_t ** const out, size_t * const selected)
+{
+	size_t i, n = 0;
+
+	*out = tree_rows_buf;
+	*selected = 0;
+	for (i = 0; i < tree_nroots; i++) {
+		const tree_node_t * const node = tree_find(tree_roots_pid[i]);
+
+		if (node && (node->member_gen == tree_gen) &&
+		    (tree_rows_add(node, 0, &n) < 0))
+			break;
+	}
+	*out = tree_rows_buf;
+
+	/* The selected process went away or was hidden, take the first */
+	for (i = 0; i < n; i++) {
+		if (tree_rows_buf[i].node->pid == tree_selected) {
+			*selected = i;
+			return n;
+		}
+	}
+	if (n)
+		tree_selected = tree_rows_buf[0].node->pid;
+	return n;
+}
+
+/*
+ *  tree_key()
+ *	tree view keys, true if the key was one
+ */
+bool tree_key(const int ch)
+{
+	const tree_row_t *visible;
+	size_t n, sel, i;
+
+	if (!tree_enabled())
+		return false;
+
+	switch (ch) {
+	case 'j':
+	case 'k':
+	case ' ':
+		n = tree_rows(&visible, &sel);
+		if (!n)
+			return true;
+		if ((ch == 'j') && (sel + 1 < n))
+			sel++;
+		else if ((ch == 'k') && (sel > 0))
+			sel--;
+		else if ((ch == ' ') && visible[sel].node->child)
+			tree_find(visible[sel].node->pid)->collapsed ^= true;
+		tree_selected = visible[sel].node->pid;
+		return true;
+	case 'c':
+	case 'e':
+		for (i = 0; i < TREE_HASH_TABLE_SIZE; i++) {
+			tree_node_t *node;
+
+			for (node = tree_hash[i]; node; node = node->next)
+				node->collapsed = (ch == 'c') && node->child;
+		}
+		return true;
+	default:
+		break;
+	}
+	return false;
+}
+
+/*
+ *  tree_json()
+ *	append the -P subtree sums as a JSON array member
+ */
+int tree_json(strbuf_t * const sb)
+{
+	size_t i;
+	bool first = true;
+	int ret = 0;
+
+	ret |= strbuf_printf(sb, "\"subtrees\":[");
+	for (i = 0; i < tree_nroots; i++) {
+		const tree_node_t * const node = tree_find(tree_roots_pid[i]);
+
+		if (!node || (node->member_gen != tree_gen))
+			continue;
+		ret |= strbuf_printf(sb, "%s{\"pid\":%d,\"processes\":%" PRIu32
+			",\"major\":%" PRId64 ",\"minor\":%" PRId64
+			",\"deltaMajor\":%" PRId64 ",\"deltaMinor\":%" PRId64 "}",
+			first ? "" : ",", node->pid, node->nsub,
+			node->sub_maj_fault, node->sub_min_fault,
+			node->d_sub_maj_fault, node->d_sub_min_fault);
+		first = false;
+	}
+	ret |= strbuf_printf(sb, "],");
+	return ret ? -1 : 0;
+}
+
+/*
+ *  tree_cleanup()
+ *	free the index
+ */
+void tree_cleanup(void)
+{
+	size_t i;
+
+	for (i = 0; i < TREE_HASH_TABLE_SIZE; i++) {
+		while (tree_hash[i]) {
+			tree_node_t * const next = tree_hash[i]->next;
+
+			free(tree_hash[i]);
+			tree_hash[i] = next;
+		}
+	}
+	while (tree_free) {
+		tree_node_t * const next = tree_free->next;
+
+		free(tree_free);
+		tree_free = next;
+	}
+	free(tree_rows_buf);
+	tree_rows_buf = NULL;
+	tree_rows_alloc = 0;
+}
@@ -17,6 +17,29 @@ void out_of_memory(const char *msg)
 	(void)fprintf(stderr, "Out of memory: %s.\n", msg);
 }
 
+/*
+ *  read_file()
+ *	read up to buflen - 1 bytes of a file into buf and
+ *	nul terminate it, returns bytes read or -1 on error.
+ *	Unlike stdio this never touches the heap
+ */
+ssize_t read_file(const char *path, char *buf, const size_t buflen)
+{
+	int fd;
+	ssize_t ret;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return -1;
+	ret = read(fd, buf, buflen - 1);
+	(void)close(fd);
+	if (ret < 0)
+		return -1;
+	buf[ret] = '\0';
+	PROFILE_IO(3, (size_t)ret);
+
+	return ret;
+}
+
 /*
  *  uname_name()
  *	fetch name from uname, handle
@@ -111,7 +134,7 @@ char *get_pid_comm(const pid_t pid)
 	int fd;
 	ssize_t ret;
 
-	(void)snprintf(buffer, sizeof(buffer), "/proc/%i/comm", pid);
+	(void)snprintf(buffer, sizeof(buffer), "%s/%i/comm", proc_root, pid);
 
 	if ((fd = open(buffer, O_RDONLY)) < 0)
 		return NULL;
@@ -121,9 +144,10 @@ char *get_pid_comm(const pid_t pid)
 		return NULL;
 	}
 	(void)close(fd);
+	PROFILE_IO(3, (size_t)ret);
 	buffer[ret - 1] = '\0';
 
-	return strdup(buffer);
+	return str_cache_dup(buffer);
 }
 
 /*
@@ -137,7 +161,7 @@ char *get_pid_cmdline(const pid_t pid)
 	int fd;
 	ssize_t ret;
 
-	(void)snprintf(buffer, sizeof(buffer), "/proc/%i/cmdline", pid);
+	(void)snprintf(buffer, sizeof(buffer), "%s/%i/cmdline", proc_root, pid);
 
 	if ((fd = open(buffer, O_RDONLY)) < 0)
 		return NULL;
@@ -147,6 +171,7 @@ char *get_pid_cmdline(const pid_t pid)
 		return NULL;
 	}
 	(void)close(fd);
+	PROFILE_IO(3, (size_t)ret);
 
 	if (ret >= (ssize_t)sizeof(buffer))
 		ret = sizeof(buffer) - 1;
@@ -181,10 +206,10 @@ char *get_pid_cmdline(const pid_t pid)
 			if (*ptr == '/')
 				base = ptr + 1;
 		}
-		return strdup(base);
+		return str_cache_dup(base);
 	}
 
-	return strdup(buffer);
+	return str_cache_dup(buffer);
 }
 
 /*
@@ -196,7 +221,8 @@ bool pid_exists(const pid_t pid)
 	char path[PATH_MAX];
 	struct stat statbuf;
 
-	(void)snprintf(path, sizeof(path), "/proc/%i", pid);
+	(void)snprintf(path, sizeof(path), "%s/%i", proc_root, pid);
+	PROFILE_IO(1, 0);
 	return stat(path, &statbuf) == 0;
 }
 
@@ -250,12 +276,14 @@ int pid_max_digits(void)
 	const int default_digits = 6;
 	const int min_digits = 6;
 	char buf[32];
+	char path[PATH_MAX];
 
 	if (max_digits)
 		goto ret;
 
 	max_digits = default_digits;
-	fd = open("/proc/sys/kernel/pid_max", O_RDONLY);
+	(void)snprintf(path, sizeof(path), "%s/sys/kernel/pid_max", proc_root);
+	fd = open(path, O_RDONLY);
 	if (fd < 0)
 		goto ret;
 	n = read(fd, buf, sizeof(buf) - 1);
@@ -362,15 +390,37 @@ void show_usage(void)
 {
 	(void)printf("%s, version %s\n\n"
 		"Usage: %s [options] [duration] [count]\n"
+		"       %s query [options] file (see %s query -h)\n"
+		"       %s run [options] [interval] -- command (see %s run -h)\n"
 		"Options are:\n"
 		"  -a\t\tshow page fault change with up/down arrows\n"
+		"  -A cpu\tpin the sampler to the given CPU\n"
+		"  -b percent\tlimit sampler CPU usage to percent of one CPU\n"
 		"  -c\t\tget command name from processes comm field\n"
 		"  -d\t\tstrip directory basename off command information\n"
+		"  -e file\tappend thrash onset and end events to file (NDJSON)\n"
+		"  -F pid\tsample the fault addresses of a process, faults by mapping\n"
 		"  -h\t\tshow this help information\n"
+		"  -H faults\tshow the threads of processes with more major or minor faults per sample\n"
+		"  -J\t\tdaemon mode, stream one JSON frame per sample (NDJSON)\n"
+		"  -k pids\tkeep 5 min and 1 hour history for up to pids processes (default 256, 0 = off)\n"
 		"  -l\t\tshow long (full) command information\n"
+		"  -M\t\thardened mode, preallocate and lock all sampler memory\n"
+		"  -o file\twrite -J frames to file or FIFO instead of stdout\n"
 		"  -p proclist\tspecify comma separated list of processes to monitor\n"
+		"  -P pidlist\tmonitor the process trees under these pids, with subtree totals\n"
+		"  -r file\treplay a recording made with -w\n"
+		"  -R policy\trun with realtime scheduling, fifo[:prio] or rr[:prio]\n"
 		"  -s\t\tshow short command information\n"
+		"  -S name\tpublish JSON frames to a shared memory ring /dev/shm/name\n"
 		"  -t\t\ttop mode, show only changes in page faults\n"
-		"  -T\t\ttop mode, show top page faulters\n",
-		app_name, VERSION, app_name);
+		"  -T\t\ttop mode, show top page faulters\n"
+		"  -w file\trecord samples to a compact binary file\n"
+		"  -W port\tserve JSON and SSE frames over HTTP on localhost:port\n"
+		"  -x speed\treplay -r at speed times the recorded pace, 0 = no waiting\n"
+		"  --proc-root dir\tread processes from dir instead of /proc\n"
+		"  --bench samples\ttake samples back to back and report their cost\n"
+		"  --profile\ttime each phase of a sample, report at exit\n"
+		"  --fault-rate n\t-F samples per second, all threads (default 1000)\n",
+		app_name, VERSION, app_name, app_name, app_name, app_name, app_name);
 }
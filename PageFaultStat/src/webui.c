@@ -0,0 +1,671 @@
+/*
+ * Embedded HTTP/SSE server for PageFaultStat
+ *
+ * A single server thread runs an epoll loop serving:
+ *   GET /api/snapshot	latest JSON frame
+ *   GET /api/stream	Server-Sent Events, one event per frame
+ *   GET /api/health	liveness check
+ *
+ * The sampler hands frames over with webui_publish() which only
+ * does an atomic pointer exchange and an eventfd write, so it never
+ * waits on the server or on slow clients. Each frame is formatted
+ * once as an SSE event and the same reference counted buffer is
+ * queued to every subscriber. Buffers come from a pool sized on the
+ * first frame, before warm-up, so publishing does not allocate.
+ * A client still sending a frame WEBUI_QUEUE_MAX frames old, or
+ * blocked for WEBUI_SEND_TIMEOUT seconds, is closed, so stalled
+ * clients cannot pin the pool and starve everyone else.
+ */
+
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+
+#include "faultstat.h"
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define WEBUI_MAX_EVENTS	(64)
+#define WEBUI_REQ_MAX		(4096)	/* max request header size */
+#define WEBUI_QUEUE_MAX		(8)	/* frames queued per client */
+#define WEBUI_BACKLOG		(128)
+#define WEBUI_FRAMES		(WEBUI_QUEUE_MAX + 4)	/* frames in the pool */
+#define WEBUI_MAX_CLIENTS	(2048)	/* connections at once */
+#define WEBUI_SEND_TIMEOUT	(10.0)	/* seconds a client may block */
+#define WEBUI_SWEEP_MS		(1000)	/* blocked client check interval */
+
+#define SSE_PREFIX		"data: "
+
+/* A published frame, formatted as an SSE event */
+typedef struct webui_frame {
+	int		refcnt;		/* references held, 0 if free */
+	uint64_t	seq;		/* fan-out sequence number */
+	size_t		len;		/* length of data */
+	size_t		size;		/* room for data */
+	char		data[];		/* "data: {json}\n\n" */
+} webui_frame_t;
+
+typedef enum {
+	CLIENT_READING,			/* reading request header */
+	CLIENT_RESPONDING,		/* writing a one-off response */
+	CLIENT_STREAMING,		/* SSE subscriber */
+} client_state_t;
+
+typedef struct webui_client {
+	struct webui_client *next;	/* next in client list */
+	int		fd;		/* socket */
+	client_state_t	state;		/* connection state */
+	bool		want_out;	/* EPOLLOUT is armed */
+	bool		blocked;	/* output is waiting on the socket */
+	double		blocked_at;	/* when it started waiting */
+	char		req[WEBUI_REQ_MAX];
+	size_t		req_len;	/* bytes of request read */
+	char		hdr[256];	/* response header */
+	size_t		hdr_len;	/* header length */
+	size_t		hdr_off;	/* header bytes sent */
+	webui_frame_t	*queue[WEBUI_QUEUE_MAX];
+	size_t		q_head;		/* index of frame being sent */
+	size_t		q_count;	/* frames queued */
+	size_t		q_off;		/* bytes of head frame sent */
+	size_t		body_off;	/* offset of body in frames */
+	size_t		body_trim;	/* bytes trimmed off end of frames */
+} webui_client_t;
+
+static pthread_t webui_thread;
+static bool webui_running;
+static int listen_fd = -1;
+static int event_fd = -1;
+static int epoll_fd = -1;
+static webui_frame_t *pending;		/* handed over, not yet taken */
+static webui_frame_t *latest;		/* latest frame, server thread only */
+static uint64_t latest_seq;		/* frames fanned out */
+static webui_client_t *clients;
+static webui_frame_t *frame_pool[WEBUI_FRAMES];
+static webui_client_t *client_pool;	/* all clients, allocated up front */
+static webui_client_t *client_free;	/* unused clients */
+
+/*
+ *  webui_frame_get()
+ *	take a reference to a frame
+ */
+static inline webui_frame_t *webui_frame_get(webui_frame_t * const frame)
+{
+	__atomic_add_fetch(&frame->refcnt, 1, __ATOMIC_RELAXED);
+	return frame;
+}
+
+/*
+ *  webui_frame_put()
+ *	drop a reference to a frame, it goes
+ *	back to the pool on the last one
+ */
+static inline void webui_frame_put(webui_frame_t * const frame)
+{
+	if (frame)
+		(void)__atomic_sub_fetch(&frame->refcnt, 1, __ATOMIC_ACQ_REL);
+}
+
+/*
+ *  webui_frame_take()
+ *	a free frame from the pool with room for len bytes, NULL
+ *	if slow clients hold them all. Only the sampling thread
+ *	takes frames, so a free frame stays free until taken
+ */
+static webui_frame_t *webui_frame_take(const size_t len)
+{
+	size_t i;
+
+	/* Twice the first frame, there is room for the process count to grow */
+	if (!frame_pool[0]) {
+		for (i = 0; i < WEBUI_FRAMES; i++) {
+			if ((frame_pool[i] = heap_calloc(1, sizeof(*frame_pool[i]) + len * 2)) == NULL)
+				return NULL;
+			frame_pool[i]->size = len * 2;
+		}
+	}
+
+	for (i = 0; i < WEBUI_FRAMES; i++) {
+		webui_frame_t *frame = frame_pool[i];
+
+		if (__atomic_load_n(&frame->refcnt, __ATOMIC_ACQUIRE))
+			continue;
+		if (frame->size < len) {
+			frame = heap_realloc(frame, sizeof(*frame) + len * 2);
+			if (!frame)
+				return NULL;
+			frame->size = len * 2;
+			frame_pool[i] = frame;
+		}
+		frame->refcnt = 1;
+		return frame;
+	}
+	return NULL;
+}
+
+/*
+ *  webui_publish()
+ *	hand a JSON frame over to the server. Called from the
+ *	sampling loop, never blocks: a frame the server has not
+ *	picked up yet is simply replaced by the newer one
+ */
+void webui_publish(const strbuf_t * const sb)
+{
+	webui_frame_t *frame, *old;
+	const uint64_t one = 1;
+	size_t len = sb->len;
+
+	if (!webui_running)
+		return;
+
+	/* JSON frames end in a newline, SSE events in a blank line */
+	while (len && (sb->buf[len - 1] == '\n'))
+		len--;
+	frame = webui_frame_take(sizeof(SSE_PREFIX) + len + 2);
+	if (!frame)
+		return;	/* Dropped, as a frame replaced before the server took it */
+	frame->refcnt = 1;
+	(void)memcpy(frame->data, SSE_PREFIX, sizeof(SSE_PREFIX) - 1);
+	(void)memcpy(frame->data + sizeof(SSE_PREFIX) - 1, sb->buf, len);
+	frame->len = sizeof(SSE_PREFIX) - 1 + len;
+	frame->data[frame->len++] = '\n';
+	frame->data[frame->len++] = '\n';
+
+	old = __atomic_exchange_n(&pending, frame, __ATOMIC_ACQ_REL);
+	webui_frame_put(old);
+	(void)write(event_fd, &one, sizeof(one));
+}
+
+/*
+ *  webui_client_arm()
+ *	(dis)arm EPOLLOUT for a client
+ */
+static void webui_client_arm(webui_client_t * const c, const bool want_out)
+{
+	struct epoll_event ev;
+
+	if (c->want_out == want_out)
+		return;
+	(void)memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLRDHUP | (want_out ? EPOLLOUT : 0);
+	ev.data.ptr = c;
+	(void)epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+	c->want_out = want_out;
+}
+
+/*
+ *  webui_client_close()
+ *	drop a client and its queued frames
+ */
+static void webui_client_close(webui_client_t * const c)
+{
+	webui_client_t **l;
+
+	for (l = &clients; *l; l = &(*l)->next) {
+		if (*l == c) {
+			*l = c->next;
+			break;
+		}
+	}
+	while (c->q_count) {
+		webui_frame_put(c->queue[c->q_head]);
+		c->q_head = (c->q_head + 1) % WEBUI_QUEUE_MAX;
+		c->q_count--;
+	}
+	(void)epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+	(void)close(c->fd);
+	c->next = client_free;
+	client_free = c;
+}
+
+/*
+ *  webui_client_enqueue()
+ *	queue a frame to a client, webui_fanout() closes
+ *	clients before their queue can overflow
+ */
+static void webui_client_enqueue(webui_client_t * const c, webui_frame_t * const frame)
+{
+	if (c->q_count >= WEBUI_QUEUE_MAX)
+		return;
+	c->queue[(c->q_head + c->q_count) % WEBUI_QUEUE_MAX] = webui_frame_get(frame);
+	c->q_count++;
+}
+
+/*
+ *  webui_client_flush()
+ *	write as much queued output as the socket takes,
+ *	returns -1 if the client should be closed
+ */
+static int webui_client_flush(webui_client_t * const c)
+{
+	while (c->hdr_off < c->hdr_len) {
+		const ssize_t ret = send(c->fd, c->hdr + c->hdr_off,
+			c->hdr_len - c->hdr_off, MSG_NOSIGNAL);
+
+		if (ret < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				goto blocked;
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		c->hdr_off += (size_t)ret;
+		c->blocked = false;
+	}
+
+	while (c->q_count) {
+		webui_frame_t *frame = c->queue[c->q_head];
+		const size_t start = c->body_off;
+		const size_t end = frame->len - c->body_trim;
+		const ssize_t ret = send(c->fd, frame->data + start + c->q_off,
+			end - start - c->q_off, MSG_NOSIGNAL);
+
+		if (ret < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				goto blocked;
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		c->q_off += (size_t)ret;
+		c->blocked = false;
+		if (c->q_off == end - start) {
+			webui_frame_put(frame);
+			c->q_head = (c->q_head + 1) % WEBUI_QUEUE_MAX;
+			c->q_count--;
+			c->q_off = 0;
+		}
+	}
+	webui_client_arm(c, false);
+
+	/* One-off responses are done once everything is out */
+	return (c->state == CLIENT_RESPONDING) ? -1 : 0;
+
+blocked:
+	if (!c->blocked) {
+		c->blocked = true;
+		c->blocked_at = gettime_to_double();
+	}
+	webui_client_arm(c, true);
+	return 0;
+}
+
+/*
+ *  webui_respond()
+ *	set up the response header and body for a one-off request
+ */
+static void webui_respond(
+	webui_client_t * const c,
+	const char *status,
+	const char *type,
+	const size_t len)
+{
+	int n;
+
+	n = snprintf(c->hdr, sizeof(c->hdr),
+		"HTTP/1.1 %s\r\n"
+		"Content-Type: %s\r\n"
+		"Content-Length: %zu\r\n"
+		"Access-Control-Allow-Origin: *\r\n"
+		"Cache-Control: no-cache\r\n"
+		"Connection: close\r\n\r\n",
+		status, type, len);
+	c->hdr_len = (n > 0) ? (size_t)n : 0;
+	c->state = CLIENT_RESPONDING;
+}
+
+/*
+ *  webui_client_request()
+ *	route a complete request, returns -1 to close the client
+ */
+static int webui_client_request(webui_client_t * const c)
+{
+	char method[8], path[256];
+	char *query;
+
+	if (sscanf(c->req, "%7s %255s", method, path) != 2) {
+		webui_respond(c, "400 Bad Request", "text/plain", 0);
+		return webui_client_flush(c);
+	}
+	if ((query = strchr(path, '?')) != NULL)
+		*query = '\0';
+
+	if (strcmp(method, "GET")) {
+		webui_respond(c, "405 Method Not Allowed", "text/plain", 0);
+	} else if (!strcmp(path, "/api/stream")) {
+		int n = snprintf(c->hdr, sizeof(c->hdr),
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/event-stream\r\n"
+			"Cache-Control: no-cache\r\n"
+			"Access-Control-Allow-Origin: *\r\n"
+			"Connection: keep-alive\r\n\r\n");
+
+		c->hdr_len = (n > 0) ? (size_t)n : 0;
+		c->state = CLIENT_STREAMING;
+		/* Start the subscriber off with the current frame */
+		if (latest)
+			webui_client_enqueue(c, latest);
+	} else if (!strcmp(path, "/api/snapshot")) {
+		if (!latest) {
+			webui_respond(c, "503 Service Unavailable", "text/plain", 0);
+		} else {
+			/* Send the JSON inside the SSE event, minus framing */
+			c->body_off = sizeof(SSE_PREFIX) - 1;
+			c->body_trim = 1;
+			webui_respond(c, "200 OK", "application/json",
+				latest->len - c->body_off - c->body_trim);
+			webui_client_enqueue(c, latest);
+		}
+	} else if (!strcmp(path, "/api/health")) {
+		static const char ok[] = "{\"status\":\"ok\"}";
+		int n;
+
+		n = snprintf(c->hdr, sizeof(c->hdr),
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: application/json\r\n"
+			"Content-Length: %zu\r\n"
+			"Access-Control-Allow-Origin: *\r\n"
+			"Connection: close\r\n\r\n%s",
+			sizeof(ok) - 1, ok);
+		c->hdr_len = (n > 0) ? (size_t)n : 0;
+		c->state = CLIENT_RESPONDING;
+	} else {
+		webui_respond(c, "404 Not Found", "text/plain", 0);
+	}
+
+	return webui_client_flush(c);
+}
+
+/*
+ *  webui_client_read()
+ *	read request data, returns -1 to close the client
+ */
+static int webui_client_read(webui_client_t * const c)
+{
+	for (;;) {
+		char discard[512];
+		ssize_t ret;
+
+		/* Subscribers have nothing more to say, just watch for EOF */
+		if (c->state != CLIENT_READING) {
+			ret = recv(c->fd, discard, sizeof(discard), 0);
+			if (ret == 0)
+				return -1;
+			if (ret < 0)
+				return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+			continue;
+		}
+
+		ret = recv(c->fd, c->req + c->req_len, sizeof(c->req) - 1 - c->req_len, 0);
+		if (ret == 0)
+			return -1;
+		if (ret < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				return 0;
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		c->req_len += (size_t)ret;
+		c->req[c->req_len] = '\0';
+		if (strstr(c->req, "\r\n\r\n") || strstr(c->req, "\n\n"))
+			return webui_client_request(c);
+		if (c->req_len >= sizeof(c->req) - 1)
+			return -1;	/* Header too big */
+	}
+}
+
+/*
+ *  webui_accept()
+ *	accept all pending connections
+ */
+static void webui_accept(void)
+{
+	for (;;) {
+		struct epoll_event ev;
+		webui_client_t *c;
+		const int one = 1;
+		const int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+		if (fd < 0)
+			return;
+		if ((c = client_free) == NULL) {
+			(void)close(fd);	/* Too many, the client can retry */
+			continue;
+		}
+		client_free = c->next;
+		(void)memset(c, 0, sizeof(*c));
+		(void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		c->fd = fd;
+		c->state = CLIENT_READING;
+
+		(void)memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = c;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			(void)close(fd);
+			c->next = client_free;
+			client_free = c;
+			continue;
+		}
+		c->next = clients;
+		clients = c;
+	}
+}
+
+/*
+ *  webui_fanout()
+ *	take the pending frame and queue it to every subscriber,
+ *	closing clients that are still sending a frame that is
+ *	WEBUI_QUEUE_MAX frames old. Frames are then only held for
+ *	the last WEBUI_QUEUE_MAX fan-outs, which the pool covers
+ */
+static void webui_fanout(void)
+{
+	webui_client_t *c, *next;
+	webui_frame_t *frame;
+	uint64_t val;
+
+	(void)read(event_fd, &val, sizeof(val));
+	frame = __atomic_exchange_n(&pending, NULL, __ATOMIC_ACQ_REL);
+	if (!frame)
+		return;
+
+	webui_frame_put(latest);
+	latest = frame;
+	frame->seq = ++latest_seq;
+
+	for (c = clients; c; c = next) {
+		next = c->next;
+		if (c->q_count &&
+		    (frame->seq - c->queue[c->q_head]->seq >= WEBUI_QUEUE_MAX)) {
+			webui_client_close(c);
+			continue;
+		}
+		if (c->state != CLIENT_STREAMING)
+			continue;
+		webui_client_enqueue(c, frame);
+		if (webui_client_flush(c) < 0)
+			webui_client_close(c);
+	}
+}
+
+/*
+ *  webui_sweep()
+ *	close clients whose output has been blocked too long
+ */
+static void webui_sweep(void)
+{
+	const double now = gettime_to_double();
+	webui_client_t *c, *next;
+
+	for (c = clients; c; c = next) {
+		next = c->next;
+		if (c->blocked && (now - c->blocked_at > WEBUI_SEND_TIMEOUT))
+			webui_client_close(c);
+	}
+}
+
+/*
+ *  webui_main()
+ *	server thread main loop
+ */
+static void *webui_main(void *arg)
+{
+	struct epoll_event events[WEBUI_MAX_EVENTS];
+	double last_sweep = gettime_to_double();
+	sigset_t mask;
+
+	(void)arg;
+
+	/* Signals are for the sampling thread to handle */
+	(void)sigfillset(&mask);
+	(void)pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+	while (__atomic_load_n(&webui_running, __ATOMIC_ACQUIRE)) {
+		bool fanout = false;
+		int i, n;
+
+		n = epoll_wait(epoll_fd, events, WEBUI_MAX_EVENTS, WEBUI_SWEEP_MS);
+		for (i = 0; i < n; i++) {
+			void *ptr = events[i].data.ptr;
+			webui_client_t *c;
+
+			if (ptr == &listen_fd) {
+				webui_accept();
+				continue;
+			}
+			if (ptr == &event_fd) {
+				fanout = true;
+				continue;
+			}
+			c = (webui_client_t *)ptr;
+			if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+				webui_client_close(c);
+				continue;
+			}
+			if ((events[i].events & (EPOLLIN | EPOLLRDHUP)) &&
+			    (webui_client_read(c) < 0)) {
+				webui_client_close(c);
+				continue;
+			}
+			if ((events[i].events & EPOLLOUT) &&
+			    (webui_client_flush(c) < 0))
+				webui_client_close(c);
+		}
+		/*
+		 *  After the batch, the fanout may close any client
+		 *  and the batch may still have events for it
+		 */
+		if (fanout)
+			webui_fanout();
+		if (gettime_to_double() - last_sweep > WEBUI_SWEEP_MS / 1000.0) {
+			webui_sweep();
+			last_sweep = gettime_to_double();
+		}
+	}
+	return NULL;
+}
+
+/*
+ *  webui_run()
+ *	start the HTTP server on the loopback interface on
+ *	the given port, returns -1 on failure
+ */
+int webui_run(uint16_t port)
+{
+	struct sockaddr_in addr;
+	struct epoll_event ev;
+	const int one = 1;
+	size_t i;
+
+	/* Connections after warm-up must not allocate */
+	if ((client_pool = heap_calloc(WEBUI_MAX_CLIENTS, sizeof(*client_pool))) == NULL)
+		goto err;
+	for (i = 0; i < WEBUI_MAX_CLIENTS; i++) {
+		client_pool[i].next = client_free;
+		client_free = &client_pool[i];
+	}
+
+	listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0)
+		goto err;
+	(void)setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	(void)memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		goto err;
+	if (listen(listen_fd, WEBUI_BACKLOG) < 0)
+		goto err;
+
+	if ((event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+		goto err;
+	if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		goto err;
+
+	(void)memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = &listen_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0)
+		goto err;
+	ev.data.ptr = &event_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &ev) < 0)
+		goto err;
+
+	webui_running = true;
+	if (pthread_create(&webui_thread, NULL, webui_main, NULL) != 0) {
+		webui_running = false;
+		goto err;
+	}
+	return 0;
+
+err:
+	(void)fprintf(stderr, "Cannot start web UI on port %u: errno=%d (%s)\n",
+		port, errno, strerror(errno));
+	webui_stop();
+	return -1;
+}
+
+/*
+ *  webui_stop()
+ *	stop the server thread and close all connections
+ */
+void webui_stop(void)
+{
+	size_t i;
+
+	if (webui_running) {
+		const uint64_t one = 1;
+
+		__atomic_store_n(&webui_running, false, __ATOMIC_RELEASE);
+		(void)write(event_fd, &one, sizeof(one));
+		(void)pthread_join(webui_thread, NULL);
+	}
+	while (clients)
+		webui_client_close(clients);
+	webui_frame_put(__atomic_exchange_n(&pending, NULL, __ATOMIC_ACQ_REL));
+	webui_frame_put(latest);
+	latest = NULL;
+	latest_seq = 0;
+	for (i = 0; i < WEBUI_FRAMES; i++) {
+		free(frame_pool[i]);
+		frame_pool[i] = NULL;
+	}
+	free(client_pool);
+	client_pool = NULL;
+	client_free = NULL;
+
+	if (epoll_fd >= 0)
+		(void)close(epoll_fd);
+	if (event_fd >= 0)
+		(void)close(event_fd);
+	if (listen_fd >= 0)
+		(void)close(listen_fd);
+	epoll_fd = event_fd = listen_fd = -1;
+}